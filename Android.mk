@@ -4,15 +4,19 @@ include $(CLEAR_VARS)
 LOCAL_ARM_MODE := arm
 
 LOCAL_SRC_FILES := \
+    src/arena.c \
     src/bos_deserializer.c \
     src/bos_serializer.c \
+    src/bos_stream.c \
     src/dump.c \
     src/error.c \
+    src/file.c \
     src/hashtable.c \
     src/hashtable_seed.c \
     src/load.c \
     src/memory.c \
     src/pack_unpack.c \
+    src/select.c \
     src/strbuffer.c \
     src/strconv.c \
     src/utf.c \
@@ -0,0 +1,435 @@
+/*
+ * Copyright (c) 2018 JCThePants <github.com/JCThePants>
+ *
+ * Bos-Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+/*
+ * Measures the JSON and BOS codecs and the value API on the corpora in
+ * bench/corpus: stratum notify and submit messages, a getblocktemplate
+ * result and a large array of shares.
+ *
+ *     bench_codecs [--json] [corpus directory]
+ *
+ * Every result is the best of BENCH_RUNS measurements and reports
+ * ns/op, MB/s and allocations/op. With --json each result is printed
+ * as one JSON object per line for regression tracking.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <bosjansson.h>
+
+#ifndef BENCH_CORPUS_DIR
+#define BENCH_CORPUS_DIR "bench/corpus"
+#endif
+
+/* the best of this many measurements is reported */
+#define BENCH_RUNS 5
+
+/* each measurement runs at least this long */
+#define BENCH_MIN_SECONDS 0.05
+
+/* the shares corpus is repeated into an array of this many shares */
+#define BENCH_SHARES 10000
+
+typedef struct {
+    const char *name;
+    char *text;
+    size_t length;
+    json_t *value;
+    bos_t *bos;
+
+    /* json_object_get looks up every key of the first object in each object */
+    json_t **objects;
+    size_t object_count;
+    const char **keys;
+    size_t key_count;
+} corpus_t;
+
+/* runs one operation and returns the bytes it processed */
+typedef size_t (*bench_op_t)(corpus_t *corpus);
+
+static size_t allocations;
+static int json_output;
+
+/* the formats of op_pack and op_unpack compiled once */
+static json_pack_program_t *pack_program;
+static json_unpack_program_t *unpack_program;
+
+static void *bench_malloc(size_t size)
+{
+    allocations++;
+    return malloc(size);
+}
+
+static void die(const char *what, const char *name)
+{
+    fprintf(stderr, "%s failed for %s\n", what, name);
+    exit(1);
+}
+
+static char *read_file(const char *dir, const char *name, size_t *length)
+{
+    char path[1024];
+    char *text;
+    long size;
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    fp = fopen(path, "rb");
+    if(!fp) {
+        fprintf(stderr, "unable to open %s\n", path);
+        exit(1);
+    }
+
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    text = malloc((size_t)size + 1);
+    if(!text || fread(text, 1, (size_t)size, fp) != (size_t)size)
+        die("read", path);
+    text[size] = '\0';
+    fclose(fp);
+
+    *length = (size_t)size;
+    return text;
+}
+
+static void corpus_init(corpus_t *corpus, const char *name, json_t *value)
+{
+    json_error_t error;
+    const char *key;
+    json_t *first, *member;
+    size_t i;
+
+    corpus->name = name;
+    corpus->value = value;
+
+    corpus->text = json_dumps(value, JSON_COMPACT | JSON_PRESERVE_ORDER);
+    corpus->bos = bos_serialize(value, &error);
+    if(!corpus->text || !corpus->bos)
+        die("encoding", name);
+    corpus->length = strlen(corpus->text);
+
+    if(json_is_array(value)) {
+        corpus->object_count = json_array_size(value);
+        corpus->objects = malloc(corpus->object_count * sizeof(json_t *));
+        for(i = 0; i < corpus->object_count; i++)
+            corpus->objects[i] = json_array_get(value, i);
+    }
+    else {
+        corpus->object_count = 1;
+        corpus->objects = malloc(sizeof(json_t *));
+        corpus->objects[0] = value;
+    }
+
+    first = corpus->objects[0];
+    corpus->key_count = 0;
+    corpus->keys = malloc((json_object_size(first) + 1) * sizeof(const char *));
+    json_object_foreach(first, key, member)
+        corpus->keys[corpus->key_count++] = key;
+}
+
+static void corpus_load(corpus_t *corpus, const char *dir, const char *name, const char *file)
+{
+    json_error_t error;
+    size_t length;
+    char *text = read_file(dir, file, &length);
+    json_t *value = json_loadb(text, length, 0, &error);
+
+    if(!value) {
+        fprintf(stderr, "%s: %s\n", file, error.text);
+        exit(1);
+    }
+
+    free(text);
+    corpus_init(corpus, name, value);
+}
+
+/* repeats the shares of the file into a large array */
+static void corpus_load_shares(corpus_t *corpus, const char *dir, const char *name, const char *file)
+{
+    corpus_t shares;
+    json_t *array = json_array();
+    size_t i;
+
+    corpus_load(&shares, dir, name, file);
+    for(i = 0; i < BENCH_SHARES; i++)
+        json_array_append_new(array, json_deep_copy(json_array_get(shares.value, i % shares.object_count)));
+
+    corpus_init(corpus, name, array);
+
+    json_decref(shares.value);
+    free(shares.text);
+    bos_free(shares.bos);
+    free(shares.objects);
+    free(shares.keys);
+}
+
+static void corpus_close(corpus_t *corpus)
+{
+    json_decref(corpus->value);
+    free(corpus->text);
+    bos_free(corpus->bos);
+    free(corpus->objects);
+    free(corpus->keys);
+}
+
+/*** operations ***/
+
+static size_t op_loadb(corpus_t *corpus)
+{
+    json_t *value = json_loadb(corpus->text, corpus->length, 0, NULL);
+
+    if(!value)
+        die("json_loadb", corpus->name);
+    json_decref(value);
+    return corpus->length;
+}
+
+static size_t op_dumps(corpus_t *corpus)
+{
+    char *text = json_dumps(corpus->value, JSON_COMPACT);
+    size_t length;
+
+    if(!text)
+        die("json_dumps", corpus->name);
+    length = strlen(text);
+    free(text);
+    return length;
+}
+
+static size_t op_serialize(corpus_t *corpus)
+{
+    bos_t *bos = bos_serialize(corpus->value, NULL);
+    size_t size;
+
+    if(!bos)
+        die("bos_serialize", corpus->name);
+    size = bos->size;
+    bos_free(bos);
+    return size;
+}
+
+static size_t op_deserialize(corpus_t *corpus)
+{
+    json_t *value = bos_deserialize_ex(corpus->bos->data, corpus->bos->size, 0, NULL);
+
+    if(!value)
+        die("bos_deserialize", corpus->name);
+    json_decref(value);
+    return corpus->bos->size;
+}
+
+static size_t op_validate(corpus_t *corpus)
+{
+    if(!bos_validate(corpus->bos->data, corpus->bos->size))
+        die("bos_validate", corpus->name);
+    return corpus->bos->size;
+}
+
+/* lookups and packing process no bytes, they only report ns/op */
+static size_t op_object_get(corpus_t *corpus)
+{
+    size_t i, j;
+
+    for(i = 0; i < corpus->object_count; i++) {
+        for(j = 0; j < corpus->key_count; j++) {
+            if(!json_object_get(corpus->objects[i], corpus->keys[j]))
+                die("json_object_get", corpus->name);
+        }
+    }
+    return 0;
+}
+
+/* copies count the size of the JSON text */
+static size_t op_deep_copy(corpus_t *corpus)
+{
+    json_t *copy = json_deep_copy(corpus->value);
+
+    if(!copy)
+        die("json_deep_copy", corpus->name);
+    json_decref(copy);
+    return corpus->length;
+}
+
+static size_t op_pack(corpus_t *corpus)
+{
+    json_t *params = json_object_get(corpus->value, "params");
+    json_t *value = json_pack("{s:I, s:s, s:[sssss]}",
+                              "id", json_integer_value(json_object_get(corpus->value, "id")),
+                              "method", "mining.submit",
+                              "params", json_string_value(json_array_get(params, 0)),
+                              json_string_value(json_array_get(params, 1)),
+                              json_string_value(json_array_get(params, 2)),
+                              json_string_value(json_array_get(params, 3)),
+                              json_string_value(json_array_get(params, 4)));
+
+    if(!value)
+        die("json_pack", corpus->name);
+    json_decref(value);
+    return 0;
+}
+
+static size_t op_unpack(corpus_t *corpus)
+{
+    const char *method, *worker, *job, *extranonce2, *ntime, *nonce;
+    json_int_t id;
+
+    if(json_unpack(corpus->value, "{s:I, s:s, s:[sssss]}", "id", &id, "method", &method,
+                   "params", &worker, &job, &extranonce2, &ntime, &nonce))
+        die("json_unpack", corpus->name);
+    return 0;
+}
+
+static size_t op_pack_run(corpus_t *corpus)
+{
+    json_t *params = json_object_get(corpus->value, "params");
+    json_t *value = json_pack_run(pack_program,
+                                  "id", json_integer_value(json_object_get(corpus->value, "id")),
+                                  "method", "mining.submit",
+                                  "params", json_string_value(json_array_get(params, 0)),
+                                  json_string_value(json_array_get(params, 1)),
+                                  json_string_value(json_array_get(params, 2)),
+                                  json_string_value(json_array_get(params, 3)),
+                                  json_string_value(json_array_get(params, 4)));
+
+    if(!value)
+        die("json_pack_run", corpus->name);
+    json_decref(value);
+    return 0;
+}
+
+static size_t op_unpack_run(corpus_t *corpus)
+{
+    const char *method, *worker, *job, *extranonce2, *ntime, *nonce;
+    json_int_t id;
+
+    if(json_unpack_run(corpus->value, unpack_program, "id", &id, "method", &method,
+                       "params", &worker, &job, &extranonce2, &ntime, &nonce))
+        die("json_unpack_run", corpus->name);
+    return 0;
+}
+
+/*** measurement ***/
+
+static double run_rounds(corpus_t *corpus, bench_op_t op, size_t rounds, size_t *bytes)
+{
+    clock_t start = clock();
+    size_t i;
+
+    *bytes = 0;
+    for(i = 0; i < rounds; i++)
+        *bytes += op(corpus);
+
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void bench(const char *name, corpus_t *corpus, bench_op_t op)
+{
+    size_t rounds = 1, bytes, run, allocated;
+    double best = 0, seconds, ns, allocs;
+    char rate[32];
+
+    /* grow the rounds until one measurement is long enough */
+    while(run_rounds(corpus, op, rounds, &bytes) < BENCH_MIN_SECONDS)
+        rounds *= 2;
+
+    allocated = allocations;
+    for(run = 0; run < BENCH_RUNS; run++) {
+        seconds = run_rounds(corpus, op, rounds, &bytes);
+        if(run == 0 || seconds < best)
+            best = seconds;
+    }
+    allocated = allocations - allocated;
+
+    if(best <= 0)
+        best = 1e-9;
+
+    ns = best * 1e9 / rounds;
+    allocs = (double)allocated / (rounds * BENCH_RUNS);
+
+    if(json_output) {
+        if(bytes)
+            snprintf(rate, sizeof(rate), "%.2f", bytes / best / 1e6);
+        else
+            strcpy(rate, "null");
+
+        printf("{\"benchmark\": \"%s\", \"corpus\": \"%s\", \"bytes\": %lu, \"ns_per_op\": %.1f, "
+               "\"mb_per_s\": %s, \"allocs_per_op\": %.2f}\n",
+               name, corpus->name, (unsigned long)(bytes / rounds), ns, rate, allocs);
+    }
+    else {
+        if(bytes)
+            snprintf(rate, sizeof(rate), "%10.2f MB/s", bytes / best / 1e6);
+        else
+            snprintf(rate, sizeof(rate), "%10s MB/s", "-");
+
+        printf("%-16s %-14s %8lu bytes %12.1f ns/op %s %10.2f allocs/op\n", name, corpus->name,
+               (unsigned long)(bytes / rounds), ns, rate, allocs);
+    }
+    fflush(stdout);
+}
+
+static void bench_corpus(corpus_t *corpus)
+{
+    bench("json_loadb", corpus, op_loadb);
+    bench("json_dumps", corpus, op_dumps);
+    bench("bos_serialize", corpus, op_serialize);
+    bench("bos_deserialize", corpus, op_deserialize);
+    bench("bos_validate", corpus, op_validate);
+    bench("json_object_get", corpus, op_object_get);
+    bench("json_deep_copy", corpus, op_deep_copy);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *dir = BENCH_CORPUS_DIR;
+    corpus_t corpus;
+    int i;
+
+    for(i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--json"))
+            json_output = 1;
+        else
+            dir = argv[i];
+    }
+
+    /* counts every allocation made by the library */
+    json_set_alloc_funcs(bench_malloc, free);
+
+    corpus_load(&corpus, dir, "notify", "notify.json");
+    bench_corpus(&corpus);
+    corpus_close(&corpus);
+
+    pack_program = json_pack_compile("{s:I, s:s, s:[sssss]}", NULL);
+    unpack_program = json_unpack_compile("{s:I, s:s, s:[sssss]}", NULL);
+    if(!pack_program || !unpack_program)
+        die("compiling", "submit");
+
+    corpus_load(&corpus, dir, "submit", "submit.json");
+    bench_corpus(&corpus);
+    bench("json_pack", &corpus, op_pack);
+    bench("json_pack_run", &corpus, op_pack_run);
+    bench("json_unpack", &corpus, op_unpack);
+    bench("json_unpack_run", &corpus, op_unpack_run);
+    corpus_close(&corpus);
+
+    json_pack_program_free(pack_program);
+    json_unpack_program_free(unpack_program);
+
+    corpus_load(&corpus, dir, "blocktemplate", "blocktemplate.json");
+    bench_corpus(&corpus);
+    corpus_close(&corpus);
+
+    corpus_load_shares(&corpus, dir, "shares", "shares.json");
+    bench_corpus(&corpus);
+    corpus_close(&corpus);
+
+    return 0;
+}
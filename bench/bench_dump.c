@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2018 JCThePants <github.com/JCThePants>
+ *
+ * Bos-Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+/* Measures json_dumps throughput on stratum-like messages. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <bosjansson.h>
+
+/* the best of this many measurements is reported */
+#define BENCH_RUNS 7
+
+#define BENCH_BYTES (64 * 1024 * 1024)
+
+/* mining.notify is mostly long hex strings without escapes */
+static const char notify[] =
+    "{\"id\": null, \"method\": \"mining.notify\", \"params\": [\"1d3f\", "
+    "\"4d16b6f85af6e2198f44ae2a6de67f78487ae5611b77c6c0440b921e00000000\", "
+    "\"01000000010000000000000000000000000000000000000000000000000000000000000000"
+    "ffffffff20020862062f503253482f04b8864e5008\", "
+    "\"072f736c7573682f000000000100f2052a010000001976a914d23fcdf86f7e756a64a7a9688e"
+    "f9903327048ed988ac00000000\", "
+    "[\"c5bd17d1bf6ad5e9dea1d1a1ac0ec3bd1d2d8d4c6ae9a6bd2c3ef4b1e3d7a2c1\", "
+    "\"57351e8569cb9d036187a79fd1844fd930c1309efcd16c46af9bb9713b6ee734\", "
+    "\"936ab9c33420f187acae660fcdb07ffdffa081273674f0f41e6ecc1347451d23\"], "
+    "\"00000002\", \"1c2ac4af\", \"504e86b9\", false]}";
+
+static const char stats[] =
+    "{\"worker\": \"rig-01\", \"hashrate\": [1234567.5, 1299811.25, 1187004.125], "
+    "\"shares\": {\"valid\": 918273, \"stale\": 1204, \"invalid\": 7}, "
+    "\"uptime\": 86400, \"temperature\": [61, 64, 58, 70], \"note\": \"fan \\\"auto\\\"\"}";
+
+static void bench(const char *name, const char *text, size_t flags)
+{
+    json_error_t error;
+    json_t *value = json_loads(text, 0, &error);
+    size_t rounds, length, i, run;
+    double best = 0, seconds;
+    char *result;
+
+    if(!value) {
+        fprintf(stderr, "%s: %s\n", name, error.text);
+        exit(1);
+    }
+
+    result = json_dumps(value, flags);
+    length = strlen(result);
+    free(result);
+
+    rounds = BENCH_BYTES / length;
+    if(rounds == 0)
+        rounds = 1;
+
+    for(run = 0; run < BENCH_RUNS; run++) {
+        clock_t start = clock();
+
+        for(i = 0; i < rounds; i++) {
+            result = json_dumps(value, flags);
+            if(!result) {
+                fprintf(stderr, "%s: json_dumps failed\n", name);
+                exit(1);
+            }
+            free(result);
+        }
+
+        seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+        if(run == 0 || seconds < best)
+            best = seconds;
+    }
+
+    printf("%-24s %8u bytes  %8.2f MB/s  %10.0f ns/doc\n", name, (unsigned int)length,
+           rounds * length / best / 1e6, best * 1e9 / rounds);
+    json_decref(value);
+}
+
+int main(void)
+{
+    bench("dumps notify", notify, JSON_COMPACT);
+    bench("dumps notify ascii", notify, JSON_COMPACT | JSON_ENSURE_ASCII);
+    bench("dumps stats", stats, JSON_COMPACT);
+    bench("dumps stats indent", stats, JSON_INDENT(2));
+    return 0;
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2018 JCThePants <github.com/JCThePants>
+ *
+ * Bos-Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+/* Compares the key hash functions on typical object key lengths. */
+
+#include <jansson_private_config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lookup3.h"
+#include "xxh64.h"
+
+/* hashes per measurement */
+#define BENCH_OPS 20000000
+
+/* the best of this many measurements is reported */
+#define BENCH_RUNS 5
+
+#define BENCH_KEYS 1024
+
+static const size_t lengths[] = {2, 4, 6, 8, 12, 16, 24, 32, 64};
+
+static volatile uint64_t sink;
+
+static uint64_t hash_lookup3(const char *key, size_t len, uint32_t seed)
+{
+    return hashlittle(key, len, seed);
+}
+
+static uint64_t hash_xxh64(const char *key, size_t len, uint32_t seed)
+{
+    return xxh64(key, len, seed);
+}
+
+static double bench(uint64_t (*hash)(const char *, size_t, uint32_t),
+                    char *keys, size_t len)
+{
+    size_t rounds = BENCH_OPS / BENCH_KEYS, i, j, run;
+    double best = 0, seconds;
+    uint64_t acc = 0;
+
+    for(run = 0; run < BENCH_RUNS; run++) {
+        clock_t start = clock();
+
+        for(i = 0; i < rounds; i++) {
+            for(j = 0; j < BENCH_KEYS; j++)
+                acc += hash(keys + j * len, len, 0x5eed1234);
+        }
+
+        seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+        if(run == 0 || seconds < best)
+            best = seconds;
+    }
+
+    sink = acc;
+    return best * 1e9 / (rounds * BENCH_KEYS);
+}
+
+int main(void)
+{
+    size_t i, j;
+
+    printf("%6s  %14s  %14s\n", "length", "lookup3 ns/op", "xxh64 ns/op");
+
+    for(i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        size_t len = lengths[i];
+        char *keys = malloc(BENCH_KEYS * len);
+
+        /* distinct printable keys */
+        for(j = 0; j < BENCH_KEYS * len; j++)
+            keys[j] = (char)('a' + (j * 7 + j / len) % 26);
+
+        printf("%6u  %14.2f  %14.2f\n", (unsigned int)len,
+               bench(hash_lookup3, keys, len), bench(hash_xxh64, keys, len));
+
+        free(keys);
+    }
+
+    return 0;
+}
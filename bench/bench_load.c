@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2018 JCThePants <github.com/JCThePants>
+ *
+ * Bos-Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+/* Measures json_loads and json_loadb throughput on stratum-like messages. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <bosjansson.h>
+
+/* the best of this many measurements is reported */
+#define BENCH_RUNS 7
+
+#define BENCH_BYTES (64 * 1024 * 1024)
+
+static const char message[] =
+    "{\"id\": 4242, \"method\": \"mining.submit\", \"params\": [\"worker.rig-01\", "
+    "\"job-3f2a\", \"00000000a1b2c3d4\", \"5b9f2a1e\", \"1c2d3e4f\"], "
+    "\"difficulty\": 65536.25, \"extra\": {\"agent\": \"cgminer/4.10.0\", "
+    "\"note\": \"escaped \\\"text\\\" \\u00e9\", \"ok\": true, \"error\": null}}";
+
+/* mining.notify is mostly long hex strings without escapes */
+static const char notify[] =
+    "{\"id\": null, \"method\": \"mining.notify\", \"params\": [\"1d3f\", "
+    "\"4d16b6f85af6e2198f44ae2a6de67f78487ae5611b77c6c0440b921e00000000\", "
+    "\"01000000010000000000000000000000000000000000000000000000000000000000000000"
+    "ffffffff20020862062f503253482f04b8864e5008\", "
+    "\"072f736c7573682f000000000100f2052a010000001976a914d23fcdf86f7e756a64a7a9688e"
+    "f9903327048ed988ac00000000\", "
+    "[\"c5bd17d1bf6ad5e9dea1d1a1ac0ec3bd1d2d8d4c6ae9a6bd2c3ef4b1e3d7a2c1\", "
+    "\"57351e8569cb9d036187a79fd1844fd930c1309efcd16c46af9bb9713b6ee734\", "
+    "\"936ab9c33420f187acae660fcdb07ffdffa081273674f0f41e6ecc1347451d23\"], "
+    "\"00000002\", \"1c2ac4af\", \"504e86b9\", false]}";
+
+/* pool statistics are mostly integers and reals */
+static const char stats[] =
+    "{\"hashrate\": [1234567.5, 1299811.25, 1187004.125, 0.000123, 9.87e12], "
+    "\"shares\": [918273, 1204, 7, 65536, 4294967296], \"difficulty\": 65536.25, "
+    "\"luck\": [0.984, 1.0212, 0.7731, 1.19, 0.88019], \"blocks\": [812345, 812346, 812400], "
+    "\"uptime\": 86400, \"temperature\": [61.5, 64.25, 58.0, 70.125]}";
+
+static char *make_document(size_t count, size_t *length)
+{
+    size_t size = count * (sizeof(message) + 2) + 3, i;
+    char *text = malloc(size), *p = text;
+
+    *p++ = '[';
+    for(i = 0; i < count; i++) {
+        if(i)
+            *p++ = ',';
+        *p++ = '\n';
+        memcpy(p, message, sizeof(message) - 1);
+        p += sizeof(message) - 1;
+    }
+    *p++ = ']';
+    *p = '\0';
+
+    *length = (size_t)(p - text);
+    return text;
+}
+
+static void bench(const char *name, const char *text, size_t length, int use_length)
+{
+    size_t rounds = BENCH_BYTES / length, i, run;
+    double best = 0, seconds;
+    json_error_t error;
+
+    if(rounds == 0)
+        rounds = 1;
+
+    for(run = 0; run < BENCH_RUNS; run++) {
+        clock_t start = clock();
+
+        for(i = 0; i < rounds; i++) {
+            json_t *value = use_length ? json_loadb(text, length, 0, &error)
+                                       : json_loads(text, 0, &error);
+            if(!value) {
+                fprintf(stderr, "%s: %s\n", name, error.text);
+                exit(1);
+            }
+            json_decref(value);
+        }
+
+        seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+        if(run == 0 || seconds < best)
+            best = seconds;
+    }
+
+    printf("%-24s %8u bytes  %8.2f MB/s  %10.0f ns/doc\n", name, (unsigned int)length,
+           rounds * length / best / 1e6, best * 1e9 / rounds);
+}
+
+int main(void)
+{
+    size_t length;
+    char *document = make_document(1000, &length);
+
+    bench("loads message", message, sizeof(message) - 1, 0);
+    bench("loadb message", message, sizeof(message) - 1, 1);
+    bench("loads notify", notify, sizeof(notify) - 1, 0);
+    bench("loadb notify", notify, sizeof(notify) - 1, 1);
+    bench("loads stats", stats, sizeof(stats) - 1, 0);
+    bench("loadb stats", stats, sizeof(stats) - 1, 1);
+    bench("loads 1000 messages", document, length, 0);
+    bench("loadb 1000 messages", document, length, 1);
+
+    free(document);
+    return 0;
+}
@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2018 JCThePants <github.com/JCThePants>
+ *
+ * Bos-Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+/* Measures get, set and iteration throughput of json objects. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <bosjansson.h>
+
+/* operations per measurement */
+#define BENCH_OPS 2000000
+
+/* the best of this many measurements is reported */
+#define BENCH_RUNS 7
+
+static const size_t sizes[] = {4, 12, 24, 32, 10000};
+
+static size_t alloc_count, alloc_bytes;
+
+static void *counting_malloc(size_t size)
+{
+    alloc_count++;
+    alloc_bytes += size;
+    return malloc(size);
+}
+
+static char **make_keys(size_t count)
+{
+    char **keys = malloc(count * sizeof(char *));
+    size_t i;
+
+    for(i = 0; i < count; i++) {
+        keys[i] = malloc(16);
+        snprintf(keys[i], 16, "key%u", (unsigned int)i);
+    }
+    return keys;
+}
+
+static void free_keys(char **keys, size_t count)
+{
+    size_t i;
+
+    for(i = 0; i < count; i++)
+        free(keys[i]);
+    free(keys);
+}
+
+static double elapsed(clock_t start)
+{
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void report(const char *name, size_t count, size_t ops, double seconds)
+{
+    printf("%-8s %6u keys  %8.2f ns/op  %8.2f Mops/s\n", name, (unsigned int)count,
+           seconds * 1e9 / ops, seconds > 0 ? ops / seconds / 1e6 : 0.0);
+}
+
+/* allocations and bytes requested to build one object */
+static void bench_memory(char **keys, size_t count)
+{
+    json_t *object;
+    size_t i;
+
+    json_set_alloc_funcs(counting_malloc, free);
+    alloc_count = alloc_bytes = 0;
+
+    object = json_object();
+    for(i = 0; i < count; i++)
+        json_object_set_new_nocheck(object, keys[i], json_null());
+
+    printf("memory   %6u keys  %8u allocs  %8u bytes\n", (unsigned int)count,
+           (unsigned int)alloc_count, (unsigned int)alloc_bytes);
+
+    json_decref(object);
+    json_set_alloc_funcs(malloc, free);
+}
+
+static void bench_set(char **keys, size_t count)
+{
+    size_t rounds = BENCH_OPS / count, i, j, run;
+    double best = 0, seconds;
+
+    for(run = 0; run < BENCH_RUNS; run++) {
+        clock_t start = clock();
+
+        for(i = 0; i < rounds; i++) {
+            json_t *object = json_object();
+            for(j = 0; j < count; j++)
+                json_object_set_new_nocheck(object, keys[j], json_null());
+            json_decref(object);
+        }
+
+        seconds = elapsed(start);
+        if(run == 0 || seconds < best)
+            best = seconds;
+    }
+
+    report("set", count, rounds * count, best);
+}
+
+static void bench_get(char **keys, size_t count)
+{
+    size_t rounds = BENCH_OPS / count, i, j, run, found = 0;
+    json_t *object = json_object();
+    double best = 0, seconds;
+
+    for(j = 0; j < count; j++)
+        json_object_set_new_nocheck(object, keys[j], json_null());
+
+    for(run = 0; run < BENCH_RUNS; run++) {
+        clock_t start = clock();
+
+        for(i = 0; i < rounds; i++) {
+            for(j = 0; j < count; j++)
+                found += json_object_get(object, keys[j]) != NULL;
+        }
+
+        seconds = elapsed(start);
+        if(run == 0 || seconds < best)
+            best = seconds;
+    }
+    report("get", count, rounds * count, best);
+
+    if(found != BENCH_RUNS * rounds * count)
+        fprintf(stderr, "lookup failed\n");
+
+    json_decref(object);
+}
+
+static void bench_iterate(char **keys, size_t count)
+{
+    size_t rounds = BENCH_OPS / count, i, j, run, seen = 0;
+    json_t *object = json_object(), *value;
+    const char *key;
+    double best = 0, seconds;
+
+    for(j = 0; j < count; j++)
+        json_object_set_new_nocheck(object, keys[j], json_null());
+
+    for(run = 0; run < BENCH_RUNS; run++) {
+        clock_t start = clock();
+
+        for(i = 0; i < rounds; i++) {
+            json_object_foreach(object, key, value)
+                seen += key[0] == 'k';
+        }
+
+        seconds = elapsed(start);
+        if(run == 0 || seconds < best)
+            best = seconds;
+    }
+    report("iterate", count, rounds * count, best);
+
+    if(seen != BENCH_RUNS * rounds * count)
+        fprintf(stderr, "iteration failed\n");
+
+    json_decref(object);
+}
+
+int main(void)
+{
+    size_t i;
+
+    for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        char **keys = make_keys(sizes[i]);
+
+        bench_memory(keys, sizes[i]);
+        bench_set(keys, sizes[i]);
+        bench_get(keys, sizes[i]);
+        bench_iterate(keys, sizes[i]);
+
+        free_keys(keys, sizes[i]);
+    }
+
+    return 0;
+}
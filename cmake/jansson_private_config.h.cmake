@@ -2,6 +2,9 @@
 #cmakedefine HAVE_FCNTL_H 1
 #cmakedefine HAVE_SCHED_H 1
 #cmakedefine HAVE_UNISTD_H 1
+#cmakedefine HAVE_MALLOC_H 1
+#cmakedefine HAVE_SYS_MMAN_H 1
+#cmakedefine HAVE_SYS_SDT_H 1
 #cmakedefine HAVE_SYS_PARAM_H 1
 #cmakedefine HAVE_SYS_STAT_H 1
 #cmakedefine HAVE_SYS_TIME_H 1
@@ -10,6 +13,8 @@
 
 #cmakedefine HAVE_CLOSE 1
 #cmakedefine HAVE_GETPID 1
+#cmakedefine HAVE_MALLOC_USABLE_SIZE 1
+#cmakedefine HAVE_MMAP 1
 #cmakedefine HAVE_GETTIMEOFDAY 1
 #cmakedefine HAVE_OPEN 1
 #cmakedefine HAVE_READ 1
@@ -49,5 +54,7 @@
 
 #cmakedefine USE_URANDOM 1
 #cmakedefine USE_WINDOWS_CRYPTOAPI 1
+#cmakedefine JANSSON_HASH_LOOKUP3 1
+#cmakedefine JANSSON_STATS 1
 
 #define INITIAL_HASHTABLE_ORDER @JANSSON_INITIAL_HASHTABLE_ORDER@
@@ -0,0 +1,305 @@
+/*
+ * Copyright (c) 2018 JCThePants <github.com/JCThePants>
+ *
+ * Bos-Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "jansson_private_config.h"
+#include "bosjansson.h"
+#include "jansson_private.h"
+
+#ifndef ARENA_DEFAULT_BLOCK_SIZE
+#define ARENA_DEFAULT_BLOCK_SIZE 4096
+#endif
+
+/* allocations larger than this get a block of their own */
+#define ARENA_LARGE(arena) ((arena)->block_size / 4)
+
+#define ARENA_ALIGN(size) (((size) + sizeof(arena_prefix_t) - 1) & ~(sizeof(arena_prefix_t) - 1))
+
+/* Stores the owning arena in front of each node. The union keeps the
+   node that follows aligned for doubles and 64-bit integers. */
+typedef union {
+    json_arena_t *arena;
+    double real;
+    json_int_t integer;
+    void *ptr;
+} arena_prefix_t;
+
+typedef struct arena_block {
+    struct arena_block *next;
+    size_t size;
+    arena_prefix_t data[1];
+} arena_block_t;
+
+struct json_arena_t {
+    arena_block_t *blocks;
+    unsigned char *pos;
+    unsigned char *end;
+    size_t block_size;
+    size_t used;
+
+    /* values released with the arena */
+    json_t **adopted;
+    size_t adopted_count;
+    size_t adopted_size;
+};
+
+static JSON_THREAD_LOCAL json_arena_t *current_arena = NULL;
+
+static arena_block_t *arena_new_block(size_t size)
+{
+    arena_block_t *block = jsonp_malloc(offsetof(arena_block_t, data) + size);
+    if(!block)
+        return NULL;
+
+    block->next = NULL;
+    block->size = size;
+    return block;
+}
+
+json_arena_t *json_arena_new(size_t block_size)
+{
+    json_arena_t *arena;
+
+    if(block_size == 0)
+        block_size = ARENA_DEFAULT_BLOCK_SIZE;
+
+    block_size = ARENA_ALIGN(block_size);
+
+    arena = jsonp_malloc(sizeof(json_arena_t));
+    if(!arena)
+        return NULL;
+
+    arena->blocks = NULL;
+    arena->pos = NULL;
+    arena->end = NULL;
+    arena->block_size = block_size;
+    arena->used = 0;
+    arena->adopted = NULL;
+    arena->adopted_count = 0;
+    arena->adopted_size = 0;
+    return arena;
+}
+
+static void arena_release_adopted(json_arena_t *arena)
+{
+    size_t i;
+
+    for(i = 0; i < arena->adopted_count; i++) {
+        json_t *json = arena->adopted[i];
+
+        /* arena bytes and packed arrays own a heap buffer, borrowed values
+           release theirs and everything else is a foreign value */
+        if(json->flags & JSON_FLAG_BORROWED)
+            jsonp_release_borrowed(json);
+        else if(json_is_packed(json) && json->flags & JSON_FLAG_ARENA)
+            jsonp_free(json_to_packed(json)->data);
+        else if(json->flags & JSON_FLAG_ARENA)
+            jsonp_free(json_to_bytes(json)->value);
+        else
+            json_decref(json);
+    }
+
+    arena->adopted_count = 0;
+}
+
+void json_arena_reset(json_arena_t *arena)
+{
+    arena_block_t *block, *next, *keep = NULL;
+
+    if(!arena)
+        return;
+
+    arena_release_adopted(arena);
+
+    /* keep one regular block so that steady state use does not allocate */
+    for(block = arena->blocks; block; block = next) {
+        next = block->next;
+        if(!keep && block->size == arena->block_size) {
+            keep = block;
+            keep->next = NULL;
+        }
+        else
+            jsonp_free(block);
+    }
+
+    arena->blocks = keep;
+    arena->pos = keep ? (unsigned char *)keep->data : NULL;
+    arena->end = keep ? arena->pos + keep->size : NULL;
+    arena->used = 0;
+}
+
+void json_arena_free(json_arena_t *arena)
+{
+    arena_block_t *block, *next;
+
+    if(!arena)
+        return;
+
+    if(current_arena == arena)
+        current_arena = NULL;
+
+    arena_release_adopted(arena);
+
+    for(block = arena->blocks; block; block = next) {
+        next = block->next;
+        jsonp_free(block);
+    }
+
+    jsonp_free(arena->adopted);
+    jsonp_free(arena);
+}
+
+json_arena_t *json_arena_use(json_arena_t *arena)
+{
+    json_arena_t *previous = current_arena;
+    current_arena = arena;
+    return previous;
+}
+
+size_t json_arena_used(const json_arena_t *arena)
+{
+    return arena ? arena->used : 0;
+}
+
+json_arena_t *jsonp_arena_current(void)
+{
+    return current_arena;
+}
+
+void *jsonp_arena_malloc(json_arena_t *arena, size_t size)
+{
+    arena_block_t *block;
+    void *ptr;
+
+    if(!arena)
+        return jsonp_malloc(size);
+
+    if(!size)
+        return NULL;
+
+    size = ARENA_ALIGN(size);
+
+    if(size > (size_t)(arena->end - arena->pos)) {
+
+        if(size > ARENA_LARGE(arena)) {
+            /* keep filling the current block */
+            block = arena_new_block(size);
+            if(!block)
+                return NULL;
+
+            if(arena->blocks) {
+                block->next = arena->blocks->next;
+                arena->blocks->next = block;
+            }
+            else
+                arena->blocks = block;
+
+            arena->used += size;
+            return block->data;
+        }
+
+        block = arena_new_block(arena->block_size);
+        if(!block)
+            return NULL;
+
+        block->next = arena->blocks;
+        arena->blocks = block;
+        arena->pos = (unsigned char *)block->data;
+        arena->end = arena->pos + block->size;
+    }
+
+    ptr = arena->pos;
+    arena->pos += size;
+    arena->used += size;
+    return ptr;
+}
+
+void jsonp_arena_free(json_arena_t *arena, void *ptr)
+{
+    /* arena memory is only released with the arena */
+    if(!arena)
+        jsonp_free(ptr);
+}
+
+char *jsonp_arena_strndup(json_arena_t *arena, const char *str, size_t len)
+{
+    char *new_str;
+
+    if(!arena)
+        return jsonp_strndup(str, len);
+
+    new_str = jsonp_arena_malloc(arena, len + 1);
+    if(!new_str)
+        return NULL;
+
+    memcpy(new_str, str, len);
+    new_str[len] = '\0';
+    return new_str;
+}
+
+void *jsonp_arena_node_malloc(json_arena_t *arena, size_t size)
+{
+    arena_prefix_t *prefix;
+
+    if(!arena)
+        return jsonp_node_malloc(size);
+
+    prefix = jsonp_arena_malloc(arena, sizeof(arena_prefix_t) + size);
+    if(!prefix)
+        return NULL;
+
+    prefix->arena = arena;
+    return prefix + 1;
+}
+
+json_arena_t *jsonp_arena_of(const json_t *json)
+{
+    if(!json || !(json->flags & JSON_FLAG_ARENA))
+        return NULL;
+
+    return ((const arena_prefix_t *)json - 1)->arena;
+}
+
+static int arena_push(json_arena_t *arena, json_t *json)
+{
+    json_t **adopted;
+    size_t new_size;
+
+    if(arena->adopted_count == arena->adopted_size) {
+        new_size = arena->adopted_size ? arena->adopted_size * 2 : 16;
+
+        adopted = jsonp_malloc(new_size * sizeof(json_t *));
+        if(!adopted)
+            return -1;
+
+        if(arena->adopted_count)
+            memcpy(adopted, arena->adopted, arena->adopted_count * sizeof(json_t *));
+
+        jsonp_free(arena->adopted);
+        arena->adopted = adopted;
+        arena->adopted_size = new_size;
+    }
+
+    arena->adopted[arena->adopted_count++] = json;
+    return 0;
+}
+
+int jsonp_arena_adopt(json_arena_t *arena, json_t *json)
+{
+    /* arena nodes and singletons don't need releasing */
+    if(!arena || !json || json->refcount == (size_t)-1)
+        return 0;
+
+    return arena_push(arena, json);
+}
+
+int jsonp_arena_adopt_bytes(json_arena_t *arena, json_t *value)
+{
+    return arena_push(arena, value);
+}
@@ -31,7 +31,7 @@
 
 /*** error reporting ***/
 
-static void error_set(json_error_t *error, enum json_error_code code, const char *msg, ...)
+static void error_set(json_error_t *error, size_t position, enum json_error_code code, const char *msg, ...)
 {
     va_list ap;
     char msg_text[JSON_ERROR_TEXT_LENGTH];
@@ -46,7 +46,7 @@ static void error_set(json_error_t *error, enum json_error_code code, const char
     msg_text[JSON_ERROR_TEXT_LENGTH - 1] = '\0';
     va_end(ap);
 
-    jsonp_error_set(error, -1, -1, 0, code, "%s", result);
+    jsonp_error_set(error, -1, -1, position, code, "%s", result);
 }
 
 /*** buffer ***/
@@ -54,403 +54,1698 @@ static void error_set(json_error_t *error, enum json_error_code code, const char
 typedef struct {
     const void *data;
     unsigned char *pos;
-    uint32_t read;
-    uint32_t size;
+    size_t read;
+    size_t size;
+    size_t keys;    /* key table entries seen by validation, BUFFER_ANY_KEYS inside views */
 } buffer_t;
 
+#define BUFFER_ANY_KEYS ((size_t)-1)
+
 static JSON_INLINE void read_buffer(buffer_t *buffer, void *destination, size_t size) {
     memcpy(destination, buffer->pos, size);
-    buffer->pos += (uint32_t)size;
-    buffer->read += (uint32_t)size;
+    buffer->pos += size;
+    buffer->read += size;
 }
 
 static int buffer_init(buffer_t *buffer, const void *data)
 {
+    uint32_t size;
+
     buffer->data = data;
     buffer->pos = (void *)data;
     buffer->read = 0;
-    read_buffer(buffer, &buffer->size, sizeof(uint32_t));
+    buffer->keys = 0;
+    read_buffer(buffer, &size, sizeof(uint32_t));
+    buffer->size = size;
     return 0;
 }
 
 /*** deserializer ***/
 
-static json_t *read_value(buffer_t *buffer, json_error_t *error);
-static bos_data_type read_data_type(buffer_t *buffer);
-static json_t *read_data(buffer_t *buffer, bos_data_type data_type, json_error_t *error);
+#define BOS_DEPTH_LIMIT_GET(flags) (((flags) >> 16) & 0xFFFF)
+
+/* a key of the frame's key table, see BOS_KEY_TABLE */
+typedef struct {
+    const char *key;
+    size_t len;
+    size_t hash;
+} decoder_key_t;
+
+#define DECODER_INLINE_KEYS 32
+
+typedef struct {
+    buffer_t buffer;
+    size_t depth;
+    size_t max_depth;
+    size_t flags;
+    json_error_t *error;
+    decoder_key_t *keys;
+    size_t key_count;
+    size_t key_size;
+    decoder_key_t inline_keys[DECODER_INLINE_KEYS];
+} decoder_t;
+
+static json_t *read_value(decoder_t *decoder);
+
+static JSON_INLINE int read_checked(decoder_t *decoder, void *destination, size_t size) {
+    buffer_t *buffer = &decoder->buffer;
+
+    if (size > buffer->size - buffer->read) {
+        error_set(decoder->error, buffer->read, json_error_premature_end_of_input,
+                  "unexpected end of data");
+        return FALSE;
+    }
 
+    read_buffer(buffer, destination, size);
+    return TRUE;
+}
 
-static json_t *read_bool(buffer_t *buffer) {
+static json_t *read_bool(decoder_t *decoder) {
     uint8_t number;
-    read_buffer(buffer, &number, sizeof(uint8_t));
+    if (!read_checked(decoder, &number, sizeof(uint8_t)))
+        return NULL;
     return number == 0 ? json_false() : json_true();
 }
 
-static json_t *read_int8(buffer_t *buffer) {
+static json_t *read_int8(decoder_t *decoder) {
     int8_t number;
-    read_buffer(buffer, &number, sizeof(int8_t));
+    if (!read_checked(decoder, &number, sizeof(int8_t)))
+        return NULL;
     return json_integer((json_int_t)number);
 }
 
-static json_t *read_int16(buffer_t *buffer) {
+static json_t *read_int16(decoder_t *decoder) {
     int16_t number;
-    read_buffer(buffer, &number, sizeof(int16_t));
+    if (!read_checked(decoder, &number, sizeof(int16_t)))
+        return NULL;
     return json_integer((json_int_t)number);
 }
 
-static json_t *read_int32(buffer_t *buffer) {
+static json_t *read_int32(decoder_t *decoder) {
     int32_t number;
-    read_buffer(buffer, &number, sizeof(int32_t));
+    if (!read_checked(decoder, &number, sizeof(int32_t)))
+        return NULL;
     return json_integer((json_int_t)number);
 }
 
-static json_t *read_int64(buffer_t *buffer) {
+static json_t *read_int64(decoder_t *decoder) {
     int64_t number;
-    read_buffer(buffer, &number, sizeof(int64_t));
+    if (!read_checked(decoder, &number, sizeof(int64_t)))
+        return NULL;
     return json_integer((json_int_t)number);
 }
 
-static json_t *read_uint8(buffer_t *buffer) {
+static json_t *read_uint8(decoder_t *decoder) {
     uint8_t number;
-    read_buffer(buffer, &number, sizeof(uint8_t));
+    if (!read_checked(decoder, &number, sizeof(uint8_t)))
+        return NULL;
     return json_integer((json_int_t)number);
 }
 
-static json_t *read_uint16(buffer_t *buffer) {
+static json_t *read_uint16(decoder_t *decoder) {
     uint16_t number;
-    read_buffer(buffer, &number, sizeof(uint16_t));
+    if (!read_checked(decoder, &number, sizeof(uint16_t)))
+        return NULL;
     return json_integer((json_int_t)number);
 }
 
-static json_t *read_uint32(buffer_t *buffer) {
+static json_t *read_uint32(decoder_t *decoder) {
     uint32_t number;
-    read_buffer(buffer, &number, sizeof(uint32_t));
+    if (!read_checked(decoder, &number, sizeof(uint32_t)))
+        return NULL;
     return json_integer((json_int_t)number);
 }
 
-static json_t *read_uint64(buffer_t *buffer) {
+static json_t *read_uint64(decoder_t *decoder) {
     int64_t number;
-    read_buffer(buffer, &number, sizeof(uint64_t));
+    if (!read_checked(decoder, &number, sizeof(uint64_t)))
+        return NULL;
     return json_integer((json_int_t)number);
 }
 
-static size_t read_uvarint(buffer_t *buffer) {
+static int read_uvarint(decoder_t *decoder, uint64_t *result) {
 
     uint8_t type_flag;
     uint64_t le64;
     uint32_t le32;
     uint16_t le16;
 
-    read_buffer(buffer, &type_flag, sizeof(uint8_t));
+    if (!read_checked(decoder, &type_flag, sizeof(uint8_t)))
+        return FALSE;
 
     switch (type_flag) {
         case 0xFF:
-            read_buffer(buffer, &le64, sizeof(uint64_t));
-            return (size_t)le64;
+            if (!read_checked(decoder, &le64, sizeof(uint64_t)))
+                return FALSE;
+            break;
 
         case 0xFE:
-            read_buffer(buffer, &le32, sizeof(uint32_t));
-            return (size_t)le32;
+            if (!read_checked(decoder, &le32, sizeof(uint32_t)))
+                return FALSE;
+            le64 = le32;
+            break;
 
         case 0xFD:
-            read_buffer(buffer, &le16, sizeof(uint16_t));
-            return (size_t)le16;
+            if (!read_checked(decoder, &le16, sizeof(uint16_t)))
+                return FALSE;
+            le64 = le16;
+            break;
 
         default:
-            return (size_t)type_flag;
+            le64 = type_flag;
+            break;
+    }
+
+    *result = le64;
+    return TRUE;
+}
+
+/* reads a length and checks that that many bytes remain */
+static int read_length(decoder_t *decoder, size_t *result) {
+
+    uint64_t le64;
+    size_t start = decoder->buffer.read;
+
+    if (!read_uvarint(decoder, &le64))
+        return FALSE;
+
+    /* every entry takes at least one byte so no length can exceed the remaining data */
+    if (le64 > decoder->buffer.size - decoder->buffer.read) {
+        error_set(decoder->error, start, json_error_premature_end_of_input,
+                  "length exceeds the remaining data");
+        return FALSE;
     }
+
+    *result = (size_t)le64;
+    return TRUE;
 }
 
-static json_t *read_real32(buffer_t *buffer) {
+static json_t *read_real32(decoder_t *decoder) {
     float number;
-    read_buffer(buffer, &number, sizeof(float));
+    if (!read_checked(decoder, &number, sizeof(float)))
+        return NULL;
     return json_real((double)number);
 }
 
-static json_t *read_real64(buffer_t *buffer) {
+static json_t *read_real64(decoder_t *decoder) {
     double number;
-    read_buffer(buffer, &number, sizeof(double));
+    if (!read_checked(decoder, &number, sizeof(double)))
+        return NULL;
     return json_real(number);
 }
 
-static char *read_raw_string(buffer_t *buffer) {
+static json_t *read_string(decoder_t *decoder) {
 
-    size_t len = read_uvarint(buffer);
+    size_t len, start;
+    json_t *string;
 
-    if (len > 0) {
-        char *utf8String = (char*)jsonp_malloc(sizeof(char) * len);
-        read_buffer(buffer, utf8String, sizeof(char) * len);
-        memset(utf8String + len, (char)0, sizeof(char));
-        return utf8String;
-    }
-    else {
-        return "";
+    if (!read_length(decoder, &len))
+        return NULL;
+
+    start = decoder->buffer.read;
+    string = json_stringn((const char *)decoder->buffer.pos, len);
+    if (!string) {
+        error_set(decoder->error, start, json_error_invalid_utf8, "invalid UTF-8 string");
+        return NULL;
     }
-}
 
-static json_t *read_string(buffer_t *buffer) {
-    return json_string(read_raw_string(buffer));
+    decoder->buffer.pos += len;
+    decoder->buffer.read += len;
+    return string;
 }
 
-static json_t *read_bytes(buffer_t *buffer) {
+static json_t *read_bytes(decoder_t *decoder) {
+
+    size_t len;
+    void *bytes;
+
+    if (!read_length(decoder, &len))
+        return NULL;
+
+    if ((decoder->flags & BOS_BORROW) && len >= BOS_BORROW_MIN_SIZE) {
+        json_t *borrowed = json_bytes_borrow(decoder->buffer.pos, len, NULL, NULL);
+        if (!borrowed) {
+            error_set(decoder->error, decoder->buffer.read, json_error_out_of_memory, "out of memory");
+            return NULL;
+        }
+
+        decoder->buffer.pos += len;
+        decoder->buffer.read += len;
+        return borrowed;
+    }
+
+    bytes = jsonp_malloc(len ? len : 1);
+    if (!bytes) {
+        error_set(decoder->error, decoder->buffer.read, json_error_out_of_memory, "out of memory");
+        return NULL;
+    }
 
-    size_t len = read_uvarint(buffer);
-    void *bytes = jsonp_malloc(len);
-    read_buffer(buffer, bytes, len);
+    read_buffer(&decoder->buffer, bytes, len);
     return json_bytes(bytes, len);
 }
 
-static json_t *read_array(buffer_t *buffer, json_error_t *error) {
+/* the element types a packed array can hold on the wire */
+static JSON_INLINE int packed_type_of_wire(uint8_t data_type, json_packed_type *type) {
+    switch (data_type) {
+        case BOS_INT64:
+            *type = JSON_PACKED_INT64;
+            return TRUE;
+        case BOS_UINT32:
+            *type = JSON_PACKED_UINT32;
+            return TRUE;
+        case BOS_DOUBLE:
+            *type = JSON_PACKED_DOUBLE;
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+static json_t *read_packed(decoder_t *decoder) {
 
-    size_t len = read_uvarint(buffer);
-    json_array_t *array = json_to_array(json_array());
+    uint8_t element;
+    json_packed_type type;
+    size_t count, element_size, start = decoder->buffer.read;
+    json_t *packed;
 
-    for (unsigned int i = 0; i < len; ++i) {
-        json_t *entry = read_value(buffer, error);
-        if (entry == NULL)
-            return NULL;
+    if (!read_checked(decoder, &element, sizeof(uint8_t)))
+        return NULL;
+
+    if (!packed_type_of_wire(element, &type)) {
+        error_set(decoder->error, start, json_error_invalid_format, "invalid packed array element type");
+        return NULL;
+    }
 
-        json_array_append(&array->json, entry);
+    if (!read_length(decoder, &count))
+        return NULL;
+
+    element_size = jsonp_packed_element_size(type);
+    if (count > (decoder->buffer.size - decoder->buffer.read) / element_size) {
+        error_set(decoder->error, start, json_error_premature_end_of_input,
+                  "length exceeds the remaining data");
+        return NULL;
+    }
+
+    /* the elements are stored as they are on the wire */
+    packed = json_packed(type, decoder->buffer.pos, count);
+    if (!packed) {
+        error_set(decoder->error, decoder->buffer.read, json_error_out_of_memory, "out of memory");
+        return NULL;
     }
 
-    return &array->json;
+    decoder->buffer.pos += count * element_size;
+    decoder->buffer.read += count * element_size;
+    return packed;
 }
 
-static json_t *read_obj(buffer_t *buffer, json_error_t *error) {
+/* keys are checked once, when they first appear in the frame */
+static int read_key(decoder_t *decoder, const char **key, size_t *key_len, size_t *hash) {
 
-    size_t len = read_uvarint(buffer);
-    json_object_t *object = json_to_object(json_object());
+    size_t start = decoder->buffer.read;
 
-    for (unsigned int i = 0; i < len; ++i) {
+    if (!read_length(decoder, key_len))
+        return FALSE;
 
-        char *key = read_raw_string(buffer);
-        json_t *entry = read_value(buffer, error);
-        if (entry == NULL)
-            return NULL;
+    /* the key is used in place, the object copies it */
+    *key = (const char *)decoder->buffer.pos;
+    decoder->buffer.pos += *key_len;
+    decoder->buffer.read += *key_len;
 
-        json_object_set(&object->json, key, entry);
+    if (memchr(*key, '\0', *key_len)) {
+        error_set(decoder->error, start, json_error_null_byte_in_key, "NUL byte in object key not supported");
+        return FALSE;
     }
 
-    return &object->json;
-}
+    if (!utf8_check_string(*key, *key_len)) {
+        error_set(decoder->error, start, json_error_invalid_utf8, "invalid UTF-8 object key");
+        return FALSE;
+    }
 
-static json_t *read_value(buffer_t *buffer, json_error_t *error) {
-    bos_data_type data_type = read_data_type(buffer);
-    return read_data(buffer, data_type, error);
+    /* objects in a message usually repeat the same keys */
+    *hash = hashtable_hash(*key, *key_len);
+    return TRUE;
 }
 
-static bos_data_type read_data_type(buffer_t *buffer) {
+static int add_key(decoder_t *decoder, const char *key, size_t key_len, size_t hash) {
 
-    uint8_t type;
-    read_buffer(buffer, &type, sizeof(uint8_t));
+    decoder_key_t *keys;
+
+    if (decoder->key_count == decoder->key_size) {
+        keys = jsonp_malloc(decoder->key_size * 2 * sizeof(decoder_key_t));
+        if (!keys) {
+            error_set(decoder->error, decoder->buffer.read, json_error_out_of_memory, "out of memory");
+            return FALSE;
+        }
 
-    if (type > 0x0F) {
-        return BOS_NULL;
+        memcpy(keys, decoder->keys, decoder->key_count * sizeof(decoder_key_t));
+        if (decoder->keys != decoder->inline_keys)
+            jsonp_free(decoder->keys);
+        decoder->keys = keys;
+        decoder->key_size *= 2;
     }
 
-    return (bos_data_type)type;
+    decoder->keys[decoder->key_count].key = key;
+    decoder->keys[decoder->key_count].len = key_len;
+    decoder->keys[decoder->key_count].hash = hash;
+    decoder->key_count++;
+    return TRUE;
 }
 
-static json_t *read_data(buffer_t *buffer, bos_data_type data_type, json_error_t *error) {
-    switch (data_type) {
-        case BOS_NULL:
-            return json_null();
-        case BOS_BOOL:
-            return read_bool(buffer);
-        case BOS_INT8:
-            return read_int8(buffer);
-        case BOS_INT16:
-            return read_int16(buffer);
-        case BOS_INT32:
-            return read_int32(buffer);
-        case BOS_INT64:
-            return read_int64(buffer);
-        case BOS_UINT8:
-            return read_uint8(buffer);
-        case BOS_UINT16:
-            return read_uint16(buffer);
-        case BOS_UINT32:
-            return read_uint32(buffer);
-        case BOS_UINT64:
-            return read_uint64(buffer);
-        case BOS_FLOAT:
-            return read_real32(buffer);
-        case BOS_DOUBLE:
-            return read_real64(buffer);
-        case BOS_STRING:
-            return read_string(buffer);
-        case BOS_BYTES:
-            return read_bytes(buffer);
-        case BOS_ARRAY:
-            return read_array(buffer, error);
-        case BOS_OBJ:
-            return read_obj(buffer, error);
-        default:
-            error_set(error, json_error_invalid_format, "invalid data_type");
-            return NULL;
+/* a key reference or a new key which is added to the key table */
+static int read_table_key(decoder_t *decoder, const char **key, size_t *key_len, size_t *hash) {
+
+    size_t start = decoder->buffer.read;
+    uint64_t ref;
+
+    if (!read_uvarint(decoder, &ref))
+        return FALSE;
+
+    if (ref == 0)
+        return read_key(decoder, key, key_len, hash) && add_key(decoder, *key, *key_len, *hash);
+
+    if (ref > decoder->key_count) {
+        error_set(decoder->error, start, json_error_invalid_format, "invalid key reference");
+        return FALSE;
     }
+
+    /* resolved keys were checked and hashed when they were added */
+    *key = decoder->keys[ref - 1].key;
+    *key_len = decoder->keys[ref - 1].len;
+    *hash = decoder->keys[ref - 1].hash;
+    return TRUE;
 }
 
-json_t *bos_deserialize(const void *data, json_error_t *error) {
+/* an array or object whose entries are being read */
+typedef struct {
+    json_t *container;
+    size_t remaining;
+    uint8_t type;
+} decoder_level_t;
 
-    buffer_t buffer;
-    buffer_init(&buffer, data);
-    jsonp_error_init(error, "<bos_deserialize>");
+#define DECODER_INLINE_LEVELS 128
 
-    if (buffer.size < 5) {
-        error_set(error, json_error_invalid_format, "size too small to be valid");
-        return NULL;
+/* Reads one value without recursing. Containers are added to their
+   parent as soon as they are created, so on error only the outermost
+   one has to be released. */
+static json_t *read_value(decoder_t *decoder) {
+
+    decoder_level_t inline_levels[DECODER_INLINE_LEVELS];
+    decoder_level_t *levels = inline_levels, *level;
+    size_t count = 0, size = DECODER_INLINE_LEVELS;
+    size_t len = 0, start, key_start = 0, key_len = 0, hash = 0;
+    const char *key = NULL;
+    json_t *root = NULL, *value;
+    uint8_t type;
+
+    for (;;) {
+        start = decoder->buffer.read;
+        if (!read_checked(decoder, &type, sizeof(uint8_t)))
+            goto error;
+
+        switch (type) {
+            case BOS_NULL:
+                value = json_null();
+                break;
+            case BOS_BOOL:
+                value = read_bool(decoder);
+                break;
+            case BOS_INT8:
+                value = read_int8(decoder);
+                break;
+            case BOS_INT16:
+                value = read_int16(decoder);
+                break;
+            case BOS_INT32:
+                value = read_int32(decoder);
+                break;
+            case BOS_INT64:
+                value = read_int64(decoder);
+                break;
+            case BOS_UINT8:
+                value = read_uint8(decoder);
+                break;
+            case BOS_UINT16:
+                value = read_uint16(decoder);
+                break;
+            case BOS_UINT32:
+                value = read_uint32(decoder);
+                break;
+            case BOS_UINT64:
+                value = read_uint64(decoder);
+                break;
+            case BOS_FLOAT:
+                value = read_real32(decoder);
+                break;
+            case BOS_DOUBLE:
+                value = read_real64(decoder);
+                break;
+            case BOS_STRING:
+                value = read_string(decoder);
+                break;
+            case BOS_BYTES:
+                value = read_bytes(decoder);
+                break;
+            case BOS_ARRAY:
+            case BOS_OBJ:
+            case BOS_KEYED_OBJ:
+                if (decoder->depth + 1 > decoder->max_depth) {
+                    error_set(decoder->error, start, json_error_stack_overflow, "maximum nesting depth exceeded");
+                    goto error;
+                }
+                if (!read_length(decoder, &len))
+                    goto error;
+
+                value = type == BOS_ARRAY ? json_array() : json_object();
+                if (!value)
+                    error_set(decoder->error, decoder->buffer.read, json_error_out_of_memory, "out of memory");
+                break;
+            case BOS_PACKED:
+                value = read_packed(decoder);
+                break;
+            default:
+                error_set(decoder->error, start, json_error_invalid_format, "invalid data_type");
+                goto error;
+        }
+
+        if (!value)
+            goto error;
+
+        if (!count)
+            root = value;
+        else if (levels[count - 1].type == BOS_ARRAY) {
+            if (json_array_append_new(levels[count - 1].container, value)) {
+                error_set(decoder->error, start, json_error_out_of_memory, "out of memory");
+                goto error;
+            }
+        }
+        else if (jsonp_object_set_hashed_new(levels[count - 1].container, key, key_len, hash, value)) {
+            error_set(decoder->error, key_start, json_error_out_of_memory, "out of memory");
+            goto error;
+        }
+
+        if ((type == BOS_ARRAY || type == BOS_OBJ || type == BOS_KEYED_OBJ) && len > 0) {
+            if (count == size) {
+                level = jsonp_malloc(size * 2 * sizeof(decoder_level_t));
+                if (!level) {
+                    error_set(decoder->error, decoder->buffer.read, json_error_out_of_memory, "out of memory");
+                    goto error;
+                }
+
+                memcpy(level, levels, count * sizeof(decoder_level_t));
+                if (levels != inline_levels)
+                    jsonp_free(levels);
+                levels = level;
+                size *= 2;
+            }
+
+            levels[count].container = value;
+            levels[count].remaining = len;
+            levels[count].type = type;
+            count++;
+            decoder->depth++;
+        }
+
+        /* move on to the next entry of the innermost unfinished container */
+        while (count && !levels[count - 1].remaining) {
+            count--;
+            decoder->depth--;
+        }
+
+        if (!count)
+            break;
+
+        level = &levels[count - 1];
+        level->remaining--;
+
+        if (level->type != BOS_ARRAY) {
+            key_start = decoder->buffer.read;
+            if (level->type == BOS_KEYED_OBJ ? !read_table_key(decoder, &key, &key_len, &hash)
+                                             : !read_key(decoder, &key, &key_len, &hash))
+                goto error;
+        }
     }
 
-    return read_value(&buffer, error);
+    if (levels != inline_levels)
+        jsonp_free(levels);
+    return root;
+
+error:
+    decoder->depth -= count;
+    if (levels != inline_levels)
+        jsonp_free(levels);
+    json_decref(root);
+    return NULL;
 }
 
-/*** validation ***/
+/* checks the frame header and sets up decoding of its value, the key
+   table storage of the decoder is kept */
+static int decoder_frame(decoder_t *decoder, const void *data, size_t size, json_error_t *error) {
 
-static int validate_value(buffer_t *buffer);
+    uint32_t data_size;
 
-static JSON_INLINE int validate_read(buffer_t *buffer, unsigned int amount) {
-    if (buffer->read + amount <= buffer->size) {
-        buffer->read += amount;
-        buffer->pos += amount;
-        return TRUE;
+    if (data == NULL || size < 5) {
+        error_set(error, 0, json_error_invalid_argument, "size too small to be valid");
+        return FALSE;
     }
-    return FALSE;
-}
 
-static JSON_INLINE int validate_read_only(buffer_t *buffer, unsigned int amount) {
-    if (buffer->read + amount <= buffer->size) {
-        return TRUE;
+    memcpy(&data_size, data, sizeof(uint32_t));
+    if (data_size < 5) {
+        error_set(error, 0, json_error_invalid_format, "size too small to be valid");
+        return FALSE;
     }
-    return FALSE;
+
+    if (data_size > size) {
+        error_set(error, 0, json_error_premature_end_of_input, "size exceeds the available data");
+        return FALSE;
+    }
+
+    decoder->buffer.data = data;
+    decoder->buffer.pos = (unsigned char *)data + sizeof(uint32_t);
+    decoder->buffer.read = sizeof(uint32_t);
+    decoder->buffer.size = data_size;
+    decoder->buffer.keys = 0;
+    decoder->depth = 0;
+    decoder->key_count = 0;
+    return TRUE;
 }
 
+static int decoder_init(decoder_t *decoder, const void *data, size_t size, size_t flags, json_error_t *error) {
 
-static JSON_INLINE int validate_uvarint(buffer_t *buffer, uint64_t *result) {
+    decoder->max_depth = BOS_DEPTH_LIMIT_GET(flags);
+    if (decoder->max_depth == 0)
+        decoder->max_depth = JSON_PARSER_MAX_DEPTH;
+    decoder->flags = flags;
+    decoder->error = error;
+    decoder->keys = decoder->inline_keys;
+    decoder->key_size = DECODER_INLINE_KEYS;
+    return decoder_frame(decoder, data, size, error);
+}
 
-    uint8_t type_flag;
-    uint64_t le64;
-    uint32_t le32;
-    uint16_t le16;
+static void decoder_close(decoder_t *decoder) {
+    if (decoder->keys != decoder->inline_keys)
+        jsonp_free(decoder->keys);
+}
 
-    if (!validate_read_only(buffer, sizeof(uint8_t)))
-        return FALSE;
+/* exact rejects frames whose size leaves bytes after the value; the
+   legacy bos_deserialize and bos_validate have always ignored them */
+static json_t *deserialize_frame(const void *data, size_t size, size_t flags, int exact, json_error_t *error) {
 
-    read_buffer(buffer, &type_flag, sizeof(uint8_t));
+    decoder_t decoder;
+    json_t *result;
 
-    switch (type_flag) {
-        case 0xFF:
+    jsonp_error_init(error, "<bos_deserialize>");
 
-            if (!validate_read_only(buffer, sizeof(uint64_t)))
-                return FALSE;
+    if (!decoder_init(&decoder, data, size, flags, error))
+        return NULL;
 
-            read_buffer(buffer, &le64, sizeof(uint64_t));
-            *(result) = le64;
-            return TRUE;
+    result = read_value(&decoder);
+    if (result && exact && decoder.buffer.read != decoder.buffer.size) {
+        error_set(error, decoder.buffer.read, json_error_end_of_input_expected,
+                  "unexpected data after value");
+        json_decref(result);
+        result = NULL;
+    }
 
-        case 0xFE:
+    if (result)
+        jsonp_stats_call(deserialize, decoder.buffer.size);
 
-            if (!validate_read_only(buffer, sizeof(uint32_t)))
-                return FALSE;
+    decoder_close(&decoder);
+    return result;
+}
 
-            read_buffer(buffer, &le32, sizeof(uint32_t));
-            *(result) = le32;
-            return TRUE;
+json_t *bos_deserialize_ex(const void *data, size_t size, size_t flags, json_error_t *error) {
+    return deserialize_frame(data, size, flags, 1, error);
+}
 
-        case 0xFD:
+json_t *bos_load_file_mmap(const char *path, size_t flags, json_error_t *error) {
 
-            if (!validate_read_only(buffer, sizeof(uint16_t)))
-                return FALSE;
+    bos_file_t file;
+    json_t *result;
 
-            read_buffer(buffer, &le16, sizeof(uint16_t));
-            *(result) = le16;
-            return TRUE;
+    jsonp_error_init(error, path);
 
-        default:
-            *(result) = type_flag;
-            return TRUE;
+    if (path == NULL) {
+        error_set(error, 0, json_error_invalid_argument, "wrong arguments");
+        return NULL;
     }
+
+    if (jsonp_file_open(&file, path, 1, error))
+        return NULL;
+
+    /* bytes can not be borrowed from a mapping that is released here */
+    result = bos_deserialize_ex(file.data, file.size, flags & ~(size_t)BOS_BORROW, error);
+    if (!result)
+        jsonp_error_set_source(error, path);
+
+    bos_file_close(&file);
+    return result;
 }
 
-static JSON_INLINE int validate_string(buffer_t *buffer) {
+int bos_deserialize_many(const void *data, size_t size, size_t flags, json_t **values, size_t count,
+                         json_error_t *error) {
 
-    uint64_t len;
+    decoder_t decoder;
+    size_t n = 0, offset = 0;
 
-    if (!validate_uvarint(buffer, &len))
-        return FALSE;
+    jsonp_error_init(error, "<bos_deserialize>");
 
-    if (len > 0) {
-        return validate_read(buffer, sizeof(char) * len);
+    if (count && (data == NULL || values == NULL)) {
+        error_set(error, 0, json_error_invalid_argument, "wrong arguments");
+        return -1;
     }
-    else {
-        return TRUE;
+
+    if (!count || !size) {
+        if (error)
+            error->position = 0;
+        return 0;
     }
-}
 
-static JSON_INLINE int validate_bytes(buffer_t *buffer) {
+    /* one decoder, and its key table, for all of the frames */
+    if (!decoder_init(&decoder, data, size, flags, error))
+        goto error;
+
+    while (1) {
+        values[n] = read_value(&decoder);
+        if (values[n] && decoder.buffer.read != decoder.buffer.size) {
+            error_set(error, decoder.buffer.read, json_error_end_of_input_expected,
+                      "unexpected data after value");
+            json_decref(values[n]);
+            values[n] = NULL;
+        }
+        if (!values[n])
+            goto error;
+
+        offset += decoder.buffer.size;
+        if (++n == count || offset == size)
+            break;
+
+        if (!decoder_frame(&decoder, (const unsigned char *)data + offset, size - offset, error))
+            goto error;
+    }
 
-    uint64_t len;
+    if (error)
+        error->position = (int)offset;
 
-    if (!validate_uvarint(buffer, &len))
-        return FALSE;
+    jsonp_stats_call(deserialize, offset);
+    decoder_close(&decoder);
+    return (int)n;
 
-    if (len > 0) {
-        return validate_read(buffer, sizeof(char) * len);
-    }
-    else {
-        return TRUE;
+error:
+    /* positions count from the start of data */
+    if (error)
+        error->position += (int)offset;
+
+    while (n > 0)
+        json_decref(values[--n]);
+    decoder_close(&decoder);
+    return -1;
+}
+
+json_t *bos_deserialize(const void *data, json_error_t *error) {
+
+    if (data == NULL) {
+        jsonp_error_init(error, "<bos_deserialize>");
+        error_set(error, 0, json_error_invalid_argument, "data is NULL");
+        return NULL;
     }
+
+    return deserialize_frame(data, bos_sizeof(data), 0, 0, error);
 }
 
-static JSON_INLINE int validate_array(buffer_t *buffer) {
+/*** selective decoding ***/
 
-    uint64_t len;
+/* Skipped values are only checked for structure: their sizes must fit in
+   the frame and keyed objects register their new keys so that later
+   references resolve. Nothing is allocated for them. */
 
-    if (!validate_uvarint(buffer, &len))
-        return FALSE;
+#define SELECT_INLINE_PATHS 8
 
-    for (uint64_t i = 0; i < len; ++i) {
-        if (!validate_value(buffer))
-            return FALSE;
+static int skip_value(decoder_t *decoder);
+
+static JSON_INLINE int skip_bytes(decoder_t *decoder, size_t size) {
+    buffer_t *buffer = &decoder->buffer;
+
+    if (size > buffer->size - buffer->read) {
+        error_set(decoder->error, buffer->read, json_error_premature_end_of_input,
+                  "unexpected end of data");
+        return FALSE;
     }
 
+    buffer->pos += size;
+    buffer->read += size;
     return TRUE;
 }
 
-static JSON_INLINE int validate_obj(buffer_t *buffer) {
+static int skip_packed(decoder_t *decoder) {
 
-    uint64_t len;
+    uint8_t element;
+    json_packed_type type;
+    size_t count, start = decoder->buffer.read;
 
-    if (!validate_uvarint(buffer, &len))
+    if (!read_checked(decoder, &element, sizeof(uint8_t)))
+        return FALSE;
+
+    if (!packed_type_of_wire(element, &type)) {
+        error_set(decoder->error, start, json_error_invalid_format, "invalid packed array element type");
         return FALSE;
+    }
 
-    for (uint64_t i = 0; i < len; ++i) {
+    if (!read_length(decoder, &count))
+        return FALSE;
 
-        if (!validate_string(buffer))
-            return FALSE;
+    if (count > (decoder->buffer.size - decoder->buffer.read) / jsonp_packed_element_size(type)) {
+        error_set(decoder->error, start, json_error_premature_end_of_input,
+                  "length exceeds the remaining data");
+        return FALSE;
+    }
+
+    return skip_bytes(decoder, count * jsonp_packed_element_size(type));
+}
+
+static int skip_container(decoder_t *decoder, uint8_t type) {
 
-        if (!validate_value(buffer))
+    size_t len, key_len, hash, i;
+    const char *key;
+
+    if (!read_length(decoder, &len))
+        return FALSE;
+
+    for (i = 0; i < len; ++i) {
+        if (type == BOS_KEYED_OBJ) {
+            if (!read_table_key(decoder, &key, &key_len, &hash))
+                return FALSE;
+        }
+        else if (type == BOS_OBJ) {
+            if (!read_length(decoder, &key_len) || !skip_bytes(decoder, key_len))
+                return FALSE;
+        }
+
+        if (!skip_value(decoder))
             return FALSE;
     }
 
     return TRUE;
 }
 
-static int validate_value(buffer_t *buffer) {
+static int skip_value(decoder_t *decoder) {
 
-    if (!validate_read_only(buffer, sizeof(uint8_t)))
-        return FALSE;
+    uint8_t type;
+    size_t len, start = decoder->buffer.read;
+    int result;
 
-    uint8_t data_type;
-    read_buffer(buffer, &data_type, sizeof(uint8_t));
+    if (!read_checked(decoder, &type, sizeof(uint8_t)))
+        return FALSE;
 
-    switch (data_type) {
+    switch (type) {
         case BOS_NULL:
             return TRUE;
         case BOS_BOOL:
-            return validate_read(buffer, sizeof(uint8_t));
         case BOS_INT8:
-            return validate_read(buffer, sizeof(int8_t));
+        case BOS_UINT8:
+            return skip_bytes(decoder, 1);
+        case BOS_INT16:
+        case BOS_UINT16:
+            return skip_bytes(decoder, 2);
+        case BOS_INT32:
+        case BOS_UINT32:
+        case BOS_FLOAT:
+            return skip_bytes(decoder, 4);
+        case BOS_INT64:
+        case BOS_UINT64:
+        case BOS_DOUBLE:
+            return skip_bytes(decoder, 8);
+        case BOS_STRING:
+        case BOS_BYTES:
+            return read_length(decoder, &len) && skip_bytes(decoder, len);
+        case BOS_ARRAY:
+        case BOS_OBJ:
+        case BOS_KEYED_OBJ:
+            if (++decoder->depth > decoder->max_depth) {
+                error_set(decoder->error, start, json_error_stack_overflow, "maximum nesting depth exceeded");
+                return FALSE;
+            }
+            result = skip_container(decoder, type);
+            decoder->depth--;
+            return result;
+        case BOS_PACKED:
+            return skip_packed(decoder);
+        default:
+            error_set(decoder->error, start, json_error_invalid_format, "invalid data_type");
+            return FALSE;
+    }
+}
+
+static int select_value(decoder_t *decoder, const char *const *paths, const jsonp_select_t *selected,
+                        size_t count, json_t **values);
+
+static int select_container(decoder_t *decoder, uint8_t type, const char *const *paths,
+                            const jsonp_select_t *selected, size_t count, json_t **values) {
+
+    jsonp_select_t inline_next[SELECT_INLINE_PATHS], *next = inline_next;
+    size_t len, key_len, hash, i, n;
+    const char *key;
+    int result = -1, found = 0;
+
+    if (count > SELECT_INLINE_PATHS) {
+        next = jsonp_malloc(count * sizeof(jsonp_select_t));
+        if (!next) {
+            error_set(decoder->error, decoder->buffer.read, json_error_out_of_memory, "out of memory");
+            return -1;
+        }
+    }
+
+    if (!read_length(decoder, &len))
+        goto out;
+
+    for (i = 0; i < len; ++i) {
+        if (type == BOS_ARRAY)
+            n = jsonp_select_index(paths, selected, count, i, next);
+        else {
+            if (type == BOS_KEYED_OBJ ? !read_table_key(decoder, &key, &key_len, &hash)
+                                      : !read_key(decoder, &key, &key_len, &hash))
+                goto out;
+            n = jsonp_select_key(paths, selected, count, key, key_len, next);
+        }
+
+        result = select_value(decoder, paths, next, n, values);
+        if (result < 0)
+            goto out;
+        found += result;
+        result = -1;
+    }
+
+    result = found;
+
+out:
+    if (next != inline_next)
+        jsonp_free(next);
+    return result;
+}
+
+static int select_value(decoder_t *decoder, const char *const *paths, const jsonp_select_t *selected,
+                        size_t count, json_t **values) {
+
+    uint8_t type;
+    size_t start = decoder->buffer.read;
+    int result;
+
+    /* nothing below here was asked for */
+    if (!count)
+        return skip_value(decoder) ? 0 : -1;
+
+    if (jsonp_select_found(paths, selected, count)) {
+        json_t *json = read_value(decoder);
+        if (!json)
+            return -1;
+        return jsonp_select_store(paths, selected, count, json, values);
+    }
+
+    if (start == decoder->buffer.size) {
+        error_set(decoder->error, start, json_error_premature_end_of_input, "unexpected end of data");
+        return -1;
+    }
+
+    /* packed arrays and scalars have nothing to look into */
+    type = *decoder->buffer.pos;
+    if (type != BOS_ARRAY && type != BOS_OBJ && type != BOS_KEYED_OBJ)
+        return skip_value(decoder) ? 0 : -1;
+
+    decoder->buffer.pos++;
+    decoder->buffer.read++;
+
+    if (++decoder->depth > decoder->max_depth) {
+        error_set(decoder->error, start, json_error_stack_overflow, "maximum nesting depth exceeded");
+        return -1;
+    }
+    result = select_container(decoder, type, paths, selected, count, values);
+    decoder->depth--;
+    return result;
+}
+
+int bos_deserialize_select(const void *data, size_t size, size_t flags, const char *const *paths, size_t count,
+                           json_t **values, json_error_t *error) {
+
+    jsonp_select_t inline_selected[SELECT_INLINE_PATHS], *selected = inline_selected;
+    decoder_t decoder;
+    int result = -1;
+
+    jsonp_error_init(error, "<bos_deserialize>");
+
+    if (count && (paths == NULL || values == NULL)) {
+        error_set(error, 0, json_error_invalid_argument, "wrong arguments");
+        return -1;
+    }
+
+    if (count > SELECT_INLINE_PATHS) {
+        selected = jsonp_malloc(count * sizeof(jsonp_select_t));
+        if (!selected) {
+            error_set(error, 0, json_error_out_of_memory, "out of memory");
+            return -1;
+        }
+    }
+
+    if (jsonp_select_init(paths, count, values, selected)) {
+        error_set(error, 0, json_error_invalid_argument, "invalid path");
+        goto free;
+    }
+
+    if (!decoder_init(&decoder, data, size, flags, error))
+        goto free;
+
+    result = select_value(&decoder, paths, selected, count, values);
+    if (result >= 0 && decoder.buffer.read != decoder.buffer.size) {
+        error_set(error, decoder.buffer.read, json_error_end_of_input_expected,
+                  "unexpected data after value");
+        result = -1;
+    }
+
+    if (result < 0)
+        jsonp_select_clear(values, count);
+    decoder_close(&decoder);
+
+free:
+    if (selected != inline_selected)
+        jsonp_free(selected);
+    return result;
+}
+
+/*** parallel ***/
+
+/* A first pass skips over the root array's elements to find where each
+   run of them starts, and how many key table entries precede it. Each
+   task then decodes a run into an array of its own, and the arrays are
+   spliced together. */
+
+typedef struct {
+    size_t offset;
+    size_t keys;
+    json_t *array;
+    json_error_t error;
+} deserialize_part_t;
+
+typedef struct {
+    const decoder_t *decoder;
+    size_t len;
+    size_t chunk;
+    deserialize_part_t *parts;
+} deserialize_job_t;
+
+static void deserialize_task(void *arg, size_t index) {
+
+    deserialize_job_t *job = (deserialize_job_t *)arg;
+    deserialize_part_t *part = &job->parts[index];
+    const decoder_t *outer = job->decoder;
+    size_t i, count = min(job->chunk, job->len - index * job->chunk);
+    json_arena_t *arena = json_arena_use(NULL);
+    decoder_t decoder;
+
+    jsonp_error_init(&part->error, "<bos_deserialize>");
+
+    decoder.buffer = outer->buffer;
+    decoder.buffer.pos = (unsigned char *)outer->buffer.data + part->offset;
+    decoder.buffer.read = part->offset;
+    decoder.depth = 1;
+    decoder.max_depth = outer->max_depth;
+    decoder.flags = outer->flags;
+    decoder.error = &part->error;
+    decoder.keys = decoder.inline_keys;
+    decoder.key_size = DECODER_INLINE_KEYS;
+    decoder.key_count = 0;
+
+    /* the keys defined before the run, new ones are added as they appear */
+    if (part->keys > DECODER_INLINE_KEYS) {
+        decoder.keys = jsonp_malloc(part->keys * sizeof(decoder_key_t));
+        decoder.key_size = part->keys;
+    }
+
+    part->array = decoder.keys ? json_array() : NULL;
+    if (!part->array) {
+        error_set(&part->error, part->offset, json_error_out_of_memory, "out of memory");
+        goto out;
+    }
+
+    memcpy(decoder.keys, outer->keys, part->keys * sizeof(decoder_key_t));
+    decoder.key_count = part->keys;
+
+    for (i = 0; i < count; i++) {
+        json_t *entry = read_value(&decoder);
+        if (entry == NULL || json_array_append_new(part->array, entry)) {
+            json_decref(part->array);
+            part->array = NULL;
+            break;
+        }
+    }
+
+out:
+    if (decoder.keys)
+        decoder_close(&decoder);
+    json_arena_use(arena);
+}
+
+json_t *bos_deserialize_parallel(const void *data, size_t size, size_t flags, size_t threads, bos_run_t run,
+                                 void *pool, json_error_t *error) {
+
+    deserialize_job_t job;
+    decoder_t decoder;
+    json_arena_t *arena;
+    json_t *result = NULL;
+    size_t len, tasks, i;
+
+    if (threads < 2 || !data || size < 6 || ((const unsigned char *)data)[4] != BOS_ARRAY)
+        return bos_deserialize_ex(data, size, flags, error);
+
+    jsonp_error_init(error, "<bos_deserialize>");
+
+    if (!decoder_init(&decoder, data, size, flags, error))
+        return NULL;
+
+    decoder.buffer.pos++;
+    decoder.buffer.read++;
+    if (!read_length(&decoder, &len))
+        goto close;
+
+    if (len < 2 * BOS_PARALLEL_MIN_CHUNK) {
+        decoder_close(&decoder);
+        return bos_deserialize_ex(data, size, flags, error);
+    }
+
+    tasks = min(threads, len / BOS_PARALLEL_MIN_CHUNK);
+    job.decoder = &decoder;
+    job.len = len;
+    job.chunk = (len + tasks - 1) / tasks;
+    tasks = (len + job.chunk - 1) / job.chunk;
+
+    job.parts = jsonp_malloc(tasks * sizeof(deserialize_part_t));
+    if (!job.parts) {
+        error_set(error, 0, json_error_out_of_memory, "out of memory");
+        goto close;
+    }
+
+    /* checks the structure of the whole frame and fills the key table */
+    decoder.depth = 1;
+    for (i = 0; i < len; i++) {
+        if (i % job.chunk == 0) {
+            job.parts[i / job.chunk].offset = decoder.buffer.read;
+            job.parts[i / job.chunk].keys = decoder.key_count;
+        }
+        if (!skip_value(&decoder))
+            goto free;
+    }
+
+    if (decoder.buffer.read != decoder.buffer.size) {
+        error_set(error, decoder.buffer.read, json_error_end_of_input_expected,
+                  "unexpected data after value");
+        goto free;
+    }
+
+    if (run)
+        run(pool, deserialize_task, &job, tasks);
+    else {
+        for (i = 0; i < tasks; i++)
+            deserialize_task(&job, i);
+    }
+
+    /* the result is built on the heap like the runs */
+    arena = json_arena_use(NULL);
+    result = json_array();
+    if (!result)
+        error_set(error, 0, json_error_out_of_memory, "out of memory");
+
+    for (i = 0; i < tasks && result; i++) {
+        if (!job.parts[i].array) {
+            /* the error of the first run that failed */
+            if (error)
+                *error = job.parts[i].error;
+            json_decref(result);
+            result = NULL;
+        }
+        else if (jsonp_array_splice(result, job.parts[i].array)) {
+            error_set(error, 0, json_error_out_of_memory, "out of memory");
+            json_decref(result);
+            result = NULL;
+        }
+    }
+    json_arena_use(arena);
+
+    for (i = 0; i < tasks; i++)
+        json_decref(job.parts[i].array);
+
+free:
+    jsonp_free(job.parts);
+close:
+    decoder_close(&decoder);
+    return result;
+}
+
+/*** transcoding ***/
+
+/* Writes a frame as JSON text straight from the wire, formatted like
+   json_dump_callback() would format the deserialized value. */
+
+#define TEXT_MAX_NUMBER_LENGTH 100
+#define TEXT_PRECISION(flags) ((int)(((flags) >> 11) & 0x1F))
+
+typedef struct {
+    decoder_t decoder;
+    size_t flags;
+    int embed;
+    json_dump_callback_t dump;
+    void *data;
+} text_t;
+
+static int text_value(text_t *text, int depth, int embed);
+
+static int text_failed(text_t *text) {
+    error_set(text->decoder.error, text->decoder.buffer.read, json_error_unknown, "dump callback failed");
+    return -1;
+}
+
+static JSON_INLINE int text_out(text_t *text, const char *str, size_t len) {
+    if (text->dump(str, len, text->data))
+        return text_failed(text);
+    return 0;
+}
+
+static JSON_INLINE int text_indent(text_t *text, int depth, int space) {
+    if (jsonp_dump_indent(text->flags, depth, space, text->dump, text->data))
+        return text_failed(text);
+    return 0;
+}
+
+static int text_string(text_t *text, const char *str, size_t len) {
+    if (jsonp_dump_string(str, len, text->dump, text->data, text->flags))
+        return text_failed(text);
+    return 0;
+}
+
+static int text_integer(text_t *text, json_int_t value) {
+    char buffer[TEXT_MAX_NUMBER_LENGTH];
+    int size = jsonp_itostr(buffer, sizeof(buffer), value);
+
+    if (size < 0)
+        return text_failed(text);
+    return text_out(text, buffer, (size_t)size);
+}
+
+static int text_real(text_t *text, double value, size_t start) {
+    char buffer[TEXT_MAX_NUMBER_LENGTH];
+    int size;
+
+    /* json_real() refuses these as well */
+    if (value != value || value - value != 0.0) {
+        error_set(text->decoder.error, start, json_error_wrong_type, "NaN or infinity has no JSON representation");
+        return -1;
+    }
+
+    size = jsonp_dtostr(buffer, sizeof(buffer), value, TEXT_PRECISION(text->flags));
+    if (size < 0)
+        return text_failed(text);
+    return text_out(text, buffer, (size_t)size);
+}
+
+/* integers are sign or zero extended like the read_int* functions do */
+static int text_read_integer(text_t *text, uint8_t type, json_int_t *value) {
+
+    decoder_t *decoder = &text->decoder;
+
+    switch (type) {
+        case BOS_INT8: {
+            int8_t number;
+            if (!read_checked(decoder, &number, sizeof(number))) return FALSE;
+            *value = (json_int_t)number;
+            return TRUE;
+        }
+        case BOS_INT16: {
+            int16_t number;
+            if (!read_checked(decoder, &number, sizeof(number))) return FALSE;
+            *value = (json_int_t)number;
+            return TRUE;
+        }
+        case BOS_INT32: {
+            int32_t number;
+            if (!read_checked(decoder, &number, sizeof(number))) return FALSE;
+            *value = (json_int_t)number;
+            return TRUE;
+        }
+        case BOS_UINT8: {
+            uint8_t number;
+            if (!read_checked(decoder, &number, sizeof(number))) return FALSE;
+            *value = (json_int_t)number;
+            return TRUE;
+        }
+        case BOS_UINT16: {
+            uint16_t number;
+            if (!read_checked(decoder, &number, sizeof(number))) return FALSE;
+            *value = (json_int_t)number;
+            return TRUE;
+        }
+        case BOS_UINT32: {
+            uint32_t number;
+            if (!read_checked(decoder, &number, sizeof(number))) return FALSE;
+            *value = (json_int_t)number;
+            return TRUE;
+        }
+        default: {
+            /* BOS_INT64 and BOS_UINT64 */
+            int64_t number;
+            if (!read_checked(decoder, &number, sizeof(number))) return FALSE;
+            *value = (json_int_t)number;
+            return TRUE;
+        }
+    }
+}
+
+static int text_packed(text_t *text, int depth, int embed) {
+
+    decoder_t *decoder = &text->decoder;
+    uint8_t element;
+    json_packed_type type;
+    size_t count, i, element_size, start = decoder->buffer.read;
+
+    if (!read_checked(decoder, &element, sizeof(uint8_t)))
+        return -1;
+
+    if (!packed_type_of_wire(element, &type)) {
+        error_set(decoder->error, start, json_error_invalid_format, "invalid packed array element type");
+        return -1;
+    }
+
+    if (!read_length(decoder, &count))
+        return -1;
+
+    element_size = jsonp_packed_element_size(type);
+    if (count > (decoder->buffer.size - decoder->buffer.read) / element_size) {
+        error_set(decoder->error, start, json_error_premature_end_of_input,
+                  "length exceeds the remaining data");
+        return -1;
+    }
+
+    /* written like an array of numbers, as the JSON encoder does */
+    if (!embed && text_out(text, "[", 1))
+        return -1;
+    if (count == 0)
+        return embed ? 0 : text_out(text, "]", 1);
+    if (text_indent(text, depth + 1, 0))
+        return -1;
+
+    for (i = 0; i < count; ++i) {
+        int res;
+
+        start = decoder->buffer.read;
+        if (type == JSON_PACKED_DOUBLE) {
+            double number;
+            read_buffer(&decoder->buffer, &number, sizeof(number));
+            res = text_real(text, number, start);
+        }
+        else if (type == JSON_PACKED_INT64) {
+            int64_t number;
+            read_buffer(&decoder->buffer, &number, sizeof(number));
+            res = text_integer(text, (json_int_t)number);
+        }
+        else {
+            uint32_t number;
+            read_buffer(&decoder->buffer, &number, sizeof(number));
+            res = text_integer(text, (json_int_t)number);
+        }
+
+        if (res)
+            return -1;
+
+        if (i < count - 1) {
+            if (text_out(text, ",", 1) || text_indent(text, depth + 1, 1))
+                return -1;
+        }
+        else if (text_indent(text, depth, 0))
+            return -1;
+    }
+
+    return embed ? 0 : text_out(text, "]", 1);
+}
+
+static int text_array(text_t *text, int depth, int embed) {
+
+    size_t len, i;
+
+    if (!read_length(&text->decoder, &len))
+        return -1;
+
+    if (!embed && text_out(text, "[", 1))
+        return -1;
+    if (len == 0)
+        return embed ? 0 : text_out(text, "]", 1);
+    if (text_indent(text, depth + 1, 0))
+        return -1;
+
+    for (i = 0; i < len; ++i) {
+        if (text_value(text, depth + 1, 0))
+            return -1;
+
+        if (i < len - 1) {
+            if (text_out(text, ",", 1) || text_indent(text, depth + 1, 1))
+                return -1;
+        }
+        else if (text_indent(text, depth, 0))
+            return -1;
+    }
+
+    return embed ? 0 : text_out(text, "]", 1);
+}
+
+static int text_obj(text_t *text, int depth, int embed, int keyed) {
+
+    decoder_t *decoder = &text->decoder;
+    const char *separator = (text->flags & JSON_COMPACT) ? ":" : ": ";
+    size_t len, i;
+
+    if (!read_length(decoder, &len))
+        return -1;
+
+    if (!embed && text_out(text, "{", 1))
+        return -1;
+    if (len == 0)
+        return embed ? 0 : text_out(text, "}", 1);
+    if (text_indent(text, depth + 1, 0))
+        return -1;
+
+    for (i = 0; i < len; ++i) {
+        const char *key;
+        size_t key_len, hash;
+
+        if (keyed ? !read_table_key(decoder, &key, &key_len, &hash) : !read_key(decoder, &key, &key_len, &hash))
+            return -1;
+
+        if (text_string(text, key, key_len) || text_out(text, separator, strlen(separator)) ||
+            text_value(text, depth + 1, 0))
+            return -1;
+
+        if (i < len - 1) {
+            if (text_out(text, ",", 1) || text_indent(text, depth + 1, 1))
+                return -1;
+        }
+        else if (text_indent(text, depth, 0))
+            return -1;
+    }
+
+    return embed ? 0 : text_out(text, "}", 1);
+}
+
+static int text_value(text_t *text, int depth, int embed) {
+
+    decoder_t *decoder = &text->decoder;
+    uint8_t type;
+    size_t start = decoder->buffer.read;
+    int result;
+
+    if (!read_checked(decoder, &type, sizeof(uint8_t)))
+        return -1;
+
+    switch (type) {
+        case BOS_NULL:
+            return text_out(text, "null", 4);
+
+        case BOS_BOOL: {
+            uint8_t value;
+            if (!read_checked(decoder, &value, sizeof(uint8_t)))
+                return -1;
+            return value == 0 ? text_out(text, "false", 5) : text_out(text, "true", 4);
+        }
+
+        case BOS_INT8:
+        case BOS_INT16:
+        case BOS_INT32:
+        case BOS_INT64:
+        case BOS_UINT8:
+        case BOS_UINT16:
+        case BOS_UINT32:
+        case BOS_UINT64: {
+            json_int_t value;
+            if (!text_read_integer(text, type, &value))
+                return -1;
+            return text_integer(text, value);
+        }
+
+        case BOS_FLOAT: {
+            float value;
+            if (!read_checked(decoder, &value, sizeof(float)))
+                return -1;
+            return text_real(text, (double)value, start);
+        }
+
+        case BOS_DOUBLE: {
+            double value;
+            if (!read_checked(decoder, &value, sizeof(double)))
+                return -1;
+            return text_real(text, value, start);
+        }
+
+        case BOS_STRING: {
+            const char *value;
+            size_t len;
+
+            if (!read_length(decoder, &len))
+                return -1;
+
+            value = (const char *)decoder->buffer.pos;
+            if (!utf8_check_string(value, len)) {
+                error_set(decoder->error, start, json_error_invalid_utf8, "invalid UTF-8 string");
+                return -1;
+            }
+
+            decoder->buffer.pos += len;
+            decoder->buffer.read += len;
+            return text_string(text, value, len);
+        }
+
+        case BOS_BYTES:
+            error_set(decoder->error, start, json_error_wrong_type, "bytes have no JSON representation");
+            return -1;
+
+        case BOS_ARRAY:
+        case BOS_OBJ:
+        case BOS_KEYED_OBJ:
+            if (++decoder->depth > decoder->max_depth) {
+                error_set(decoder->error, start, json_error_stack_overflow, "maximum nesting depth exceeded");
+                return -1;
+            }
+            result = type == BOS_ARRAY ? text_array(text, depth, embed)
+                                       : text_obj(text, depth, embed, type == BOS_KEYED_OBJ);
+            decoder->depth--;
+            return result;
+
+        case BOS_PACKED:
+            return text_packed(text, depth, embed);
+
+        default:
+            error_set(decoder->error, start, json_error_invalid_format, "invalid data_type");
+            return -1;
+    }
+}
+
+static int text_emit(json_dump_callback_t dump, void *data, void *arg) {
+
+    text_t *text = arg;
+    decoder_t *decoder = &text->decoder;
+
+    text->dump = dump;
+    text->data = data;
+
+    if (text_value(text, 0, text->embed))
+        return -1;
+
+    if (decoder->buffer.read != decoder->buffer.size) {
+        error_set(decoder->error, decoder->buffer.read, json_error_end_of_input_expected,
+                  "unexpected data after value");
+        return -1;
+    }
+
+    return 0;
+}
+
+int bos_to_json_dump(const void *data, size_t size, json_dump_callback_t callback, void *callback_data,
+                     size_t flags, json_error_t *error) {
+
+    text_t text;
+    int result;
+
+    jsonp_error_init(error, "<bos_to_json_dump>");
+
+    if (callback == NULL) {
+        error_set(error, 0, json_error_invalid_argument, "wrong arguments");
+        return -1;
+    }
+
+    /* sorting needs all keys of an object at once, that takes the tree */
+    if (flags & JSON_SORT_KEYS) {
+        json_t *value = bos_deserialize_ex(data, size, 0, error);
+
+        if (!value)
+            return -1;
+
+        result = json_dump_callback(value, callback, callback_data, flags);
+        json_decref(value);
+        if (result)
+            error_set(error, 0, json_error_unknown, "dump failed");
+        return result;
+    }
+
+    if (!decoder_init(&text.decoder, data, size, 0, error))
+        return -1;
+
+    if (!(flags & JSON_ENCODE_ANY)) {
+        uint8_t type = text.decoder.buffer.pos[0];
+
+        if (type != BOS_ARRAY && type != BOS_OBJ && type != BOS_KEYED_OBJ && type != BOS_PACKED) {
+            error_set(error, sizeof(uint32_t), json_error_wrong_type,
+                      "array or object expected without JSON_ENCODE_ANY");
+            decoder_close(&text.decoder);
+            return -1;
+        }
+    }
+
+    /* JSON_EMBED is for the root only */
+    text.flags = flags & ~(size_t)JSON_EMBED;
+    text.embed = (flags & JSON_EMBED) != 0;
+    result = jsonp_dump_staged(flags, callback, callback_data, text_emit, &text);
+
+    decoder_close(&text.decoder);
+    return result;
+}
+
+/*** validation ***/
+
+/* amount is compared against the remaining size so that huge lengths
+   read from corrupt data cannot wrap around */
+static JSON_INLINE int validate_read(buffer_t *buffer, uint64_t amount) {
+    if (amount <= buffer->size - buffer->read) {
+        buffer->read += (size_t)amount;
+        buffer->pos += (size_t)amount;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static JSON_INLINE int validate_read_only(buffer_t *buffer, uint64_t amount) {
+    if (amount <= buffer->size - buffer->read) {
+        return TRUE;
+    }
+    return FALSE;
+}
+
+
+static JSON_INLINE int validate_uvarint(buffer_t *buffer, uint64_t *result) {
+
+    uint8_t type_flag;
+    uint64_t le64;
+    uint32_t le32;
+    uint16_t le16;
+
+    if (!validate_read_only(buffer, sizeof(uint8_t)))
+        return FALSE;
+
+    read_buffer(buffer, &type_flag, sizeof(uint8_t));
+
+    switch (type_flag) {
+        case 0xFF:
+
+            if (!validate_read_only(buffer, sizeof(uint64_t)))
+                return FALSE;
+
+            read_buffer(buffer, &le64, sizeof(uint64_t));
+            *(result) = le64;
+            return TRUE;
+
+        case 0xFE:
+
+            if (!validate_read_only(buffer, sizeof(uint32_t)))
+                return FALSE;
+
+            read_buffer(buffer, &le32, sizeof(uint32_t));
+            *(result) = le32;
+            return TRUE;
+
+        case 0xFD:
+
+            if (!validate_read_only(buffer, sizeof(uint16_t)))
+                return FALSE;
+
+            read_buffer(buffer, &le16, sizeof(uint16_t));
+            *(result) = le16;
+            return TRUE;
+
+        default:
+            *(result) = type_flag;
+            return TRUE;
+    }
+}
+
+static JSON_INLINE int validate_string(buffer_t *buffer) {
+
+    uint64_t len;
+
+    if (!validate_uvarint(buffer, &len))
+        return FALSE;
+
+    if (len > 0) {
+        return validate_read(buffer, sizeof(char) * len);
+    }
+    else {
+        return TRUE;
+    }
+}
+
+static JSON_INLINE int validate_bytes(buffer_t *buffer) {
+
+    uint64_t len;
+
+    if (!validate_uvarint(buffer, &len))
+        return FALSE;
+
+    if (len > 0) {
+        return validate_read(buffer, sizeof(char) * len);
+    }
+    else {
+        return TRUE;
+    }
+}
+
+static JSON_INLINE int validate_packed(buffer_t *buffer) {
+
+    uint8_t element;
+    json_packed_type type;
+    uint64_t count;
+    size_t element_size;
+
+    if (!validate_read_only(buffer, sizeof(uint8_t)))
+        return FALSE;
+
+    read_buffer(buffer, &element, sizeof(uint8_t));
+    if (!packed_type_of_wire(element, &type) || !validate_uvarint(buffer, &count))
+        return FALSE;
+
+    element_size = jsonp_packed_element_size(type);
+    if (count > (buffer->size - buffer->read) / element_size)
+        return FALSE;
+
+    return validate_read(buffer, count * element_size);
+}
+
+/* an array or object whose entries are being checked */
+typedef struct {
+    uint64_t remaining;
+    uint8_t type;
+} validate_level_t;
+
+#define VALIDATE_INLINE_LEVELS 128
+
+static JSON_INLINE int validate_scalar(buffer_t *buffer, uint8_t data_type) {
+
+    switch (data_type) {
+        case BOS_NULL:
+            return TRUE;
+        case BOS_BOOL:
+            return validate_read(buffer, sizeof(uint8_t));
+        case BOS_INT8:
+            return validate_read(buffer, sizeof(int8_t));
         case BOS_INT16:
             return validate_read(buffer, sizeof(int16_t));
         case BOS_INT32:
@@ -473,18 +1768,105 @@ static int validate_value(buffer_t *buffer) {
             return validate_string(buffer);
         case BOS_BYTES:
             return validate_bytes(buffer);
-        case BOS_ARRAY:
-            return validate_array(buffer);
-        case BOS_OBJ:
-            return validate_obj(buffer);
+        case BOS_PACKED:
+            return validate_packed(buffer);
         default:
             return FALSE;
     }
 }
 
+/* Checks one value without recursing, so hostile nesting fails on
+   max_depth instead of exhausting the stack. */
+static int validate_nested(buffer_t *buffer, size_t max_depth) {
+
+    validate_level_t inline_levels[VALIDATE_INLINE_LEVELS];
+    validate_level_t *levels = inline_levels, *level;
+    size_t count = 0, size = VALIDATE_INLINE_LEVELS;
+    uint64_t len, ref;
+    uint8_t data_type;
+    int result = FALSE;
+
+    for (;;) {
+        if (!validate_read_only(buffer, sizeof(uint8_t)))
+            goto done;
+
+        read_buffer(buffer, &data_type, sizeof(uint8_t));
+
+        if (data_type == BOS_ARRAY || data_type == BOS_OBJ || data_type == BOS_KEYED_OBJ) {
+
+            if (count >= max_depth || !validate_uvarint(buffer, &len))
+                goto done;
+
+            if (len > 0) {
+                if (count == size) {
+                    level = jsonp_malloc(size * 2 * sizeof(validate_level_t));
+                    if (!level)
+                        goto done;
+
+                    memcpy(level, levels, count * sizeof(validate_level_t));
+                    if (levels != inline_levels)
+                        jsonp_free(levels);
+                    levels = level;
+                    size *= 2;
+                }
+
+                levels[count].remaining = len;
+                levels[count].type = data_type;
+                count++;
+            }
+        }
+        else if (!validate_scalar(buffer, data_type))
+            goto done;
+
+        while (count && !levels[count - 1].remaining)
+            count--;
+
+        if (!count)
+            break;
+
+        level = &levels[count - 1];
+        level->remaining--;
+
+        if (level->type == BOS_OBJ) {
+            if (!validate_string(buffer))
+                goto done;
+        }
+        else if (level->type == BOS_KEYED_OBJ) {
+            if (!validate_uvarint(buffer, &ref))
+                goto done;
+
+            if (ref == 0) {
+                if (!validate_string(buffer))
+                    goto done;
+                if (buffer->keys != BUFFER_ANY_KEYS)
+                    buffer->keys++;
+            }
+            else if (buffer->keys != BUFFER_ANY_KEYS && ref > buffer->keys)
+                goto done;
+        }
+    }
+
+    result = TRUE;
+
+done:
+    if (levels != inline_levels)
+        jsonp_free(levels);
+    return result;
+}
+
+static int validate_value(buffer_t *buffer) {
+    return validate_nested(buffer, JSON_PARSER_MAX_DEPTH);
+}
+
 int bos_validate(const void *data, size_t size) {
+    return bos_validate_ex(data, size, 0);
+}
+
+int bos_validate_ex(const void *data, size_t size, size_t flags) {
 
     uint32_t data_size;
+    size_t max_depth;
+    buffer_t buffer;
 
     if (data == NULL)
         return FALSE;
@@ -499,10 +1881,13 @@ int bos_validate(const void *data, size_t size) {
         return FALSE;
 
     // deeper length/format validation
-    buffer_t buffer;
     buffer_init(&buffer, data);
 
-    return validate_value(&buffer);
+    max_depth = BOS_DEPTH_LIMIT_GET(flags);
+    if (!max_depth)
+        max_depth = JSON_PARSER_MAX_DEPTH;
+
+    return validate_nested(&buffer, max_depth);
 }
 
 unsigned int bos_sizeof(const void *data) {
@@ -516,3 +1901,497 @@ unsigned int bos_sizeof(const void *data) {
 
     return data_size;
 }
+
+/*** view ***/
+
+static JSON_INLINE void view_to_buffer(const bos_view_t *view, buffer_t *buffer) {
+    buffer->data = view->data;
+    buffer->pos = (unsigned char *)view->data;
+    buffer->read = 0;
+    buffer->size = view->size;
+
+    /* a view does not know the keys before it */
+    buffer->keys = BUFFER_ANY_KEYS;
+}
+
+static JSON_INLINE void buffer_to_view(const buffer_t *buffer, bos_view_t *view) {
+    view->data = buffer->pos;
+    view->size = buffer->size - buffer->read;
+}
+
+static JSON_INLINE int view_read(buffer_t *buffer, void *destination, size_t size) {
+    if (!validate_read_only(buffer, size))
+        return FALSE;
+
+    read_buffer(buffer, destination, size);
+    return TRUE;
+}
+
+/* open the view for reading and return its data type */
+static int view_open(const bos_view_t *view, buffer_t *buffer, uint8_t *data_type) {
+
+    if (!view || !view->data)
+        return FALSE;
+
+    view_to_buffer(view, buffer);
+
+    if (!view_read(buffer, data_type, sizeof(uint8_t)) || *data_type > BOS_KEYED_OBJ)
+        return FALSE;
+
+    return TRUE;
+}
+
+/* open a container view and read its entry count */
+static int view_open_container(const bos_view_t *view, buffer_t *buffer,
+                               bos_data_type expected, uint64_t *count) {
+    uint8_t data_type;
+
+    if (!view_open(view, buffer, &data_type) || data_type != expected)
+        return FALSE;
+
+    return validate_uvarint(buffer, count);
+}
+
+int bos_view_init(bos_view_t *view, const void *data, size_t size) {
+
+    uint32_t data_size;
+
+    if (!view)
+        return -1;
+
+    view->data = NULL;
+    view->size = 0;
+
+    if (data == NULL || size < 5)
+        return -1;
+
+    memcpy(&data_size, data, sizeof(uint32_t));
+    if (data_size < 5 || size < data_size)
+        return -1;
+
+    view->data = (const unsigned char *)data + 4;
+    view->size = data_size - 4;
+    return 0;
+}
+
+int bos_view_open_file(bos_view_t *view, bos_file_t *file, const char *path, json_error_t *error) {
+
+    jsonp_error_init(error, path);
+
+    if (!view || !file || !path) {
+        error_set(error, 0, json_error_invalid_argument, "wrong arguments");
+        return -1;
+    }
+
+    if (jsonp_file_open(file, path, 0, error))
+        return -1;
+
+    if (bos_view_init(view, file->data, file->size)) {
+        error_set(error, 0, json_error_invalid_format, "invalid frame size");
+        bos_file_close(file);
+        return -1;
+    }
+
+    return 0;
+}
+
+int bos_view_type(const bos_view_t *view) {
+
+    buffer_t buffer;
+    uint8_t data_type;
+
+    if (!view_open(view, &buffer, &data_type))
+        return -1;
+
+    switch (data_type) {
+        case BOS_NULL:
+            return JSON_NULL;
+        case BOS_BOOL:
+            if (!validate_read_only(&buffer, 1))
+                return -1;
+            return *buffer.pos ? JSON_TRUE : JSON_FALSE;
+        case BOS_INT8:
+        case BOS_INT16:
+        case BOS_INT32:
+        case BOS_INT64:
+        case BOS_UINT8:
+        case BOS_UINT16:
+        case BOS_UINT32:
+        case BOS_UINT64:
+            return JSON_INTEGER;
+        case BOS_FLOAT:
+        case BOS_DOUBLE:
+            return JSON_REAL;
+        case BOS_STRING:
+            return JSON_STRING;
+        case BOS_BYTES:
+            return JSON_BYTES;
+        case BOS_ARRAY:
+            return JSON_ARRAY;
+        case BOS_OBJ:
+        case BOS_KEYED_OBJ:
+            return JSON_OBJECT;
+        case BOS_PACKED:
+            return JSON_PACKED;
+        default:
+            return -1;
+    }
+}
+
+size_t bos_view_size(const bos_view_t *view) {
+
+    buffer_t buffer;
+    uint8_t data_type;
+    uint64_t len;
+
+    if (!view_open(view, &buffer, &data_type))
+        return 0;
+
+    switch (data_type) {
+        case BOS_STRING:
+        case BOS_BYTES:
+        case BOS_ARRAY:
+        case BOS_OBJ:
+        case BOS_KEYED_OBJ:
+            if (!validate_uvarint(&buffer, &len))
+                return 0;
+            return (size_t)len;
+        case BOS_PACKED:
+            if (!validate_read(&buffer, 1) || !validate_uvarint(&buffer, &len))
+                return 0;
+            return (size_t)len;
+        default:
+            return 0;
+    }
+}
+
+int bos_view_skip(const bos_view_t *view, bos_view_t *next) {
+
+    buffer_t buffer;
+
+    if (!view || !view->data)
+        return -1;
+
+    view_to_buffer(view, &buffer);
+    if (!validate_value(&buffer))
+        return -1;
+
+    if (next)
+        buffer_to_view(&buffer, next);
+    return 0;
+}
+
+int bos_view_array_at(const bos_view_t *view, size_t index, bos_view_t *value) {
+
+    buffer_t buffer;
+    uint64_t count, i;
+
+    if (!view_open_container(view, &buffer, BOS_ARRAY, &count) || index >= count)
+        return -1;
+
+    for (i = 0; i < index; ++i) {
+        if (!validate_value(&buffer))
+            return -1;
+    }
+
+    if (value)
+        buffer_to_view(&buffer, value);
+    return 0;
+}
+
+static int view_object_find(const bos_view_t *view, const char *key, size_t key_len,
+                            bos_view_t *value) {
+    buffer_t buffer;
+    uint64_t count, i, len;
+    uint8_t data_type;
+    int match;
+
+    if (!key || !view_open(view, &buffer, &data_type))
+        return -1;
+
+    /* references point to keys anywhere earlier in the frame */
+    if (data_type == BOS_KEYED_OBJ)
+        return BOS_VIEW_UNSUPPORTED;
+
+    if (data_type != BOS_OBJ || !validate_uvarint(&buffer, &count))
+        return -1;
+
+    for (i = 0; i < count; ++i) {
+
+        if (!validate_uvarint(&buffer, &len) || !validate_read_only(&buffer, len))
+            return -1;
+
+        match = len == key_len && memcmp(buffer.pos, key, key_len) == 0;
+        validate_read(&buffer, len);
+
+        if (match) {
+            if (value)
+                buffer_to_view(&buffer, value);
+            return 0;
+        }
+
+        if (!validate_value(&buffer))
+            return -1;
+    }
+
+    return -1;
+}
+
+int bos_view_object_get(const bos_view_t *view, const char *key, bos_view_t *value) {
+    if (!key)
+        return -1;
+
+    return view_object_find(view, key, strlen(key), value);
+}
+
+int bos_view_object_getn(const bos_view_t *view, const char *key, size_t key_len, bos_view_t *value) {
+    return view_object_find(view, key, key_len, value);
+}
+
+int bos_view_iter_init(const bos_view_t *view, bos_view_iter_t *iter) {
+
+    buffer_t buffer;
+    uint8_t data_type;
+    uint64_t count;
+
+    if (!iter || !view_open(view, &buffer, &data_type))
+        return -1;
+
+    if (data_type == BOS_KEYED_OBJ)
+        return BOS_VIEW_UNSUPPORTED;
+
+    if (data_type != BOS_ARRAY && data_type != BOS_OBJ)
+        return -1;
+
+    if (!validate_uvarint(&buffer, &count))
+        return -1;
+
+    iter->pos.data = buffer.pos;
+    iter->pos.size = buffer.size - buffer.read;
+    iter->remaining = (size_t)count;
+    iter->is_object = data_type == BOS_OBJ;
+    return 0;
+}
+
+int bos_view_iter_next(bos_view_iter_t *iter, const char **key, size_t *key_len, bos_view_t *value) {
+
+    buffer_t buffer;
+    uint64_t len;
+
+    if (!iter || !iter->pos.data)
+        return -1;
+
+    if (!iter->remaining)
+        return 0;
+
+    view_to_buffer(&iter->pos, &buffer);
+
+    if (iter->is_object) {
+        if (!validate_uvarint(&buffer, &len) || !validate_read_only(&buffer, len))
+            return -1;
+
+        if (key)
+            *key = (const char *)buffer.pos;
+        if (key_len)
+            *key_len = (size_t)len;
+
+        validate_read(&buffer, len);
+    }
+    else {
+        if (key)
+            *key = NULL;
+        if (key_len)
+            *key_len = 0;
+    }
+
+    if (value)
+        buffer_to_view(&buffer, value);
+
+    if (!validate_value(&buffer))
+        return -1;
+
+    buffer_to_view(&buffer, &iter->pos);
+    iter->remaining--;
+    return 1;
+}
+
+int bos_view_integer(const bos_view_t *view, json_int_t *value) {
+
+    buffer_t buffer;
+    uint8_t data_type;
+    json_int_t result;
+
+    if (!view_open(view, &buffer, &data_type))
+        return -1;
+
+    switch (data_type) {
+        case BOS_INT8: {
+            int8_t number;
+            if (!view_read(&buffer, &number, sizeof(int8_t))) return -1;
+            result = (json_int_t)number;
+            break;
+        }
+        case BOS_INT16: {
+            int16_t number;
+            if (!view_read(&buffer, &number, sizeof(int16_t))) return -1;
+            result = (json_int_t)number;
+            break;
+        }
+        case BOS_INT32: {
+            int32_t number;
+            if (!view_read(&buffer, &number, sizeof(int32_t))) return -1;
+            result = (json_int_t)number;
+            break;
+        }
+        case BOS_INT64: {
+            int64_t number;
+            if (!view_read(&buffer, &number, sizeof(int64_t))) return -1;
+            result = (json_int_t)number;
+            break;
+        }
+        case BOS_UINT8: {
+            uint8_t number;
+            if (!view_read(&buffer, &number, sizeof(uint8_t))) return -1;
+            result = (json_int_t)number;
+            break;
+        }
+        case BOS_UINT16: {
+            uint16_t number;
+            if (!view_read(&buffer, &number, sizeof(uint16_t))) return -1;
+            result = (json_int_t)number;
+            break;
+        }
+        case BOS_UINT32: {
+            uint32_t number;
+            if (!view_read(&buffer, &number, sizeof(uint32_t))) return -1;
+            result = (json_int_t)number;
+            break;
+        }
+        case BOS_UINT64: {
+            uint64_t number;
+            if (!view_read(&buffer, &number, sizeof(uint64_t))) return -1;
+            result = (json_int_t)number;
+            break;
+        }
+        default:
+            return -1;
+    }
+
+    if (value)
+        *value = result;
+    return 0;
+}
+
+int bos_view_real(const bos_view_t *view, double *value) {
+
+    buffer_t buffer;
+    uint8_t data_type;
+    double result;
+
+    if (!view_open(view, &buffer, &data_type))
+        return -1;
+
+    if (data_type == BOS_FLOAT) {
+        float number;
+        if (!view_read(&buffer, &number, sizeof(float)))
+            return -1;
+        result = (double)number;
+    }
+    else if (data_type == BOS_DOUBLE) {
+        if (!view_read(&buffer, &result, sizeof(double)))
+            return -1;
+    }
+    else
+        return -1;
+
+    if (value)
+        *value = result;
+    return 0;
+}
+
+int bos_view_number(const bos_view_t *view, double *value) {
+
+    json_int_t integer;
+
+    if (!bos_view_real(view, value))
+        return 0;
+
+    if (bos_view_integer(view, &integer))
+        return -1;
+
+    if (value)
+        *value = (double)integer;
+    return 0;
+}
+
+int bos_view_boolean(const bos_view_t *view, int *value) {
+
+    buffer_t buffer;
+    uint8_t data_type;
+    uint8_t number;
+
+    if (!view_open(view, &buffer, &data_type) || data_type != BOS_BOOL)
+        return -1;
+
+    if (!view_read(&buffer, &number, sizeof(uint8_t)))
+        return -1;
+
+    if (value)
+        *value = number != 0;
+    return 0;
+}
+
+/* string and bytes payloads are returned in place */
+static int view_payload(const bos_view_t *view, bos_data_type expected,
+                        const void **data, size_t *len) {
+    buffer_t buffer;
+    uint8_t data_type;
+    uint64_t length;
+
+    if (!view_open(view, &buffer, &data_type) || data_type != expected)
+        return -1;
+
+    if (!validate_uvarint(&buffer, &length) || !validate_read_only(&buffer, length))
+        return -1;
+
+    if (data)
+        *data = buffer.pos;
+    if (len)
+        *len = (size_t)length;
+    return 0;
+}
+
+int bos_view_string(const bos_view_t *view, const char **value, size_t *len) {
+    return view_payload(view, BOS_STRING, (const void **)value, len);
+}
+
+int bos_view_bytes(const bos_view_t *view, const void **value, size_t *len) {
+    return view_payload(view, BOS_BYTES, value, len);
+}
+
+/* the elements are returned in place and may not be aligned for their type */
+int bos_view_packed(const bos_view_t *view, json_packed_type *type, const void **data, size_t *count) {
+
+    buffer_t buffer;
+    uint8_t data_type, element;
+    json_packed_type element_type;
+    uint64_t length;
+
+    if (!view_open(view, &buffer, &data_type) || data_type != BOS_PACKED)
+        return -1;
+
+    if (!view_read(&buffer, &element, sizeof(uint8_t)) || !packed_type_of_wire(element, &element_type))
+        return -1;
+
+    if (!validate_uvarint(&buffer, &length) ||
+        length > (buffer.size - buffer.read) / jsonp_packed_element_size(element_type))
+        return -1;
+
+    if (type)
+        *type = element_type;
+    if (data)
+        *data = buffer.pos;
+    if (count)
+        *count = (size_t)length;
+    return 0;
+}
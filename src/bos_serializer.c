@@ -13,7 +13,9 @@
 #include "jansson_private.h"
 
 #include <errno.h>
+#include <float.h>
 #include <limits.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -52,64 +54,249 @@ static void error_set(json_error_t *error, enum json_error_code code, const char
 
 /*** buffer **/
 
+/* The serializer writes straight into the public writer context. */
+typedef bos_writer_t buffer_t;
+
+#define BOS_WRITER_DEFAULT_SIZE 1024
+
+/* private writer flag, set on the side buffer of a bos_iov_list_t */
+#define BOS_WRITER_IOV ((size_t)1 << (sizeof(size_t) * 8 - 1))
+
+#define BOS_IOV_DEFAULT_THRESHOLD 512
+#define BOS_IOV_BLOCK_SIZE 4096
+
+#define iov_list_of(buffer_) container_of(buffer_, bos_iov_list_t, side)
+
+/* side buffer blocks never move, so iov entries can point into them */
+typedef struct iov_block {
+    struct iov_block *next;
+    unsigned char data[1];
+} iov_block_t;
+
+/* Keys already written in the current frame, used with BOS_KEY_TABLE.
+   Open addressed by hash; the keys point into the value being written. */
 typedef struct {
-    void *data;
-    unsigned char *pos;
-    size_t size; // size of data
-    size_t allocated; // size of allocated memory
-} buffer_t;
+    const char *key;
+    size_t len;
+    size_t hash;
+    size_t ref;
+} key_slot_t;
+
+typedef struct {
+    key_slot_t *slots;
+    size_t capacity;
+    size_t count;
+} key_table_t;
+
+#define KEY_TABLE_INITIAL_SIZE 64
 
 static int write_value(json_t *value, buffer_t *buffer, json_error_t *error);
+static int iov_next_block(bos_iov_list_t *list, size_t amount, json_error_t *error);
+static JSON_INLINE size_t uvarint_size(uint64_t value);
+
+static JSON_INLINE int writer_is_region(const buffer_t *buffer)
+{
+    return buffer->region != NULL && buffer->data == buffer->region;
+}
 
 static int ensure_buffer_size(buffer_t *buffer, size_t amount, json_error_t *error)
 {
-    void *old_data = buffer->data;
-    size_t new_size = max(buffer->size + amount, buffer->size * 2);
+    unsigned char *old_data = buffer->data;
+    size_t new_size;
 
     if(buffer->size + amount <= buffer->allocated)
         return TRUE;
 
+    if(buffer->flags & BOS_WRITER_IOV)
+        return iov_next_block(iov_list_of(buffer), amount, error);
+
+    if(writer_is_region(buffer) && !(buffer->flags & BOS_WRITER_SPILL)) {
+        error_set(error, json_error_out_of_memory, "output buffer too small");
+        return FALSE;
+    }
+
+    new_size = max(buffer->size + amount, buffer->allocated * 2);
+    if(new_size < BOS_WRITER_DEFAULT_SIZE && !(buffer->flags & BOS_EXACT_SIZE))
+        new_size = BOS_WRITER_DEFAULT_SIZE;
+
     buffer->data = jsonp_malloc(new_size * sizeof(uint8_t));
     if(!buffer->data) {
+        buffer->data = old_data;
         error_set(error, json_error_out_of_memory, "failed to allocate additional buffer memory");
         return FALSE;
     }
 
     buffer->allocated = new_size;
-    buffer->pos = (unsigned char *)buffer->data + buffer->size;
-    memcpy(buffer->data, old_data, buffer->size);
-    jsonp_free(old_data);
+    if(buffer->size > 0)
+        memcpy(buffer->data, old_data, buffer->size);
+
+    /* never free the caller's region when spilling out of it */
+    if(old_data != buffer->region)
+        jsonp_free(old_data);
     return TRUE;
 }
 
+/* The capacity check is inlined so that writing into a presized buffer
+   never leaves the fast path; ensure_buffer_size only runs to grow. */
 static JSON_INLINE int write_buffer(buffer_t *buffer, const void *source, size_t len, json_error_t *error) {
-    if (!ensure_buffer_size(buffer, buffer->size + len, error))
+    if (buffer->size + len > buffer->allocated && !ensure_buffer_size(buffer, len, error))
         return FALSE;
-    memcpy(buffer->pos, source, len);
-    buffer->pos += len;
+    memcpy(buffer->data + buffer->size, source, len);
     buffer->size += len;
     return TRUE;
 }
 
+/*** scatter-gather ***/
+
+static int iov_push(bos_iov_list_t *list, const void *base, size_t len, json_error_t *error)
+{
+    bos_iov_t *last = list->count ? &list->iov[list->count - 1] : NULL;
+
+    /* pieces that continue the previous one are merged */
+    if(last && (const unsigned char *)last->iov_base + last->iov_len == (const unsigned char *)base) {
+        last->iov_len += len;
+        list->size += len;
+        return TRUE;
+    }
+
+    if(list->count == list->allocated) {
+        size_t new_size = list->allocated ? list->allocated * 2 : 16;
+        bos_iov_t *iov = jsonp_malloc(new_size * sizeof(bos_iov_t));
+
+        if(!iov) {
+            error_set(error, json_error_out_of_memory, "failed to allocate iov entries");
+            return FALSE;
+        }
+
+        if(list->count)
+            memcpy(iov, list->iov, list->count * sizeof(bos_iov_t));
+
+        jsonp_free(list->iov);
+        list->iov = iov;
+        list->allocated = new_size;
+    }
+
+    list->iov[list->count].iov_base = (void *)base;
+    list->iov[list->count].iov_len = len;
+    list->count++;
+    list->size += len;
+    return TRUE;
+}
+
+/* lists the side buffer bytes written since the last entry */
+static int iov_flush_side(bos_iov_list_t *list, json_error_t *error)
+{
+    bos_writer_t *side = &list->side;
+
+    if(side->size > list->side_start &&
+       !iov_push(list, side->data + list->side_start, side->size - list->side_start, error))
+        return FALSE;
+
+    list->side_start = side->size;
+    return TRUE;
+}
+
+static int iov_next_block(bos_iov_list_t *list, size_t amount, json_error_t *error)
+{
+    size_t size = max(amount, BOS_IOV_BLOCK_SIZE);
+    iov_block_t *block;
+
+    if(!iov_flush_side(list, error))
+        return FALSE;
+
+    block = jsonp_malloc(offsetof(iov_block_t, data) + size);
+    if(!block) {
+        error_set(error, json_error_out_of_memory, "failed to allocate additional buffer memory");
+        return FALSE;
+    }
+
+    block->next = (iov_block_t *)list->blocks;
+    list->blocks = block;
+
+    list->side.data = block->data;
+    list->side.size = 0;
+    list->side.allocated = size;
+    list->side_start = 0;
+    return TRUE;
+}
+
+/* payloads above the threshold are referenced in place instead of copied */
+static int write_payload(buffer_t *buffer, const void *source, size_t len, json_error_t *error) {
+
+    if ((buffer->flags & BOS_WRITER_IOV) && len >= iov_list_of(buffer)->threshold) {
+        bos_iov_list_t *list = iov_list_of(buffer);
+        return iov_flush_side(list, error) && iov_push(list, source, len, error);
+    }
+
+    return write_buffer(buffer, source, len, error);
+}
+
 static JSON_INLINE int write_buffer_byte(buffer_t *buffer, int value, json_error_t *error) {
-    if (!ensure_buffer_size(buffer, buffer->size + 1, error))
+    if (buffer->size + 1 > buffer->allocated && !ensure_buffer_size(buffer, 1, error))
         return FALSE;
-    *((uint8_t *)buffer->pos) = (uint8_t)value;
-    buffer->pos += 1;
+    buffer->data[buffer->size] = (uint8_t)value;
     buffer->size += 1;
     return TRUE;
 }
 
-static int buffer_init(buffer_t *buffer)
-{
-    buffer->data = jsonp_malloc(1024);
-    buffer->pos = buffer->data;
-    buffer->size = 0;
-    buffer->allocated = 1024;
-    return 0;
+/* integral reals are written as integers with BOS_INTEGRAL_REALS */
+static JSON_INLINE json_int_t integer_of(json_t *value) {
+    if (json_is_real(value))
+        return (json_int_t)json_to_real(value)->value;
+    return json_to_integer(value)->value;
+}
+
+static bos_data_type integer_data_type(json_int_t integer) {
+
+    if (integer < 0) {
+
+        if (integer >= INT8_MIN)
+            return BOS_INT8;
+
+        if (integer >= INT16_MIN)
+            return BOS_INT16;
+
+        if (integer >= INT32_MIN)
+            return BOS_INT32;
+
+        return BOS_INT64;
+    }
+
+    if (integer <= 255)
+        return BOS_UINT8;
+
+    if (integer <= 65535)
+        return BOS_UINT16;
+
+    if (integer <= 4294967295)
+        return BOS_UINT32;
+
+    return BOS_UINT64;
 }
 
-static bos_data_type get_data_type(json_t *value) {
+/* the smallest encoding that gives back the same double */
+static bos_data_type real_data_type(double real, size_t flags) {
+
+    if (flags & BOS_FLOAT_REALS)
+        return BOS_FLOAT;
+
+    if (flags & BOS_INTEGRAL_REALS) {
+        const double limit = sizeof(json_int_t) >= 8 ? 9223372036854775808.0 : 2147483648.0;
+
+        /* also rules out NaN; -0.0 has no integer encoding */
+        if (real >= -limit && real < limit && (double)(json_int_t)real == real &&
+            (real != 0.0 || !signbit(real)))
+            return integer_data_type((json_int_t)real);
+    }
+
+    /* NaN never compares equal and is written as a double */
+    if (isinf(real) || (real >= -FLT_MAX && real <= FLT_MAX && (double)(float)real == real))
+        return BOS_FLOAT;
+
+    return BOS_DOUBLE;
+}
+
+static bos_data_type get_data_type(json_t *value, size_t flags) {
 
     if (json_is_object(value))
         return BOS_OBJ;
@@ -125,47 +312,88 @@ static bos_data_type get_data_type(json_t *value) {
 
     if (json_is_number(value)) {
 
-        if (json_is_integer(value)) {
+        if (json_is_integer(value))
+            return integer_data_type(json_to_integer(value)->value);
 
-            json_int_t integer = json_to_integer(value)->value;
+        return real_data_type(json_to_real(value)->value, flags);
+    }
 
-            if (integer < 0) {
+    if (json_is_array(value))
+        return BOS_ARRAY;
 
-                if (integer >= INT8_MIN)
-                    return BOS_INT8;
+    if (json_is_bytes(value))
+        return BOS_BYTES;
 
-                if (integer >= INT16_MIN)
-                    return BOS_INT16;
+    if (json_is_packed(value))
+        return (flags & BOS_EXPAND_PACKED) ? BOS_ARRAY : BOS_PACKED;
 
-                if (integer >= INT32_MIN)
-                    return BOS_INT32;
+    return BOS_NULL;
+}
 
-                return BOS_INT64;
-            }
+/* encoded size of a value without a payload, including the type byte */
+static size_t scalar_size(bos_data_type data_type) {
 
-            if (integer <= 255)
-                return BOS_UINT8;
+    switch (data_type) {
 
-            if (integer <= 65535)
-                return BOS_UINT16;
+        case BOS_NULL:
+            return 1;
 
-            if (integer <= 4294967295)
-                return BOS_UINT32;
+        case BOS_BOOL:
+        case BOS_INT8:
+        case BOS_UINT8:
+            return 2;
 
-            return BOS_UINT64;
-        }
-        else {
-            return BOS_FLOAT;
-        }
-    }
+        case BOS_INT16:
+        case BOS_UINT16:
+            return 3;
 
-    if (json_is_array(value))
-        return BOS_ARRAY;
+        case BOS_INT32:
+        case BOS_UINT32:
+        case BOS_FLOAT:
+            return 5;
 
-    if (json_is_bytes(value))
-        return BOS_BYTES;
+        case BOS_INT64:
+        case BOS_UINT64:
+        case BOS_DOUBLE:
+            return 9;
 
-    return BOS_NULL;
+        default:
+            return 0;
+    }
+}
+
+static JSON_INLINE bos_data_type packed_wire_type(json_packed_type type) {
+    switch (type) {
+        case JSON_PACKED_INT64:
+            return BOS_INT64;
+        case JSON_PACKED_UINT32:
+            return BOS_UINT32;
+        default:
+            return BOS_DOUBLE;
+    }
+}
+
+/* the encoding of a packed element written as a regular array entry */
+static bos_data_type packed_element_type(const json_packed_t *packed, size_t index, size_t flags,
+                                         json_int_t *integer, double *real) {
+    switch (packed->type) {
+        case JSON_PACKED_INT64:
+            *integer = (json_int_t)((const int64_t *)packed->data)[index];
+            return integer_data_type(*integer);
+        case JSON_PACKED_UINT32:
+            *integer = (json_int_t)((const uint32_t *)packed->data)[index];
+            return integer_data_type(*integer);
+        default: {
+            bos_data_type data_type;
+
+            *real = ((const double *)packed->data)[index];
+            data_type = real_data_type(*real, flags);
+
+            /* only reals that real_data_type found integral are converted */
+            *integer = data_type == BOS_FLOAT || data_type == BOS_DOUBLE ? 0 : (json_int_t)*real;
+            return data_type;
+        }
+    }
 }
 
 /*** serializer ***/
@@ -182,60 +410,60 @@ static int write_bool(json_t *value, buffer_t *buffer, json_error_t *error) {
 
 static int write_int8(json_t *value, buffer_t *buffer, json_error_t *error) {
     if (!write_buffer_byte(buffer, BOS_INT8, error)) return FALSE;
-    if (!write_buffer_byte(buffer, (int8_t)json_to_integer(value)->value, error)) return FALSE;
+    if (!write_buffer_byte(buffer, (int8_t)integer_of(value), error)) return FALSE;
     return TRUE;
 }
 
 static int write_int16(json_t *value, buffer_t *buffer, json_error_t *error) {
-    int16_t integer = (int16_t)json_to_integer(value)->value;
+    int16_t integer = (int16_t)integer_of(value);
     if (!write_buffer_byte(buffer, BOS_INT16, error)) return FALSE;
     if (!write_buffer(buffer, &integer, 2, error)) return FALSE;
     return TRUE;
 }
 
 static int write_int32(json_t *value, buffer_t *buffer, json_error_t *error) {
-    int32_t integer = (int32_t)json_to_integer(value)->value;
+    int32_t integer = (int32_t)integer_of(value);
     if (!write_buffer_byte(buffer, BOS_INT32, error)) return FALSE;
     if (!write_buffer(buffer, &integer, 4, error)) return FALSE;
     return TRUE;
 }
 
 static int write_int64(json_t *value, buffer_t *buffer, json_error_t *error) {
-    int64_t integer = (int64_t)json_to_integer(value)->value;
+    int64_t integer = (int64_t)integer_of(value);
     if (!write_buffer_byte(buffer, BOS_INT64, error)) return FALSE;
     if (!write_buffer(buffer, &integer, 8, error)) return FALSE;
     return TRUE;
 }
 
 static int write_uint8(json_t *value, buffer_t *buffer, json_error_t *error) {
-    uint8_t integer = (uint8_t)json_to_integer(value)->value;
+    uint8_t integer = (uint8_t)integer_of(value);
     if (!write_buffer_byte(buffer, BOS_UINT8, error)) return FALSE;
     if (!write_buffer(buffer, &integer, 1, error)) return FALSE;
     return TRUE;
 }
 
 static int write_uint16(json_t *value, buffer_t *buffer, json_error_t *error) {
-    uint16_t integer = (uint16_t)json_to_integer(value)->value;
+    uint16_t integer = (uint16_t)integer_of(value);
     if (!write_buffer_byte(buffer, BOS_UINT16, error)) return FALSE;
     if (!write_buffer(buffer, &integer, 2, error)) return FALSE;
     return TRUE;
 }
 
 static int write_uint32(json_t *value, buffer_t *buffer, json_error_t *error) {
-    uint32_t integer = (uint32_t)json_to_integer(value)->value;
+    uint32_t integer = (uint32_t)integer_of(value);
     if (!write_buffer_byte(buffer, BOS_UINT32, error)) return FALSE;
     if (!write_buffer(buffer, &integer, 4, error)) return FALSE;
     return TRUE;
 }
 
 static int write_uint64(json_t *value, buffer_t *buffer, json_error_t *error) {
-    uint64_t integer = (uint64_t)json_to_integer(value)->value;
+    uint64_t integer = (uint64_t)integer_of(value);
     if (!write_buffer_byte(buffer, BOS_UINT64, error)) return FALSE;
     if (!write_buffer(buffer, &integer, 8, error)) return FALSE;
     return TRUE;
 }
 
-static int write_uvarint(unsigned int value, buffer_t *buffer, json_error_t *error) {
+static int write_uvarint(uint64_t value, buffer_t *buffer, json_error_t *error) {
 
     if (value < 0xFD) {
         uint8_t integer8 = (uint8_t)value;
@@ -283,7 +511,7 @@ static int write_string(json_t *value, buffer_t *buffer, json_error_t *error) {
 
     if (!write_buffer_byte(buffer, BOS_STRING, error)) return FALSE;
     if (!write_uvarint(len, buffer, error)) return FALSE;
-    if (len > 0 && !write_buffer(buffer, str, len, error)) return FALSE;
+    if (len > 0 && !write_payload(buffer, str, len, error)) return FALSE;
 
     return TRUE;
 }
@@ -308,7 +536,7 @@ static int write_bytes(json_t *value, buffer_t *buffer, json_error_t *error) {
 
     if (!write_buffer_byte(buffer, BOS_BYTES, error)) return FALSE;
     if (!write_uvarint(len, buffer, error)) return FALSE;
-    if (len > 0 && !write_buffer(buffer, json_bytes_value(value), len, error)) return FALSE;
+    if (len > 0 && !write_payload(buffer, json_bytes_value(value), len, error)) return FALSE;
 
     return TRUE;
 }
@@ -330,6 +558,97 @@ static int write_array(json_t *value, buffer_t *buffer, json_error_t *error) {
     return TRUE;
 }
 
+static int key_table_grow(key_table_t *table) {
+
+    size_t i, j, capacity = table->capacity ? table->capacity * 2 : KEY_TABLE_INITIAL_SIZE;
+    key_slot_t *slots = jsonp_malloc(capacity * sizeof(key_slot_t));
+
+    if (!slots)
+        return FALSE;
+
+    memset(slots, 0, capacity * sizeof(key_slot_t));
+    for (i = 0; i < table->capacity; i++) {
+        if (!table->slots[i].key)
+            continue;
+
+        j = table->slots[i].hash & (capacity - 1);
+        while (slots[j].key)
+            j = (j + 1) & (capacity - 1);
+        slots[j] = table->slots[i];
+    }
+
+    jsonp_free(table->slots);
+    table->slots = slots;
+    table->capacity = capacity;
+    return TRUE;
+}
+
+/* gets the reference of a key seen before in the frame, or 0 if the key
+   is written in full. A reference is never longer than the key written
+   in full, so value_size() can budget every key as new. */
+static int key_table_ref(key_table_t *table, const char *key, size_t len, size_t *ref, json_error_t *error) {
+
+    size_t hash = hashtable_hash(key, len);
+    size_t i;
+
+    if (table->count * 2 >= table->capacity && !key_table_grow(table)) {
+        error_set(error, json_error_out_of_memory, "out of memory");
+        return FALSE;
+    }
+
+    for (i = hash & (table->capacity - 1); table->slots[i].key; i = (i + 1) & (table->capacity - 1)) {
+        key_slot_t *slot = &table->slots[i];
+        if (slot->hash == hash && slot->len == len && !memcmp(slot->key, key, len)) {
+            if (uvarint_size(slot->ref) <= 1 + uvarint_size(len) + len) {
+                *ref = slot->ref;
+                return TRUE;
+            }
+
+            /* the reader adds the key again, later uses keep the shorter reference */
+            table->count++;
+            *ref = 0;
+            return TRUE;
+        }
+    }
+
+    table->slots[i].key = key;
+    table->slots[i].len = len;
+    table->slots[i].hash = hash;
+    table->slots[i].ref = ++table->count;
+    *ref = 0;
+    return TRUE;
+}
+
+/* keys after their first use in the frame are written as a reference */
+static int write_keyed_obj(json_t *value, buffer_t *buffer, json_error_t *error) {
+
+    key_table_t *table = buffer->keys;
+    size_t len = json_object_size(value);
+    void *iter = json_object_iter(value);
+
+    if (!write_buffer_byte(buffer, BOS_KEYED_OBJ, error)) return FALSE;
+    if (!write_uvarint(len, buffer, error)) return FALSE;
+
+    while (iter) {
+        const char *key = json_object_iter_key(iter);
+        size_t key_len = strlen(key), ref;
+
+        if (key_len > 255) {
+            error_set(error, json_error_invalid_argument, "key string is too long");
+            return FALSE;
+        }
+
+        if (!key_table_ref(table, key, key_len, &ref, error)) return FALSE;
+        if (!write_uvarint(ref, buffer, error)) return FALSE;
+        if (!ref && !write_key_string(key, buffer, error)) return FALSE;
+
+        if (!write_value(json_object_iter_value(iter), buffer, error)) return FALSE;
+        iter = json_object_iter_next(value, iter);
+    }
+
+    return TRUE;
+}
+
 static int write_obj(json_t *value, buffer_t *buffer, json_error_t *error) {
 
     size_t len = json_object_size(value);
@@ -355,9 +674,91 @@ static int write_obj(json_t *value, buffer_t *buffer, json_error_t *error) {
     return TRUE;
 }
 
+/* little endian like the rest of the format */
+static int write_scalar(bos_data_type data_type, json_int_t integer, double real,
+                        buffer_t *buffer, json_error_t *error) {
+    unsigned char le[8];
+    size_t size = scalar_size(data_type) - 1;
+
+    if (data_type == BOS_FLOAT) {
+        float real32 = (float)real;
+        memcpy(le, &real32, 4);
+    }
+    else if (data_type == BOS_DOUBLE)
+        memcpy(le, &real, 8);
+    else {
+        int64_t integer64 = (int64_t)integer;
+        memcpy(le, &integer64, size);
+    }
+
+    if (!write_buffer_byte(buffer, data_type, error)) return FALSE;
+    return write_buffer(buffer, le, size, error);
+}
+
+static int write_packed(json_t *value, buffer_t *buffer, json_error_t *error) {
+
+    json_packed_t *packed = json_to_packed(value);
+    size_t i;
+
+    /* element by element for readers without BOS_PACKED */
+    if (buffer->flags & BOS_EXPAND_PACKED) {
+        json_int_t integer;
+        double real;
+
+        if (!write_buffer_byte(buffer, BOS_ARRAY, error)) return FALSE;
+        if (!write_uvarint(packed->size, buffer, error)) return FALSE;
+
+        for (i = 0; i < packed->size; ++i) {
+            bos_data_type data_type = packed_element_type(packed, i, buffer->flags, &integer, &real);
+            if (!write_scalar(data_type, integer, real, buffer, error)) return FALSE;
+        }
+        return TRUE;
+    }
+
+    if (!write_buffer_byte(buffer, BOS_PACKED, error)) return FALSE;
+    if (!write_buffer_byte(buffer, packed_wire_type(packed->type), error)) return FALSE;
+    if (!write_uvarint(packed->size, buffer, error)) return FALSE;
+    if (packed->size > 0 &&
+        !write_payload(buffer, packed->data, packed->size * jsonp_packed_element_size(packed->type), error))
+        return FALSE;
+
+    return TRUE;
+}
+
+/* the encoded value of a fragment if it can be used with flags */
+static JSON_INLINE const json_fragment_t *fragment_bos(json_t *value, size_t flags) {
+
+    const json_fragment_t *fragment = json_to_fragment(value);
+
+    if (fragment->bos && (!fragment->value || (flags & BOS_FRAGMENT_FLAGS) == fragment->bos_flags))
+        return fragment;
+    return NULL;
+}
+
+static int write_fragment(json_t *value, buffer_t *buffer, json_error_t *error) {
+
+    const json_fragment_t *fragment = fragment_bos(value, buffer->flags);
+
+    /* plain objects are valid in frames with a key table too */
+    if (fragment)
+        return write_payload(buffer, fragment->bos, fragment->bos_size, error);
+
+    if (!json_to_fragment(value)->value) {
+        error_set(error, json_error_wrong_type, "fragment has no BOS encoding");
+        return FALSE;
+    }
+
+    return write_value(json_to_fragment(value)->value, buffer, error);
+}
+
 static int write_value(json_t *value, buffer_t *buffer, json_error_t *error) {
 
-    bos_data_type data_type = get_data_type(value);
+    bos_data_type data_type;
+
+    if (json_is_fragment(value))
+        return write_fragment(value, buffer, error);
+
+    data_type = get_data_type(value, buffer->flags);
 
     switch (data_type) {
 
@@ -404,9 +805,16 @@ static int write_value(json_t *value, buffer_t *buffer, json_error_t *error) {
             return write_bytes(value, buffer, error);
 
         case BOS_ARRAY:
+            if (json_is_packed(value))
+                return write_packed(value, buffer, error);
             return write_array(value, buffer, error);
 
+        case BOS_PACKED:
+            return write_packed(value, buffer, error);
+
         case BOS_OBJ:
+            if (buffer->keys)
+                return write_keyed_obj(value, buffer, error);
             return write_obj(value, buffer, error);
 
         default:
@@ -415,36 +823,684 @@ static int write_value(json_t *value, buffer_t *buffer, json_error_t *error) {
     }
 }
 
-bos_t *bos_serialize(json_t *value, json_error_t *error) {
+/*** size calculation ***/
+
+static JSON_INLINE size_t uvarint_size(uint64_t value) {
+
+    if (value < 0xFD)
+        return 1;
+
+    if (value <= 0xFFFF)
+        return 3;
+
+    if (value <= 0xFFFFFFFF)
+        return 5;
+
+    return 9;
+}
+
+/* Mirrors write_value(); returns the encoded size or 0 on error */
+static size_t value_size(json_t *value, size_t flags) {
+
+    bos_data_type data_type;
+
+    if (json_is_fragment(value)) {
+        if (fragment_bos(value, flags))
+            return json_to_fragment(value)->bos_size;
+        return json_to_fragment(value)->value ? value_size(json_to_fragment(value)->value, flags) : 0;
+    }
+
+    data_type = get_data_type(value, flags);
+
+    switch (data_type) {
+
+        case BOS_STRING: {
+            size_t len = json_string_length(value);
+            return 1 + uvarint_size(len) + len;
+        }
+
+        case BOS_BYTES: {
+            size_t len = json_bytes_size(value);
+            return 1 + uvarint_size(len) + len;
+        }
+
+        case BOS_ARRAY: {
+            size_t i, entry_size;
+            size_t len = json_array_size(value);
+            size_t total = 1 + uvarint_size(len);
+
+            if (json_is_packed(value)) {
+                json_packed_t *packed = json_to_packed(value);
+                json_int_t integer;
+                double real;
+
+                total = 1 + uvarint_size(packed->size);
+                for (i = 0; i < packed->size; ++i)
+                    total += scalar_size(packed_element_type(packed, i, flags, &integer, &real));
+                return total;
+            }
+
+            for (i = 0; i < len; ++i) {
+                entry_size = value_size(json_array_get(value, i), flags);
+                if (!entry_size)
+                    return 0;
+                total += entry_size;
+            }
+            return total;
+        }
+
+        case BOS_OBJ: {
+            size_t key_len, entry_size;
+            size_t total = 1 + uvarint_size(json_object_size(value));
+            void *iter = json_object_iter(value);
+
+            while (iter) {
+                key_len = strlen(json_object_iter_key(iter));
+                if (key_len > 255)
+                    return 0;
+
+                entry_size = value_size(json_object_iter_value(iter), flags);
+                if (!entry_size)
+                    return 0;
+
+                /* with a key table this is an upper bound, every key may be
+                   new and a reference is never longer than a new key */
+                total += uvarint_size(key_len) + key_len + entry_size + ((flags & BOS_KEY_TABLE) ? 1 : 0);
+                iter = json_object_iter_next(value, iter);
+            }
+            return total;
+        }
+
+        case BOS_PACKED: {
+            json_packed_t *packed = json_to_packed(value);
+            return 2 + uvarint_size(packed->size) + packed->size * jsonp_packed_element_size(packed->type);
+        }
+
+        default:
+            return scalar_size(data_type);
+    }
+}
 
+static size_t serialized_size(json_t *value, size_t flags) {
+
+    size_t size;
+
+    if (!value)
+        return 0;
+
+    size = value_size(value, flags);
+    if (!size || size > UINT32_MAX - 4)
+        return 0;
+
+    return size + 4;
+}
+
+size_t bos_serialized_size(json_t *value) {
+    return serialized_size(value, 0);
+}
+
+/*** writer ***/
+
+void bos_writer_init(bos_writer_t *writer, void *buffer, size_t size, size_t flags)
+{
+    writer->flags = flags;
+    writer->size = 0;
+    writer->region = buffer;
+    writer->region_size = buffer ? size : 0;
+
+    /* without a region, heap memory is allocated lazily by the first write */
+    writer->data = buffer;
+    writer->allocated = writer->region_size;
+    writer->keys = NULL;
+}
+
+void bos_writer_reset(bos_writer_t *writer)
+{
+    if(!writer)
+        return;
+
+    /* drop a spill buffer so the next frame goes back to the region */
+    if(writer->region && writer->data != writer->region) {
+        jsonp_free(writer->data);
+        writer->data = writer->region;
+        writer->allocated = writer->region_size;
+    }
+
+    writer->size = 0;
+}
+
+void bos_writer_close(bos_writer_t *writer)
+{
+    if(!writer)
+        return;
+
+    if(writer->data != writer->region)
+        jsonp_free(writer->data);
+
+    if(writer->keys) {
+        jsonp_free(((key_table_t *)writer->keys)->slots);
+        jsonp_free(writer->keys);
+        writer->keys = NULL;
+    }
+
+    writer->data = NULL;
+    writer->region = NULL;
+    writer->region_size = 0;
+    writer->size = 0;
+    writer->allocated = 0;
+}
+
+int bos_writer_serialize(bos_writer_t *writer, json_t *value, json_error_t *error)
+{
+    size_t start;
     uint32_t size;
-    bos_t *result;
 
-    buffer_t *buffer = jsonp_malloc(sizeof(buffer_t));
-    buffer_init(buffer);
     jsonp_error_init(error, "<bos_serialize>");
 
+    if(!writer || !value) {
+        error_set(error, json_error_invalid_argument, "wrong arguments");
+        return -1;
+    }
+
+    start = writer->size;
+
+    /* the key table lives as long as the writer but only covers one frame */
+    if(writer->flags & BOS_KEY_TABLE) {
+        key_table_t *table = writer->keys;
+
+        if(!table) {
+            table = jsonp_malloc(sizeof(key_table_t));
+            if(!table) {
+                error_set(error, json_error_out_of_memory, "out of memory");
+                return -1;
+            }
+            table->slots = NULL;
+            table->capacity = 0;
+            writer->keys = table;
+        }
+        else if(table->count)
+            memset(table->slots, 0, table->capacity * sizeof(key_slot_t));
+
+        table->count = 0;
+    }
+
     // leave room for data length integer which will be filled later
-    buffer->pos += 4;
-    buffer->size = 4;
+    if(writer->flags & BOS_EXACT_SIZE) {
+        size_t needed = serialized_size(value, writer->flags);
+        if(!needed) {
+            error_set(error, json_error_invalid_argument, "value cannot be serialized");
+            return -1;
+        }
 
-    if (!write_value(value, buffer, error))
-        return NULL;
+        /* the only allocation; the writes below never need to grow */
+        if(!ensure_buffer_size(writer, needed, error))
+            return -1;
+    }
+
+    if(!ensure_buffer_size(writer, 4, error))
+        return -1;
+    writer->size += 4;
+
+    if(!write_value(value, writer, error))
+        goto error;
+
+    if(writer->size - start > UINT32_MAX) {
+        error_set(error, json_error_invalid_argument, "serialized data is too large");
+        goto error;
+    }
 
     // write size
-    size = (uint32_t)buffer->size;
-    memcpy(buffer->data, &size, sizeof(uint32_t));
+    size = (uint32_t)(writer->size - start);
+    memcpy(writer->data + start, &size, sizeof(uint32_t));
+    jsonp_stats_call(serialize, size);
+    return 0;
+
+error:
+    /* discard the partially written frame */
+    writer->size = start;
+    return -1;
+}
+
+int bos_writer_serialize_many(bos_writer_t *writer, json_t *const *values, size_t count, size_t *offsets,
+                              json_error_t *error)
+{
+    size_t start, i;
+
+    if(!writer || (count && !values)) {
+        jsonp_error_init(error, "<bos_serialize>");
+        error_set(error, json_error_invalid_argument, "wrong arguments");
+        return -1;
+    }
+
+    start = writer->size;
+
+    for(i = 0; i < count; i++) {
+        if(offsets)
+            offsets[i] = writer->size;
+
+        if(bos_writer_serialize(writer, values[i], error)) {
+            /* discard the whole batch */
+            writer->size = start;
+            return -1;
+        }
+    }
+
+    if(offsets)
+        offsets[count] = writer->size;
+    return 0;
+}
+
+const void *bos_writer_data(const bos_writer_t *writer)
+{
+    return writer ? writer->data : NULL;
+}
+
+size_t bos_writer_size(const bos_writer_t *writer)
+{
+    return writer ? writer->size : 0;
+}
+
+bos_t *bos_writer_take(bos_writer_t *writer)
+{
+    bos_t *result;
+    void *data;
+
+    if(!writer || !writer->size || writer->size > UINT32_MAX)
+        return NULL;
 
     result = (bos_t *)jsonp_malloc(sizeof(bos_t));
-    result->data = buffer->data;
-    result->size = buffer->size;
+    if(!result)
+        return NULL;
+
+    if(writer_is_region(writer)) {
+        /* the region belongs to the caller, hand out a copy */
+        data = jsonp_malloc(writer->size);
+        if(!data) {
+            jsonp_free(result);
+            return NULL;
+        }
+        memcpy(data, writer->data, writer->size);
+    }
+    else {
+        data = writer->data;
+        writer->data = writer->region;
+        writer->allocated = writer->region_size;
+    }
+
+    result->data = data;
+    result->size = (uint32_t)writer->size;
+    writer->size = 0;
+
+    return result;
+}
+
+/*** transcoding ***/
+
+/* Used by json_text_to_bos(), which writes values as the lexer produces
+   them. Numbers get the same encodings write_value() would pick. */
+
+int jsonp_bos_begin(bos_writer_t *writer, size_t *start, json_error_t *error)
+{
+    *start = writer->size;
+
+    if (!ensure_buffer_size(writer, 4, error))
+        return FALSE;
+    writer->size += 4;
+    return TRUE;
+}
+
+int jsonp_bos_end(bos_writer_t *writer, size_t start, json_error_t *error)
+{
+    uint32_t size;
+
+    if (writer->size - start > UINT32_MAX) {
+        error_set(error, json_error_invalid_argument, "serialized data is too large");
+        return FALSE;
+    }
+
+    size = (uint32_t)(writer->size - start);
+    memcpy(writer->data + start, &size, sizeof(uint32_t));
+    return TRUE;
+}
+
+int jsonp_bos_null(bos_writer_t *writer, json_error_t *error)
+{
+    return write_null(writer, error);
+}
+
+int jsonp_bos_boolean(bos_writer_t *writer, int value, json_error_t *error)
+{
+    if (!write_buffer_byte(writer, BOS_BOOL, error)) return FALSE;
+    return write_buffer_byte(writer, value ? 1 : 0, error);
+}
+
+int jsonp_bos_integer(bos_writer_t *writer, json_int_t value, json_error_t *error)
+{
+    return write_scalar(integer_data_type(value), value, 0.0, writer, error);
+}
+
+int jsonp_bos_real(bos_writer_t *writer, double value, json_error_t *error)
+{
+    bos_data_type data_type = real_data_type(value, writer->flags);
+
+    /* only integral reals in range are converted */
+    json_int_t integer = data_type == BOS_FLOAT || data_type == BOS_DOUBLE ? 0 : (json_int_t)value;
+    return write_scalar(data_type, integer, value, writer, error);
+}
+
+int jsonp_bos_string(bos_writer_t *writer, const char *value, size_t len, json_error_t *error)
+{
+    if (!write_buffer_byte(writer, BOS_STRING, error)) return FALSE;
+    if (!write_uvarint(len, writer, error)) return FALSE;
+    if (len > 0 && !write_payload(writer, value, len, error)) return FALSE;
+    return TRUE;
+}
 
-    jsonp_free(buffer);
+int jsonp_bos_key(bos_writer_t *writer, const char *key, size_t len, json_error_t *error)
+{
+    if (len > 255) {
+        error_set(error, json_error_invalid_argument, "key string is too long");
+        return FALSE;
+    }
+
+    if (!write_uvarint(len, writer, error)) return FALSE;
+    if (len > 0 && !write_buffer(writer, key, len, error)) return FALSE;
+    return TRUE;
+}
+
+/* the count is not known yet, one byte is reserved for it */
+int jsonp_bos_open(bos_writer_t *writer, int object, size_t *mark, json_error_t *error)
+{
+    if (!write_buffer_byte(writer, object ? BOS_OBJ : BOS_ARRAY, error)) return FALSE;
+
+    *mark = writer->size;
+    return write_buffer_byte(writer, 0, error);
+}
+
+/* Counts of 0xFD and more need a wider uvarint, the entries are moved
+   up to make room. That happens once per large container. */
+int jsonp_bos_close(bos_writer_t *writer, size_t mark, size_t count, json_error_t *error)
+{
+    size_t extra = uvarint_size(count) - 1, end;
+
+    if (extra) {
+        if (!ensure_buffer_size(writer, extra, error))
+            return FALSE;
+
+        memmove(writer->data + mark + 1 + extra, writer->data + mark + 1, writer->size - mark - 1);
+        writer->size += extra;
+    }
+
+    /* rewrite the count in place, there is room for it */
+    end = writer->size;
+    writer->size = mark;
+    write_uvarint(count, writer, error);
+    writer->size = end;
+    return TRUE;
+}
+
+/*** scatter-gather output ***/
+
+void bos_iov_init(bos_iov_list_t *list, size_t threshold)
+{
+    list->iov = NULL;
+    list->count = 0;
+    list->size = 0;
+    list->allocated = 0;
+    list->threshold = threshold ? threshold : BOS_IOV_DEFAULT_THRESHOLD;
+    list->side_start = 0;
+    list->blocks = NULL;
+
+    /* the first write allocates a block */
+    bos_writer_init(&list->side, NULL, 0, BOS_WRITER_IOV);
+}
+
+void bos_iov_reset(bos_iov_list_t *list)
+{
+    iov_block_t *block, *next;
+
+    if(!list)
+        return;
+
+    /* keep the newest block for the next frames */
+    block = (iov_block_t *)list->blocks;
+    if(block) {
+        for(next = block->next; next; next = block->next) {
+            block->next = next->next;
+            jsonp_free(next);
+        }
+    }
+
+    list->count = 0;
+    list->size = 0;
+    list->side.size = 0;
+    list->side_start = 0;
+}
+
+void bos_iov_close(bos_iov_list_t *list)
+{
+    iov_block_t *block, *next;
+
+    if(!list)
+        return;
+
+    for(block = (iov_block_t *)list->blocks; block; block = next) {
+        next = block->next;
+        jsonp_free(block);
+    }
+
+    jsonp_free(list->iov);
+    bos_iov_init(list, list->threshold);
+}
+
+int bos_serialize_iov(bos_iov_list_t *list, json_t *value, json_error_t *error)
+{
+    size_t start_count, start_size, last_len;
+    unsigned char *header;
+    uint32_t size;
+
+    jsonp_error_init(error, "<bos_serialize>");
+
+    if(!list || !value) {
+        error_set(error, json_error_invalid_argument, "wrong arguments");
+        return -1;
+    }
+
+    /* the first piece of the frame may be merged into the last entry */
+    start_count = list->count;
+    start_size = list->size;
+    last_len = start_count ? list->iov[start_count - 1].iov_len : 0;
+
+    /* the size is filled in once the frame is complete, the block
+       holding it does not move */
+    if(!ensure_buffer_size(&list->side, 4, error))
+        goto error;
+    header = list->side.data + list->side.size;
+    list->side.size += 4;
+
+    if(!write_value(value, &list->side, error) || !iov_flush_side(list, error))
+        goto error;
+
+    if(list->size - start_size > UINT32_MAX) {
+        error_set(error, json_error_invalid_argument, "serialized data is too large");
+        goto error;
+    }
+
+    size = (uint32_t)(list->size - start_size);
+    memcpy(header, &size, sizeof(uint32_t));
+    return 0;
+
+error:
+    /* discard the partially listed frame */
+    list->count = start_count;
+    list->size = start_size;
+    if(start_count)
+        list->iov[start_count - 1].iov_len = last_len;
+    list->side_start = list->side.size;
+    return -1;
+}
 
+bos_t *bos_serialize(json_t *value, json_error_t *error) {
+    return bos_serialize_ex(value, 0, error);
+}
+
+bos_t *bos_serialize_ex(json_t *value, size_t flags, json_error_t *error) {
+
+    bos_t *result;
+    bos_writer_t writer;
+
+    bos_writer_init(&writer, NULL, 0, flags);
+
+    if (bos_writer_serialize(&writer, value, error)) {
+        bos_writer_close(&writer);
+        return NULL;
+    }
+
+    result = bos_writer_take(&writer);
+    if (!result)
+        error_set(error, json_error_out_of_memory, "failed to allocate result");
+
+    bos_writer_close(&writer);
+    return result;
+}
+
+bos_t *bos_serialize_many(json_t *const *values, size_t count, size_t flags, size_t *offsets, json_error_t *error) {
+
+    bos_t *result;
+    bos_writer_t writer;
+
+    bos_writer_init(&writer, NULL, 0, flags);
+
+    if (bos_writer_serialize_many(&writer, values, count, offsets, error)) {
+        bos_writer_close(&writer);
+        return NULL;
+    }
+
+    result = bos_writer_take(&writer);
+    if (!result)
+        error_set(error, json_error_out_of_memory, "failed to allocate result");
+
+    bos_writer_close(&writer);
     return result;
 }
 
 void bos_free(bos_t *ptr) {
+    if (!ptr)
+        return;
     jsonp_free((void *)ptr->data);
     jsonp_free(ptr);
 }
+
+/*** parallel ***/
+
+/* Each task writes a run of the root array's elements into a buffer of
+   its own. The runs are then copied behind the array header, so the
+   frame is the same as bos_serialize_ex() writes. */
+
+typedef struct {
+    bos_writer_t writer;
+    json_error_t error;
+    int failed;
+} serialize_part_t;
+
+typedef struct {
+    json_t *array;
+    size_t flags;
+    size_t chunk;
+    serialize_part_t *parts;
+} serialize_job_t;
+
+static void serialize_task(void *arg, size_t index) {
+
+    serialize_job_t *job = (serialize_job_t *)arg;
+    serialize_part_t *part = &job->parts[index];
+    size_t i = index * job->chunk, end = min(i + job->chunk, json_array_size(job->array));
+
+    jsonp_error_init(&part->error, "<bos_serialize>");
+    bos_writer_init(&part->writer, NULL, 0, job->flags);
+
+    for (; i < end; i++) {
+        if (!write_value(json_array_get(job->array, i), &part->writer, &part->error)) {
+            part->failed = 1;
+            return;
+        }
+    }
+}
+
+bos_t *bos_serialize_parallel(json_t *value, size_t flags, size_t threads, bos_run_t run, void *pool,
+                              json_error_t *error) {
+
+    serialize_job_t job;
+    bos_writer_t writer;
+    bos_t *result = NULL;
+    size_t len = json_array_size(value), tasks, needed, i;
+    uint32_t size;
+
+    /* key references would cross the runs */
+    if (!json_is_array(value) || threads < 2 || (flags & BOS_KEY_TABLE) || len < 2 * BOS_PARALLEL_MIN_CHUNK)
+        return bos_serialize_ex(value, flags, error);
+
+    jsonp_error_init(error, "<bos_serialize>");
+
+    tasks = min(threads, len / BOS_PARALLEL_MIN_CHUNK);
+    job.array = value;
+    job.flags = flags & ~(size_t)BOS_EXACT_SIZE;
+    job.chunk = (len + tasks - 1) / tasks;
+    tasks = (len + job.chunk - 1) / job.chunk;
+
+    job.parts = jsonp_malloc(tasks * sizeof(serialize_part_t));
+    if (!job.parts) {
+        error_set(error, json_error_out_of_memory, "out of memory");
+        return NULL;
+    }
+    for (i = 0; i < tasks; i++)
+        job.parts[i].failed = 0;
+
+    if (run)
+        run(pool, serialize_task, &job, tasks);
+    else {
+        for (i = 0; i < tasks; i++)
+            serialize_task(&job, i);
+    }
+
+    needed = 4 + 1 + uvarint_size(len);
+    for (i = 0; i < tasks; i++) {
+        if (job.parts[i].failed) {
+            if (error)
+                *error = job.parts[i].error;
+            goto out;
+        }
+        needed += job.parts[i].writer.size;
+    }
+
+    if (needed > UINT32_MAX) {
+        error_set(error, json_error_invalid_argument, "serialized data is too large");
+        goto out;
+    }
+
+    /* a single allocation of the exact frame size */
+    bos_writer_init(&writer, NULL, 0, BOS_EXACT_SIZE);
+    if (!ensure_buffer_size(&writer, needed, error)) {
+        bos_writer_close(&writer);
+        goto out;
+    }
+
+    writer.size = 4;
+    write_buffer_byte(&writer, BOS_ARRAY, error);
+    write_uvarint(len, &writer, error);
+    for (i = 0; i < tasks; i++)
+        write_buffer(&writer, job.parts[i].writer.data, job.parts[i].writer.size, error);
+    size = (uint32_t)needed;
+    memcpy(writer.data, &size, sizeof(uint32_t));
+
+    result = bos_writer_take(&writer);
+    if (!result)
+        error_set(error, json_error_out_of_memory, "failed to allocate result");
+    bos_writer_close(&writer);
+
+out:
+    for (i = 0; i < tasks; i++)
+        bos_writer_close(&job.parts[i].writer);
+    jsonp_free(job.parts);
+    return result;
+}
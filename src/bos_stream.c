@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2018 JCThePants <github.com/JCThePants>
+ *
+ * Bos-Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "jansson_private_config.h"
+#include "jansson_private.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "bosjansson.h"
+
+#define BOS_STREAM_DEFAULT_SIZE 1024
+#define BOS_FRAME_HEADER_SIZE sizeof(uint32_t)
+
+/*** error reporting ***/
+
+static void error_set(json_error_t *error, size_t position, enum json_error_code code, const char *msg, ...)
+{
+    va_list ap;
+    char msg_text[JSON_ERROR_TEXT_LENGTH];
+
+    const char *result = msg_text;
+
+    if(!error)
+        return;
+
+    va_start(ap, msg);
+    vsnprintf(msg_text, JSON_ERROR_TEXT_LENGTH, msg, ap);
+    msg_text[JSON_ERROR_TEXT_LENGTH - 1] = '\0';
+    va_end(ap);
+
+    jsonp_error_set(error, -1, -1, position, code, "%s", result);
+}
+
+/*** buffer ***/
+
+/* grows the reassembly buffer to hold at least size bytes */
+static int ensure_buffer_size(bos_stream_t *stream, size_t size, json_error_t *error) {
+
+    unsigned char *data;
+    size_t allocated;
+
+    if (size <= stream->allocated)
+        return TRUE;
+
+    allocated = stream->allocated ? stream->allocated : BOS_STREAM_DEFAULT_SIZE;
+    while (allocated < size)
+        allocated *= 2;
+
+    data = jsonp_malloc(allocated);
+    if (!data) {
+        error_set(error, 0, json_error_out_of_memory, "out of memory");
+        return FALSE;
+    }
+
+    if (stream->buffered)
+        memcpy(data, stream->buffer, stream->buffered);
+
+    jsonp_free(stream->buffer);
+    stream->buffer = data;
+    stream->allocated = allocated;
+    return TRUE;
+}
+
+/* moves up to amount bytes of the current chunk into the reassembly buffer */
+static void buffer_chunk(bos_stream_t *stream, size_t amount) {
+
+    if (amount > stream->chunk_size)
+        amount = stream->chunk_size;
+
+    memcpy(stream->buffer + stream->buffered, stream->chunk, amount);
+    stream->buffered += amount;
+    stream->chunk += amount;
+    stream->chunk_size -= amount;
+}
+
+static int check_frame_size(bos_stream_t *stream, uint32_t frame_size, json_error_t *error) {
+
+    if (frame_size < 5) {
+        error_set(error, 0, json_error_invalid_format, "frame size too small to be valid");
+        return FALSE;
+    }
+
+    if (stream->max_frame && frame_size > stream->max_frame) {
+        error_set(error, 0, json_error_invalid_format, "frame size exceeds the maximum");
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*** stream ***/
+
+void bos_stream_init(bos_stream_t *stream, size_t max_frame, size_t flags) {
+    stream->buffer = NULL;
+    stream->buffered = 0;
+    stream->allocated = 0;
+    stream->chunk = NULL;
+    stream->chunk_size = 0;
+    stream->max_frame = max_frame;
+    /* frames may be assembled in the stream buffer, which is reused */
+    stream->flags = flags & ~(size_t)BOS_BORROW;
+}
+
+void bos_stream_reset(bos_stream_t *stream) {
+    stream->buffered = 0;
+    stream->chunk = NULL;
+    stream->chunk_size = 0;
+}
+
+void bos_stream_close(bos_stream_t *stream) {
+    jsonp_free(stream->buffer);
+    bos_stream_init(stream, stream->max_frame, stream->flags);
+}
+
+int bos_stream_feed(bos_stream_t *stream, const void *data, size_t size) {
+
+    /* the previous chunk must be drained first, its frames may still be read in place */
+    if (stream->chunk_size || (!data && size))
+        return -1;
+
+    stream->chunk = (const unsigned char *)data;
+    stream->chunk_size = size;
+    return 0;
+}
+
+size_t bos_stream_pending(const bos_stream_t *stream) {
+    return stream->buffered + stream->chunk_size;
+}
+
+int bos_stream_next_frame(bos_stream_t *stream, const void **frame, size_t *size, json_error_t *error) {
+
+    uint32_t frame_size;
+
+    if (error)
+        jsonp_error_init(error, "<bos_stream>");
+
+    if (!stream->buffered) {
+
+        if (stream->chunk_size >= BOS_FRAME_HEADER_SIZE) {
+
+            memcpy(&frame_size, stream->chunk, sizeof(uint32_t));
+            if (!check_frame_size(stream, frame_size, error))
+                return -1;
+
+            /* the whole frame is inside the caller's chunk */
+            if (stream->chunk_size >= frame_size) {
+                *frame = stream->chunk;
+                *size = frame_size;
+                stream->chunk += frame_size;
+                stream->chunk_size -= frame_size;
+                return 1;
+            }
+
+            if (!ensure_buffer_size(stream, frame_size, error))
+                return -1;
+        }
+        else if (!stream->chunk_size) {
+            return 0;
+        }
+        else if (!ensure_buffer_size(stream, BOS_FRAME_HEADER_SIZE, error)) {
+            return -1;
+        }
+    }
+
+    /* reassemble a frame split across chunks */
+    if (stream->buffered < BOS_FRAME_HEADER_SIZE) {
+        buffer_chunk(stream, BOS_FRAME_HEADER_SIZE - stream->buffered);
+        if (stream->buffered < BOS_FRAME_HEADER_SIZE)
+            return 0;
+    }
+
+    memcpy(&frame_size, stream->buffer, sizeof(uint32_t));
+    if (!check_frame_size(stream, frame_size, error))
+        return -1;
+
+    if (!ensure_buffer_size(stream, frame_size, error))
+        return -1;
+
+    buffer_chunk(stream, frame_size - stream->buffered);
+    if (stream->buffered < frame_size)
+        return 0;
+
+    /* the data stays in the buffer until the next call */
+    stream->buffered = 0;
+    *frame = stream->buffer;
+    *size = frame_size;
+    return 1;
+}
+
+int bos_stream_next_view(bos_stream_t *stream, bos_view_t *view, json_error_t *error) {
+
+    const void *frame;
+    size_t size;
+    int result = bos_stream_next_frame(stream, &frame, &size, error);
+
+    if (result != 1)
+        return result;
+
+    if (bos_view_init(view, frame, size)) {
+        error_set(error, 0, json_error_invalid_format, "invalid frame");
+        return -1;
+    }
+
+    return 1;
+}
+
+int bos_stream_next(bos_stream_t *stream, json_t **value, json_error_t *error) {
+
+    const void *frame;
+    size_t size;
+    int result = bos_stream_next_frame(stream, &frame, &size, error);
+
+    if (result != 1)
+        return result;
+
+    *value = bos_deserialize_ex(frame, size, stream->flags, error);
+    return *value ? 1 : -1;
+}
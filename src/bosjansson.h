@@ -57,19 +57,123 @@ typedef enum {
     JSON_TRUE,
     JSON_FALSE,
     JSON_NULL,
-    JSON_BYTES
+    JSON_BYTES,
+    JSON_PACKED,
+    JSON_FRAGMENT
 } json_type;
 
+/* element types of packed arrays */
+typedef enum {
+    JSON_PACKED_INT64,
+    JSON_PACKED_DOUBLE,
+    JSON_PACKED_UINT32
+} json_packed_type;
+
 typedef struct json_t {
     json_type type;
+    unsigned int flags;
     volatile size_t refcount;
 } json_t;
 
+typedef struct json_arena_t json_arena_t;
+
 typedef struct bos_t {
     const void *data;
     uint32_t size;
 } bos_t;
 
+/* Read-only cursor into serialized BOS data, see bos_view_init() */
+typedef struct bos_view_t {
+    const void *data;
+    size_t size;
+} bos_view_t;
+
+/* A read-only file mapped into memory, see bos_view_open_file(). data and
+   size may be read, the other members are private. */
+typedef struct bos_file_t {
+    const void *data;
+    size_t size;
+    int mapped;
+} bos_file_t;
+
+typedef struct bos_view_iter_t {
+    bos_view_t pos;
+    size_t remaining;
+    int is_object;
+} bos_view_iter_t;
+
+/* Push decoder for frames split across or packed into arbitrary chunks, see bos_stream_init() */
+typedef struct bos_stream_t {
+    unsigned char *buffer;
+    size_t buffered;
+    size_t allocated;
+    const unsigned char *chunk;
+    size_t chunk_size;
+    size_t max_frame;
+    size_t flags;
+} bos_stream_t;
+
+/* Push parser for JSON text split across or packed into arbitrary chunks,
+   see json_stream_init(). The members are private. */
+typedef struct json_stream_t {
+    char *buffer;
+    size_t buffered;
+    size_t allocated;
+    const char *chunk;
+    size_t chunk_size;
+    size_t max_size;
+    size_t flags;
+    size_t depth;
+    int state;
+    void *lexer;
+} json_stream_t;
+
+/* Reusable parser for complete JSON texts, see json_loader_init().
+   The members are private. */
+typedef struct json_loader_t {
+    size_t flags;
+    json_arena_t *arena;
+    void *lexer;
+} json_loader_t;
+
+/* A caller provided thread pool for the parallel functions, see
+   bos_serialize_parallel(). run calls task(arg, i) for every i below
+   count, in any order and on any threads, and returns once all of the
+   calls have returned. */
+typedef void (*bos_task_t)(void *arg, size_t index);
+typedef void (*bos_run_t)(void *pool, bos_task_t task, void *arg, size_t count);
+
+/* Reusable serialization context. The members are private; use the
+   bos_writer_* functions to access them. */
+typedef struct bos_writer_t {
+    unsigned char *data;
+    size_t size;
+    size_t allocated;
+    size_t flags;
+    void *region;
+    size_t region_size;
+    void *keys;
+} bos_writer_t;
+
+/* One piece of scatter-gather output, laid out like POSIX struct iovec */
+typedef struct bos_iov_t {
+    void *iov_base;
+    size_t iov_len;
+} bos_iov_t;
+
+/* Scatter-gather serialization context, see bos_iov_init(). iov, count
+   and size may be read directly; the other members are private. */
+typedef struct bos_iov_list_t {
+    bos_iov_t *iov;
+    size_t count;
+    size_t size;
+    size_t allocated;
+    size_t threshold;
+    size_t side_start;
+    bos_writer_t side;
+    void *blocks;
+} bos_iov_list_t;
+
 #ifndef JANSSON_USING_CMAKE /* disabled if using cmake */
 #if JSON_INTEGER_IS_LONG_LONG
 #ifdef _WIN32
@@ -97,15 +201,25 @@ typedef long json_int_t;
 #define json_is_boolean(json)  (json_is_true(json) || json_is_false(json))
 #define json_is_null(json)     ((json) && json_typeof(json) == JSON_NULL)
 #define json_is_bytes(json)    ((json) && json_typeof(json) == JSON_BYTES)
+#define json_is_packed(json)   ((json) && json_typeof(json) == JSON_PACKED)
+#define json_is_fragment(json) ((json) && json_typeof(json) == JSON_FRAGMENT)
+
+/* set on the nodes of a tree passed to json_freeze() */
+#define JSON_FLAG_FROZEN 0x8
+#define json_is_frozen(json)   ((json) && ((json)->flags & JSON_FLAG_FROZEN))
 
 /* construction, destruction, reference counting */
 
+/* called when a borrowed string or bytes value no longer uses its memory */
+typedef void (*json_release_t)(const void *ptr, size_t size, void *ctx);
+
 json_t *json_object(void);
 json_t *json_array(void);
 json_t *json_string(const char *value);
 json_t *json_stringn(const char *value, size_t len);
 json_t *json_string_nocheck(const char *value);
 json_t *json_stringn_nocheck(const char *value, size_t len);
+json_t *json_string_borrow(const char *value, size_t len, json_release_t release, void *ctx);
 json_t *json_integer(json_int_t value);
 json_t *json_real(double value);
 json_t *json_true(void);
@@ -113,6 +227,10 @@ json_t *json_false(void);
 #define json_boolean(val)      ((val) ? json_true() : json_false())
 json_t *json_null(void);
 json_t *json_bytes(void *bytes, size_t size);
+json_t *json_bytes_borrow(const void *bytes, size_t size, json_release_t release, void *ctx);
+json_t *json_packed(json_packed_type type, const void *data, size_t count);
+json_t *json_fragment(const char *text, size_t len, const void *bos, size_t size);
+json_t *json_encode_cache(json_t *value, size_t json_flags, size_t bos_flags);
 
 /* do not call JSON_INTERNAL_INCREF or JSON_INTERNAL_DECREF directly */
 #if JSON_HAVE_ATOMIC_BUILTINS
@@ -129,7 +247,7 @@ json_t *json_bytes(void *bytes, size_t size);
 static JSON_INLINE
 json_t *json_incref(json_t *json)
 {
-    if(json && json->refcount != (size_t)-1)
+    if(json && json->refcount != (size_t)-1 && !(json->flags & JSON_FLAG_FROZEN))
         JSON_INTERNAL_INCREF(json);
     return json;
 }
@@ -140,10 +258,15 @@ void json_delete(json_t *json);
 static JSON_INLINE
 void json_decref(json_t *json)
 {
-    if(json && json->refcount != (size_t)-1 && JSON_INTERNAL_DECREF(json) == 0)
+    if(json && json->refcount != (size_t)-1 && !(json->flags & JSON_FLAG_FROZEN) &&
+       JSON_INTERNAL_DECREF(json) == 0)
         json_delete(json);
 }
 
+/* frozen trees are read only and skip reference counting until thawed */
+int json_freeze(json_t *json);
+void json_thaw_release(json_t *json);
+
 #if defined(__GNUC__) || defined(__clang__)
 static JSON_INLINE
 void json_decrefp(json_t **json)
@@ -198,12 +321,26 @@ static JSON_INLINE enum json_error_code json_error_code(const json_error_t *e) {
 
 /* getters, setters, manipulation */
 
+/* an object key with its length and hash computed once */
+typedef struct json_key_t {
+    const char *key;
+    size_t len;
+    size_t hash;
+} json_key_t;
+
+json_key_t json_key_make(const char *key);
+json_key_t json_key_maken(const char *key, size_t len);
+
 void json_object_seed(size_t seed);
 size_t json_object_size(const json_t *object);
 json_t *json_object_get(const json_t *object, const char *key) JANSSON_ATTRS(warn_unused_result);
+json_t *json_object_getn(const json_t *object, const char *key, size_t len) JANSSON_ATTRS(warn_unused_result);
+json_t *json_object_get_k(const json_t *object, const json_key_t *key) JANSSON_ATTRS(warn_unused_result);
 int json_object_set_new(json_t *object, const char *key, json_t *value);
 int json_object_set_new_nocheck(json_t *object, const char *key, json_t *value);
+int json_object_set_new_k(json_t *object, const json_key_t *key, json_t *value);
 int json_object_del(json_t *object, const char *key);
+int json_object_del_k(json_t *object, const json_key_t *key);
 int json_object_clear(json_t *object);
 int json_object_update(json_t *object, json_t *other);
 int json_object_update_existing(json_t *object, json_t *other);
@@ -245,6 +382,12 @@ int json_object_set_nocheck(json_t *object, const char *key, json_t *value)
     return json_object_set_new_nocheck(object, key, json_incref(value));
 }
 
+static JSON_INLINE
+int json_object_set_k(json_t *object, const json_key_t *key, json_t *value)
+{
+    return json_object_set_new_k(object, key, json_incref(value));
+}
+
 static JSON_INLINE
 int json_object_iter_set(json_t *object, void *iter, json_t *value)
 {
@@ -295,6 +438,48 @@ const void *json_bytes_value(const json_t *bos);
 size_t json_bytes_size(const json_t *bos);
 int json_bytes_set(json_t *bos, void *value, size_t size);
 
+int json_packed_type_of(const json_t *packed);
+size_t json_packed_size(const json_t *packed);
+void *json_packed_data(const json_t *packed);
+int json_packed_resize(json_t *packed, size_t count);
+
+json_t *json_fragment_value(const json_t *fragment);
+
+/* node pools */
+
+void json_pool_set_limit(size_t limit);
+size_t json_pool_get_limit(void);
+void json_pool_trim(void);
+
+/* statistics, counted per thread when built with JANSSON_STATS */
+
+typedef struct json_stats_t {
+    size_t allocations;
+    size_t frees;
+    size_t allocated_bytes;
+    size_t live_bytes;
+    size_t peak_bytes;
+    size_t load_calls;
+    size_t load_bytes;
+    size_t dump_calls;
+    size_t dump_bytes;
+    size_t serialize_calls;
+    size_t serialize_bytes;
+    size_t deserialize_calls;
+    size_t deserialize_bytes;
+} json_stats_t;
+
+int json_get_stats(json_stats_t *stats);
+void json_reset_stats(void);
+
+/* arenas */
+
+json_arena_t *json_arena_new(size_t block_size) JANSSON_ATTRS(warn_unused_result);
+void json_arena_reset(json_arena_t *arena);
+void json_arena_free(json_arena_t *arena);
+json_arena_t *json_arena_use(json_arena_t *arena);
+size_t json_arena_used(const json_arena_t *arena);
+
 /* pack, unpack */
 
 json_t *json_pack(const char *fmt, ...) JANSSON_ATTRS(warn_unused_result);
@@ -308,6 +493,23 @@ int json_unpack(json_t *root, const char *fmt, ...);
 int json_unpack_ex(json_t *root, json_error_t *error, size_t flags, const char *fmt, ...);
 int json_vunpack_ex(json_t *root, json_error_t *error, size_t flags, const char *fmt, va_list ap);
 
+/* format strings compiled once and run many times */
+
+typedef struct json_pack_program_t json_pack_program_t;
+typedef struct json_unpack_program_t json_unpack_program_t;
+
+json_pack_program_t *json_pack_compile(const char *fmt, json_error_t *error) JANSSON_ATTRS(warn_unused_result);
+void json_pack_program_free(json_pack_program_t *program);
+json_t *json_pack_run(const json_pack_program_t *program, ...) JANSSON_ATTRS(warn_unused_result);
+json_t *json_pack_run_ex(json_error_t *error, size_t flags, const json_pack_program_t *program, ...) JANSSON_ATTRS(warn_unused_result);
+json_t *json_vpack_run_ex(json_error_t *error, size_t flags, const json_pack_program_t *program, va_list ap) JANSSON_ATTRS(warn_unused_result);
+
+json_unpack_program_t *json_unpack_compile(const char *fmt, json_error_t *error) JANSSON_ATTRS(warn_unused_result);
+void json_unpack_program_free(json_unpack_program_t *program);
+int json_unpack_run(json_t *root, const json_unpack_program_t *program, ...);
+int json_unpack_run_ex(json_t *root, json_error_t *error, size_t flags, const json_unpack_program_t *program, ...);
+int json_vunpack_run_ex(json_t *root, json_error_t *error, size_t flags, const json_unpack_program_t *program, va_list ap);
+
 /* sprintf */
 
 json_t *json_sprintf(const char *fmt, ...) JANSSON_ATTRS(warn_unused_result, format(printf, 1, 2));
@@ -318,20 +520,117 @@ json_t *json_vsprintf(const char *fmt, va_list ap) JANSSON_ATTRS(warn_unused_res
 
 int json_equal(const json_t *value1, const json_t *value2);
 
+/* structural hash, the same for equal values whatever their key order */
+uint64_t json_hash(const json_t *value, uint64_t seed);
+int json_hash_cache(json_t *value, uint64_t seed);
+
 
 /* copying */
 
 json_t *json_copy(json_t *value) JANSSON_ATTRS(warn_unused_result);
 json_t *json_deep_copy(const json_t *value) JANSSON_ATTRS(warn_unused_result);
 
+/* copies of a container with one child replaced, sharing the others */
+json_t *json_object_with_new(json_t *object, const char *key, json_t *value) JANSSON_ATTRS(warn_unused_result);
+json_t *json_array_with_new(json_t *array, size_t index, json_t *value) JANSSON_ATTRS(warn_unused_result);
+
+static JSON_INLINE
+json_t *json_object_with(json_t *object, const char *key, json_t *value)
+{
+    return json_object_with_new(object, key, json_incref(value));
+}
+
+static JSON_INLINE
+json_t *json_array_with(json_t *array, size_t index, json_t *value)
+{
+    return json_array_with_new(array, index, json_incref(value));
+}
+
 /* bos */
 
 int bos_validate(const void *data, size_t size);
+int bos_validate_ex(const void *data, size_t size, size_t flags);
 unsigned int bos_sizeof(const void *data);
 json_t *bos_deserialize(const void *data, json_error_t *error) JANSSON_ATTRS(warn_unused_result);
 bos_t *bos_serialize(json_t *value, json_error_t *error) JANSSON_ATTRS(warn_unused_result);
 void bos_free(bos_t *ptr);
 
+#define BOS_WRITER_SPILL        0x1
+#define BOS_EXACT_SIZE          0x2
+#define BOS_BORROW              0x4
+#define BOS_FLOAT_REALS         0x8
+#define BOS_INTEGRAL_REALS      0x10
+#define BOS_EXPAND_PACKED       0x20
+#define BOS_KEY_TABLE           0x40
+
+bos_t *bos_serialize_ex(json_t *value, size_t flags, json_error_t *error) JANSSON_ATTRS(warn_unused_result);
+bos_t *bos_serialize_parallel(json_t *value, size_t flags, size_t threads, bos_run_t run, void *pool,
+                              json_error_t *error) JANSSON_ATTRS(warn_unused_result);
+bos_t *bos_serialize_many(json_t *const *values, size_t count, size_t flags, size_t *offsets,
+                          json_error_t *error) JANSSON_ATTRS(warn_unused_result);
+size_t bos_serialized_size(json_t *value);
+
+#define BOS_DEPTH_LIMIT(n)      (((size_t)(n) & 0xFFFF) << 16)
+
+json_t *bos_deserialize_ex(const void *data, size_t size, size_t flags, json_error_t *error) JANSSON_ATTRS(warn_unused_result);
+json_t *bos_load_file_mmap(const char *path, size_t flags, json_error_t *error) JANSSON_ATTRS(warn_unused_result);
+json_t *bos_deserialize_parallel(const void *data, size_t size, size_t flags, size_t threads, bos_run_t run,
+                                 void *pool, json_error_t *error) JANSSON_ATTRS(warn_unused_result);
+int bos_deserialize_many(const void *data, size_t size, size_t flags, json_t **values, size_t count,
+                         json_error_t *error);
+int bos_deserialize_select(const void *data, size_t size, size_t flags, const char *const *paths, size_t count,
+                           json_t **values, json_error_t *error);
+
+/* bos streams */
+
+void bos_stream_init(bos_stream_t *stream, size_t max_frame, size_t flags);
+void bos_stream_reset(bos_stream_t *stream);
+void bos_stream_close(bos_stream_t *stream);
+int bos_stream_feed(bos_stream_t *stream, const void *data, size_t size);
+size_t bos_stream_pending(const bos_stream_t *stream);
+int bos_stream_next_frame(bos_stream_t *stream, const void **frame, size_t *size, json_error_t *error);
+int bos_stream_next_view(bos_stream_t *stream, bos_view_t *view, json_error_t *error);
+int bos_stream_next(bos_stream_t *stream, json_t **value, json_error_t *error);
+
+/* bos views */
+
+/* returned by object lookups and iteration on an object written with BOS_KEY_TABLE */
+#define BOS_VIEW_UNSUPPORTED    (-2)
+
+int bos_view_init(bos_view_t *view, const void *data, size_t size);
+int bos_view_type(const bos_view_t *view);
+size_t bos_view_size(const bos_view_t *view);
+int bos_view_skip(const bos_view_t *view, bos_view_t *next);
+int bos_view_object_get(const bos_view_t *view, const char *key, bos_view_t *value);
+int bos_view_object_getn(const bos_view_t *view, const char *key, size_t key_len, bos_view_t *value);
+int bos_view_array_at(const bos_view_t *view, size_t index, bos_view_t *value);
+int bos_view_iter_init(const bos_view_t *view, bos_view_iter_t *iter);
+int bos_view_iter_next(bos_view_iter_t *iter, const char **key, size_t *key_len, bos_view_t *value);
+int bos_view_integer(const bos_view_t *view, json_int_t *value);
+int bos_view_real(const bos_view_t *view, double *value);
+int bos_view_number(const bos_view_t *view, double *value);
+int bos_view_boolean(const bos_view_t *view, int *value);
+int bos_view_string(const bos_view_t *view, const char **value, size_t *len);
+int bos_view_bytes(const bos_view_t *view, const void **value, size_t *len);
+int bos_view_packed(const bos_view_t *view, json_packed_type *type, const void **data, size_t *count);
+int bos_view_open_file(bos_view_t *view, bos_file_t *file, const char *path, json_error_t *error);
+void bos_file_close(bos_file_t *file);
+
+void bos_writer_init(bos_writer_t *writer, void *buffer, size_t size, size_t flags);
+void bos_writer_reset(bos_writer_t *writer);
+void bos_writer_close(bos_writer_t *writer);
+int bos_writer_serialize(bos_writer_t *writer, json_t *value, json_error_t *error);
+int bos_writer_serialize_many(bos_writer_t *writer, json_t *const *values, size_t count, size_t *offsets,
+                              json_error_t *error);
+const void *bos_writer_data(const bos_writer_t *writer);
+size_t bos_writer_size(const bos_writer_t *writer);
+bos_t *bos_writer_take(bos_writer_t *writer) JANSSON_ATTRS(warn_unused_result);
+
+void bos_iov_init(bos_iov_list_t *list, size_t threshold);
+void bos_iov_reset(bos_iov_list_t *list);
+void bos_iov_close(bos_iov_list_t *list);
+int bos_serialize_iov(bos_iov_list_t *list, json_t *value, json_error_t *error);
+
 /* decoding */
 
 #define JSON_REJECT_DUPLICATES  0x1
@@ -344,11 +643,51 @@ typedef size_t (*json_load_callback_t)(void *buffer, size_t buflen, void *data);
 
 json_t *json_loads(const char *input, size_t flags, json_error_t *error) JANSSON_ATTRS(warn_unused_result);
 json_t *json_loadb(const char *buffer, size_t buflen, size_t flags, json_error_t *error) JANSSON_ATTRS(warn_unused_result);
+int json_loadb_many(const char *buffer, size_t buflen, size_t flags, json_t **values, size_t count,
+                    json_error_t *error);
 json_t *json_loadf(FILE *input, size_t flags, json_error_t *error) JANSSON_ATTRS(warn_unused_result);
 json_t *json_loadfd(int input, size_t flags, json_error_t *error) JANSSON_ATTRS(warn_unused_result);
 json_t *json_load_file(const char *path, size_t flags, json_error_t *error) JANSSON_ATTRS(warn_unused_result);
+json_t *json_load_file_mmap(const char *path, size_t flags, json_error_t *error) JANSSON_ATTRS(warn_unused_result);
 json_t *json_load_callback(json_load_callback_t callback, void *data, size_t flags, json_error_t *error) JANSSON_ATTRS(warn_unused_result);
 
+/* event parsing */
+
+#define JSON_SAX_CONTINUE       0
+#define JSON_SAX_SKIP           1
+#define JSON_SAX_STOP           2
+
+/* Callbacks may be NULL. Strings and keys are not null terminated. */
+typedef struct json_sax_t {
+    int (*start_object)(void *data);
+    int (*end_object)(void *data);
+    int (*start_array)(void *data);
+    int (*end_array)(void *data);
+    int (*key)(void *data, const char *key, size_t len);
+    int (*string)(void *data, const char *value, size_t len);
+    int (*integer)(void *data, json_int_t value);
+    int (*real)(void *data, double value);
+    int (*boolean)(void *data, int value);
+    int (*null)(void *data);
+} json_sax_t;
+
+int json_sax_parse(const char *buffer, size_t buflen, size_t flags, const json_sax_t *sax, void *data,
+                   json_error_t *error);
+int json_loadb_select(const char *buffer, size_t buflen, size_t flags, const char *const *paths, size_t count,
+                      json_t **values, json_error_t *error);
+
+void json_stream_init(json_stream_t *stream, size_t max_size, size_t flags);
+void json_stream_reset(json_stream_t *stream);
+void json_stream_close(json_stream_t *stream);
+int json_stream_feed(json_stream_t *stream, const char *data, size_t size);
+size_t json_stream_pending(const json_stream_t *stream);
+int json_stream_next(json_stream_t *stream, json_t **value, json_error_t *error);
+
+void json_loader_init(json_loader_t *loader, size_t flags, json_arena_t *arena);
+void json_loader_close(json_loader_t *loader);
+json_t *json_loader_parse(json_loader_t *loader, const char *buffer, size_t buflen,
+                          json_error_t *error) JANSSON_ATTRS(warn_unused_result);
+
 
 /* encoding */
 
@@ -362,16 +701,26 @@ json_t *json_load_callback(json_load_callback_t callback, void *data, size_t fla
 #define JSON_ESCAPE_SLASH       0x400
 #define JSON_REAL_PRECISION(n)  (((n) & 0x1F) << 11)
 #define JSON_EMBED              0x10000
+#define JSON_DUMP_BUFFERED      0x20000
+#define JSON_NO_CYCLE_CHECK     0x40000
 
 typedef int (*json_dump_callback_t)(const char *buffer, size_t size, void *data);
 
 char *json_dumps(const json_t *json, size_t flags) JANSSON_ATTRS(warn_unused_result);
 size_t json_dumpb(const json_t *json, char *buffer, size_t size, size_t flags);
+size_t json_dumpb_many(json_t *const *values, size_t count, char *buffer, size_t size, size_t *offsets,
+                       size_t flags);
 int json_dumpf(const json_t *json, FILE *output, size_t flags);
 int json_dumpfd(const json_t *json, int output, size_t flags);
 int json_dump_file(const json_t *json, const char *path, size_t flags);
 int json_dump_callback(const json_t *json, json_dump_callback_t callback, void *data, size_t flags);
 
+/* transcoding */
+
+int bos_to_json_dump(const void *data, size_t size, json_dump_callback_t callback, void *callback_data,
+                     size_t flags, json_error_t *error);
+int json_text_to_bos(bos_writer_t *writer, const char *buffer, size_t buflen, size_t flags, json_error_t *error);
+
 /* custom memory allocation */
 
 typedef void *(*json_malloc_t)(size_t);
@@ -11,6 +11,7 @@
 
 #include "jansson_private.h"
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -20,6 +21,7 @@
 #endif
 
 #include "bosjansson.h"
+#include "scan.h"
 #include "strbuffer.h"
 #include "utf.h"
 
@@ -29,12 +31,25 @@
 #define FLAGS_TO_INDENT(f)      ((f) & 0x1F)
 #define FLAGS_TO_PRECISION(f)   (((f) >> 11) & 0x1F)
 
+/* size of the JSON_DUMP_BUFFERED staging buffer */
+#ifndef DUMP_BUFFER_SIZE
+#define DUMP_BUFFER_SIZE 4096
+#endif
+
 struct buffer {
     const size_t size;
     size_t used;
     char *data;
 };
 
+/* collects the small pieces of output before passing them on */
+struct staging {
+    json_dump_callback_t dump;
+    void *data;
+    size_t used;
+    char buffer[DUMP_BUFFER_SIZE];
+};
+
 static int dump_to_strbuffer(const char *buffer, size_t size, void *data)
 {
     return strbuffer_append_bytes((strbuffer_t *)data, buffer, size);
@@ -63,10 +78,42 @@ static int dump_to_fd(const char *buffer, size_t size, void *data)
 {
 #ifdef HAVE_UNISTD_H
     int *dest = (int *)data;
-    if(write(*dest, buffer, size) == (ssize_t)size)
-        return 0;
-#endif
+
+    /* a socket may take a large buffer in several writes */
+    while(size > 0) {
+        ssize_t written = write(*dest, buffer, size);
+
+        if(written < 0 && errno == EINTR)
+            continue;
+        if(written <= 0)
+            return -1;
+
+        buffer += written;
+        size -= (size_t)written;
+    }
+    return 0;
+#else
     return -1;
+#endif
+}
+
+static int dump_to_staging(const char *buffer, size_t size, void *data)
+{
+    struct staging *staging = (struct staging *)data;
+
+    if(size > sizeof(staging->buffer) - staging->used) {
+        if(staging->used && staging->dump(staging->buffer, staging->used, staging->data))
+            return -1;
+        staging->used = 0;
+
+        /* pieces that don't fit are passed on as they are */
+        if(size > sizeof(staging->buffer))
+            return staging->dump(buffer, size, staging->data);
+    }
+
+    memcpy(staging->buffer + staging->used, buffer, size);
+    staging->used += size;
+    return 0;
 }
 
 /* 32 spaces (the maximum indentation size) */
@@ -98,94 +145,118 @@ static int dump_indent(size_t flags, int depth, int space, json_dump_callback_t
     return 0;
 }
 
+/* second character of the escape for each byte below 0x60 that needs
+   one, 'u' for the \u00XX form and 0 for bytes written as they are */
+static const char escape_chars[0x60] = {
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+     0,   0,  '"',  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,  '/',
+     0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+     0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+     0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0, '\\',  0,   0,   0
+};
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+static size_t escape_codepoint(char *seq, int32_t codepoint)
+{
+    size_t i, length = 0;
+    int32_t units[2];
+    size_t count = 1;
+
+    /* not in BMP -> construct a UTF-16 surrogate pair */
+    if(codepoint >= 0x10000) {
+        codepoint -= 0x10000;
+        units[0] = 0xD800 | ((codepoint & 0xffc00) >> 10);
+        units[1] = 0xDC00 | (codepoint & 0x003ff);
+        count = 2;
+    }
+    else
+        units[0] = codepoint;
+
+    for(i = 0; i < count; i++) {
+        seq[length++] = '\\';
+        seq[length++] = 'u';
+        seq[length++] = hex_digits[(units[i] >> 12) & 0xF];
+        seq[length++] = hex_digits[(units[i] >> 8) & 0xF];
+        seq[length++] = hex_digits[(units[i] >> 4) & 0xF];
+        seq[length++] = hex_digits[units[i] & 0xF];
+    }
+
+    return length;
+}
+
 static int dump_string(const char *str, size_t len, json_dump_callback_t dump, void *data, size_t flags)
 {
-    const char *pos, *end, *lim;
-    int32_t codepoint = 0;
+    const unsigned char *run, *pos, *lim;
 
     if(dump("\"", 1, data))
         return -1;
 
-    end = pos = str;
-    lim = str + len;
+    run = pos = (const unsigned char *)str;
+    lim = pos + len;
+
     while(1)
     {
-        const char *text;
-        char seq[13];
-        int length;
-
-        while(end < lim)
-        {
-            end = utf8_iterate(pos, lim - pos, &codepoint);
-            if(!end)
-                return -1;
-
-            /* mandatory escape or control char */
-            if(codepoint == '\\' || codepoint == '"' || codepoint < 0x20)
-                break;
-
-            /* slash */
-            if((flags & JSON_ESCAPE_SLASH) && codepoint == '/')
-                break;
+        const unsigned char *start = pos, *next;
+        char seq[12];
+        size_t length;
 
-            /* non-ASCII */
-            if((flags & JSON_ENSURE_ASCII) && codepoint > 0x7F)
-                break;
+        /* plain ASCII needs no escaping and is written in one run */
+        pos += scan_plain(pos, (size_t)(lim - pos));
 
-            pos = end;
+        if(flags & JSON_ESCAPE_SLASH) {
+            const unsigned char *slash = memchr(start, '/', (size_t)(pos - start));
+            if(slash)
+                pos = slash;
         }
 
-        if(pos != str) {
-            if(dump(str, pos - str, data))
-                return -1;
-        }
-
-        if(end == pos)
+        if(pos == lim)
             break;
 
-        /* handle \, /, ", and control codes */
-        length = 2;
-        switch(codepoint)
-        {
-            case '\\': text = "\\\\"; break;
-            case '\"': text = "\\\""; break;
-            case '\b': text = "\\b"; break;
-            case '\f': text = "\\f"; break;
-            case '\n': text = "\\n"; break;
-            case '\r': text = "\\r"; break;
-            case '\t': text = "\\t"; break;
-            case '/':  text = "\\/"; break;
-            default:
-            {
-                /* codepoint is in BMP */
-                if(codepoint < 0x10000)
-                {
-                    snprintf(seq, sizeof(seq), "\\u%04X", (unsigned int)codepoint);
-                    length = 6;
-                }
+        if(*pos >= 0x80) {
+            int32_t codepoint;
 
-                /* not in BMP -> construct a UTF-16 surrogate pair */
-                else
-                {
-                    int32_t first, last;
+            next = (const unsigned char *)utf8_iterate((const char *)pos, (size_t)(lim - pos), &codepoint);
+            if(!next)
+                return -1;
 
-                    codepoint -= 0x10000;
-                    first = 0xD800 | ((codepoint & 0xffc00) >> 10);
-                    last = 0xDC00 | (codepoint & 0x003ff);
+            /* valid UTF-8 stays part of the run */
+            if(!(flags & JSON_ENSURE_ASCII)) {
+                pos = next;
+                continue;
+            }
 
-                    snprintf(seq, sizeof(seq), "\\u%04X\\u%04X", (unsigned int)first, (unsigned int)last);
-                    length = 12;
-                }
+            length = escape_codepoint(seq, codepoint);
+        }
+        else {
+            /* \, /, ", and control codes */
+            char escape = escape_chars[*pos];
 
-                text = seq;
-                break;
+            if(escape == 'u')
+                length = escape_codepoint(seq, *pos);
+            else {
+                seq[0] = '\\';
+                seq[1] = escape;
+                length = 2;
             }
+            next = pos + 1;
+        }
+
+        if(pos != run) {
+            if(dump((const char *)run, (size_t)(pos - run), data))
+                return -1;
         }
 
-        if(dump(text, length, data))
+        if(dump(seq, length, data))
             return -1;
 
-        str = pos = end;
+        run = pos = next;
+    }
+
+    if(pos != run) {
+        if(dump((const char *)run, (size_t)(pos - run), data))
+            return -1;
     }
 
     return dump("\"", 1, data);
@@ -196,17 +267,75 @@ static int compare_keys(const void *key1, const void *key2)
     return strcmp(*(const char **)key1, *(const char **)key2);
 }
 
-static int loop_check(hashtable_t *parents, const json_t *json, char *key, size_t key_size)
+/* Number of container levels tracked without allocating */
+#define DUMP_INLINE_PARENTS 32
+
+/* The arrays and objects being dumped, by depth. Only ancestors are
+   at lower depths, so a container that is found there is in a loop.
+   Nothing is written to the values, which other threads may be dumping
+   at the same time. */
+typedef struct {
+    const json_t **stack;
+    size_t size;
+    const json_t *inline_stack[DUMP_INLINE_PARENTS];
+} dump_parents_t;
+
+static void parents_init(dump_parents_t *parents)
 {
-    snprintf(key, key_size, "%p", json);
-    if (hashtable_get(parents, key))
-        return -1;
+    parents->stack = parents->inline_stack;
+    parents->size = DUMP_INLINE_PARENTS;
+}
+
+static void parents_close(dump_parents_t *parents)
+{
+    if(parents->stack != parents->inline_stack)
+        jsonp_free((void *)parents->stack);
+}
 
-    return hashtable_set(parents, key, json_null());
+static int loop_check(dump_parents_t *parents, const json_t *json, int depth, size_t flags)
+{
+    size_t i, level = (size_t)depth;
+    const json_t **stack;
+
+    if(flags & JSON_NO_CYCLE_CHECK)
+        return 0;
+
+    for(i = 0; i < level; i++) {
+        if(parents->stack[i] == json)
+            return -1;
+    }
+
+    if(level == parents->size) {
+        stack = jsonp_malloc(2 * parents->size * sizeof(const json_t *));
+        if(!stack)
+            return -1;
+
+        memcpy((void *)stack, (const void *)parents->stack, parents->size * sizeof(const json_t *));
+        parents_close(parents);
+        parents->stack = stack;
+        parents->size *= 2;
+    }
+
+    parents->stack[level] = json;
+    return 0;
+}
+
+/* the values that may be dumped without JSON_ENCODE_ANY */
+static int dump_is_container(const json_t *json)
+{
+    if(json_is_fragment(json)) {
+        const json_fragment_t *fragment = json_to_fragment(json);
+
+        if(fragment->value)
+            return dump_is_container(fragment->value);
+        return fragment->text && (fragment->text[0] == '[' || fragment->text[0] == '{');
+    }
+
+    return json_is_array(json) || json_is_object(json) || json_is_packed(json);
 }
 
 static int do_dump(const json_t *json, size_t flags, int depth,
-                   hashtable_t *parents, json_dump_callback_t dump, void *data)
+                   dump_parents_t *parents, json_dump_callback_t dump, void *data)
 {
     int embed = flags & JSON_EMBED;
 
@@ -230,10 +359,9 @@ static int do_dump(const json_t *json, size_t flags, int depth,
             char buffer[MAX_INTEGER_STR_LENGTH];
             int size;
 
-            size = snprintf(buffer, MAX_INTEGER_STR_LENGTH,
-                            "%" JSON_INTEGER_FORMAT,
-                            json_integer_value(json));
-            if(size < 0 || size >= MAX_INTEGER_STR_LENGTH)
+            size = jsonp_itostr(buffer, MAX_INTEGER_STR_LENGTH,
+                                json_integer_value(json));
+            if(size < 0)
                 return -1;
 
             return dump(buffer, size, data);
@@ -260,21 +388,17 @@ static int do_dump(const json_t *json, size_t flags, int depth,
         {
             size_t n;
             size_t i;
-            /* Space for "0x", double the sizeof a pointer for the hex and a terminator. */
-            char key[2 + (sizeof(json) * 2) + 1];
 
             /* detect circular references */
-            if (loop_check(parents, json, key, sizeof(key)))
+            if (loop_check(parents, json, depth, flags))
                 return -1;
 
             n = json_array_size(json);
 
             if(!embed && dump("[", 1, data))
                 return -1;
-            if(n == 0) {
-                hashtable_del(parents, key);
+            if(n == 0)
                 return embed ? 0 : dump("]", 1, data);
-            }
             if(dump_indent(flags, depth + 1, 0, dump, data))
                 return -1;
 
@@ -296,7 +420,57 @@ static int do_dump(const json_t *json, size_t flags, int depth,
                 }
             }
 
-            hashtable_del(parents, key);
+            return embed ? 0 : dump("]", 1, data);
+        }
+
+        case JSON_PACKED:
+        {
+            /* written like an array of numbers, which is how it loads back */
+            const void *values = json_packed_data(json);
+            int type = json_packed_type_of(json);
+            size_t n = json_packed_size(json);
+            size_t i;
+
+            if(!embed && dump("[", 1, data))
+                return -1;
+            if(n == 0)
+                return embed ? 0 : dump("]", 1, data);
+            if(dump_indent(flags, depth + 1, 0, dump, data))
+                return -1;
+
+            for(i = 0; i < n; ++i) {
+                char buffer[MAX_REAL_STR_LENGTH];
+                int size;
+
+                if(type == JSON_PACKED_DOUBLE) {
+                    double value = ((const double *)values)[i];
+
+                    /* JSON has no NaN or infinity, json_real() refuses them too */
+                    if(value != value || value - value != 0.0)
+                        return -1;
+
+                    size = jsonp_dtostr(buffer, MAX_REAL_STR_LENGTH, value,
+                                        FLAGS_TO_PRECISION(flags));
+                }
+                else if(type == JSON_PACKED_INT64)
+                    size = jsonp_itostr(buffer, MAX_REAL_STR_LENGTH,
+                                        (json_int_t)((const int64_t *)values)[i]);
+                else
+                    size = jsonp_itostr(buffer, MAX_REAL_STR_LENGTH,
+                                        (json_int_t)((const uint32_t *)values)[i]);
+
+                if(size < 0 || dump(buffer, size, data))
+                    return -1;
+
+                if(i < n - 1) {
+                    if(dump(",", 1, data) ||
+                       dump_indent(flags, depth + 1, 1, dump, data))
+                        return -1;
+                }
+                else if(dump_indent(flags, depth, 0, dump, data))
+                    return -1;
+            }
+
             return embed ? 0 : dump("]", 1, data);
         }
 
@@ -305,8 +479,6 @@ static int do_dump(const json_t *json, size_t flags, int depth,
             void *iter;
             const char *separator;
             int separator_length;
-            /* Space for "0x", double the sizeof a pointer for the hex and a terminator. */
-            char loop_key[2 + (sizeof(json) * 2) + 1];
 
             if(flags & JSON_COMPACT) {
                 separator = ":";
@@ -318,17 +490,15 @@ static int do_dump(const json_t *json, size_t flags, int depth,
             }
 
             /* detect circular references */
-            if (loop_check(parents, json, loop_key, sizeof(loop_key)))
+            if (loop_check(parents, json, depth, flags))
                 return -1;
 
             iter = json_object_iter((json_t *)json);
 
             if(!embed && dump("{", 1, data))
                 return -1;
-            if(!iter) {
-                hashtable_del(parents, loop_key);
+            if(!iter)
                 return embed ? 0 : dump("}", 1, data);
-            }
             if(dump_indent(flags, depth + 1, 0, dump, data))
                 return -1;
 
@@ -422,16 +592,64 @@ static int do_dump(const json_t *json, size_t flags, int depth,
                 }
             }
 
-            hashtable_del(parents, loop_key);
             return embed ? 0 : dump("}", 1, data);
         }
 
+        case JSON_FRAGMENT:
+        {
+            const json_fragment_t *fragment = json_to_fragment(json);
+
+            /* nested text is indented as if it was at the top */
+            if(fragment->text && !embed &&
+               (!fragment->value || ((flags & JSON_FRAGMENT_FLAGS) == fragment->text_flags &&
+                                     (depth == 0 || !JSON_INDENT(flags)))))
+                return dump(fragment->text, fragment->text_length, data);
+
+            if(!fragment->value)
+                return -1;
+
+            return do_dump(fragment->value, flags | embed, depth, parents, dump, data);
+        }
+
         default:
             /* not reached */
             return -1;
     }
 }
 
+/*** transcoding ***/
+
+/* BOS frames are written as JSON text with the same formatting as do_dump() */
+
+int jsonp_dump_string(const char *str, size_t len, json_dump_callback_t dump, void *data, size_t flags)
+{
+    return dump_string(str, len, dump, data, flags);
+}
+
+int jsonp_dump_indent(size_t flags, int depth, int space, json_dump_callback_t dump, void *data)
+{
+    return dump_indent(flags, depth, space, dump, data);
+}
+
+int jsonp_dump_staged(size_t flags, json_dump_callback_t callback, void *data,
+                      jsonp_emit_t emit, void *arg)
+{
+    struct staging staging;
+    int res;
+
+    if(!(flags & JSON_DUMP_BUFFERED))
+        return emit(callback, data, arg);
+
+    staging.dump = callback;
+    staging.data = data;
+    staging.used = 0;
+
+    res = emit(dump_to_staging, &staging, arg);
+    if(!res && staging.used)
+        res = callback(staging.buffer, staging.used, data);
+    return res;
+}
+
 char *json_dumps(const json_t *json, size_t flags)
 {
     strbuffer_t strbuff;
@@ -459,14 +677,53 @@ size_t json_dumpb(const json_t *json, char *buffer, size_t size, size_t flags)
     return buf.used;
 }
 
+size_t json_dumpb_many(json_t *const *values, size_t count, char *buffer, size_t size, size_t *offsets,
+                       size_t flags)
+{
+    struct buffer buf = { size, 0, buffer };
+    dump_parents_t parents;
+    size_t i;
+
+    if(count && !values)
+        return 0;
+
+    /* one loop detection stack for all of the values */
+    parents_init(&parents);
+
+    for(i = 0; i < count; i++) {
+        if(!(flags & JSON_ENCODE_ANY)) {
+            if(!dump_is_container(values[i]))
+                goto error;
+        }
+
+        if(offsets)
+            offsets[i] = buf.used;
+
+        if(do_dump(values[i], flags, 0, &parents, dump_to_buffer, &buf) ||
+           dump_to_buffer("\n", 1, &buf))
+            goto error;
+    }
+
+    if(offsets)
+        offsets[count] = buf.used;
+
+    jsonp_stats_call(dump, buf.used);
+    parents_close(&parents);
+    return buf.used;
+
+error:
+    parents_close(&parents);
+    return 0;
+}
+
 int json_dumpf(const json_t *json, FILE *output, size_t flags)
 {
-    return json_dump_callback(json, dump_to_file, (void *)output, flags);
+    return json_dump_callback(json, dump_to_file, (void *)output, flags | JSON_DUMP_BUFFERED);
 }
 
 int json_dumpfd(const json_t *json, int output, size_t flags)
 {
-    return json_dump_callback(json, dump_to_fd, (void *)&output, flags);
+    return json_dump_callback(json, dump_to_fd, (void *)&output, flags | JSON_DUMP_BUFFERED);
 }
 
 int json_dump_file(const json_t *json, const char *path, size_t flags)
@@ -485,20 +742,66 @@ int json_dump_file(const json_t *json, const char *path, size_t flags)
     return result;
 }
 
+#ifdef JANSSON_STATS
+/* counts the output of json_dump_callback() for json_get_stats() */
+struct stats_dump {
+    json_dump_callback_t dump;
+    void *data;
+    size_t used;
+};
+
+static int dump_to_stats(const char *buffer, size_t size, void *data)
+{
+    struct stats_dump *stats = (struct stats_dump *)data;
+
+    stats->used += size;
+    return stats->dump(buffer, size, stats->data);
+}
+#endif
+
 int json_dump_callback(const json_t *json, json_dump_callback_t callback, void *data, size_t flags)
 {
     int res;
-    hashtable_t parents_set;
+    dump_parents_t parents;
+#ifdef JANSSON_STATS
+    struct stats_dump stats;
+#endif
 
     if(!(flags & JSON_ENCODE_ANY)) {
-        if(!json_is_array(json) && !json_is_object(json))
+        if(!dump_is_container(json))
            return -1;
     }
 
-    if (hashtable_init(&parents_set))
-        return -1;
-    res = do_dump(json, flags, 0, &parents_set, callback, data);
-    hashtable_close(&parents_set);
+#ifdef JANSSON_STATS
+    stats.dump = callback;
+    stats.data = data;
+    stats.used = 0;
+    callback = dump_to_stats;
+    data = &stats;
+#endif
+
+    parents_init(&parents);
+
+    if(flags & JSON_DUMP_BUFFERED) {
+        struct staging staging;
+
+        staging.dump = callback;
+        staging.data = data;
+        staging.used = 0;
+
+        res = do_dump(json, flags, 0, &parents, dump_to_staging, &staging);
+        if(!res && staging.used)
+            res = callback(staging.buffer, staging.used, data);
+    }
+    else
+        res = do_dump(json, flags, 0, &parents, callback, data);
+
+    parents_close(&parents);
+
+#ifdef JANSSON_STATS
+    if(!res)
+        jsonp_stats_call(dump, stats.used);
+#endif
 
     return res;
 }
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2018 JCThePants <github.com/JCThePants>
+ *
+ * Bos-Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+/*
+ * Read-only file access for json_load_file_mmap(), bos_load_file_mmap()
+ * and bos_view_open_file(). Files are mapped into memory where mmap()
+ * is available so that the decoders read them in place, and read into
+ * a heap buffer otherwise.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "jansson_private_config.h"
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP) && defined(HAVE_FCNTL_H) && defined(HAVE_UNISTD_H)
+#define FILE_USE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "bosjansson.h"
+#include "jansson_private.h"
+
+static int file_error(json_error_t *error, const char *path)
+{
+    jsonp_error_set(error, -1, -1, 0, json_error_cannot_open_file, "unable to open %s: %s",
+                    path, strerror(errno));
+    return -1;
+}
+
+/* reads the whole file, the buffer has a spare byte so that empty
+   files are not a NULL pointer */
+static int file_read(bos_file_t *file, const char *path, json_error_t *error)
+{
+    char *data = NULL, *grown;
+    size_t size = 0, allocated = 4096, count;
+    FILE *fp = fopen(path, "rb");
+
+    if(!fp)
+        return file_error(error, path);
+
+    for(;;) {
+        if(!data || size + 1 >= allocated) {
+            if(data)
+                allocated *= 2;
+
+            grown = jsonp_malloc(allocated);
+            if(!grown) {
+                jsonp_free(data);
+                fclose(fp);
+                jsonp_error_set(error, -1, -1, 0, json_error_out_of_memory, "out of memory");
+                return -1;
+            }
+
+            if(data)
+                memcpy(grown, data, size);
+            jsonp_free(data);
+            data = grown;
+        }
+
+        count = fread(data + size, 1, allocated - size - 1, fp);
+        size += count;
+        if(count == 0)
+            break;
+    }
+
+    if(ferror(fp)) {
+        jsonp_free(data);
+        fclose(fp);
+        return file_error(error, path);
+    }
+
+    fclose(fp);
+    file->data = data;
+    file->size = size;
+    file->mapped = 0;
+    return 0;
+}
+
+int jsonp_file_open(bos_file_t *file, const char *path, int sequential, json_error_t *error)
+{
+#ifdef FILE_USE_MMAP
+    struct stat st;
+    void *data;
+    int fd;
+#endif
+
+    file->data = NULL;
+    file->size = 0;
+    file->mapped = 0;
+
+#ifdef FILE_USE_MMAP
+    fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return file_error(error, path);
+
+    if(fstat(fd, &st)) {
+        close(fd);
+        return file_error(error, path);
+    }
+
+    /* empty files and pipes can not be mapped */
+    if(!S_ISREG(st.st_mode) || st.st_size <= 0) {
+        close(fd);
+        return file_read(file, path, error);
+    }
+
+    if((unsigned long long)st.st_size > (size_t)-1) {
+        close(fd);
+        jsonp_error_set(error, -1, -1, 0, json_error_cannot_open_file, "unable to open %s: %s",
+                        path, "file too large");
+        return -1;
+    }
+
+    data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED)
+        return file_error(error, path);
+
+#ifdef MADV_SEQUENTIAL
+    if(sequential)
+        madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+
+    file->data = data;
+    file->size = (size_t)st.st_size;
+    file->mapped = 1;
+    return 0;
+#else
+    (void)sequential;
+    return file_read(file, path, error);
+#endif
+}
+
+void bos_file_close(bos_file_t *file)
+{
+    if(!file || !file->data)
+        return;
+
+#ifdef FILE_USE_MMAP
+    if(file->mapped)
+        munmap((void *)file->data, file->size);
+    else
+#endif
+        jsonp_free((void *)file->data);
+
+    file->data = NULL;
+    file->size = 0;
+    file->mapped = 0;
+}
@@ -20,22 +20,57 @@
 #include "jansson_private.h"  /* for container_of() */
 #include "hashtable.h"
 
-#ifndef INITIAL_HASHTABLE_ORDER
-#define INITIAL_HASHTABLE_ORDER 3
+/* slots are probed in groups of this many control bytes */
+#define GROUP_WIDTH 8
+
+/* capacity of the index when a small table grows, a multiple of
+   GROUP_WIDTH with room for more than HASHTABLE_SMALL_SIZE pairs */
+#ifndef INITIAL_HASHTABLE_CAPACITY
+#define INITIAL_HASHTABLE_CAPACITY 64
+#endif
+
+/* control bytes of slots without a pair, full slots hold 7 hash bits */
+#define CTRL_EMPTY   0x80
+#define CTRL_DELETED 0xFE
+
+/* at most 7/8 of the slots are used, so every probe ends in an empty slot */
+#define max_entries(capacity_) ((capacity_) - (capacity_) / 8)
+
+#if HASHTABLE_SMALL_SIZE % GROUP_WIDTH
+#error "the tags of a small table must fill whole groups"
 #endif
 
+/* tag of a key in a small table */
+#define small_tag(key_, len_) \
+    ((unsigned char)((len_) ? (unsigned char)(key_)[(len_) - 1] + ((len_) << 5) : 0))
+
+#define hash_h1(hash_) ((hash_) >> 7)
+#define hash_h2(hash_) ((unsigned char)((hash_) & 0x7F))
+
+#define GROUP_LSB ((uint64_t)0x0101010101010101ULL)
+#define GROUP_MSB ((uint64_t)0x8080808080808080ULL)
+
 typedef struct hashtable_list list_t;
 typedef struct hashtable_pair pair_t;
-typedef struct hashtable_bucket bucket_t;
+typedef uint64_t group_t;
 
 extern volatile uint32_t hashtable_seed;
 
-/* Implementation of the hash function */
+/* Implementation of the hash function. XXH64 reads 8 bytes per step,
+   lookup3 stays available as a build option. */
+#ifdef JANSSON_HASH_LOOKUP3
 #include "lookup3.h"
+#define hash_strn(key, len)  ((size_t)hashlittle((key), (len), hashtable_seed))
+#else
+#include "xxh64.h"
+#define hash_strn(key, len)  ((size_t)xxh64((key), (len), hashtable_seed))
+#endif
 
 #define list_to_pair(list_)  container_of(list_, pair_t, list)
-#define ordered_list_to_pair(list_)  container_of(list_, pair_t, ordered_list)
-#define hash_str(key)        ((size_t)hashlittle((key), strlen(key), hashtable_seed))
+
+/* control byte and pair of an index slot */
+#define slot_ctrl(hashtable_, slot_)  ((hashtable_)->u.index.ctrl[slot_])
+#define slot_pair(hashtable_, slot_)  ((hashtable_)->u.index.slots[slot_])
 
 static JSON_INLINE void list_init(list_t *list)
 {
@@ -57,80 +92,298 @@ static JSON_INLINE void list_remove(list_t *list)
     list->next->prev = list->prev;
 }
 
-static JSON_INLINE int bucket_is_empty(hashtable_t *hashtable, bucket_t *bucket)
+/* values of arena hashtables are released with the arena */
+static JSON_INLINE void release_value(hashtable_t *hashtable, json_t *value)
+{
+    if(!hashtable->arena)
+        json_decref(value);
+}
+
+/* Loads a group of control bytes, byte i in bits 8*i to 8*i+7 on every
+   platform. Compilers turn this into a single load. */
+static JSON_INLINE group_t group_load(const unsigned char *ctrl)
+{
+    return (group_t)ctrl[0] | (group_t)ctrl[1] << 8 |
+           (group_t)ctrl[2] << 16 | (group_t)ctrl[3] << 24 |
+           (group_t)ctrl[4] << 32 | (group_t)ctrl[5] << 40 |
+           (group_t)ctrl[6] << 48 | (group_t)ctrl[7] << 56;
+}
+
+/* Sets the high bit of the bytes equal to h2. May also flag a byte
+   above a match, candidates are compared in full anyway. */
+static JSON_INLINE group_t group_match(group_t group, unsigned char h2)
+{
+    group_t x = group ^ (GROUP_LSB * h2);
+    return (x - GROUP_LSB) & ~x & GROUP_MSB;
+}
+
+static JSON_INLINE group_t group_match_empty(group_t group)
+{
+    return group & (~group << 6) & GROUP_MSB;
+}
+
+static JSON_INLINE group_t group_match_free(group_t group)
+{
+    return group & (~group << 7) & GROUP_MSB;
+}
+
+/* index of the lowest flagged byte */
+static JSON_INLINE size_t group_first(group_t mask)
 {
-    return bucket->first == &hashtable->list && bucket->first == bucket->last;
+#if defined(__GNUC__)
+    return (size_t)__builtin_ctzll(mask) >> 3;
+#else
+    size_t i = 0;
+    while(!(mask & 0x80)) {
+        mask >>= 8;
+        i++;
+    }
+    return i;
+#endif
 }
 
-static void insert_to_bucket(hashtable_t *hashtable, bucket_t *bucket,
-                             list_t *list)
+/* index of a free slot in a group that has one, the slot at home if
+   it is free */
+static JSON_INLINE size_t group_free(group_t group, size_t home)
 {
-    if(bucket_is_empty(hashtable, bucket))
+    group_t match = group_match_free(group);
+
+    if(home < GROUP_WIDTH && (match >> (8 * home) & 0x80))
+        return home;
+    return group_first(match);
+}
+
+/* Compares keys of equal length. Most keys are short, and loading
+   their ends as two overlapping words is cheaper than calling memcmp. */
+static JSON_INLINE int key_equal(const char *a, const char *b, size_t len)
+{
+    uint64_t x, y, z, w;
+    uint32_t u, v;
+
+    if(len >= 8 && len <= 16)
     {
-        list_insert(&hashtable->list, list);
-        bucket->first = bucket->last = list;
+        memcpy(&x, a, 8);
+        memcpy(&y, b, 8);
+        memcpy(&z, a + len - 8, 8);
+        memcpy(&w, b + len - 8, 8);
+        return ((x ^ y) | (z ^ w)) == 0;
     }
-    else
+    if(len >= 4 && len < 8)
     {
-        list_insert(bucket->first, list);
-        bucket->first = list;
+        memcpy(&u, a, 4);
+        memcpy(&v, b, 4);
+        x = u ^ v;
+        memcpy(&u, a + len - 4, 4);
+        memcpy(&v, b + len - 4, 4);
+        return (x | (u ^ v)) == 0;
     }
+    if(len < 4)
+    {
+        while(len && *a == *b)
+        {
+            a++;
+            b++;
+            len--;
+        }
+        return len == 0;
+    }
+    return memcmp(a, b, len) == 0;
 }
 
-static pair_t *hashtable_find_pair(hashtable_t *hashtable, bucket_t *bucket,
-                                   const char *key, size_t hash)
+/* Returns the pair of the key in the index, or NULL if there's none.
+   Then slot, if not NULL, gets the slot of the pair. And free_slot, if
+   not NULL, gets the first free slot of the probe sequence so that
+   inserting the key needs no second probe. */
+static JSON_INLINE pair_t *hashtable_probe(hashtable_t *hashtable, const char *key,
+                                           size_t key_len, size_t hash, size_t *slot,
+                                           size_t *free_slot)
 {
-    list_t *list;
+    size_t group_mask = hashtable->capacity / GROUP_WIDTH - 1;
+    size_t home = hash_h1(hash) & (hashtable->capacity - 1);
+    size_t index = home / GROUP_WIDTH;
+    size_t step = 0;
+    unsigned char h2 = hash_h2(hash);
     pair_t *pair;
 
-    if(bucket_is_empty(hashtable, bucket))
-        return NULL;
+    /* Most pairs are in their home slot. Its pair is loaded along with
+       its control byte, so a hit needs no group match. */
+    if(slot_ctrl(hashtable, home) == h2)
+    {
+        pair = slot_pair(hashtable, home);
+        if(pair->hash == hash && pair->key_len == key_len &&
+           key_equal(pair->key, key, key_len))
+        {
+            if(slot)
+                *slot = home;
+            return pair;
+        }
+    }
 
-    list = bucket->first;
     while(1)
     {
-        pair = list_to_pair(list);
-        if(pair->hash == hash && strcmp(pair->key, key) == 0)
-            return pair;
+        size_t base = index * GROUP_WIDTH;
+        group_t group = group_load(hashtable->u.index.ctrl + base);
+        group_t match = group_match(group, h2);
+
+        while(match)
+        {
+            size_t i = group_first(match);
+
+            pair = hashtable->u.index.slots[base + i];
+
+            /* the hash check also rejects the rare false group match */
+            if(pair->hash == hash && pair->key_len == key_len &&
+               key_equal(pair->key, key, key_len))
+            {
+                if(slot)
+                    *slot = base + i;
+                return pair;
+            }
+
+            match &= match - 1;
+        }
 
-        if(list == bucket->last)
-            break;
+        if(free_slot && *free_slot == hashtable->capacity && group_match_free(group))
+            *free_slot = base + group_free(group, step ? GROUP_WIDTH : home % GROUP_WIDTH);
 
-        list = list->next;
+        /* a key is never placed past a group with an empty slot */
+        if(group_match_empty(group))
+            return NULL;
+
+        step++;
+        index = (index + step) & group_mask;
+    }
+}
+
+/* Search of a small table, no hash needed. Keys of similar objects
+   tend to share prefixes, so the tags use the last byte. */
+static JSON_INLINE pair_t *hashtable_find_small(hashtable_t *hashtable, const char *key,
+                                                size_t key_len)
+{
+    pair_t **pairs = hashtable->u.small.pairs;
+    unsigned char tag = small_tag(key, key_len);
+    size_t i;
+
+    for(i = 0; i < hashtable->size; i += GROUP_WIDTH)
+    {
+        group_t match = group_match(hashtable->u.small.tags[i / GROUP_WIDTH], tag);
+
+        /* tags past the last pair are stale */
+        if(hashtable->size - i < GROUP_WIDTH)
+            match &= ((group_t)1 << (8 * (hashtable->size - i))) - 1;
+
+        while(match)
+        {
+            pair_t *pair = pairs[i + group_first(match)];
+
+            if(pair->key_len == key_len && key_equal(pair->key, key, key_len))
+                return pair;
+
+            match &= match - 1;
+        }
     }
 
     return NULL;
 }
 
+static JSON_INLINE void hashtable_set_small(hashtable_t *hashtable, size_t i, pair_t *pair)
+{
+    group_t *tags = &hashtable->u.small.tags[i / GROUP_WIDTH];
+    group_t shift = 8 * (i % GROUP_WIDTH);
+
+    pair->index = (uint32_t)i;
+    hashtable->u.small.pairs[i] = pair;
+    *tags = (*tags & ~((group_t)0xFF << shift)) |
+            (group_t)small_tag(pair->key, pair->key_len) << shift;
+}
+
+static JSON_INLINE pair_t *hashtable_find_pair(hashtable_t *hashtable, const char *key,
+                                               size_t key_len, size_t hash)
+{
+    if(!hashtable->capacity)
+        return hashtable_find_small(hashtable, key, key_len);
+
+    return hashtable_probe(hashtable, key, key_len, hash, NULL, NULL);
+}
+
+/* returns the first free slot on the probe sequence of the hash */
+static JSON_INLINE size_t hashtable_find_free(hashtable_t *hashtable, size_t hash)
+{
+    size_t group_mask = hashtable->capacity / GROUP_WIDTH - 1;
+    size_t home = hash_h1(hash) & (hashtable->capacity - 1);
+    size_t index = home / GROUP_WIDTH;
+    size_t step = 0;
+    group_t group;
+
+    while(1)
+    {
+        group = group_load(hashtable->u.index.ctrl + index * GROUP_WIDTH);
+        if(group_match_free(group))
+            return index * GROUP_WIDTH + group_free(group, step ? GROUP_WIDTH : home % GROUP_WIDTH);
+
+        step++;
+        index = (index + step) & group_mask;
+    }
+}
+
+/* puts a pair in a free slot, the slot of a deleted pair was used already */
+static JSON_INLINE void hashtable_place(hashtable_t *hashtable, size_t slot, pair_t *pair)
+{
+    if(slot_ctrl(hashtable, slot) == CTRL_EMPTY)
+        hashtable->used++;
+
+    slot_ctrl(hashtable, slot) = hash_h2(pair->hash);
+    slot_pair(hashtable, slot) = pair;
+}
+
+/* places a pair known not to be in the index */
+static JSON_INLINE void hashtable_insert_slot(hashtable_t *hashtable, pair_t *pair)
+{
+    hashtable_place(hashtable, hashtable_find_free(hashtable, pair->hash), pair);
+}
+
+static void hashtable_empty_index(hashtable_t *hashtable)
+{
+    memset(hashtable->u.index.ctrl, CTRL_EMPTY, hashtable->capacity);
+}
+
 /* returns 0 on success, -1 if key was not found */
 static int hashtable_do_del(hashtable_t *hashtable,
-                            const char *key, size_t hash)
+                            const char *key, size_t key_len, size_t hash)
 {
     pair_t *pair;
-    bucket_t *bucket;
-    size_t index;
-
-    index = hash & hashmask(hashtable->order);
-    bucket = &hashtable->buckets[index];
-
-    pair = hashtable_find_pair(hashtable, bucket, key, hash);
-    if(!pair)
-        return -1;
+    size_t slot;
 
-    if(&pair->list == bucket->first && &pair->list == bucket->last)
-        bucket->first = bucket->last = &hashtable->list;
+    if(!hashtable->capacity)
+    {
+        pair = hashtable_find_small(hashtable, key, key_len);
+        if(!pair)
+            return -1;
 
-    else if(&pair->list == bucket->first)
-        bucket->first = pair->list.next;
+        /* the last pair fills the hole, the list keeps the order */
+        hashtable_set_small(hashtable, pair->index, hashtable->u.small.pairs[hashtable->size - 1]);
+    }
+    else
+    {
+        pair = hashtable_probe(hashtable, key, key_len, hash, &slot, NULL);
+        if(!pair)
+            return -1;
 
-    else if(&pair->list == bucket->last)
-        bucket->last = pair->list.prev;
+        /* probes stop at a group with an empty slot, so one more does not
+           hide any key placed after this group */
+        if(group_match_empty(group_load(hashtable->u.index.ctrl + slot - slot % GROUP_WIDTH)))
+        {
+            slot_ctrl(hashtable, slot) = CTRL_EMPTY;
+            hashtable->used--;
+        }
+        else
+            slot_ctrl(hashtable, slot) = CTRL_DELETED;
+    }
 
     list_remove(&pair->list);
-    list_remove(&pair->ordered_list);
-    json_decref(pair->value);
+    release_value(hashtable, pair->value);
 
-    jsonp_free(pair);
+    jsonp_arena_free(hashtable->arena, pair);
     hashtable->size--;
 
     return 0;
@@ -145,138 +398,141 @@ static void hashtable_do_clear(hashtable_t *hashtable)
     {
         next = list->next;
         pair = list_to_pair(list);
-        json_decref(pair->value);
-        jsonp_free(pair);
+        release_value(hashtable, pair->value);
+        jsonp_arena_free(hashtable->arena, pair);
     }
 }
 
+/* Rebuilds the index. A small table gets its first index, larger ones
+   double unless enough slots of deleted pairs are reclaimed. */
 static int hashtable_do_rehash(hashtable_t *hashtable)
 {
-    list_t *list, *next;
-    pair_t *pair;
-    size_t i, index, new_size, new_order;
-    struct hashtable_bucket *new_buckets;
+    size_t new_capacity;
+    pair_t **new_slots, **old_slots = NULL;
+    list_t *list;
 
-    new_order = hashtable->order + 1;
-    new_size = hashsize(new_order);
+    new_capacity = hashtable->capacity;
+    if(!new_capacity)
+        new_capacity = INITIAL_HASHTABLE_CAPACITY;
+    else if(hashtable->size >= max_entries(new_capacity) - max_entries(new_capacity) / 4)
+        new_capacity *= 2;
 
-    new_buckets = jsonp_malloc(new_size * sizeof(bucket_t));
-    if(!new_buckets)
+    if(new_capacity > ((size_t)-1) / (sizeof(pair_t *) + 1))
         return -1;
 
-    jsonp_free(hashtable->buckets);
-    hashtable->buckets = new_buckets;
-    hashtable->order = new_order;
+    new_slots = jsonp_arena_malloc(hashtable->arena, new_capacity * (sizeof(pair_t *) + 1));
+    if(!new_slots)
+        return -1;
 
-    for(i = 0; i < hashsize(hashtable->order); i++)
-    {
-        hashtable->buckets[i].first = hashtable->buckets[i].last =
-            &hashtable->list;
-    }
+    /* the index overwrites the small array, the list still has the pairs */
+    if(hashtable->capacity)
+        old_slots = hashtable->u.index.slots;
 
-    list = hashtable->list.next;
-    list_init(&hashtable->list);
+    hashtable->capacity = new_capacity;
+    hashtable->used = 0;
+    hashtable->u.index.slots = new_slots;
+    hashtable->u.index.ctrl = (unsigned char *)(new_slots + new_capacity);
+    hashtable_empty_index(hashtable);
 
-    for(; list != &hashtable->list; list = next) {
-        next = list->next;
-        pair = list_to_pair(list);
-        index = pair->hash % new_size;
-        insert_to_bucket(hashtable, &hashtable->buckets[index], &pair->list);
-    }
+    for(list = hashtable->list.next; list != &hashtable->list; list = list->next)
+        hashtable_insert_slot(hashtable, list_to_pair(list));
 
+    jsonp_arena_free(hashtable->arena, old_slots);
     return 0;
 }
 
 
-int hashtable_init(hashtable_t *hashtable)
+int hashtable_init(hashtable_t *hashtable, json_arena_t *arena)
 {
-    size_t i;
-
+    /* tables start small and need no allocation */
     hashtable->size = 0;
-    hashtable->order = INITIAL_HASHTABLE_ORDER;
-    hashtable->buckets = jsonp_malloc(hashsize(hashtable->order) * sizeof(bucket_t));
-    if(!hashtable->buckets)
-        return -1;
-
+    hashtable->used = 0;
+    hashtable->capacity = 0;
+    hashtable->arena = arena;
     list_init(&hashtable->list);
-    list_init(&hashtable->ordered_list);
-
-    for(i = 0; i < hashsize(hashtable->order); i++)
-    {
-        hashtable->buckets[i].first = hashtable->buckets[i].last =
-            &hashtable->list;
-    }
-
     return 0;
 }
 
 void hashtable_close(hashtable_t *hashtable)
 {
     hashtable_do_clear(hashtable);
-    jsonp_free(hashtable->buckets);
+    if(hashtable->capacity)
+        jsonp_arena_free(hashtable->arena, hashtable->u.index.slots);
 }
 
 int hashtable_set(hashtable_t *hashtable, const char *key, json_t *value)
 {
-    pair_t *pair;
-    bucket_t *bucket;
-    size_t hash, index;
+    size_t len = strlen(key);
+    return hashtable_setn(hashtable, key, len, hashtable_hash(key, len), value);
+}
 
-    /* rehash if the load ratio exceeds 1 */
-    if(hashtable->size >= hashsize(hashtable->order))
-        if(hashtable_do_rehash(hashtable))
-            return -1;
+int hashtable_setn(hashtable_t *hashtable, const char *key, size_t key_len,
+                   size_t hash, json_t *value)
+{
+    pair_t *pair;
+    size_t free_slot = hashtable->capacity;
 
-    hash = hash_str(key);
-    index = hash & hashmask(hashtable->order);
-    bucket = &hashtable->buckets[index];
-    pair = hashtable_find_pair(hashtable, bucket, key, hash);
+    if(!hashtable->capacity)
+        pair = hashtable_find_small(hashtable, key, key_len);
+    else
+        pair = hashtable_probe(hashtable, key, key_len, hash, NULL, &free_slot);
 
     if(pair)
     {
-        json_decref(pair->value);
+        release_value(hashtable, pair->value);
         pair->value = value;
+        return 0;
     }
-    else
-    {
-        /* offsetof(...) returns the size of pair_t without the last,
-           flexible member. This way, the correct amount is
-           allocated. */
 
-        size_t len = strlen(key);
-        if(len >= (size_t)-1 - offsetof(pair_t, key)) {
-            /* Avoid an overflow if the key is very long */
-            return -1;
-        }
+    if(key_len >= UINT32_MAX) {
+        /* Avoid an overflow if the key is very long */
+        return -1;
+    }
 
-        pair = jsonp_malloc(offsetof(pair_t, key) + len + 1);
-        if(!pair)
+    if(hashtable->capacity ? hashtable->used == max_entries(hashtable->capacity)
+                           : hashtable->size == HASHTABLE_SMALL_SIZE)
+    {
+        if(hashtable_do_rehash(hashtable))
             return -1;
 
-        pair->hash = hash;
-        strncpy(pair->key, key, len + 1);
-        pair->value = value;
-        list_init(&pair->list);
-        list_init(&pair->ordered_list);
+        /* the slot found above belongs to the old index */
+        free_slot = hashtable->capacity;
+    }
 
-        insert_to_bucket(hashtable, bucket, &pair->list);
-        list_insert(&hashtable->ordered_list, &pair->ordered_list);
+    /* offsetof(...) returns the size of pair_t without the last,
+       flexible member. This way, the correct amount is
+       allocated. */
+    pair = jsonp_arena_malloc(hashtable->arena, offsetof(pair_t, key) + key_len + 1);
+    if(!pair)
+        return -1;
 
-        hashtable->size++;
-    }
+    pair->hash = hash;
+    memcpy(pair->key, key, key_len);
+    pair->key[key_len] = '\0';
+    pair->value = value;
+    pair->key_len = (uint32_t)key_len;
+    list_insert(&hashtable->list, &pair->list);
+
+    if(!hashtable->capacity)
+        hashtable_set_small(hashtable, hashtable->size, pair);
+    else if(free_slot < hashtable->capacity)
+        hashtable_place(hashtable, free_slot, pair);
+    else
+        hashtable_insert_slot(hashtable, pair);
+
+    hashtable->size++;
     return 0;
 }
 
 void *hashtable_get(hashtable_t *hashtable, const char *key)
 {
-    pair_t *pair;
-    size_t hash;
-    bucket_t *bucket;
-
-    hash = hash_str(key);
-    bucket = &hashtable->buckets[hash & hashmask(hashtable->order)];
+    size_t len = strlen(key);
+    return hashtable_getn(hashtable, key, len, hashtable->capacity ? hash_strn(key, len) : 0);
+}
 
-    pair = hashtable_find_pair(hashtable, bucket, key, hash);
+void *hashtable_getn(hashtable_t *hashtable, const char *key, size_t key_len, size_t hash)
+{
+    pair_t *pair = hashtable_find_pair(hashtable, key, key_len, hash);
     if(!pair)
         return NULL;
 
@@ -285,72 +541,64 @@ void *hashtable_get(hashtable_t *hashtable, const char *key)
 
 int hashtable_del(hashtable_t *hashtable, const char *key)
 {
-    size_t hash = hash_str(key);
-    return hashtable_do_del(hashtable, key, hash);
+    size_t len = strlen(key);
+    return hashtable_do_del(hashtable, key, len, hashtable->capacity ? hash_strn(key, len) : 0);
 }
 
-void hashtable_clear(hashtable_t *hashtable)
+int hashtable_deln(hashtable_t *hashtable, const char *key, size_t key_len, size_t hash)
 {
-    size_t i;
+    return hashtable_do_del(hashtable, key, key_len, hash);
+}
 
+void hashtable_clear(hashtable_t *hashtable)
+{
     hashtable_do_clear(hashtable);
 
-    for(i = 0; i < hashsize(hashtable->order); i++)
-    {
-        hashtable->buckets[i].first = hashtable->buckets[i].last =
-            &hashtable->list;
-    }
+    if(hashtable->capacity)
+        hashtable_empty_index(hashtable);
 
-    list_init(&hashtable->list);
-    list_init(&hashtable->ordered_list);
+    hashtable->used = 0;
     hashtable->size = 0;
+    list_init(&hashtable->list);
 }
 
 void *hashtable_iter(hashtable_t *hashtable)
 {
-    return hashtable_iter_next(hashtable, &hashtable->ordered_list);
+    list_t *list = hashtable->list.next;
+    return list == &hashtable->list ? NULL : list_to_pair(list);
 }
 
 void *hashtable_iter_at(hashtable_t *hashtable, const char *key)
 {
-    pair_t *pair;
-    size_t hash;
-    bucket_t *bucket;
-
-    hash = hash_str(key);
-    bucket = &hashtable->buckets[hash & hashmask(hashtable->order)];
-
-    pair = hashtable_find_pair(hashtable, bucket, key, hash);
-    if(!pair)
-        return NULL;
-
-    return &pair->ordered_list;
+    size_t len = strlen(key);
+    return hashtable_find_pair(hashtable, key, len, hashtable->capacity ? hash_strn(key, len) : 0);
 }
 
 void *hashtable_iter_next(hashtable_t *hashtable, void *iter)
 {
-    list_t *list = (list_t *)iter;
-    if(list->next == &hashtable->ordered_list)
-        return NULL;
-    return list->next;
+    list_t *list = ((pair_t *)iter)->list.next;
+    return list == &hashtable->list ? NULL : list_to_pair(list);
 }
 
 void *hashtable_iter_key(void *iter)
 {
-    pair_t *pair = ordered_list_to_pair((list_t *)iter);
-    return pair->key;
+    return ((pair_t *)iter)->key;
 }
 
 void *hashtable_iter_value(void *iter)
 {
-    pair_t *pair = ordered_list_to_pair((list_t *)iter);
-    return pair->value;
+    return ((pair_t *)iter)->value;
 }
 
-void hashtable_iter_set(void *iter, json_t *value)
+void hashtable_iter_set(hashtable_t *hashtable, void *iter, json_t *value)
 {
-    pair_t *pair = ordered_list_to_pair((list_t *)iter);
+    pair_t *pair = (pair_t *)iter;
 
-    json_decref(pair->value);
+    release_value(hashtable, pair->value);
     pair->value = value;
 }
+
+size_t hashtable_hash(const char *key, size_t key_len)
+{
+    return hash_strn(key, key_len);
+}
@@ -20,42 +20,68 @@ struct hashtable_list {
    key-value pair. In this case, it just encodes some extra data,
    too */
 struct hashtable_pair {
-    struct hashtable_list list;
-    struct hashtable_list ordered_list;
+    struct hashtable_list list;  /* insertion order */
     size_t hash;
+    uint32_t index;  /* position in the array of a small table */
+    uint32_t key_len;
     json_t *value;
     char key[1];
 };
 
-struct hashtable_bucket {
-    struct hashtable_list *first;
-    struct hashtable_list *last;
-};
+/* Objects with up to this many keys keep their pairs in an array
+   and are searched by their tags, a multiple of 8 */
+#ifndef HASHTABLE_SMALL_SIZE
+#define HASHTABLE_SMALL_SIZE 16
+#endif
 
+/* Pairs are linked in insertion order, so iterating needs no lookup.
+
+   Small tables keep their pairs in an array. In the hashtable itself
+   every pair has a tag byte made of its key length and last byte, so
+   a search compares 8 tags at once without hashing the key. The
+   pairs still keep the hash they were set with, so growing into an
+   index hashes nothing again. Larger tables allocate an open
+   addressed index: every slot has a control byte holding 7 bits of
+   the hash, so a probe compares a group of slots at once and only
+   looks at pairs that are likely to match. A pair is most often in
+   its home slot, which is checked first with no group match. */
 typedef struct hashtable {
-    size_t size;
-    struct hashtable_bucket *buckets;
-    size_t order;  /* hashtable has pow(2, order) buckets */
+    size_t size;      /* number of pairs */
+    size_t used;      /* slots used in the index, including deleted ones */
+    size_t capacity;  /* number of index slots, 0 for small tables */
     struct hashtable_list list;
-    struct hashtable_list ordered_list;
+    json_arena_t *arena;  /* storage owner, NULL for the heap */
+    union {
+        struct {
+            struct hashtable_pair *pairs[HASHTABLE_SMALL_SIZE];
+            uint64_t tags[HASHTABLE_SMALL_SIZE / 8];  /* byte i tags pairs[i] */
+        } small;
+        struct {
+            struct hashtable_pair **slots;
+            unsigned char *ctrl;  /* allocated after the slots */
+        } index;
+    } u;
 } hashtable_t;
 
 
 #define hashtable_key_to_iter(key_) \
-    (&(container_of(key_, struct hashtable_pair, key)->ordered_list))
+    ((void *)container_of(key_, struct hashtable_pair, key))
 
 
 /**
  * hashtable_init - Initialize a hashtable object
  *
  * @hashtable: The (statically allocated) hashtable object
+ * @arena: Arena to allocate the storage from, or NULL for the heap
  *
  * Initializes a statically allocated hashtable object. The object
  * should be cleared with hashtable_close when it's no longer used.
+ * A hashtable in an arena does not release its values, they are
+ * released with the arena.
  *
  * Returns 0 on success, -1 on error (out of memory).
  */
-int hashtable_init(hashtable_t *hashtable) JANSSON_ATTRS(warn_unused_result);
+int hashtable_init(hashtable_t *hashtable, json_arena_t *arena) JANSSON_ATTRS(warn_unused_result);
 
 /**
  * hashtable_close - Release all resources used by a hashtable object
@@ -83,6 +109,32 @@ void hashtable_close(hashtable_t *hashtable);
  */
 int hashtable_set(hashtable_t *hashtable, const char *key, json_t *value);
 
+/**
+ * hashtable_setn - Add/modify value in hashtable with a known key length and hash
+ *
+ * @hashtable: The hashtable object
+ * @key: The key, does not need to be null terminated
+ * @key_len: The length of the key, which must not contain null bytes
+ * @hash: The hash of the key as returned by hashtable_hash
+ * @value: The value
+ *
+ * Like hashtable_set() but skips measuring and hashing the key.
+ */
+int hashtable_setn(hashtable_t *hashtable, const char *key, size_t key_len,
+                   size_t hash, json_t *value);
+
+/**
+ * hashtable_hash - Hash a key
+ *
+ * @key: The key, does not need to be null terminated
+ * @key_len: The length of the key
+ *
+ * Returns the hash of the key, to be passed to the hashtable_*n
+ * functions. A caller that looks up the same key several times can
+ * hash it once.
+ */
+size_t hashtable_hash(const char *key, size_t key_len);
+
 /**
  * hashtable_get - Get a value associated with a key
  *
@@ -93,6 +145,15 @@ int hashtable_set(hashtable_t *hashtable, const char *key, json_t *value);
  */
 void *hashtable_get(hashtable_t *hashtable, const char *key);
 
+/**
+ * hashtable_getn - Get a value with a known key length and hash
+ *
+ * Like hashtable_get() but skips measuring and hashing the key. The
+ * hash is only read once the table has an index (capacity != 0), a
+ * small table may be given any hash.
+ */
+void *hashtable_getn(hashtable_t *hashtable, const char *key, size_t key_len, size_t hash);
+
 /**
  * hashtable_del - Remove a value from the hashtable
  *
@@ -103,6 +164,13 @@ void *hashtable_get(hashtable_t *hashtable, const char *key);
  */
 int hashtable_del(hashtable_t *hashtable, const char *key);
 
+/**
+ * hashtable_deln - Remove a value with a known key length and hash
+ *
+ * Like hashtable_del() but skips measuring and hashing the key.
+ */
+int hashtable_deln(hashtable_t *hashtable, const char *key, size_t key_len, size_t hash);
+
 /**
  * hashtable_clear - Clear hashtable
  *
@@ -119,7 +187,7 @@ void hashtable_clear(hashtable_t *hashtable);
  *
  * Returns an opaque iterator to the first element in the hashtable.
  * The iterator should be passed to hashtable_iter_* functions.
- * The hashtable items are not iterated over in any particular order.
+ * The hashtable items are iterated over in insertion order.
  *
  * There's no need to free the iterator in any way. The iterator is
  * valid as long as the item that is referenced by the iterator is not
@@ -168,9 +236,10 @@ void *hashtable_iter_value(void *iter);
 /**
  * hashtable_iter_set - Set the value pointed by an iterator
  *
+ * @hashtable: The hashtable object
  * @iter: The iterator
  * @value: The value to set
  */
-void hashtable_iter_set(void *iter, json_t *value);
+void hashtable_iter_set(hashtable_t *hashtable, void *iter, json_t *value);
 
 #endif
@@ -17,10 +17,13 @@
 #define container_of(ptr_, type_, member_)  \
     ((type_ *)((char *)ptr_ - offsetof(type_, member_)))
 
-/* On some platforms, max() may already be defined */
+/* On some platforms, max() and min() may already be defined */
 #ifndef max
 #define max(a, b)  ((a) > (b) ? (a) : (b))
 #endif
+#ifndef min
+#define min(a, b)  ((a) < (b) ? (a) : (b))
+#endif
 
 /* va_copy is a C99 feature. In C89 implementations, it's sometimes
    available as __va_copy. If not, memcpy() should do the trick. */
@@ -35,6 +38,29 @@
 #define TRUE 1;
 #define FALSE 0;
 
+/* Thread local storage for per thread state such as the current arena.
+   Without it the state is shared by all threads and the node pools
+   stay disabled. */
+#ifndef JSON_THREAD_LOCAL
+#if defined(_MSC_VER)
+#define JSON_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__) || defined(__clang__)
+#define JSON_THREAD_LOCAL __thread
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define JSON_THREAD_LOCAL _Thread_local
+#else
+#define JSON_THREAD_LOCAL
+#define JSON_NO_THREAD_LOCAL 1
+#endif
+#endif
+
+/* json_t flags */
+#define JSON_FLAG_ARENA 0x1  /* allocated from an arena, never deleted */
+#define JSON_FLAG_INLINE 0x2 /* string node with inline storage */
+#define JSON_FLAG_BORROWED 0x4 /* string or bytes node that can release caller memory */
+/* JSON_FLAG_FROZEN 0x8 is public, the inline reference counting checks it */
+#define JSON_FLAG_HASHED 0x10 /* frozen container holding its json_hash() */
+
 typedef enum {
     BOS_NULL   = 0x00,
     BOS_BOOL   = 0x01,
@@ -51,12 +77,16 @@ typedef enum {
     BOS_STRING = 0x0C,
     BOS_BYTES  = 0x0D,
     BOS_ARRAY  = 0x0E,
-    BOS_OBJ    = 0x0F
+    BOS_OBJ    = 0x0F,
+    BOS_PACKED = 0x10,
+    BOS_KEYED_OBJ = 0x11
 } bos_data_type;
 
 typedef struct {
     json_t json;
     hashtable_t hashtable;
+    uint64_t hash;       /* valid with JSON_FLAG_HASHED */
+    uint64_t hash_seed;
 } json_object_t;
 
 typedef struct {
@@ -64,6 +94,8 @@ typedef struct {
     size_t size;
     size_t entries;
     json_t **table;
+    uint64_t hash;       /* valid with JSON_FLAG_HASHED */
+    uint64_t hash_seed;
 } json_array_t;
 
 typedef struct {
@@ -88,16 +120,61 @@ typedef struct {
     size_t size;
 } json_bytes_t;
 
+typedef struct {
+    json_t json;
+    json_packed_type type;
+    size_t size;
+    size_t allocated;
+    void *data;
+} json_packed_t;
+
+/* Encoded forms of a value, spliced into the output by the encoders.
+   Each form is used when the encoder's flags match the ones it was
+   encoded with, or always if there is no value to encode instead. */
+typedef struct {
+    json_t json;
+    json_t *value;      /* NULL for fragments made from raw data */
+    char *text;         /* JSON text or NULL */
+    size_t text_length;
+    size_t text_flags;
+    unsigned char *bos; /* one BOS value without the frame header, or NULL */
+    size_t bos_size;
+    size_t bos_flags;
+} json_fragment_t;
+
+/* the encoder flags that change the encoded form of a fragment */
+#define JSON_FRAGMENT_FLAGS (JSON_MAX_INDENT | JSON_COMPACT | JSON_ENSURE_ASCII | JSON_SORT_KEYS | \
+                             JSON_ESCAPE_SLASH | JSON_REAL_PRECISION(0x1F))
+#define BOS_FRAGMENT_FLAGS (BOS_FLOAT_REALS | BOS_INTEGRAL_REALS | BOS_EXPAND_PACKED)
+
 #define json_to_object(json_)  container_of(json_, json_object_t, json)
 #define json_to_array(json_)   container_of(json_, json_array_t, json)
 #define json_to_string(json_)  container_of(json_, json_string_t, json)
 #define json_to_real(json_)    container_of(json_, json_real_t, json)
 #define json_to_integer(json_) container_of(json_, json_integer_t, json)
 #define json_to_bytes(json_)   container_of(json_, json_bytes_t, json)
+#define json_to_packed(json_)  container_of(json_, json_packed_t, json)
+#define json_to_fragment(json_) container_of(json_, json_fragment_t, json)
+
+/* size in bytes of a packed array element, 0 for an invalid type */
+#define jsonp_packed_element_size(type_) \
+    ((type_) == JSON_PACKED_UINT32 ? 4 : \
+     (type_) == JSON_PACKED_INT64 || (type_) == JSON_PACKED_DOUBLE ? 8 : 0)
 
 /* Create a string by taking ownership of an existing buffer */
 json_t *jsonp_stringn_nocheck_own(const char *value, size_t len);
 
+/* Hand the memory of a borrowed string or bytes value back to its owner */
+void jsonp_release_borrowed(json_t *json);
+
+/* Object access with a key hashed by hashtable_hash(). The key does not
+   need to be null terminated; it must be valid UTF-8 without null bytes. */
+json_t *jsonp_object_get_hashed(const json_t *json, const char *key, size_t len, size_t hash);
+int jsonp_object_set_hashed_new(json_t *json, const char *key, size_t len, size_t hash, json_t *value);
+
+/* Maps the file, or reads it where mmap() is not available */
+int jsonp_file_open(bos_file_t *file, const char *path, int sequential, json_error_t *error);
+
 /* Error message formatting */
 void jsonp_error_init(json_error_t *error, const char *source);
 void jsonp_error_set_source(json_error_t *error, const char *source);
@@ -110,7 +187,67 @@ void jsonp_error_vset(json_error_t *error, int line, int column,
 
 /* Locale independent string<->double conversions */
 int jsonp_strtod(strbuffer_t *strbuffer, double *out);
+int jsonp_strtoint(const char *str, size_t length, json_int_t *out);
 int jsonp_dtostr(char *buffer, size_t size, double value, int prec);
+int jsonp_itostr(char *buffer, size_t size, json_int_t value);
+
+/* Pieces of the JSON encoder for writing text without a json_t tree.
+   jsonp_dump_staged() runs emit through the JSON_DUMP_BUFFERED staging
+   buffer when the flag is set. */
+typedef int (*jsonp_emit_t)(json_dump_callback_t dump, void *data, void *arg);
+int jsonp_dump_string(const char *str, size_t len, json_dump_callback_t dump, void *data, size_t flags);
+int jsonp_dump_indent(size_t flags, int depth, int space, json_dump_callback_t dump, void *data);
+int jsonp_dump_staged(size_t flags, json_dump_callback_t callback, void *data,
+                      jsonp_emit_t emit, void *arg);
+
+/* Emitters for writing a BOS frame without a json_t tree. They return
+   TRUE or FALSE like the rest of the serializer. A container is opened
+   with a placeholder count which is filled in when it is closed. */
+int jsonp_bos_begin(bos_writer_t *writer, size_t *start, json_error_t *error);
+int jsonp_bos_end(bos_writer_t *writer, size_t start, json_error_t *error);
+int jsonp_bos_null(bos_writer_t *writer, json_error_t *error);
+int jsonp_bos_boolean(bos_writer_t *writer, int value, json_error_t *error);
+int jsonp_bos_integer(bos_writer_t *writer, json_int_t value, json_error_t *error);
+int jsonp_bos_real(bos_writer_t *writer, double value, json_error_t *error);
+int jsonp_bos_string(bos_writer_t *writer, const char *value, size_t len, json_error_t *error);
+int jsonp_bos_key(bos_writer_t *writer, const char *key, size_t len, json_error_t *error);
+int jsonp_bos_open(bos_writer_t *writer, int object, size_t *mark, json_error_t *error);
+int jsonp_bos_close(bos_writer_t *writer, size_t mark, size_t count, json_error_t *error);
+
+/* Path matching of the selective decoders. A jsonp_select_t is a path
+   that matches up to offset, where its next segment starts. */
+typedef struct {
+    size_t index;
+    size_t offset;
+} jsonp_select_t;
+
+int jsonp_select_init(const char *const *paths, size_t count, json_t **values, jsonp_select_t *selected);
+size_t jsonp_select_key(const char *const *paths, const jsonp_select_t *selected, size_t count,
+                        const char *key, size_t len, jsonp_select_t *next);
+size_t jsonp_select_index(const char *const *paths, const jsonp_select_t *selected, size_t count,
+                          size_t index, jsonp_select_t *next);
+int jsonp_select_found(const char *const *paths, const jsonp_select_t *selected, size_t count);
+int jsonp_select_store(const char *const *paths, const jsonp_select_t *selected, size_t count,
+                       json_t *value, json_t **values);
+void jsonp_select_clear(json_t **values, size_t count);
+
+/* Parallel encoding and decoding of large root arrays. Arrays of fewer
+   than two runs of this many elements are not worth handing out. */
+#ifndef BOS_PARALLEL_MIN_CHUNK
+#define BOS_PARALLEL_MIN_CHUNK 1024
+#endif
+
+/* BOS_BORROW copies bytes payloads shorter than this: the copy costs
+   less than the borrowed node and the frame isn't kept alive for them. */
+#ifndef BOS_BORROW_MIN_SIZE
+#define BOS_BORROW_MIN_SIZE 64
+#endif
+
+/* Creates an array with room for at least size entries */
+json_t *jsonp_array_sized(size_t size);
+
+/* Moves the entries of other to the end of array, leaving other empty */
+int jsonp_array_splice(json_t *array, json_t *other);
 
 /* Wrappers for custom memory functions */
 void* jsonp_malloc(size_t size) JANSSON_ATTRS(warn_unused_result);
@@ -119,6 +256,46 @@ char *jsonp_strndup(const char *str, size_t length) JANSSON_ATTRS(warn_unused_re
 char *jsonp_strdup(const char *str) JANSSON_ATTRS(warn_unused_result);
 char *jsonp_strndup(const char *str, size_t len) JANSSON_ATTRS(warn_unused_result);
 
+/* Statistics of the calling thread, see json_get_stats(). Each
+   successful call of a public entry point adds its input or output
+   size and fires a USDT probe of the same name where sys/sdt.h is
+   available. Without JANSSON_STATS the arguments are not evaluated. */
+#ifdef JANSSON_STATS
+extern JSON_THREAD_LOCAL json_stats_t jsonp_stats;
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define jsonp_stats_probe(api, bytes) DTRACE_PROBE1(bosjansson, api, bytes)
+#else
+#define jsonp_stats_probe(api, bytes) ((void)0)
+#endif
+
+#define jsonp_stats_call(api, bytes)                \
+    do {                                            \
+        size_t stats_bytes_ = (bytes);              \
+        jsonp_stats.api##_calls++;                  \
+        jsonp_stats.api##_bytes += stats_bytes_;    \
+        jsonp_stats_probe(api, stats_bytes_);       \
+    } while(0)
+#else
+#define jsonp_stats_call(api, bytes) ((void)0)
+#endif
+
+/* Allocation of json_t nodes, cached per thread when pools are enabled.
+   The size must be the same when freeing. */
+void *jsonp_node_malloc(size_t size) JANSSON_ATTRS(warn_unused_result);
+void jsonp_node_free(void *ptr, size_t size);
+
+/* Arena allocation. A NULL arena uses jsonp_malloc and jsonp_free. */
+json_arena_t *jsonp_arena_current(void);
+json_arena_t *jsonp_arena_of(const json_t *json);
+void *jsonp_arena_malloc(json_arena_t *arena, size_t size) JANSSON_ATTRS(warn_unused_result);
+void jsonp_arena_free(json_arena_t *arena, void *ptr);
+char *jsonp_arena_strndup(json_arena_t *arena, const char *str, size_t len) JANSSON_ATTRS(warn_unused_result);
+void *jsonp_arena_node_malloc(json_arena_t *arena, size_t size) JANSSON_ATTRS(warn_unused_result);
+int jsonp_arena_adopt(json_arena_t *arena, json_t *json);
+int jsonp_arena_adopt_bytes(json_arena_t *arena, json_t *value);
+
 
 /* Windows compatibility */
 #if defined(_WIN32) || defined(WIN32)
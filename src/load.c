@@ -22,6 +22,7 @@
 #endif
 
 #include "bosjansson.h"
+#include "scan.h"
 #include "strbuffer.h"
 #include "utf.h"
 
@@ -51,8 +52,11 @@
    behaviour of fgetc(). */
 typedef int (*get_func)(void *data);
 
+/* Input is either read through a get function, or scanned directly
+   when it is contiguous in memory. Contiguous streams don't track the
+   line and column, they are computed from the position on errors. */
 typedef struct {
-    get_func get;
+    get_func get;  /* NULL for contiguous input */
     void *data;
     char buffer[5];
     size_t buffer_pos;
@@ -60,6 +64,12 @@ typedef struct {
     int line;
     int column, last_column;
     size_t position;
+
+    /* contiguous input */
+    const unsigned char *begin;
+    const unsigned char *pos;
+    const unsigned char *end;
+    const unsigned char *utf8_end;  /* end of the last checked UTF-8 sequence */
 } stream_t;
 
 typedef struct {
@@ -76,11 +86,22 @@ typedef struct {
         json_int_t integer;
         double real;
     } value;
+
+    /* decoded strings with LEX_SPANS */
+    char *spans;
+    size_t spans_size;
 } lex_t;
 
+/* private lexer flag: strings are left in the input where possible and
+   decoded into a buffer of the lexer otherwise, see json_sax_parse() */
+#define LEX_SPANS ((size_t)1 << (sizeof(size_t) * 8 - 1))
+
 #define stream_to_lex(stream) container_of(stream, lex_t, stream)
 
 
+static void stream_location(const stream_t *stream, int *line, int *column, size_t *position);
+
+
 /*** error reporting ***/
 
 static void error_set(json_error_t *error, const lex_t *lex,
@@ -107,9 +128,7 @@ static void error_set(json_error_t *error, const lex_t *lex,
     {
         const char *saved_text = strbuffer_value(&lex->saved_text);
 
-        line = lex->stream.line;
-        col = lex->stream.column;
-        pos = lex->stream.position;
+        stream_location(&lex->stream, &line, &col, &pos);
 
         if(saved_text && saved_text[0])
         {
@@ -157,6 +176,81 @@ stream_init(stream_t *stream, get_func get, void *data)
     stream->line = 1;
     stream->column = 0;
     stream->position = 0;
+
+    stream->begin = stream->pos = stream->end = stream->utf8_end = NULL;
+}
+
+static void
+stream_init_buffer(stream_t *stream, const char *data, size_t len)
+{
+    stream_init(stream, NULL, NULL);
+
+    stream->begin = stream->pos = stream->utf8_end = (const unsigned char *)data;
+    stream->end = stream->begin + len;
+}
+
+static size_t stream_position(const stream_t *stream)
+{
+    if(!stream->get)
+        return (size_t)(stream->pos - stream->begin);
+    return stream->position;
+}
+
+static void stream_location(const stream_t *stream, int *line, int *column, size_t *position)
+{
+    const unsigned char *p;
+
+    if(stream->get) {
+        *line = stream->line;
+        *column = stream->column;
+        *position = stream->position;
+        return;
+    }
+
+    /* count the same way stream_get() does for the other streams */
+    *line = 1;
+    *column = 0;
+    for(p = stream->begin; p < stream->pos; p++) {
+        if(*p == '\n') {
+            (*line)++;
+            *column = 0;
+        }
+        else if(utf8_check_first((char)*p))
+            (*column)++;
+    }
+    *position = (size_t)(stream->pos - stream->begin);
+}
+
+static int stream_get_buffer(stream_t *stream, json_error_t *error)
+{
+    const unsigned char *p = stream->pos;
+    int c;
+
+    if(p >= stream->end) {
+        stream->state = STREAM_STATE_EOF;
+        return STREAM_STATE_EOF;
+    }
+
+    if(*p >= 0x80 && p >= stream->utf8_end)
+    {
+        /* check a multi-byte UTF-8 sequence when reaching its first byte */
+        size_t count = utf8_check_first((char)*p);
+
+        if(!count || (size_t)(stream->end - p) < count ||
+           !utf8_check_full((const char *)p, count, NULL))
+        {
+            stream->state = STREAM_STATE_ERROR;
+            error_set(error, stream_to_lex(stream), json_error_invalid_utf8, "unable to decode byte 0x%x", *p);
+            return STREAM_STATE_ERROR;
+        }
+
+        stream->utf8_end = p + count;
+    }
+
+    /* same value as stream_get() returns for the byte */
+    c = (char)*p;
+    stream->pos = p + 1;
+    return c;
 }
 
 static int stream_get(stream_t *stream, json_error_t *error)
@@ -166,6 +260,9 @@ static int stream_get(stream_t *stream, json_error_t *error)
     if(stream->state != STREAM_STATE_OK)
         return stream->state;
 
+    if(!stream->get)
+        return stream_get_buffer(stream, error);
+
     if(!stream->buffer[stream->buffer_pos])
     {
         c = stream->get(stream->data);
@@ -227,6 +324,12 @@ static void stream_unget(stream_t *stream, int c)
     if(c == STREAM_STATE_EOF || c == STREAM_STATE_ERROR)
         return;
 
+    if(!stream->get) {
+        stream->pos--;
+        assert((char)*stream->pos == c);
+        return;
+    }
+
     stream->position--;
     if(c == '\n') {
         stream->line--;
@@ -285,6 +388,12 @@ static void lex_unget_unsave(lex_t *lex, int c)
 
 static void lex_save_cached(lex_t *lex)
 {
+    if(!lex->stream.get) {
+        while(lex->stream.pos < lex->stream.utf8_end)
+            lex_save(lex, *lex->stream.pos++);
+        return;
+    }
+
     while(lex->stream.buffer[lex->stream.buffer_pos] != '\0')
     {
         lex_save(lex, lex->stream.buffer[lex->stream.buffer_pos]);
@@ -295,7 +404,8 @@ static void lex_save_cached(lex_t *lex)
 
 static void lex_free_string(lex_t *lex)
 {
-    jsonp_free(lex->value.string.val);
+    if(!(lex->flags & LEX_SPANS))
+        jsonp_free(lex->value.string.val);
     lex->value.string.val = NULL;
     lex->value.string.len = 0;
 }
@@ -324,17 +434,95 @@ static int32_t decode_unicode_escape(const char *str)
     return value;
 }
 
+/* Scans a string of contiguous input up to and including the closing
+   quote, saving it in one go. Stops early at anything that needs an
+   error reported, the caller continues from there byte by byte.
+   Returns 1 if the whole string was scanned. */
+static int lex_scan_string_buffer(lex_t *lex, int *escaped)
+{
+    stream_t *stream = &lex->stream;
+    const unsigned char *start = stream->pos, *p = start, *end = stream->end;
+    int done = 0;
+
+    *escaped = 0;
+
+    while(p < end) {
+        unsigned char c;
+
+        /* skip runs of plain ASCII a block at a time */
+        p += scan_plain(p, (size_t)(end - p));
+        if(p == end)
+            break;
+
+        c = *p;
+        if(c == '"') {
+            p++;
+            done = 1;
+            break;
+        }
+
+        if(c <= 0x1F)
+            break;
+
+        if(c == '\\') {
+            if(end - p < 2)
+                break;
+
+            c = p[1];
+            if(c == 'u') {
+                if(end - p < 6 || !l_isxdigit(p[2]) || !l_isxdigit(p[3]) ||
+                   !l_isxdigit(p[4]) || !l_isxdigit(p[5]))
+                    break;
+                p += 6;
+            }
+            else if(c == '"' || c == '\\' || c == '/' || c == 'b' ||
+                    c == 'f' || c == 'n' || c == 'r' || c == 't')
+                p += 2;
+            else
+                break;
+
+            *escaped = 1;
+        }
+        else if(c >= 0x80) {
+            size_t count = utf8_check_first((char)c);
+
+            if(!count || (size_t)(end - p) < count ||
+               !utf8_check_full((const char *)p, count, NULL))
+                break;
+            p += count;
+        }
+    }
+
+    if(strbuffer_append_bytes(&lex->saved_text, (const char *)start, (size_t)(p - start)))
+        return -1;
+
+    stream->pos = p;
+    return done;
+}
+
 static void lex_scan_string(lex_t *lex, json_error_t *error)
 {
     int c;
     const char *p;
     char *t;
-    int i;
+    int i, escaped = 1;
 
     lex->value.string.val = NULL;
     lex->token = TOKEN_INVALID;
 
-    c = lex_get_save(lex, error);
+    c = 0;
+    if(!lex->stream.get) {
+        int result = lex_scan_string_buffer(lex, &escaped);
+        if(result < 0)
+            goto out;
+        if(result)
+            c = '"';
+        else
+            escaped = 1;
+    }
+
+    if(c != '"')
+        c = lex_get_save(lex, error);
 
     while(c != '"') {
         if(c == STREAM_STATE_ERROR)
@@ -386,16 +574,49 @@ static void lex_scan_string(lex_t *lex, json_error_t *error)
          - two \uXXXX escapes (length 12) forming an UTF-16 surrogate pair
            are converted to 4 bytes
     */
-    t = jsonp_malloc(lex->saved_text.length + 1);
-    if(!t) {
-        /* this is not very nice, since TOKEN_INVALID is returned */
-        goto out;
+    if(lex->flags & LEX_SPANS) {
+        if(!escaped) {
+            /* the text between the quotes, just scanned from the input */
+            lex->value.string.len = lex->saved_text.length - 2;
+            lex->value.string.val = (char *)lex->stream.pos - 1 - lex->value.string.len;
+            lex->token = TOKEN_STRING;
+            return;
+        }
+
+        if(lex->spans_size < lex->saved_text.length + 1) {
+            size_t size = max(lex->saved_text.length + 1, lex->spans_size * 2);
+
+            t = jsonp_malloc(size);
+            if(!t)
+                goto out;
+            jsonp_free(lex->spans);
+            lex->spans = t;
+            lex->spans_size = size;
+        }
+        t = lex->spans;
+    }
+    else {
+        t = jsonp_malloc(lex->saved_text.length + 1);
+        if(!t) {
+            /* this is not very nice, since TOKEN_INVALID is returned */
+            goto out;
+        }
     }
     lex->value.string.val = t;
 
     /* + 1 to skip the " */
     p = strbuffer_value(&lex->saved_text) + 1;
 
+    if(!escaped) {
+        /* nothing to decode, the value is the text between the quotes */
+        size_t len = lex->saved_text.length - 2;
+        memcpy(t, p, len);
+        t[len] = '\0';
+        lex->value.string.len = len;
+        lex->token = TOKEN_STRING;
+        return;
+    }
+
     while(*p != '"') {
         if(*p == '\\') {
             p++;
@@ -479,26 +700,79 @@ out:
     lex_free_string(lex);
 }
 
-#ifndef JANSSON_USING_CMAKE /* disabled if using cmake */
-#if JSON_INTEGER_IS_LONG_LONG
-#ifdef _MSC_VER  /* Microsoft Visual Studio */
-#define json_strtoint     _strtoi64
-#else
-#define json_strtoint     strtoll
-#endif
-#else
-#define json_strtoint     strtol
-#endif
-#endif
+/* returns the end of the well formed number at p in contiguous input,
+   or NULL to leave reporting the error to the byte-by-byte scan */
+static const unsigned char *lex_number_end(const unsigned char *p, const unsigned char *end, int *real)
+{
+    *real = 0;
+
+    if(p < end && *p == '-')
+        p++;
+
+    if(p < end && *p == '0') {
+        p++;
+        if(p < end && l_isdigit(*p))
+            return NULL;
+    }
+    else if(p < end && l_isdigit(*p)) {
+        do
+            p++;
+        while(p < end && l_isdigit(*p));
+    }
+    else
+        return NULL;
+
+    if(p < end && *p == '.') {
+        p++;
+        if(p == end || !l_isdigit(*p))
+            return NULL;
+
+        do
+            p++;
+        while(p < end && l_isdigit(*p));
+        *real = 1;
+    }
+
+    if(p < end && (*p == 'E' || *p == 'e')) {
+        p++;
+        if(p < end && (*p == '+' || *p == '-'))
+            p++;
+
+        if(p == end || !l_isdigit(*p))
+            return NULL;
+
+        do
+            p++;
+        while(p < end && l_isdigit(*p));
+        *real = 1;
+    }
+
+    return p;
+}
 
 static int lex_scan_number(lex_t *lex, int c, json_error_t *error)
 {
     const char *saved_text;
-    char *end;
     double doubleval;
+    int real = 1;
 
     lex->token = TOKEN_INVALID;
 
+    if(!lex->stream.get) {
+        /* the first character has already been read and saved */
+        stream_t *stream = &lex->stream;
+        const unsigned char *end = lex_number_end(stream->pos - 1, stream->end, &real);
+
+        if(end) {
+            if(strbuffer_append_bytes(&lex->saved_text, (const char *)stream->pos,
+                                      (size_t)(end - stream->pos)))
+                goto out;
+
+            stream->pos = end;
+            goto convert;
+        }
+    }
+
     if(c == '-')
         c = lex_get_save(lex, error);
 
@@ -519,31 +793,7 @@ static int lex_scan_number(lex_t *lex, int c, json_error_t *error)
         goto out;
     }
 
-    if(!(lex->flags & JSON_DECODE_INT_AS_REAL) &&
-       c != '.' && c != 'E' && c != 'e')
-    {
-        json_int_t intval;
-
-        lex_unget_unsave(lex, c);
-
-        saved_text = strbuffer_value(&lex->saved_text);
-
-        errno = 0;
-        intval = json_strtoint(saved_text, &end, 10);
-        if(errno == ERANGE) {
-            if(intval < 0)
-                error_set(error, lex, json_error_numeric_overflow, "too big negative integer");
-            else
-                error_set(error, lex, json_error_numeric_overflow, "too big integer");
-            goto out;
-        }
-
-        assert(end == saved_text + lex->saved_text.length);
-
-        lex->token = TOKEN_INTEGER;
-        lex->value.integer = intval;
-        return 0;
-    }
+    real = c == '.' || c == 'E' || c == 'e';
 
     if(c == '.') {
         c = lex_get(lex, error);
@@ -575,6 +825,25 @@ static int lex_scan_number(lex_t *lex, int c, json_error_t *error)
 
     lex_unget_unsave(lex, c);
 
+convert:
+    if(!real && !(lex->flags & JSON_DECODE_INT_AS_REAL)) {
+        json_int_t intval;
+
+        saved_text = strbuffer_value(&lex->saved_text);
+
+        if(jsonp_strtoint(saved_text, lex->saved_text.length, &intval)) {
+            if(intval < 0)
+                error_set(error, lex, json_error_numeric_overflow, "too big negative integer");
+            else
+                error_set(error, lex, json_error_numeric_overflow, "too big integer");
+            goto out;
+        }
+
+        lex->token = TOKEN_INTEGER;
+        lex->value.integer = intval;
+        return 0;
+    }
+
     if(jsonp_strtod(&lex->saved_text, &doubleval)) {
         error_set(error, lex, json_error_numeric_overflow, "real number overflow");
         goto out;
@@ -676,16 +945,71 @@ static int lex_init(lex_t *lex, get_func get, size_t flags, void *data)
 
     lex->flags = flags;
     lex->token = TOKEN_INVALID;
+    lex->spans = NULL;
+    lex->spans_size = 0;
+    return 0;
+}
+
+static int lex_init_buffer(lex_t *lex, const char *data, size_t len, size_t flags)
+{
+    stream_init_buffer(&lex->stream, data, len);
+    if(strbuffer_init(&lex->saved_text))
+        return -1;
+
+    lex->flags = flags;
+    lex->token = TOKEN_INVALID;
+    lex->spans = NULL;
+    lex->spans_size = 0;
     return 0;
 }
 
+/* reuses the lexer and its saved text buffer for new contiguous input */
+static void lex_reset_buffer(lex_t *lex, const char *data, size_t len, size_t flags)
+{
+    stream_init_buffer(&lex->stream, data, len);
+    strbuffer_clear(&lex->saved_text);
+
+    lex->flags = flags;
+    lex->token = TOKEN_INVALID;
+}
+
 static void lex_close(lex_t *lex)
 {
     if(lex->token == TOKEN_STRING)
         lex_free_string(lex);
+    jsonp_free(lex->spans);
     strbuffer_close(&lex->saved_text);
 }
 
+/* sets up the lexer kept in *lexer for new contiguous input, allocating
+   it on first use, see json_stream_t and json_loader_t */
+static lex_t *lex_reuse(void **lexer, const char *data, size_t len, size_t flags, json_error_t *error)
+{
+    lex_t *lex = *lexer;
+
+    if(!lex) {
+        lex = jsonp_malloc(sizeof(lex_t));
+        if(!lex || lex_init_buffer(lex, data, len, flags)) {
+            jsonp_free(lex);
+            error_set(error, NULL, json_error_out_of_memory, "out of memory");
+            return NULL;
+        }
+        *lexer = lex;
+    }
+    else
+        lex_reset_buffer(lex, data, len, flags);
+
+    return lex;
+}
+
+/* drops the last token but keeps the buffers for the next input */
+static void lex_release(lex_t *lex)
+{
+    if(lex->token == TOKEN_STRING)
+        lex_free_string(lex);
+    lex->token = TOKEN_INVALID;
+}
+
 
 /*** parser ***/
 
@@ -703,7 +1027,7 @@ static json_t *parse_object(lex_t *lex, size_t flags, json_error_t *error)
 
     while(1) {
         char *key;
-        size_t len;
+        size_t len, hash;
         json_t *value;
 
         if(lex->token != TOKEN_STRING) {
@@ -720,8 +1044,11 @@ static json_t *parse_object(lex_t *lex, size_t flags, json_error_t *error)
             goto error;
         }
 
+        /* hashed once for both the duplicate check and the insert */
+        hash = hashtable_hash(key, len);
+
         if(flags & JSON_REJECT_DUPLICATES) {
-            if(json_object_get(object, key)) {
+            if(jsonp_object_get_hashed(object, key, len, hash)) {
                 jsonp_free(key);
                 error_set(error, lex, json_error_duplicate_key, "duplicate object key");
                 goto error;
@@ -742,7 +1069,7 @@ static json_t *parse_object(lex_t *lex, size_t flags, json_error_t *error)
             goto error;
         }
 
-        if(json_object_set_new_nocheck(object, key, value)) {
+        if(jsonp_object_set_hashed_new(object, key, len, hash, value)) {
             jsonp_free(key);
             goto error;
         }
@@ -909,37 +1236,17 @@ static json_t *parse_json(lex_t *lex, size_t flags, json_error_t *error)
 
     if(error) {
         /* Save the position even though there was no error */
-        error->position = (int)lex->stream.position;
+        error->position = (int)stream_position(&lex->stream);
     }
 
+    jsonp_stats_call(load, stream_position(&lex->stream));
     return result;
 }
 
-typedef struct
-{
-    const char *data;
-    size_t pos;
-} string_data_t;
-
-static int string_get(void *data)
-{
-    char c;
-    string_data_t *stream = (string_data_t *)data;
-    c = stream->data[stream->pos];
-    if(c == '\0')
-        return EOF;
-    else
-    {
-        stream->pos++;
-        return (unsigned char)c;
-    }
-}
-
 json_t *json_loads(const char *string, size_t flags, json_error_t *error)
 {
     lex_t lex;
     json_t *result;
-    string_data_t stream_data;
 
     jsonp_error_init(error, "<string>");
 
@@ -948,10 +1255,7 @@ json_t *json_loads(const char *string, size_t flags, json_error_t *error)
         return NULL;
     }
 
-    stream_data.data = string;
-    stream_data.pos = 0;
-
-    if(lex_init(&lex, string_get, flags, (void *)&stream_data))
+    if(lex_init_buffer(&lex, string, strlen(string), flags))
         return NULL;
 
     result = parse_json(&lex, flags, error);
@@ -960,30 +1264,10 @@ json_t *json_loads(const char *string, size_t flags, json_error_t *error)
     return result;
 }
 
-typedef struct
-{
-    const char *data;
-    size_t len;
-    size_t pos;
-} buffer_data_t;
-
-static int buffer_get(void *data)
-{
-    char c;
-    buffer_data_t *stream = data;
-    if(stream->pos >= stream->len)
-      return EOF;
-
-    c = stream->data[stream->pos];
-    stream->pos++;
-    return (unsigned char)c;
-}
-
 json_t *json_loadb(const char *buffer, size_t buflen, size_t flags, json_error_t *error)
 {
     lex_t lex;
     json_t *result;
-    buffer_data_t stream_data;
 
     jsonp_error_init(error, "<buffer>");
 
@@ -992,11 +1276,7 @@ json_t *json_loadb(const char *buffer, size_t buflen, size_t flags, json_error_t
         return NULL;
     }
 
-    stream_data.data = buffer;
-    stream_data.pos = 0;
-    stream_data.len = buflen;
-
-    if(lex_init(&lex, buffer_get, flags, (void *)&stream_data))
+    if(lex_init_buffer(&lex, buffer, buflen, flags))
         return NULL;
 
     result = parse_json(&lex, flags, error);
@@ -1005,6 +1285,62 @@ json_t *json_loadb(const char *buffer, size_t buflen, size_t flags, json_error_t
     return result;
 }
 
+int json_loadb_many(const char *buffer, size_t buflen, size_t flags, json_t **values, size_t count,
+                    json_error_t *error)
+{
+    lex_t lex;
+    size_t n = 0, end = 0;
+
+    jsonp_error_init(error, "<buffer>");
+
+    if(buffer == NULL || (count && values == NULL)) {
+        error_set(error, NULL, json_error_invalid_argument, "wrong arguments");
+        return -1;
+    }
+
+    /* one lexer for all of the values */
+    if(lex_init_buffer(&lex, buffer, buflen, flags))
+        return -1;
+
+    lex.depth = 0;
+    lex_scan(&lex, error);
+
+    while(n < count && lex.token != TOKEN_EOF) {
+        if(!(flags & JSON_DECODE_ANY)) {
+            if(lex.token != '[' && lex.token != '{') {
+                error_set(error, &lex, json_error_invalid_syntax, "'[' or '{' expected");
+                goto error;
+            }
+        }
+
+        values[n] = parse_value(&lex, flags, error);
+        if(!values[n])
+            goto error;
+        n++;
+
+        /* the rest is left for the next call once values is full */
+        end = stream_position(&lex.stream);
+        if(n < count)
+            lex_scan(&lex, error);
+    }
+
+    if(lex.token == TOKEN_EOF)
+        end = stream_position(&lex.stream);
+
+    if(error)
+        error->position = (int)end;
+
+    jsonp_stats_call(load, end);
+    lex_close(&lex);
+    return (int)n;
+
+error:
+    while(n > 0)
+        json_decref(values[--n]);
+    lex_close(&lex);
+    return -1;
+}
+
 json_t *json_loadf(FILE *input, size_t flags, json_error_t *error)
 {
     lex_t lex;
@@ -1099,10 +1435,39 @@ json_t *json_load_file(const char *path, size_t flags, json_error_t *error)
 
 #define MAX_BUF_LEN 1024
 
-typedef struct
+json_t *json_load_file_mmap(const char *path, size_t flags, json_error_t *error)
 {
-    char data[MAX_BUF_LEN];
-    size_t len;
+    bos_file_t file;
+    lex_t lex;
+    json_t *result;
+
+    jsonp_error_init(error, path);
+
+    if (path == NULL) {
+        error_set(error, NULL, json_error_invalid_argument, "wrong arguments");
+        return NULL;
+    }
+
+    /* the mapped file is contiguous input for the fast lexer paths */
+    if(jsonp_file_open(&file, path, 1, error))
+        return NULL;
+
+    if(lex_init_buffer(&lex, file.data, file.size, flags)) {
+        bos_file_close(&file);
+        return NULL;
+    }
+
+    result = parse_json(&lex, flags, error);
+
+    lex_close(&lex);
+    bos_file_close(&file);
+    return result;
+}
+
+typedef struct
+{
+    char data[MAX_BUF_LEN];
+    size_t len;
     size_t pos;
     json_load_callback_t callback;
     void *arg;
@@ -1151,3 +1516,1136 @@ json_t *json_load_callback(json_load_callback_t callback, void *arg, size_t flag
     lex_close(&lex);
     return result;
 }
+
+
+/*** transcoding ***/
+
+/* The parser above without the tree: values go to the BOS writer as the
+   lexer produces them. Errors of the writer are reported at the current
+   position of the lexer. */
+
+typedef struct {
+    lex_t lex;
+    bos_writer_t *writer;
+    json_error_t local;     /* errors of the writer */
+} transcoder_t;
+
+static int transcode_value(transcoder_t *t, size_t flags, json_error_t *error);
+
+static int writer_error(transcoder_t *t, json_error_t *error)
+{
+    error_set(error, &t->lex, json_error_code(&t->local), "%s", t->local.text);
+    return -1;
+}
+
+static int transcode_object(transcoder_t *t, size_t flags, json_error_t *error)
+{
+    hashtable_t seen;
+    size_t mark, count = 0;
+    int result = -1;
+
+    if(!jsonp_bos_open(t->writer, 1, &mark, &t->local))
+        return writer_error(t, error);
+
+    /* only the keys are kept, to find duplicates */
+    if((flags & JSON_REJECT_DUPLICATES) && hashtable_init(&seen, NULL))
+        return -1;
+
+    lex_scan(&t->lex, error);
+    if(t->lex.token == '}')
+        goto close;
+
+    while(1) {
+        const char *key;
+        size_t len;
+
+        if(t->lex.token != TOKEN_STRING) {
+            error_set(error, &t->lex, json_error_invalid_syntax, "string or '}' expected");
+            goto out;
+        }
+
+        key = t->lex.value.string.val;
+        len = t->lex.value.string.len;
+        if(memchr(key, '\0', len)) {
+            error_set(error, &t->lex, json_error_null_byte_in_key, "NUL byte in object key not supported");
+            goto out;
+        }
+
+        if(flags & JSON_REJECT_DUPLICATES) {
+            size_t hash = hashtable_hash(key, len);
+
+            if(hashtable_getn(&seen, key, len, hash)) {
+                error_set(error, &t->lex, json_error_duplicate_key, "duplicate object key");
+                goto out;
+            }
+            if(hashtable_setn(&seen, key, len, hash, json_null()))
+                goto out;
+        }
+
+        if(!jsonp_bos_key(t->writer, key, len, &t->local)) {
+            writer_error(t, error);
+            goto out;
+        }
+
+        lex_scan(&t->lex, error);
+        if(t->lex.token != ':') {
+            error_set(error, &t->lex, json_error_invalid_syntax, "':' expected");
+            goto out;
+        }
+
+        lex_scan(&t->lex, error);
+        if(transcode_value(t, flags, error))
+            goto out;
+        count++;
+
+        lex_scan(&t->lex, error);
+        if(t->lex.token != ',')
+            break;
+
+        lex_scan(&t->lex, error);
+    }
+
+    if(t->lex.token != '}') {
+        error_set(error, &t->lex, json_error_invalid_syntax, "'}' expected");
+        goto out;
+    }
+
+close:
+    if(!jsonp_bos_close(t->writer, mark, count, &t->local)) {
+        writer_error(t, error);
+        goto out;
+    }
+    result = 0;
+
+out:
+    if(flags & JSON_REJECT_DUPLICATES)
+        hashtable_close(&seen);
+    return result;
+}
+
+static int transcode_array(transcoder_t *t, size_t flags, json_error_t *error)
+{
+    size_t mark, count = 0;
+
+    if(!jsonp_bos_open(t->writer, 0, &mark, &t->local))
+        return writer_error(t, error);
+
+    lex_scan(&t->lex, error);
+    if(t->lex.token != ']') {
+        while(t->lex.token) {
+            if(transcode_value(t, flags, error))
+                return -1;
+            count++;
+
+            lex_scan(&t->lex, error);
+            if(t->lex.token != ',')
+                break;
+
+            lex_scan(&t->lex, error);
+        }
+
+        if(t->lex.token != ']') {
+            error_set(error, &t->lex, json_error_invalid_syntax, "']' expected");
+            return -1;
+        }
+    }
+
+    if(!jsonp_bos_close(t->writer, mark, count, &t->local))
+        return writer_error(t, error);
+    return 0;
+}
+
+static int transcode_value(transcoder_t *t, size_t flags, json_error_t *error)
+{
+    int written;
+
+
+    t->lex.depth++;
+    if(t->lex.depth > JSON_PARSER_MAX_DEPTH) {
+        error_set(error, &t->lex, json_error_stack_overflow, "maximum parsing depth reached");
+        return -1;
+    }
+
+    switch(t->lex.token) {
+        case TOKEN_STRING: {
+            const char *value = t->lex.value.string.val;
+            size_t len = t->lex.value.string.len;
+
+            if(!(flags & JSON_ALLOW_NUL)) {
+                if(memchr(value, '\0', len)) {
+                    error_set(error, &t->lex, json_error_null_character, "\\u0000 is not allowed without JSON_ALLOW_NUL");
+                    return -1;
+                }
+            }
+
+            written = jsonp_bos_string(t->writer, value, len, &t->local);
+            break;
+        }
+
+        case TOKEN_INTEGER:
+            written = jsonp_bos_integer(t->writer, t->lex.value.integer, &t->local);
+            break;
+
+        case TOKEN_REAL:
+            written = jsonp_bos_real(t->writer, t->lex.value.real, &t->local);
+            break;
+
+        case TOKEN_TRUE:
+            written = jsonp_bos_boolean(t->writer, 1, &t->local);
+            break;
+
+        case TOKEN_FALSE:
+            written = jsonp_bos_boolean(t->writer, 0, &t->local);
+            break;
+
+        case TOKEN_NULL:
+            written = jsonp_bos_null(t->writer, &t->local);
+            break;
+
+        case '{':
+            if(transcode_object(t, flags, error))
+                return -1;
+            written = 1;
+            break;
+
+        case '[':
+            if(transcode_array(t, flags, error))
+                return -1;
+            written = 1;
+            break;
+
+        case TOKEN_INVALID:
+            error_set(error, &t->lex, json_error_invalid_syntax, "invalid token");
+            return -1;
+
+        default:
+            error_set(error, &t->lex, json_error_invalid_syntax, "unexpected token");
+            return -1;
+    }
+
+    if(!written)
+        return writer_error(t, error);
+
+    t->lex.depth--;
+    return 0;
+}
+
+int json_text_to_bos(bos_writer_t *writer, const char *buffer, size_t buflen, size_t flags, json_error_t *error)
+{
+    transcoder_t t;
+    size_t start;
+    int result = -1;
+
+    jsonp_error_init(error, "<buffer>");
+
+    if(writer == NULL || buffer == NULL) {
+        error_set(error, NULL, json_error_invalid_argument, "wrong arguments");
+        return -1;
+    }
+
+    t.writer = writer;
+    jsonp_error_init(&t.local, NULL);
+
+    if(!jsonp_bos_begin(writer, &start, &t.local)) {
+        error_set(error, NULL, json_error_code(&t.local), "%s", t.local.text);
+        return -1;
+    }
+
+    if(lex_init_buffer(&t.lex, buffer, buflen, flags)) {
+        writer->size = start;
+        return -1;
+    }
+
+    t.lex.depth = 0;
+
+    lex_scan(&t.lex, error);
+    if(!(flags & JSON_DECODE_ANY)) {
+        if(t.lex.token != '[' && t.lex.token != '{') {
+            error_set(error, &t.lex, json_error_invalid_syntax, "'[' or '{' expected");
+            goto out;
+        }
+    }
+
+    if(transcode_value(&t, flags, error))
+        goto out;
+
+    if(!(flags & JSON_DISABLE_EOF_CHECK)) {
+        lex_scan(&t.lex, error);
+        if(t.lex.token != TOKEN_EOF) {
+            error_set(error, &t.lex, json_error_end_of_input_expected, "end of file expected");
+            goto out;
+        }
+    }
+
+    if(!jsonp_bos_end(writer, start, &t.local)) {
+        writer_error(&t, error);
+        goto out;
+    }
+
+    if(error) {
+        /* Save the position even though there was no error */
+        error->position = (int)stream_position(&t.lex.stream);
+    }
+
+    result = 0;
+
+out:
+    /* discard the partially written frame */
+    if(result)
+        writer->size = start;
+
+    lex_close(&t.lex);
+    return result;
+}
+
+
+/*** event parsing ***/
+
+/* Like the parser, but each value is handed to the callbacks of a
+   json_sax_t instead of being added to a tree. A subtree that is being
+   skipped is still checked, only the callbacks are left out. */
+
+#define SAX_ERROR   -1
+#define SAX_STOPPED -2
+
+typedef struct {
+    lex_t lex;
+    const json_sax_t *sax;
+    void *data;
+} sax_parser_t;
+
+static int sax_value(sax_parser_t *s, size_t flags, int quiet, json_error_t *error);
+
+/* returns JSON_SAX_CONTINUE, JSON_SAX_SKIP or SAX_STOPPED */
+static JSON_INLINE int sax_result(int result)
+{
+    if(result == JSON_SAX_CONTINUE || result == JSON_SAX_SKIP)
+        return result;
+    return SAX_STOPPED;
+}
+
+static int sax_object(sax_parser_t *s, size_t flags, int quiet, json_error_t *error)
+{
+    const json_sax_t *sax = s->sax;
+    hashtable_t seen;
+    int result = SAX_ERROR, skip;
+
+    if((flags & JSON_REJECT_DUPLICATES) && hashtable_init(&seen, NULL))
+        return SAX_ERROR;
+
+    lex_scan(&s->lex, error);
+    if(s->lex.token == '}')
+        goto close;
+
+    while(1) {
+        const char *key;
+        size_t len;
+
+        if(s->lex.token != TOKEN_STRING) {
+            error_set(error, &s->lex, json_error_invalid_syntax, "string or '}' expected");
+            goto out;
+        }
+
+        key = s->lex.value.string.val;
+        len = s->lex.value.string.len;
+        if(memchr(key, '\0', len)) {
+            error_set(error, &s->lex, json_error_null_byte_in_key, "NUL byte in object key not supported");
+            goto out;
+        }
+
+        if(flags & JSON_REJECT_DUPLICATES) {
+            size_t hash = hashtable_hash(key, len);
+
+            if(hashtable_getn(&seen, key, len, hash)) {
+                error_set(error, &s->lex, json_error_duplicate_key, "duplicate object key");
+                goto out;
+            }
+            if(hashtable_setn(&seen, key, len, hash, json_null()))
+                goto out;
+        }
+
+        skip = quiet || !sax->key ? JSON_SAX_CONTINUE : sax_result(sax->key(s->data, key, len));
+        if(skip == SAX_STOPPED) {
+            result = SAX_STOPPED;
+            goto out;
+        }
+
+        lex_scan(&s->lex, error);
+        if(s->lex.token != ':') {
+            error_set(error, &s->lex, json_error_invalid_syntax, "':' expected");
+            goto out;
+        }
+
+        lex_scan(&s->lex, error);
+        result = sax_value(s, flags, quiet || skip == JSON_SAX_SKIP, error);
+        if(result < 0)
+            goto out;
+        result = SAX_ERROR;
+
+        lex_scan(&s->lex, error);
+        if(s->lex.token != ',')
+            break;
+
+        lex_scan(&s->lex, error);
+    }
+
+    if(s->lex.token != '}') {
+        error_set(error, &s->lex, json_error_invalid_syntax, "'}' expected");
+        goto out;
+    }
+
+close:
+    result = quiet || !sax->end_object ? 0 : sax_result(sax->end_object(s->data));
+    if(result == JSON_SAX_SKIP)
+        result = 0;
+
+out:
+    if(flags & JSON_REJECT_DUPLICATES)
+        hashtable_close(&seen);
+    return result;
+}
+
+static int sax_array(sax_parser_t *s, size_t flags, int quiet, json_error_t *error)
+{
+    const json_sax_t *sax = s->sax;
+    int result;
+
+    lex_scan(&s->lex, error);
+    if(s->lex.token != ']') {
+        while(s->lex.token) {
+            result = sax_value(s, flags, quiet, error);
+            if(result < 0)
+                return result;
+
+            lex_scan(&s->lex, error);
+            if(s->lex.token != ',')
+                break;
+
+            lex_scan(&s->lex, error);
+        }
+
+        if(s->lex.token != ']') {
+            error_set(error, &s->lex, json_error_invalid_syntax, "']' expected");
+            return SAX_ERROR;
+        }
+    }
+
+    result = quiet || !sax->end_array ? 0 : sax_result(sax->end_array(s->data));
+    return result == SAX_STOPPED ? SAX_STOPPED : 0;
+}
+
+static int sax_value(sax_parser_t *s, size_t flags, int quiet, json_error_t *error)
+{
+    const json_sax_t *sax = s->sax;
+    int result = JSON_SAX_CONTINUE;
+
+    s->lex.depth++;
+    if(s->lex.depth > JSON_PARSER_MAX_DEPTH) {
+        error_set(error, &s->lex, json_error_stack_overflow, "maximum parsing depth reached");
+        return SAX_ERROR;
+    }
+
+    switch(s->lex.token) {
+        case TOKEN_STRING: {
+            const char *value = s->lex.value.string.val;
+            size_t len = s->lex.value.string.len;
+
+            if(!(flags & JSON_ALLOW_NUL)) {
+                if(memchr(value, '\0', len)) {
+                    error_set(error, &s->lex, json_error_null_character, "\\u0000 is not allowed without JSON_ALLOW_NUL");
+                    return SAX_ERROR;
+                }
+            }
+
+            if(!quiet && sax->string)
+                result = sax_result(sax->string(s->data, value, len));
+            break;
+        }
+
+        case TOKEN_INTEGER:
+            if(!quiet && sax->integer)
+                result = sax_result(sax->integer(s->data, s->lex.value.integer));
+            break;
+
+        case TOKEN_REAL:
+            if(!quiet && sax->real)
+                result = sax_result(sax->real(s->data, s->lex.value.real));
+            break;
+
+        case TOKEN_TRUE:
+        case TOKEN_FALSE:
+            if(!quiet && sax->boolean)
+                result = sax_result(sax->boolean(s->data, s->lex.token == TOKEN_TRUE));
+            break;
+
+        case TOKEN_NULL:
+            if(!quiet && sax->null)
+                result = sax_result(sax->null(s->data));
+            break;
+
+        case '{':
+            if(!quiet && sax->start_object)
+                result = sax_result(sax->start_object(s->data));
+            if(result != SAX_STOPPED)
+                result = sax_object(s, flags, quiet || result == JSON_SAX_SKIP, error);
+            break;
+
+        case '[':
+            if(!quiet && sax->start_array)
+                result = sax_result(sax->start_array(s->data));
+            if(result != SAX_STOPPED)
+                result = sax_array(s, flags, quiet || result == JSON_SAX_SKIP, error);
+            break;
+
+        case TOKEN_INVALID:
+            error_set(error, &s->lex, json_error_invalid_syntax, "invalid token");
+            return SAX_ERROR;
+
+        default:
+            error_set(error, &s->lex, json_error_invalid_syntax, "unexpected token");
+            return SAX_ERROR;
+    }
+
+    if(result < 0)
+        return result;
+
+    s->lex.depth--;
+    return 0;
+}
+
+int json_sax_parse(const char *buffer, size_t buflen, size_t flags, const json_sax_t *sax, void *data,
+                   json_error_t *error)
+{
+    sax_parser_t s;
+    int result = -1;
+
+    jsonp_error_init(error, "<buffer>");
+
+    if(buffer == NULL || sax == NULL) {
+        error_set(error, NULL, json_error_invalid_argument, "wrong arguments");
+        return -1;
+    }
+
+    if(lex_init_buffer(&s.lex, buffer, buflen, flags | LEX_SPANS))
+        return -1;
+
+    s.sax = sax;
+    s.data = data;
+    s.lex.depth = 0;
+
+    lex_scan(&s.lex, error);
+    if(!(flags & JSON_DECODE_ANY)) {
+        if(s.lex.token != '[' && s.lex.token != '{') {
+            error_set(error, &s.lex, json_error_invalid_syntax, "'[' or '{' expected");
+            goto out;
+        }
+    }
+
+    result = sax_value(&s, flags, 0, error);
+    if(result == SAX_ERROR)
+        goto out;
+
+    if(result == SAX_STOPPED)
+        result = 1;
+    else if(!(flags & JSON_DISABLE_EOF_CHECK)) {
+        lex_scan(&s.lex, error);
+        if(s.lex.token != TOKEN_EOF) {
+            error_set(error, &s.lex, json_error_end_of_input_expected, "end of file expected");
+            result = -1;
+            goto out;
+        }
+    }
+
+    if(error) {
+        /* Save the position, also where a callback stopped */
+        error->position = (int)stream_position(&s.lex.stream);
+    }
+
+out:
+    lex_close(&s.lex);
+    return result;
+}
+
+
+/*** selective decoding ***/
+
+/* Walks down the paths that match the current position and decodes
+   the values they end at. Everything else is skipped like an ignored
+   subtree of json_sax_parse(). */
+
+#define SELECT_INLINE_PATHS 8
+
+static int select_value(sax_parser_t *s, size_t flags, const char *const *paths,
+                        const jsonp_select_t *selected, size_t count, json_t **values,
+                        json_error_t *error);
+
+static json_t *select_parse(sax_parser_t *s, size_t flags, json_error_t *error)
+{
+    json_t *json;
+
+    /* the string is a span of the input or of the lexer's buffer */
+    if(s->lex.token == TOKEN_STRING) {
+        const char *value = s->lex.value.string.val;
+        size_t len = s->lex.value.string.len;
+
+        if(!(flags & JSON_ALLOW_NUL) && memchr(value, '\0', len)) {
+            error_set(error, &s->lex, json_error_null_character, "\\u0000 is not allowed without JSON_ALLOW_NUL");
+            return NULL;
+        }
+
+        json = json_stringn_nocheck(value, len);
+        if(!json)
+            error_set(error, &s->lex, json_error_out_of_memory, "out of memory");
+        return json;
+    }
+
+    /* the tree parser owns the strings it scans; on error the flag stays
+       off so that lex_close() frees the last one */
+    s->lex.flags &= ~LEX_SPANS;
+    json = parse_value(&s->lex, flags, error);
+    if(json)
+        s->lex.flags |= LEX_SPANS;
+    return json;
+}
+
+static int select_object(sax_parser_t *s, size_t flags, const char *const *paths,
+                         const jsonp_select_t *selected, size_t count, json_t **values,
+                         json_error_t *error)
+{
+    jsonp_select_t inline_next[SELECT_INLINE_PATHS], *next = inline_next;
+    hashtable_t seen;
+    int result = -1, found = 0;
+
+    if(count > SELECT_INLINE_PATHS) {
+        next = jsonp_malloc(count * sizeof(jsonp_select_t));
+        if(!next)
+            return -1;
+    }
+
+    if((flags & JSON_REJECT_DUPLICATES) && hashtable_init(&seen, NULL)) {
+        if(next != inline_next)
+            jsonp_free(next);
+        return -1;
+    }
+
+    lex_scan(&s->lex, error);
+    if(s->lex.token == '}')
+        goto close;
+
+    while(1) {
+        const char *key;
+        size_t len, n;
+
+        if(s->lex.token != TOKEN_STRING) {
+            error_set(error, &s->lex, json_error_invalid_syntax, "string or '}' expected");
+            goto out;
+        }
+
+        key = s->lex.value.string.val;
+        len = s->lex.value.string.len;
+        if(memchr(key, '\0', len)) {
+            error_set(error, &s->lex, json_error_null_byte_in_key, "NUL byte in object key not supported");
+            goto out;
+        }
+
+        if(flags & JSON_REJECT_DUPLICATES) {
+            size_t hash = hashtable_hash(key, len);
+
+            if(hashtable_getn(&seen, key, len, hash)) {
+                error_set(error, &s->lex, json_error_duplicate_key, "duplicate object key");
+                goto out;
+            }
+            if(hashtable_setn(&seen, key, len, hash, json_null()))
+                goto out;
+        }
+
+        n = jsonp_select_key(paths, selected, count, key, len, next);
+
+        lex_scan(&s->lex, error);
+        if(s->lex.token != ':') {
+            error_set(error, &s->lex, json_error_invalid_syntax, "':' expected");
+            goto out;
+        }
+
+        lex_scan(&s->lex, error);
+        result = select_value(s, flags, paths, next, n, values, error);
+        if(result < 0)
+            goto out;
+        found += result;
+        result = -1;
+
+        lex_scan(&s->lex, error);
+        if(s->lex.token != ',')
+            break;
+
+        lex_scan(&s->lex, error);
+    }
+
+    if(s->lex.token != '}') {
+        error_set(error, &s->lex, json_error_invalid_syntax, "'}' expected");
+        goto out;
+    }
+
+close:
+    result = found;
+
+out:
+    if(flags & JSON_REJECT_DUPLICATES)
+        hashtable_close(&seen);
+    if(next != inline_next)
+        jsonp_free(next);
+    return result;
+}
+
+static int select_array(sax_parser_t *s, size_t flags, const char *const *paths,
+                        const jsonp_select_t *selected, size_t count, json_t **values,
+                        json_error_t *error)
+{
+    jsonp_select_t inline_next[SELECT_INLINE_PATHS], *next = inline_next;
+    size_t index = 0;
+    int result = -1, found = 0;
+
+    if(count > SELECT_INLINE_PATHS) {
+        next = jsonp_malloc(count * sizeof(jsonp_select_t));
+        if(!next)
+            return -1;
+    }
+
+    lex_scan(&s->lex, error);
+    if(s->lex.token == ']')
+        goto close;
+
+    while(s->lex.token) {
+        size_t n = jsonp_select_index(paths, selected, count, index++, next);
+
+        result = select_value(s, flags, paths, next, n, values, error);
+        if(result < 0)
+            goto out;
+        found += result;
+        result = -1;
+
+        lex_scan(&s->lex, error);
+        if(s->lex.token != ',')
+            break;
+
+        lex_scan(&s->lex, error);
+    }
+
+    if(s->lex.token != ']') {
+        error_set(error, &s->lex, json_error_invalid_syntax, "']' expected");
+        goto out;
+    }
+
+close:
+    result = found;
+
+out:
+    if(next != inline_next)
+        jsonp_free(next);
+    return result;
+}
+
+static int select_value(sax_parser_t *s, size_t flags, const char *const *paths,
+                        const jsonp_select_t *selected, size_t count, json_t **values,
+                        json_error_t *error)
+{
+    int result;
+
+    /* nothing below here was asked for */
+    if(!count)
+        return sax_value(s, flags, 1, error) ? -1 : 0;
+
+    if(jsonp_select_found(paths, selected, count)) {
+        json_t *json = select_parse(s, flags, error);
+        if(!json)
+            return -1;
+        return jsonp_select_store(paths, selected, count, json, values);
+    }
+
+    if(s->lex.token != '{' && s->lex.token != '[')
+        return sax_value(s, flags, 1, error) ? -1 : 0;
+
+    s->lex.depth++;
+    if(s->lex.depth > JSON_PARSER_MAX_DEPTH) {
+        error_set(error, &s->lex, json_error_stack_overflow, "maximum parsing depth reached");
+        return -1;
+    }
+
+    if(s->lex.token == '{')
+        result = select_object(s, flags, paths, selected, count, values, error);
+    else
+        result = select_array(s, flags, paths, selected, count, values, error);
+
+    s->lex.depth--;
+    return result;
+}
+
+int json_loadb_select(const char *buffer, size_t buflen, size_t flags, const char *const *paths, size_t count,
+                      json_t **values, json_error_t *error)
+{
+    jsonp_select_t inline_selected[SELECT_INLINE_PATHS], *selected = inline_selected;
+    sax_parser_t s;
+    int result = -1;
+
+    jsonp_error_init(error, "<buffer>");
+
+    if(buffer == NULL || (count && (paths == NULL || values == NULL))) {
+        error_set(error, NULL, json_error_invalid_argument, "wrong arguments");
+        return -1;
+    }
+
+    if(count > SELECT_INLINE_PATHS) {
+        selected = jsonp_malloc(count * sizeof(jsonp_select_t));
+        if(!selected) {
+            error_set(error, NULL, json_error_out_of_memory, "out of memory");
+            return -1;
+        }
+    }
+
+    if(jsonp_select_init(paths, count, values, selected)) {
+        error_set(error, NULL, json_error_invalid_argument, "invalid path");
+        goto free;
+    }
+
+    if(lex_init_buffer(&s.lex, buffer, buflen, flags | LEX_SPANS))
+        goto free;
+
+    s.sax = NULL;
+    s.data = NULL;
+    s.lex.depth = 0;
+
+    lex_scan(&s.lex, error);
+    if(!(flags & JSON_DECODE_ANY)) {
+        if(s.lex.token != '[' && s.lex.token != '{') {
+            error_set(error, &s.lex, json_error_invalid_syntax, "'[' or '{' expected");
+            goto out;
+        }
+    }
+
+    result = select_value(&s, flags, paths, selected, count, values, error);
+    if(result < 0)
+        goto out;
+
+    if(!(flags & JSON_DISABLE_EOF_CHECK)) {
+        lex_scan(&s.lex, error);
+        if(s.lex.token != TOKEN_EOF) {
+            error_set(error, &s.lex, json_error_end_of_input_expected, "end of file expected");
+            result = -1;
+            goto out;
+        }
+    }
+
+    if(error) {
+        /* Save the position even though there was no error */
+        error->position = (int)stream_position(&s.lex.stream);
+    }
+
+out:
+    if(result < 0)
+        jsonp_select_clear(values, count);
+    lex_close(&s.lex);
+
+free:
+    if(selected != inline_selected)
+        jsonp_free(selected);
+    return result;
+}
+
+
+/*** push parsing ***/
+
+/* The end of each value is found as its bytes arrive, so no byte is
+   scanned twice. Complete values are parsed with a lexer kept in the
+   stream; values that lie within the caller's chunk are parsed in
+   place and the others are assembled in the stream buffer. */
+
+#define JSON_STREAM_DEFAULT_SIZE 1024
+
+/* where the scan of the current value stopped */
+#define STREAM_SCAN_IDLE    0   /* before a value */
+#define STREAM_SCAN_VALUE   1   /* in an array or object */
+#define STREAM_SCAN_STRING  2
+#define STREAM_SCAN_ESCAPE  3   /* after a backslash in a string */
+#define STREAM_SCAN_SCALAR  4   /* in a number or literal outside any array or object */
+
+#define STREAM_SPACE(c) ((c) == ' ' || (c) == '\t' || (c) == '\n' || (c) == '\r')
+#define STREAM_DELIMITER(c) (STREAM_SPACE(c) || (c) == '{' || (c) == '}' || (c) == '[' || \
+                             (c) == ']' || (c) == ',' || (c) == ':' || (c) == '"')
+
+/* Scans up to length bytes of the current value. Returns 1 and the bytes
+   up to the end of the value in used once it is complete, 0 otherwise. */
+static int stream_scan(json_stream_t *stream, const unsigned char *p, size_t length, size_t *used)
+{
+    const unsigned char *start = p, *end = p + length;
+    unsigned char c;
+
+    while(p < end) {
+        switch(stream->state) {
+            case STREAM_SCAN_IDLE:
+                c = *p++;
+                if(c == '{' || c == '[') {
+                    stream->depth = 1;
+                    stream->state = STREAM_SCAN_VALUE;
+                }
+                else if(c == '"')
+                    stream->state = STREAM_SCAN_STRING;
+                else if(STREAM_DELIMITER(c)) {
+                    /* left for the parser to reject */
+                    *used = (size_t)(p - start);
+                    return 1;
+                }
+                else
+                    stream->state = STREAM_SCAN_SCALAR;
+                break;
+
+            case STREAM_SCAN_VALUE:
+                /* numbers, literals and punctuation need no state */
+                while(p < end && *p != '"' && *p != '{' && *p != '}' && *p != '[' && *p != ']')
+                    p++;
+                if(p == end)
+                    break;
+
+                c = *p++;
+                if(c == '"')
+                    stream->state = STREAM_SCAN_STRING;
+                else if(c == '{' || c == '[')
+                    stream->depth++;
+                else if((c == '}' || c == ']') && !--stream->depth) {
+                    stream->state = STREAM_SCAN_IDLE;
+                    *used = (size_t)(p - start);
+                    return 1;
+                }
+                break;
+
+            case STREAM_SCAN_STRING:
+                p += scan_plain(p, (size_t)(end - p));
+                if(p == end)
+                    break;
+
+                c = *p++;
+                if(c == '\\')
+                    stream->state = STREAM_SCAN_ESCAPE;
+                else if(c == '"') {
+                    stream->state = stream->depth ? STREAM_SCAN_VALUE : STREAM_SCAN_IDLE;
+                    if(!stream->depth) {
+                        *used = (size_t)(p - start);
+                        return 1;
+                    }
+                }
+                break;
+
+            case STREAM_SCAN_ESCAPE:
+                stream->state = STREAM_SCAN_STRING;
+                p++;
+                break;
+
+            default:
+                /* the delimiter belongs to what follows */
+                if(STREAM_DELIMITER(*p)) {
+                    stream->state = STREAM_SCAN_IDLE;
+                    *used = (size_t)(p - start);
+                    return 1;
+                }
+                p++;
+                break;
+        }
+    }
+
+    *used = length;
+    return 0;
+}
+
+/* appends the next amount bytes of the chunk to the stream buffer */
+static int stream_buffer_chunk(json_stream_t *stream, size_t amount, json_error_t *error)
+{
+    size_t size = stream->buffered + amount;
+
+    if(size > stream->allocated) {
+        size_t allocated = stream->allocated ? stream->allocated : JSON_STREAM_DEFAULT_SIZE;
+        char *buffer;
+
+        while(allocated < size)
+            allocated *= 2;
+
+        buffer = jsonp_malloc(allocated);
+        if(!buffer) {
+            error_set(error, NULL, json_error_out_of_memory, "out of memory");
+            return -1;
+        }
+
+        if(stream->buffered)
+            memcpy(buffer, stream->buffer, stream->buffered);
+
+        jsonp_free(stream->buffer);
+        stream->buffer = buffer;
+        stream->allocated = allocated;
+    }
+
+    memcpy(stream->buffer + stream->buffered, stream->chunk, amount);
+    stream->buffered = size;
+    stream->chunk += amount;
+    stream->chunk_size -= amount;
+    return 0;
+}
+
+static json_t *stream_parse(json_stream_t *stream, const char *data, size_t size, json_error_t *error)
+{
+    json_t *result;
+    lex_t *lex;
+
+    /* the lexer and its saved text buffer are kept for the next value */
+    lex = lex_reuse(&stream->lexer, data, size, stream->flags, error);
+    if(!lex)
+        return NULL;
+
+    result = parse_json(lex, stream->flags, error);
+
+    lex_release(lex);
+    return result;
+}
+
+void json_stream_init(json_stream_t *stream, size_t max_size, size_t flags)
+{
+    stream->buffer = NULL;
+    stream->buffered = 0;
+    stream->allocated = 0;
+    stream->chunk = NULL;
+    stream->chunk_size = 0;
+    stream->max_size = max_size;
+    stream->flags = flags;
+    stream->depth = 0;
+    stream->state = STREAM_SCAN_IDLE;
+    stream->lexer = NULL;
+}
+
+void json_stream_reset(json_stream_t *stream)
+{
+    stream->buffered = 0;
+    stream->chunk = NULL;
+    stream->chunk_size = 0;
+    stream->depth = 0;
+    stream->state = STREAM_SCAN_IDLE;
+}
+
+void json_stream_close(json_stream_t *stream)
+{
+    if(stream->lexer) {
+        lex_close(stream->lexer);
+        jsonp_free(stream->lexer);
+    }
+    jsonp_free(stream->buffer);
+    json_stream_init(stream, stream->max_size, stream->flags);
+}
+
+int json_stream_feed(json_stream_t *stream, const char *data, size_t size)
+{
+    /* the previous chunk must be drained first */
+    if(stream->chunk_size || (!data && size))
+        return -1;
+
+    stream->chunk = data;
+    stream->chunk_size = size;
+    return 0;
+}
+
+size_t json_stream_pending(const json_stream_t *stream)
+{
+    return stream->buffered + stream->chunk_size;
+}
+
+int json_stream_next(json_stream_t *stream, json_t **value, json_error_t *error)
+{
+    const char *data;
+    size_t used, size;
+
+    jsonp_error_init(error, "<json_stream>");
+    *value = NULL;
+
+    /* whitespace between values, such as the newlines of line
+       delimited messages, is dropped */
+    if(!stream->buffered && stream->state == STREAM_SCAN_IDLE) {
+        while(stream->chunk_size && STREAM_SPACE(*stream->chunk)) {
+            stream->chunk++;
+            stream->chunk_size--;
+        }
+    }
+
+    if(!stream->chunk_size)
+        return 0;
+
+    if(!stream_scan(stream, (const unsigned char *)stream->chunk, stream->chunk_size, &used)) {
+        if(stream->max_size && stream->buffered + used > stream->max_size) {
+            error_set(error, NULL, json_error_invalid_format, "value size exceeds the maximum");
+            return -1;
+        }
+        return stream_buffer_chunk(stream, used, error);
+    }
+
+    size = stream->buffered + used;
+    if(stream->max_size && size > stream->max_size) {
+        error_set(error, NULL, json_error_invalid_format, "value size exceeds the maximum");
+        return -1;
+    }
+
+    if(stream->buffered) {
+        if(stream_buffer_chunk(stream, used, error))
+            return -1;
+        data = stream->buffer;
+    }
+    else {
+        /* the whole value is inside the caller's chunk */
+        data = stream->chunk;
+        stream->chunk += used;
+        stream->chunk_size -= used;
+    }
+
+    /* the value is consumed even if it does not parse */
+    stream->buffered = 0;
+    *value = stream_parse(stream, data, size, error);
+    return *value ? 1 : -1;
+}
+
+void json_loader_init(json_loader_t *loader, size_t flags, json_arena_t *arena)
+{
+    loader->flags = flags;
+    loader->arena = arena;
+    loader->lexer = NULL;
+}
+
+void json_loader_close(json_loader_t *loader)
+{
+    if(loader->lexer) {
+        lex_close(loader->lexer);
+        jsonp_free(loader->lexer);
+    }
+    loader->lexer = NULL;
+}
+
+json_t *json_loader_parse(json_loader_t *loader, const char *buffer, size_t buflen, json_error_t *error)
+{
+    json_arena_t *previous = NULL;
+    json_t *result;
+    lex_t *lex;
+
+    jsonp_error_init(error, "<buffer>");
+
+    if(!loader || !buffer) {
+        error_set(error, NULL, json_error_invalid_argument, "wrong arguments");
+        return NULL;
+    }
+
+    lex = lex_reuse(&loader->lexer, buffer, buflen, loader->flags, error);
+    if(!lex)
+        return NULL;
+
+    if(loader->arena)
+        previous = json_arena_use(loader->arena);
+
+    result = parse_json(lex, loader->flags, error);
+
+    if(loader->arena)
+        json_arena_use(previous);
+
+    lex_release(lex);
+    return result;
+}
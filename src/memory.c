@@ -10,6 +10,12 @@
 #include <string.h>
 
 #include "jansson_private_config.h"
+
+#if defined(JANSSON_STATS) && defined(HAVE_MALLOC_H) && defined(HAVE_MALLOC_USABLE_SIZE)
+#include <malloc.h>
+#define STATS_USABLE_SIZE 1
+#endif
+
 #include "bosjansson.h"
 #include "jansson_private.h"
 
@@ -21,22 +27,121 @@
 static json_malloc_t do_malloc = malloc;
 static json_free_t do_free = free;
 
+/* Per thread caches of freed json_t nodes. Nodes are allocated one by
+   one with do_malloc, so a node may be freed by any thread and a
+   cached node can always be released with do_free. */
+#define POOL_GRANULARITY 8
+#define POOL_CLASSES 32  /* nodes up to 256 bytes */
+
+#define pool_class(size_) (((size_) + POOL_GRANULARITY - 1) / POOL_GRANULARITY - 1)
+
+typedef struct pool_entry {
+    struct pool_entry *next;
+} pool_entry_t;
+
+static volatile size_t pool_limit = 0;
+static JSON_THREAD_LOCAL pool_entry_t *pool_entries[POOL_CLASSES];
+static JSON_THREAD_LOCAL size_t pool_counts[POOL_CLASSES];
+
+#ifdef JANSSON_STATS
+JSON_THREAD_LOCAL json_stats_t jsonp_stats;
+
+/* live bytes need the size of a block when it is freed, which only
+   the default allocator can tell */
+static size_t stats_block_size(void *ptr)
+{
+#ifdef STATS_USABLE_SIZE
+    if(do_malloc == malloc)
+        return malloc_usable_size(ptr);
+#endif
+    (void)ptr;
+    return 0;
+}
+#endif
+
 void *jsonp_malloc(size_t size)
 {
+#ifdef JANSSON_STATS
+    void *ptr;
+
+    if(!size)
+        return NULL;
+
+    ptr = (*do_malloc)(size);
+    if(ptr) {
+        jsonp_stats.allocations++;
+        jsonp_stats.allocated_bytes += size;
+        jsonp_stats.live_bytes += stats_block_size(ptr);
+        if(jsonp_stats.live_bytes > jsonp_stats.peak_bytes)
+            jsonp_stats.peak_bytes = jsonp_stats.live_bytes;
+    }
+    return ptr;
+#else
     if(!size)
         return NULL;
 
     return (*do_malloc)(size);
+#endif
 }
 
 void jsonp_free(void *ptr)
 {
+#ifdef JANSSON_STATS
+    size_t size;
+#endif
+
     if(!ptr)
         return;
 
+#ifdef JANSSON_STATS
+    /* blocks from other threads may take a thread below zero */
+    size = stats_block_size(ptr);
+    jsonp_stats.frees++;
+    jsonp_stats.live_bytes -= size < jsonp_stats.live_bytes ? size : jsonp_stats.live_bytes;
+#endif
+
     (*do_free)(ptr);
 }
 
+void *jsonp_node_malloc(size_t size)
+{
+    size_t index = pool_class(size);
+    pool_entry_t *entry;
+
+    if(size && index < POOL_CLASSES) {
+        entry = pool_entries[index];
+        if(entry) {
+            pool_entries[index] = entry->next;
+            pool_counts[index]--;
+            return entry;
+        }
+
+        /* allocate the full class size so any node of the class can reuse it */
+        return jsonp_malloc((index + 1) * POOL_GRANULARITY);
+    }
+
+    return jsonp_malloc(size);
+}
+
+void jsonp_node_free(void *ptr, size_t size)
+{
+    size_t index = pool_class(size);
+    pool_entry_t *entry;
+
+    if(!ptr)
+        return;
+
+    if(size && index < POOL_CLASSES && pool_counts[index] < pool_limit) {
+        entry = (pool_entry_t *)ptr;
+        entry->next = pool_entries[index];
+        pool_entries[index] = entry;
+        pool_counts[index]++;
+        return;
+    }
+
+    jsonp_free(ptr);
+}
+
 char *jsonp_strdup(const char *str)
 {
     return jsonp_strndup(str, strlen(str));
@@ -68,3 +173,60 @@ void json_get_alloc_funcs(json_malloc_t *malloc_fn, json_free_t *free_fn)
     if (free_fn)
         *free_fn = do_free;
 }
+
+void json_pool_set_limit(size_t limit)
+{
+#ifdef JSON_NO_THREAD_LOCAL
+    /* the pools would be shared by all threads without locking */
+    (void)limit;
+#else
+    pool_limit = limit;
+#endif
+}
+
+size_t json_pool_get_limit(void)
+{
+    return pool_limit;
+}
+
+void json_pool_trim(void)
+{
+    size_t i;
+    pool_entry_t *entry, *next;
+
+    for(i = 0; i < POOL_CLASSES; i++) {
+        for(entry = pool_entries[i]; entry; entry = next) {
+            next = entry->next;
+            jsonp_free(entry);
+        }
+
+        pool_entries[i] = NULL;
+        pool_counts[i] = 0;
+    }
+}
+
+int json_get_stats(json_stats_t *stats)
+{
+    if(!stats)
+        return -1;
+
+#ifdef JANSSON_STATS
+    *stats = jsonp_stats;
+    return 0;
+#else
+    memset(stats, 0, sizeof(json_stats_t));
+    return -1;
+#endif
+}
+
+void json_reset_stats(void)
+{
+#ifdef JANSSON_STATS
+    /* memory that is still allocated stays counted */
+    size_t live_bytes = jsonp_stats.live_bytes;
+
+    memset(&jsonp_stats, 0, sizeof(json_stats_t));
+    jsonp_stats.live_bytes = live_bytes;
+    jsonp_stats.peak_bytes = live_bytes;
+#endif
+}
@@ -17,11 +17,26 @@ typedef struct {
     int column;
     size_t pos;
     char token;
+
+    /* set by compile() for '[' and '{': the number of values or keys,
+       and 1 or -1 if the container ends with '!' or '*' */
+    signed char strict;
+    size_t count;
 } token_t;
 
+/* format strings tokenized once, the last token is the end of the format */
+struct json_pack_program_t {
+    token_t tokens[1];
+};
+
+struct json_unpack_program_t {
+    token_t tokens[1];
+};
+
 typedef struct {
     const char *start;
     const char *fmt;
+    const token_t *program;
     token_t prev_token;
     token_t token;
     token_t next_token;
@@ -43,7 +58,10 @@ static const char * const type_names[] = {
     "real",
     "true",
     "false",
-    "null"
+    "null",
+    "bytes",
+    "packed array",
+    "fragment"
 };
 
 #define type_name(x) type_names[json_typeof(x)]
@@ -56,6 +74,7 @@ static void scanner_init(scanner_t *s, json_error_t *error,
     s->error = error;
     s->flags = flags;
     s->fmt = s->start = fmt;
+    s->program = NULL;
     memset(&s->prev_token, 0, sizeof(token_t));
     memset(&s->token, 0, sizeof(token_t));
     memset(&s->next_token, 0, sizeof(token_t));
@@ -76,6 +95,13 @@ static void next_token(scanner_t *s)
         return;
     }
 
+    if(s->program) {
+        s->token = *s->program;
+        if(s->program->token)
+            s->program++;
+        return;
+    }
+
     if (!token(s) && !*s->fmt)
         return;
 
@@ -235,6 +261,7 @@ static json_t *pack_object(scanner_t *s, va_list *ap)
         char *key;
         size_t len;
         int ours;
+        const json_key_t *prepared = NULL;
         json_t *value;
         char valueOptional;
 
@@ -243,12 +270,27 @@ static json_t *pack_object(scanner_t *s, va_list *ap)
             goto error;
         }
 
-        if(token(s) != 's') {
+        if(token(s) == 'k') {
+            prepared = va_arg(*ap, const json_key_t *);
+            key = NULL;
+            len = 0;
+            ours = 0;
+
+            if(!prepared || !prepared->key) {
+                set_error(s, "<args>", json_error_null_value, "NULL object key");
+                s->has_error = 1;
+            }
+            else {
+                key = (char *)prepared->key;
+                len = prepared->len;
+            }
+        }
+        else if(token(s) != 's') {
             set_error(s, "<format>", json_error_invalid_format, "Expected format 's', got '%c'", token(s));
             goto error;
         }
-
-        key = read_string(s, ap, "object key", &len, &ours, 0);
+        else
+            key = read_string(s, ap, "object key", &len, &ours, 0);
 
         next_token(s);
 
@@ -273,8 +315,11 @@ static json_t *pack_object(scanner_t *s, va_list *ap)
         if(s->has_error)
             json_decref(value);
 
-        if(!s->has_error && json_object_set_new_nocheck(object, key, value)) {
-            set_error(s, "<internal>", json_error_out_of_memory, "Unable to add key \"%s\"", key);
+        if(!s->has_error && (prepared
+                             ? jsonp_object_set_hashed_new(object, key, len, prepared->hash, value)
+                             : json_object_set_new_nocheck(object, key, value))) {
+            set_error(s, "<internal>", json_error_out_of_memory, "Unable to add key \"%.*s\"",
+                      (int)len, key);
             s->has_error = 1;
         }
 
@@ -294,7 +339,7 @@ error:
 
 static json_t *pack_array(scanner_t *s, va_list *ap)
 {
-    json_t *array = json_array();
+    json_t *array = jsonp_array_sized(s->token.count);
     next_token(s);
 
     while(token(s) != ']') {
@@ -490,11 +535,14 @@ static int unpack_object(scanner_t *s, json_t *root, va_list *ap)
     /* Use a set (emulated by a hashtable) to check that all object
        keys are accessed. Checking that the correct number of keys
        were accessed is not enough, as the same key can be unpacked
-       multiple times.
+       multiple times. Compiled formats know whether the check is
+       done and skip the set otherwise.
     */
     hashtable_t key_set;
+    int track_keys = !s->program ||
+                     (root && (s->token.strict == 1 || (!s->token.strict && (s->flags & JSON_STRICT))));
 
-    if(hashtable_init(&key_set)) {
+    if(hashtable_init(&key_set, NULL)) {
         set_error(s, "<internal>", json_error_out_of_memory, "Out of memory");
         return -1;
     }
@@ -508,6 +556,7 @@ static int unpack_object(scanner_t *s, json_t *root, va_list *ap)
 
     while(token(s) != '}') {
         const char *key;
+        const json_key_t *prepared = NULL;
         json_t *value;
         int opt = 0;
 
@@ -528,12 +577,17 @@ static int unpack_object(scanner_t *s, json_t *root, va_list *ap)
             continue;
         }
 
-        if(token(s) != 's') {
+        if(token(s) == 'k') {
+            prepared = va_arg(*ap, const json_key_t *);
+            key = prepared ? prepared->key : NULL;
+        }
+        else if(token(s) != 's') {
             set_error(s, "<format>", json_error_invalid_format, "Expected format 's', got '%c'", token(s));
             goto out;
         }
+        else
+            key = va_arg(*ap, const char *);
 
-        key = va_arg(*ap, const char *);
         if(!key) {
             set_error(s, "<args>", json_error_null_value, "NULL object key");
             goto out;
@@ -550,6 +604,14 @@ static int unpack_object(scanner_t *s, json_t *root, va_list *ap)
             /* skipping */
             value = NULL;
         }
+        else if(prepared) {
+            value = jsonp_object_get_hashed(root, key, prepared->len, prepared->hash);
+            if(!value && !opt) {
+                set_error(s, "<validation>", json_error_item_not_found, "Object item not found: %.*s",
+                          (int)prepared->len, key);
+                goto out;
+            }
+        }
         else {
             value = json_object_get(root, key);
             if(!value && !opt) {
@@ -561,7 +623,12 @@ static int unpack_object(scanner_t *s, json_t *root, va_list *ap)
         if(unpack(s, value, ap))
             goto out;
 
-        hashtable_set(&key_set, key, json_null());
+        if(track_keys) {
+            if(prepared)
+                hashtable_setn(&key_set, key, prepared->len, prepared->hash, json_null());
+            else
+                hashtable_set(&key_set, key, json_null());
+        }
         next_token(s);
     }
 
@@ -833,12 +900,13 @@ static int unpack(scanner_t *s, json_t *root, va_list *ap)
     }
 }
 
-json_t *json_vpack_ex(json_error_t *error, size_t flags,
-                      const char *fmt, va_list ap)
+/* tokenizes fmt and records the size of every container */
+static token_t *compile(const char *fmt, json_error_t *error)
 {
     scanner_t s;
-    va_list ap_copy;
-    json_t *value;
+    token_t *tokens;
+    size_t *open;
+    size_t count = 0, depth = 0, i;
 
     if(!fmt || !*fmt) {
         jsonp_error_init(error, "<format>");
@@ -847,23 +915,88 @@ json_t *json_vpack_ex(json_error_t *error, size_t flags,
     }
     jsonp_error_init(error, NULL);
 
-    scanner_init(&s, error, flags, fmt);
-    next_token(&s);
+    scanner_init(&s, error, 0, fmt);
+    do {
+        next_token(&s);
+        count++;
+    } while(token(&s));
+
+    tokens = jsonp_malloc(count * sizeof(token_t));
+    open = jsonp_malloc(count * sizeof(size_t));
+    if(!tokens || !open) {
+        jsonp_free(tokens);
+        jsonp_free(open);
+        jsonp_error_set(error, -1, -1, 0, json_error_out_of_memory, "Out of memory");
+        jsonp_error_set_source(error, "<internal>");
+        return NULL;
+    }
+
+    scanner_init(&s, error, 0, fmt);
+    for(i = 0; i < count; i++) {
+        char t;
+
+        next_token(&s);
+        tokens[i] = s.token;
+        t = token(&s);
+
+        if(depth && t && (t == 'k' || strchr(unpack_value_starters, t)))
+            tokens[open[depth - 1]].count++;
+
+        if(t == '[' || t == '{') {
+            open[depth++] = i;
+        }
+        else if(t == ']' || t == '}') {
+            token_t *container;
+
+            if(!depth || tokens[open[depth - 1]].token != (t == ']' ? '[' : '{')) {
+                set_error(&s, "<format>", json_error_invalid_format, "Unexpected format character '%c'", t);
+                break;
+            }
+
+            container = &tokens[open[--depth]];
+            if(container->token == '{')
+                container->count /= 2;
+
+            if(i > 0 && (tokens[i - 1].token == '!' || tokens[i - 1].token == '*'))
+                container->strict = tokens[i - 1].token == '!' ? 1 : -1;
+        }
+        else if(!t && depth) {
+            set_error(&s, "<format>", json_error_invalid_format, "Unexpected end of format string");
+            break;
+        }
+    }
+
+    jsonp_free(open);
+
+    if(i < count) {
+        jsonp_free(tokens);
+        return NULL;
+    }
+
+    return tokens;
+}
+
+static json_t *pack_scanned(scanner_t *s, va_list ap)
+{
+    va_list ap_copy;
+    json_t *value;
+
+    next_token(s);
 
     va_copy(ap_copy, ap);
-    value = pack(&s, &ap_copy);
+    value = pack(s, &ap_copy);
     va_end(ap_copy);
 
     if(!value)
         return NULL;
 
-    next_token(&s);
-    if(token(&s)) {
+    next_token(s);
+    if(token(s)) {
         json_decref(value);
-        set_error(&s, "<format>", json_error_invalid_format, "Garbage after format string");
+        set_error(s, "<format>", json_error_invalid_format, "Garbage after format string");
         return NULL;
     }
-    if(s.has_error) {
+    if(s->has_error) {
         json_decref(value);
         return NULL;
     }
@@ -871,6 +1004,22 @@ json_t *json_vpack_ex(json_error_t *error, size_t flags,
     return value;
 }
 
+json_t *json_vpack_ex(json_error_t *error, size_t flags,
+                      const char *fmt, va_list ap)
+{
+    scanner_t s;
+
+    if(!fmt || !*fmt) {
+        jsonp_error_init(error, "<format>");
+        jsonp_error_set(error, -1, -1, 0, json_error_invalid_argument, "NULL or empty format string");
+        return NULL;
+    }
+    jsonp_error_init(error, NULL);
+
+    scanner_init(&s, error, flags, fmt);
+    return pack_scanned(&s, ap);
+}
+
 json_t *json_pack_ex(json_error_t *error, size_t flags, const char *fmt, ...)
 {
     json_t *value;
@@ -895,11 +1044,83 @@ json_t *json_pack(const char *fmt, ...)
     return value;
 }
 
+json_pack_program_t *json_pack_compile(const char *fmt, json_error_t *error)
+{
+    return (json_pack_program_t *)compile(fmt, error);
+}
+
+void json_pack_program_free(json_pack_program_t *program)
+{
+    jsonp_free(program);
+}
+
+json_t *json_vpack_run_ex(json_error_t *error, size_t flags,
+                          const json_pack_program_t *program, va_list ap)
+{
+    scanner_t s;
+
+    if(!program) {
+        jsonp_error_init(error, "<format>");
+        jsonp_error_set(error, -1, -1, 0, json_error_invalid_argument, "NULL program");
+        return NULL;
+    }
+    jsonp_error_init(error, NULL);
+
+    scanner_init(&s, error, flags, "");
+    s.program = program->tokens;
+    return pack_scanned(&s, ap);
+}
+
+json_t *json_pack_run_ex(json_error_t *error, size_t flags, const json_pack_program_t *program, ...)
+{
+    json_t *value;
+    va_list ap;
+
+    va_start(ap, program);
+    value = json_vpack_run_ex(error, flags, program, ap);
+    va_end(ap);
+
+    return value;
+}
+
+json_t *json_pack_run(const json_pack_program_t *program, ...)
+{
+    json_t *value;
+    va_list ap;
+
+    va_start(ap, program);
+    value = json_vpack_run_ex(NULL, 0, program, ap);
+    va_end(ap);
+
+    return value;
+}
+
+static int unpack_scanned(scanner_t *s, json_t *root, va_list ap)
+{
+    va_list ap_copy;
+
+    next_token(s);
+
+    va_copy(ap_copy, ap);
+    if(unpack(s, root, &ap_copy)) {
+        va_end(ap_copy);
+        return -1;
+    }
+    va_end(ap_copy);
+
+    next_token(s);
+    if(token(s)) {
+        set_error(s, "<format>", json_error_invalid_format, "Garbage after format string");
+        return -1;
+    }
+
+    return 0;
+}
+
 int json_vunpack_ex(json_t *root, json_error_t *error, size_t flags,
                     const char *fmt, va_list ap)
 {
     scanner_t s;
-    va_list ap_copy;
 
     if(!root) {
         jsonp_error_init(error, "<root>");
@@ -915,43 +1136,86 @@ int json_vunpack_ex(json_t *root, json_error_t *error, size_t flags,
     jsonp_error_init(error, NULL);
 
     scanner_init(&s, error, flags, fmt);
-    next_token(&s);
+    return unpack_scanned(&s, root, ap);
+}
 
-    va_copy(ap_copy, ap);
-    if(unpack(&s, root, &ap_copy)) {
-        va_end(ap_copy);
+int json_unpack_ex(json_t *root, json_error_t *error, size_t flags, const char *fmt, ...)
+{
+    int ret;
+    va_list ap;
+
+    va_start(ap, fmt);
+    ret = json_vunpack_ex(root, error, flags, fmt, ap);
+    va_end(ap);
+
+    return ret;
+}
+
+int json_unpack(json_t *root, const char *fmt, ...)
+{
+    int ret;
+    va_list ap;
+
+    va_start(ap, fmt);
+    ret = json_vunpack_ex(root, NULL, 0, fmt, ap);
+    va_end(ap);
+
+    return ret;
+}
+
+json_unpack_program_t *json_unpack_compile(const char *fmt, json_error_t *error)
+{
+    return (json_unpack_program_t *)compile(fmt, error);
+}
+
+void json_unpack_program_free(json_unpack_program_t *program)
+{
+    jsonp_free(program);
+}
+
+int json_vunpack_run_ex(json_t *root, json_error_t *error, size_t flags,
+                        const json_unpack_program_t *program, va_list ap)
+{
+    scanner_t s;
+
+    if(!root) {
+        jsonp_error_init(error, "<root>");
+        jsonp_error_set(error, -1, -1, 0, json_error_null_value, "NULL root value");
         return -1;
     }
-    va_end(ap_copy);
 
-    next_token(&s);
-    if(token(&s)) {
-        set_error(&s, "<format>", json_error_invalid_format, "Garbage after format string");
+    if(!program) {
+        jsonp_error_init(error, "<format>");
+        jsonp_error_set(error, -1, -1, 0, json_error_invalid_argument, "NULL program");
         return -1;
     }
+    jsonp_error_init(error, NULL);
 
-    return 0;
+    scanner_init(&s, error, flags, "");
+    s.program = program->tokens;
+    return unpack_scanned(&s, root, ap);
 }
 
-int json_unpack_ex(json_t *root, json_error_t *error, size_t flags, const char *fmt, ...)
+int json_unpack_run_ex(json_t *root, json_error_t *error, size_t flags,
+                       const json_unpack_program_t *program, ...)
 {
     int ret;
     va_list ap;
 
-    va_start(ap, fmt);
-    ret = json_vunpack_ex(root, error, flags, fmt, ap);
+    va_start(ap, program);
+    ret = json_vunpack_run_ex(root, error, flags, program, ap);
     va_end(ap);
 
     return ret;
 }
 
-int json_unpack(json_t *root, const char *fmt, ...)
+int json_unpack_run(json_t *root, const json_unpack_program_t *program, ...)
 {
     int ret;
     va_list ap;
 
-    va_start(ap, fmt);
-    ret = json_vunpack_ex(root, NULL, 0, fmt, ap);
+    va_start(ap, program);
+    ret = json_vunpack_run_ex(root, NULL, 0, program, ap);
     va_end(ap);
 
     return ret;
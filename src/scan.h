@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2018 JCThePants <github.com/JCThePants>
+ *
+ * Bos-Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+/*
+ * Block scanning of string bodies. Finds the first byte that is not
+ * plain printable ASCII, i.e. a control character, '"', '\\' or a byte
+ * with the high bit set. Uses AVX2, SSE2 or NEON where the compiler
+ * targets them and 8 byte words everywhere else.
+ */
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include <jansson_config.h>   /* for JSON_INLINE */
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SCAN_AVX2 1
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SCAN_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define SCAN_NEON 1
+#endif
+
+#define SCAN_PLAIN(c) ((c) >= 0x20 && (c) < 0x80 && (c) != '"' && (c) != '\\')
+
+#define SCAN_LSB 0x0101010101010101ULL
+#define SCAN_MSB 0x8080808080808080ULL
+
+static JSON_INLINE size_t scan_first_bit(uint32_t mask)
+{
+#if defined(__GNUC__)
+    return (size_t)__builtin_ctz(mask);
+#else
+    size_t i = 0;
+    while(!(mask & 1)) {
+        mask >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+/* little endian load so that the lowest flagged byte comes first */
+static JSON_INLINE uint64_t scan_read64(const unsigned char *p)
+{
+    return (uint64_t)p[0] | (uint64_t)p[1] << 8 |
+           (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24 |
+           (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 |
+           (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+}
+
+/* sets the high bit of every byte that needs a closer look. Borrows
+   can only flag bytes above a real match, so the lowest flag is exact. */
+static JSON_INLINE uint64_t scan_word(uint64_t w)
+{
+    uint64_t quote = w ^ (SCAN_LSB * '"');
+    uint64_t backslash = w ^ (SCAN_LSB * '\\');
+
+    return (w | ((w - SCAN_LSB * 0x20) & ~w) |
+            ((quote - SCAN_LSB) & ~quote) |
+            ((backslash - SCAN_LSB) & ~backslash)) & SCAN_MSB;
+}
+
+/* returns the number of plain bytes at the start of the length bytes at p */
+static JSON_INLINE size_t scan_plain(const unsigned char *p, size_t length)
+{
+    size_t i = 0;
+
+#if defined(SCAN_AVX2)
+    {
+        const __m256i quote = _mm256_set1_epi8('"');
+        const __m256i backslash = _mm256_set1_epi8('\\');
+        const __m256i space = _mm256_set1_epi8(0x20);
+
+        for(; i + 32 <= length; i += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+
+            /* signed compare catches both controls and bytes >= 0x80 */
+            __m256i bad = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, backslash)),
+                _mm256_cmpgt_epi8(space, v));
+            uint32_t mask = (uint32_t)_mm256_movemask_epi8(bad);
+
+            if(mask)
+                return i + scan_first_bit(mask);
+        }
+    }
+#endif
+
+#if defined(SCAN_SSE2)
+    {
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        const __m128i space = _mm_set1_epi8(0x20);
+
+        for(; i + 16 <= length; i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+            __m128i bad = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+                _mm_cmplt_epi8(v, space));
+            uint32_t mask = (uint32_t)_mm_movemask_epi8(bad);
+
+            if(mask)
+                return i + scan_first_bit(mask);
+        }
+    }
+#elif defined(SCAN_NEON)
+    {
+        const uint8x16_t quote = vdupq_n_u8('"');
+        const uint8x16_t backslash = vdupq_n_u8('\\');
+        const uint8x16_t space = vdupq_n_u8(0x20);
+        const uint8x16_t del = vdupq_n_u8(0x7F);
+
+        for(; i + 16 <= length; i += 16) {
+            uint8x16_t v = vld1q_u8(p + i);
+            uint8x16_t bad = vorrq_u8(
+                vorrq_u8(vceqq_u8(v, quote), vceqq_u8(v, backslash)),
+                vorrq_u8(vcltq_u8(v, space), vcgtq_u8(v, del)));
+
+            /* the scalar loop below finds the exact byte */
+            if(vmaxvq_u8(bad))
+                break;
+        }
+    }
+#endif
+
+    for(; i + 8 <= length; i += 8) {
+        uint64_t mask = scan_word(scan_read64(p + i));
+
+        if(mask) {
+#if defined(__GNUC__)
+            return i + ((size_t)__builtin_ctzll(mask) >> 3);
+#else
+            break;
+#endif
+        }
+    }
+
+    while(i < length && SCAN_PLAIN(p[i]))
+        i++;
+
+    return i;
+}
+
+#endif
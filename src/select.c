@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2018 JCThePants <github.com/JCThePants>
+ *
+ * Bos-Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+/*
+ * Path matching for json_loadb_select() and bos_deserialize_select().
+ * Paths are JSON Pointers (RFC 6901) such as "/params/0". The decoders
+ * keep the paths that match the current position and narrow them down
+ * at each key or index.
+ */
+
+#include <string.h>
+
+#include "jansson_private_config.h"
+#include "bosjansson.h"
+#include "jansson_private.h"
+
+int jsonp_select_init(const char *const *paths, size_t count, json_t **values, jsonp_select_t *selected)
+{
+    size_t i;
+
+    for(i = 0; i < count; i++)
+        values[i] = NULL;
+
+    for(i = 0; i < count; i++) {
+        if(!paths[i] || (paths[i][0] != '\0' && paths[i][0] != '/'))
+            return -1;
+
+        selected[i].index = i;
+        selected[i].offset = 0;
+    }
+
+    return 0;
+}
+
+/* compares the segment starting after the '/' at path with key,
+   returns the end of the segment or NULL if they differ */
+static const char *segment_match(const char *path, const char *key, size_t len)
+{
+    const char *end = key + len;
+
+    for(path++; *path && *path != '/'; path++, key++) {
+        char c = *path;
+
+        if(c == '~') {
+            if(path[1] == '0')
+                c = '~';
+            else if(path[1] == '1')
+                c = '/';
+            else
+                return NULL;
+            path++;
+        }
+
+        if(key == end || *key != c)
+            return NULL;
+    }
+
+    return key == end ? path : NULL;
+}
+
+/* array indexes are plain decimal numbers without leading zeros */
+static const char *segment_index(const char *path, size_t *index)
+{
+    const char *p = path + 1;
+    size_t value = 0;
+
+    if(*p < '0' || *p > '9' || (p[0] == '0' && p[1] && p[1] != '/'))
+        return NULL;
+
+    for(; *p >= '0' && *p <= '9'; p++) {
+        if(value > ((size_t)-1 - 9) / 10)
+            return NULL;
+        value = value * 10 + (size_t)(*p - '0');
+    }
+
+    if(*p && *p != '/')
+        return NULL;
+
+    *index = value;
+    return p;
+}
+
+size_t jsonp_select_key(const char *const *paths, const jsonp_select_t *selected, size_t count,
+                        const char *key, size_t len, jsonp_select_t *next)
+{
+    size_t i, n = 0;
+
+    for(i = 0; i < count; i++) {
+        const char *path = paths[selected[i].index];
+        const char *end;
+
+        if(!path[selected[i].offset])
+            continue;
+
+        end = segment_match(path + selected[i].offset, key, len);
+        if(end) {
+            next[n].index = selected[i].index;
+            next[n].offset = (size_t)(end - path);
+            n++;
+        }
+    }
+
+    return n;
+}
+
+size_t jsonp_select_index(const char *const *paths, const jsonp_select_t *selected, size_t count,
+                          size_t index, jsonp_select_t *next)
+{
+    size_t i, n = 0, value;
+
+    for(i = 0; i < count; i++) {
+        const char *path = paths[selected[i].index];
+        const char *end;
+
+        if(!path[selected[i].offset])
+            continue;
+
+        end = segment_index(path + selected[i].offset, &value);
+        if(end && value == index) {
+            next[n].index = selected[i].index;
+            next[n].offset = (size_t)(end - path);
+            n++;
+        }
+    }
+
+    return n;
+}
+
+int jsonp_select_found(const char *const *paths, const jsonp_select_t *selected, size_t count)
+{
+    size_t i;
+
+    for(i = 0; i < count; i++) {
+        if(!paths[selected[i].index][selected[i].offset])
+            return 1;
+    }
+
+    return 0;
+}
+
+/* the member of object named by the segment starting after the '/' at
+   path, decoded like segment_match() */
+static json_t *segment_get(json_t *object, const char *path, const char **end)
+{
+    const char *p, *key;
+    json_t *member;
+
+    for(p = path + 1; *p && *p != '/' && *p != '~'; p++)
+        ;
+
+    if(*p != '~') {
+        *end = p;
+        return json_object_getn(object, path + 1, (size_t)(p - path - 1));
+    }
+
+    /* escaped segments are compared with every key */
+    json_object_foreach(object, key, member) {
+        p = segment_match(path, key, strlen(key));
+        if(p) {
+            *end = p;
+            return member;
+        }
+    }
+
+    return NULL;
+}
+
+/* the paths that end at value get it, longer ones look inside it,
+   returns the number of paths that had no value yet */
+int jsonp_select_store(const char *const *paths, const jsonp_select_t *selected, size_t count,
+                       json_t *value, json_t **values)
+{
+    jsonp_select_t next;
+    size_t i, found = 0;
+
+    for(i = 0; i < count; i++) {
+        const char *path = paths[selected[i].index];
+        json_t *target = value;
+
+        next = selected[i];
+        while(target && path[next.offset]) {
+            const char *end;
+            size_t index;
+
+            if(json_is_object(target))
+                target = segment_get(target, path + next.offset, &end);
+            else if(json_is_array(target)) {
+                end = segment_index(path + next.offset, &index);
+                target = end ? json_array_get(target, index) : NULL;
+            }
+            else
+                target = NULL;
+
+            if(target)
+                next.offset = (size_t)(end - path);
+        }
+
+        if(target) {
+            json_t **stored = &values[selected[i].index];
+
+            /* a repeated key replaces the value and is not found again */
+            if(*stored)
+                json_decref(*stored);
+            else
+                found++;
+            *stored = json_incref(target);
+        }
+    }
+
+    json_decref(value);
+    return (int)found;
+}
+
+void jsonp_select_clear(json_t **values, size_t count)
+{
+    size_t i;
+
+    for(i = 0; i < count; i++) {
+        json_decref(values[i]);
+        values[i] = NULL;
+    }
+}
@@ -3,10 +3,15 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <float.h>
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
 #ifdef __MINGW32__
 #undef __NO_ISOCEXT /* ensure stdlib.h will declare prototypes for mingw own 'strtod' replacement, called '__strtod' */
 #endif
 #include "jansson_private.h"
+#include "eisel_lemire.h"
 #include "strbuffer.h"
 
 /* need jansson_private_config.h to get the correct snprintf */
@@ -64,11 +69,111 @@ static void from_locale(char *buffer)
 }
 #endif
 
+/* exact double arithmetic needs doubles evaluated as doubles */
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+#define STRTOD_EXACT_POWERS 22
+
+static const double exact_powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+#endif
+
+/*
+  Converts a number that the lexer has already validated, without
+  strtod or the locale. Returns -1 when the value needs strtod: more
+  than 19 significant digits, subnormals, overflow, or a case that
+  Eisel-Lemire can't decide.
+*/
+static int strtod_fast(const char *str, size_t length, double *out)
+{
+    const char *p = str, *end = str + length;
+    uint64_t significand = 0;
+    int digits = 0, exponent = 0, negative = 0;
+
+    if(p < end && *p == '-') {
+        negative = 1;
+        p++;
+    }
+
+    for(; p < end && *p >= '0' && *p <= '9'; p++) {
+        if(digits < 19) {
+            significand = significand * 10 + (uint64_t)(*p - '0');
+            if(significand)
+                digits++;
+        }
+        else if(*p != '0')
+            return -1;
+        else
+            exponent++;
+    }
+
+    if(p < end && *p == '.') {
+        for(p++; p < end && *p >= '0' && *p <= '9'; p++) {
+            if(digits < 19) {
+                significand = significand * 10 + (uint64_t)(*p - '0');
+                if(significand)
+                    digits++;
+                exponent--;
+            }
+            else if(*p != '0')
+                return -1;
+        }
+    }
+
+    if(p < end && (*p == 'e' || *p == 'E')) {
+        int exp_negative = 0, exp_value = 0;
+
+        p++;
+        if(p < end && (*p == '+' || *p == '-')) {
+            exp_negative = *p == '-';
+            p++;
+        }
+
+        for(; p < end && *p >= '0' && *p <= '9'; p++) {
+            /* far outside of the double range either way */
+            if(exp_value < 100000)
+                exp_value = exp_value * 10 + (*p - '0');
+        }
+
+        exponent += exp_negative ? -exp_value : exp_value;
+    }
+
+    if(p != end)
+        return -1;
+
+    if(significand == 0) {
+        *out = negative ? -0.0 : 0.0;
+        return 0;
+    }
+
+#ifdef STRTOD_EXACT_POWERS
+    /* both operands and the result are exact, so is the division */
+    if(significand <= (1ULL << 53) &&
+       exponent >= -STRTOD_EXACT_POWERS && exponent <= STRTOD_EXACT_POWERS) {
+        double value = (double)significand;
+
+        if(exponent < 0)
+            value /= exact_powers_of_ten[-exponent];
+        else
+            value *= exact_powers_of_ten[exponent];
+
+        *out = negative ? -value : value;
+        return 0;
+    }
+#endif
+
+    return eisel_lemire(significand, exponent, negative, out);
+}
+
 int jsonp_strtod(strbuffer_t *strbuffer, double *out)
 {
     double value;
     char *end;
 
+    if(strtod_fast(strbuffer->value, strbuffer->length, out) == 0)
+        return 0;
+
 #if JSON_HAVE_LOCALECONV
     to_locale(strbuffer);
 #endif
@@ -86,15 +191,332 @@ int jsonp_strtod(strbuffer_t *strbuffer, double *out)
     return 0;
 }
 
-int jsonp_dtostr(char *buffer, size_t size, double value, int precision)
+/*
+  Shortest round trip formatting of doubles with Grisu2 (Florian
+  Loitsch, "Printing Floating-Point Numbers Quickly and Accurately with
+  Integers"). The digits always read back as the same double and are
+  the shortest such digits for all but a tiny fraction of values, where
+  one more digit than necessary is produced.
+*/
+
+typedef struct {
+    uint64_t f;
+    int e;
+} diy_fp_t;
+
+#define DP_SIGNIFICAND_SIZE 52
+#define DP_EXPONENT_BIAS    (0x3FF + DP_SIGNIFICAND_SIZE)
+#define DP_HIDDEN_BIT       0x0010000000000000ULL
+#define DP_SIGNIFICAND_MASK 0x000FFFFFFFFFFFFFULL
+#define DP_EXPONENT_MASK    0x7FF0000000000000ULL
+
+/* normalized 10^(-348 + 8 * i) */
+static const uint64_t cached_powers_f[] = {
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+    0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+    0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+    0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+    0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+    0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+    0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+    0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+    0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+    0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+    0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+    0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+    0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+    0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+    0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+    0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+    0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+    0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+    0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+    0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+    0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+    0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL
+};
+
+static const int16_t cached_powers_e[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+    -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+    -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+    -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+    -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+    109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+    641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+    907, 933, 960, 986, 1013, 1039, 1066
+};
+
+static const uint64_t pow10_u64[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+    100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+    10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+static diy_fp_t diy_fp_multiply(diy_fp_t x, diy_fp_t y)
+{
+    const uint64_t mask = 0xFFFFFFFFULL;
+    uint64_t a = x.f >> 32, b = x.f & mask, c = y.f >> 32, d = y.f & mask;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & mask) + (bc & mask);
+    diy_fp_t r;
+
+    /* round the dropped low half */
+    tmp += 1ULL << 31;
+    r.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+    r.e = x.e + y.e + 64;
+    return r;
+}
+
+static diy_fp_t diy_fp_normalize(diy_fp_t x)
+{
+    while(!(x.f & 0x8000000000000000ULL)) {
+        x.f <<= 1;
+        x.e--;
+    }
+    return x;
+}
+
+static diy_fp_t cached_power(int e, int *k)
+{
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int index = (int)dk;
+    diy_fp_t r;
+
+    if(dk - index > 0.0)
+        index++;
+
+    index = (index >> 3) + 1;
+    *k = -(-348 + index * 8);
+
+    r.f = cached_powers_f[index];
+    r.e = cached_powers_e[index];
+    return r;
+}
+
+static void grisu_round(char *buffer, int length, uint64_t delta, uint64_t rest,
+                        uint64_t ten_kappa, uint64_t wp_w)
+{
+    while(rest < wp_w && delta - rest >= ten_kappa &&
+          (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+        buffer[length - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+static int count_digits(uint32_t n)
+{
+    int digits = 1;
+
+    while(n >= 10) {
+        n /= 10;
+        digits++;
+    }
+    return digits;
+}
+
+static int digit_gen(diy_fp_t w, diy_fp_t mp, uint64_t delta, char *buffer, int *k)
+{
+    diy_fp_t one;
+    uint64_t wp_w = mp.f - w.f, p2;
+    uint32_t p1;
+    int kappa, length = 0;
+
+    one.f = 1ULL << -mp.e;
+    one.e = mp.e;
+    p1 = (uint32_t)(mp.f >> -one.e);
+    p2 = mp.f & (one.f - 1);
+    kappa = count_digits(p1);
+
+    while(kappa > 0) {
+        uint32_t d = p1 / (uint32_t)pow10_u64[kappa - 1];
+        uint64_t rest;
+
+        p1 %= (uint32_t)pow10_u64[kappa - 1];
+        if(d || length)
+            buffer[length++] = (char)('0' + d);
+
+        kappa--;
+        rest = ((uint64_t)p1 << -one.e) + p2;
+        if(rest <= delta) {
+            *k += kappa;
+            grisu_round(buffer, length, delta, rest, pow10_u64[kappa] << -one.e, wp_w);
+            return length;
+        }
+    }
+
+    for(;;) {
+        char d;
+
+        p2 *= 10;
+        delta *= 10;
+        d = (char)(p2 >> -one.e);
+        if(d || length)
+            buffer[length++] = (char)('0' + d);
+
+        p2 &= one.f - 1;
+        kappa--;
+        if(p2 < delta) {
+            *k += kappa;
+            grisu_round(buffer, length, delta, p2, one.f,
+                        -kappa < 20 ? wp_w * pow10_u64[-kappa] : 0);
+            return length;
+        }
+    }
+}
+
+/* writes the digits of a finite positive value, which is digits * 10^k */
+static int grisu2(double value, char *buffer, int *k)
+{
+    diy_fp_t v, w_plus, w_minus, c_mk, w, wp, wm;
+    uint64_t bits;
+    int biased_e;
+
+    memcpy(&bits, &value, sizeof(bits));
+    biased_e = (int)((bits & DP_EXPONENT_MASK) >> DP_SIGNIFICAND_SIZE);
+
+    if(biased_e) {
+        v.f = (bits & DP_SIGNIFICAND_MASK) + DP_HIDDEN_BIT;
+        v.e = biased_e - DP_EXPONENT_BIAS;
+    }
+    else {
+        v.f = bits & DP_SIGNIFICAND_MASK;
+        v.e = 1 - DP_EXPONENT_BIAS;
+    }
+
+    /* boundaries halfway to the neighbouring doubles */
+    w_plus.f = (v.f << 1) + 1;
+    w_plus.e = v.e - 1;
+    while(!(w_plus.f & (DP_HIDDEN_BIT << 1))) {
+        w_plus.f <<= 1;
+        w_plus.e--;
+    }
+    w_plus.f <<= 64 - DP_SIGNIFICAND_SIZE - 2;
+    w_plus.e -= 64 - DP_SIGNIFICAND_SIZE - 2;
+
+    if(v.f == DP_HIDDEN_BIT) {
+        w_minus.f = (v.f << 2) - 1;
+        w_minus.e = v.e - 2;
+    }
+    else {
+        w_minus.f = (v.f << 1) - 1;
+        w_minus.e = v.e - 1;
+    }
+    w_minus.f <<= w_minus.e - w_plus.e;
+    w_minus.e = w_plus.e;
+
+    c_mk = cached_power(w_plus.e, k);
+    w = diy_fp_multiply(diy_fp_normalize(v), c_mk);
+    wp = diy_fp_multiply(w_plus, c_mk);
+    wm = diy_fp_multiply(w_minus, c_mk);
+    wm.f++;
+    wp.f--;
+
+    return digit_gen(w, wp, wp.f - wm.f, buffer, k);
+}
+
+static char *write_exponent(char *p, int exponent)
+{
+    char digits[4];
+    int n = 0;
+
+    if(exponent < 0) {
+        *p++ = '-';
+        exponent = -exponent;
+    }
+
+    do {
+        digits[n++] = (char)('0' + exponent % 10);
+        exponent /= 10;
+    } while(exponent);
+
+    while(n)
+        *p++ = digits[--n];
+
+    return p;
+}
+
+/* lays the digits out the way "%.17g" would, with the exponent
+   shortened and ".0" appended to integral values */
+static int dtostr_shortest(char *buffer, size_t size, double value)
+{
+    char digits[18], text[32], *p = text;
+    int length, k, exponent;
+
+    if(signbit(value)) {
+        *p++ = '-';
+        value = -value;
+    }
+
+    if(value == 0.0) {
+        length = 1;
+        digits[0] = '0';
+        k = 0;
+    }
+    else
+        length = grisu2(value, digits, &k);
+
+    /* exponent of the first digit */
+    exponent = length + k - 1;
+
+    if(exponent < -4 || exponent >= 17) {
+        *p++ = digits[0];
+        if(length > 1) {
+            *p++ = '.';
+            memcpy(p, digits + 1, (size_t)(length - 1));
+            p += length - 1;
+        }
+        *p++ = 'e';
+        p = write_exponent(p, exponent);
+    }
+    else if(exponent < 0) {
+        *p++ = '0';
+        *p++ = '.';
+        memset(p, '0', (size_t)(-exponent - 1));
+        p += -exponent - 1;
+        memcpy(p, digits, (size_t)length);
+        p += length;
+    }
+    else if(length <= exponent + 1) {
+        memcpy(p, digits, (size_t)length);
+        p += length;
+        memset(p, '0', (size_t)(exponent + 1 - length));
+        p += exponent + 1 - length;
+        *p++ = '.';
+        *p++ = '0';
+    }
+    else {
+        memcpy(p, digits, (size_t)(exponent + 1));
+        p += exponent + 1;
+        *p++ = '.';
+        memcpy(p, digits + exponent + 1, (size_t)(length - exponent - 1));
+        p += length - exponent - 1;
+    }
+
+    length = (int)(p - text);
+    if((size_t)length >= size)
+        return -1;
+
+    memcpy(buffer, text, (size_t)length);
+    buffer[length] = '\0';
+    return length;
+}
+
+static int dtostr_printf(char *buffer, size_t size, double value, int precision)
 {
     int ret;
     char *start, *end;
     size_t length;
 
-    if (precision == 0)
-        precision = 17;
-
     ret = snprintf(buffer, size, "%.*g", precision, value);
     if(ret < 0)
         return -1;
@@ -143,3 +565,77 @@ int jsonp_dtostr(char *buffer, size_t size, double value, int precision)
 
     return (int)length;
 }
+
+int jsonp_dtostr(char *buffer, size_t size, double value, int precision)
+{
+    if(precision == 0)
+        return dtostr_shortest(buffer, size, value);
+
+    return dtostr_printf(buffer, size, value, precision);
+}
+
+static const char digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+int jsonp_strtoint(const char *str, size_t length, json_int_t *out)
+{
+    const unsigned long long max = (unsigned long long)-1 >> (64 - sizeof(json_int_t) * 8 + 1);
+    const char *p = str, *end = str + length;
+    unsigned long long value = 0, limit = max;
+    int negative = 0;
+
+    if(p < end && *p == '-') {
+        negative = 1;
+        limit = max + 1;
+        p++;
+    }
+
+    for(; p < end; p++) {
+        unsigned int digit = (unsigned int)(*p - '0');
+
+        if(value > (limit - digit) / 10) {
+            *out = negative ? (json_int_t)(0ULL - limit) : (json_int_t)limit;
+            return -1;
+        }
+        value = value * 10 + digit;
+    }
+
+    *out = negative ? (json_int_t)(0ULL - value) : (json_int_t)value;
+    return 0;
+}
+
+int jsonp_itostr(char *buffer, size_t size, json_int_t value)
+{
+    char text[24], *end = text + sizeof(text), *p = end;
+    unsigned long long u = value < 0 ? 0ULL - (unsigned long long)value
+                                     : (unsigned long long)value;
+    size_t length;
+
+    /* two digits per division */
+    while(u >= 100) {
+        unsigned int pair = (unsigned int)(u % 100) * 2;
+        u /= 100;
+        *--p = digit_pairs[pair + 1];
+        *--p = digit_pairs[pair];
+    }
+
+    if(u >= 10) {
+        *--p = digit_pairs[u * 2 + 1];
+        *--p = digit_pairs[u * 2];
+    }
+    else
+        *--p = (char)('0' + u);
+
+    if(value < 0)
+        *--p = '-';
+
+    length = (size_t)(end - p);
+    if(length >= size)
+        return -1;
+
+    memcpy(buffer, p, length);
+    buffer[length] = '\0';
+    return (int)length;
+}
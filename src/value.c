@@ -26,6 +26,7 @@
 #include "hashtable.h"
 #include "jansson_private.h"
 #include "utf.h"
+#include "xxh64.h"
 
 /* Work around nonstandard isnan() and isinf() implementations */
 #ifndef isnan
@@ -37,10 +38,35 @@ static JSON_INLINE int isnan(double x) { return x != x; }
 static JSON_INLINE int isinf(double x) { return !isnan(x) && isnan(x - x); }
 #endif
 
-static JSON_INLINE void json_init(json_t *json, json_type type)
+/* Nodes in an arena are not reference counted, they live until
+   the arena is released. */
+static JSON_INLINE void json_init(json_t *json, json_type type, json_arena_t *arena)
 {
     json->type = type;
-    json->refcount = 1;
+    if(arena) {
+        json->flags = JSON_FLAG_ARENA;
+        json->refcount = (size_t)-1;
+    }
+    else {
+        json->flags = 0;
+        json->refcount = 1;
+    }
+}
+
+/* Arena containers do not release their children. Values from outside
+   the arena are handed over to it instead. */
+static JSON_INLINE int json_adopt(json_arena_t *arena, json_t *value)
+{
+    if(!arena)
+        return 0;
+
+    return jsonp_arena_adopt(arena, value);
+}
+
+static JSON_INLINE void json_release(json_arena_t *arena, json_t *value)
+{
+    if(!arena)
+        json_decref(value);
 }
 
 
@@ -50,7 +76,8 @@ extern volatile uint32_t hashtable_seed;
 
 json_t *json_object(void)
 {
-    json_object_t *object = jsonp_malloc(sizeof(json_object_t));
+    json_arena_t *arena = jsonp_arena_current();
+    json_object_t *object = jsonp_arena_node_malloc(arena, sizeof(json_object_t));
     if(!object)
         return NULL;
 
@@ -59,11 +86,12 @@ json_t *json_object(void)
         json_object_seed(0);
     }
 
-    json_init(&object->json, JSON_OBJECT);
+    json_init(&object->json, JSON_OBJECT, arena);
 
-    if(hashtable_init(&object->hashtable))
+    if(hashtable_init(&object->hashtable, arena))
     {
-        jsonp_free(object);
+        if(!arena)
+            jsonp_node_free(object, sizeof(json_object_t));
         return NULL;
     }
 
@@ -73,7 +101,7 @@ json_t *json_object(void)
 static void json_delete_object(json_object_t *object)
 {
     hashtable_close(&object->hashtable);
-    jsonp_free(object);
+    jsonp_node_free(object, sizeof(json_object_t));
 }
 
 size_t json_object_size(const json_t *json)
@@ -98,26 +126,118 @@ json_t *json_object_get(const json_t *json, const char *key)
     return hashtable_get(&object->hashtable, key);
 }
 
+json_t *json_object_getn(const json_t *json, const char *key, size_t len)
+{
+    json_object_t *object;
+
+    /* keys never contain null bytes */
+    if(!key || !json_is_object(json) || memchr(key, '\0', len))
+        return NULL;
+
+    /* small tables search by tags, only the index needs the hash */
+    object = json_to_object(json);
+    return hashtable_getn(&object->hashtable, key, len,
+                          object->hashtable.capacity ? hashtable_hash(key, len) : 0);
+}
+
+json_key_t json_key_make(const char *key)
+{
+    return json_key_maken(key, key ? strlen(key) : 0);
+}
+
+json_key_t json_key_maken(const char *key, size_t len)
+{
+    json_key_t result;
+
+    if (!hashtable_seed) {
+        /* the hash must be computed with the seed objects will use */
+        json_object_seed(0);
+    }
+
+    /* invalid keys are stored as NULL so that not every access has to check */
+    if(!key || memchr(key, '\0', len) || !utf8_check_string(key, len)) {
+        result.key = NULL;
+        result.len = 0;
+        result.hash = 0;
+        return result;
+    }
+
+    result.key = key;
+    result.len = len;
+    result.hash = hashtable_hash(key, len);
+    return result;
+}
+
+json_t *json_object_get_k(const json_t *json, const json_key_t *key)
+{
+    if(!key || !key->key)
+        return NULL;
+
+    return jsonp_object_get_hashed(json, key->key, key->len, key->hash);
+}
+
+int json_object_set_new_k(json_t *json, const json_key_t *key, json_t *value)
+{
+    if(!key || !key->key)
+    {
+        json_decref(value);
+        return -1;
+    }
+
+    return jsonp_object_set_hashed_new(json, key->key, key->len, key->hash, value);
+}
+
 int json_object_set_new_nocheck(json_t *json, const char *key, json_t *value)
+{
+    size_t len;
+
+    if(!key)
+    {
+        json_decref(value);
+        return -1;
+    }
+
+    len = strlen(key);
+    return jsonp_object_set_hashed_new(json, key, len, hashtable_hash(key, len), value);
+}
+
+json_t *jsonp_object_get_hashed(const json_t *json, const char *key, size_t len, size_t hash)
+{
+    json_object_t *object;
+
+    if(!json_is_object(json))
+        return NULL;
+
+    object = json_to_object(json);
+    return hashtable_getn(&object->hashtable, key, len, hash);
+}
+
+int jsonp_object_set_hashed_new(json_t *json, const char *key, size_t len, size_t hash, json_t *value)
 {
     json_object_t *object;
 
     if(!value)
         return -1;
 
-    if(!key || !json_is_object(json) || json == value)
+    if(!json_is_object(json) || json_is_frozen(json) || json == value)
     {
         json_decref(value);
         return -1;
     }
     object = json_to_object(json);
 
-    if(hashtable_set(&object->hashtable, key, value))
+    if(json_adopt(object->hashtable.arena, value))
     {
         json_decref(value);
         return -1;
     }
 
+    if(hashtable_setn(&object->hashtable, key, len, hash, value))
+    {
+        json_release(object->hashtable.arena, value);
+        return -1;
+    }
+
     return 0;
 }
 
@@ -136,18 +256,29 @@ int json_object_del(json_t *json, const char *key)
 {
     json_object_t *object;
 
-    if(!key || !json_is_object(json))
+    if(!key || !json_is_object(json) || json_is_frozen(json))
         return -1;
 
     object = json_to_object(json);
     return hashtable_del(&object->hashtable, key);
 }
 
+int json_object_del_k(json_t *json, const json_key_t *key)
+{
+    json_object_t *object;
+
+    if(!key || !key->key || !json_is_object(json) || json_is_frozen(json))
+        return -1;
+
+    object = json_to_object(json);
+    return hashtable_deln(&object->hashtable, key->key, key->len, key->hash);
+}
+
 int json_object_clear(json_t *json)
 {
     json_object_t *object;
 
-    if(!json_is_object(json))
+    if(!json_is_object(json) || json_is_frozen(json))
         return -1;
 
     object = json_to_object(json);
@@ -161,7 +292,7 @@ int json_object_update(json_t *object, json_t *other)
     const char *key;
     json_t *value;
 
-    if(!json_is_object(object) || !json_is_object(other))
+    if(!json_is_object(object) || json_is_frozen(object) || !json_is_object(other))
         return -1;
 
     json_object_foreach(other, key, value) {
@@ -177,7 +308,7 @@ int json_object_update_existing(json_t *object, json_t *other)
     const char *key;
     json_t *value;
 
-    if(!json_is_object(object) || !json_is_object(other))
+    if(!json_is_object(object) || json_is_frozen(object) || !json_is_object(other))
         return -1;
 
     json_object_foreach(other, key, value) {
@@ -193,7 +324,7 @@ int json_object_update_missing(json_t *object, json_t *other)
     const char *key;
     json_t *value;
 
-    if(!json_is_object(object) || !json_is_object(other))
+    if(!json_is_object(object) || json_is_frozen(object) || !json_is_object(other))
         return -1;
 
     json_object_foreach(other, key, value) {
@@ -255,13 +386,22 @@ json_t *json_object_iter_value(void *iter)
 
 int json_object_iter_set_new(json_t *json, void *iter, json_t *value)
 {
-    if(!json_is_object(json) || !iter || !value)
+    json_object_t *object;
+
+    if(!json_is_object(json) || json_is_frozen(json) || !iter || !value)
+    {
+        json_decref(value);
+        return -1;
+    }
+    object = json_to_object(json);
+
+    if(json_adopt(object->hashtable.arena, value))
     {
         json_decref(value);
         return -1;
     }
 
-    hashtable_iter_set(iter, value);
+    hashtable_iter_set(&object->hashtable, iter, value);
     return 0;
 }
 
@@ -338,17 +478,24 @@ static json_t *json_object_deep_copy(const json_t *object)
 
 json_t *json_array(void)
 {
-    json_array_t *array = jsonp_malloc(sizeof(json_array_t));
+    return jsonp_array_sized(8);
+}
+
+json_t *jsonp_array_sized(size_t size)
+{
+    json_arena_t *arena = jsonp_arena_current();
+    json_array_t *array = jsonp_arena_node_malloc(arena, sizeof(json_array_t));
     if(!array)
         return NULL;
-    json_init(&array->json, JSON_ARRAY);
+    json_init(&array->json, JSON_ARRAY, arena);
 
     array->entries = 0;
-    array->size = 8;
+    array->size = max(size, 8);
 
-    array->table = jsonp_malloc(array->size * sizeof(json_t *));
+    array->table = jsonp_arena_malloc(arena, array->size * sizeof(json_t *));
     if(!array->table) {
-        jsonp_free(array);
+        if(!arena)
+            jsonp_node_free(array, sizeof(json_array_t));
         return NULL;
     }
 
@@ -363,7 +510,7 @@ static void json_delete_array(json_array_t *array)
         json_decref(array->table[i]);
 
     jsonp_free(array->table);
-    jsonp_free(array);
+    jsonp_node_free(array, sizeof(json_array_t));
 }
 
 size_t json_array_size(const json_t *json)
@@ -394,7 +541,7 @@ int json_array_set_new(json_t *json, size_t index, json_t *value)
     if(!value)
         return -1;
 
-    if(!json_is_array(json) || json == value)
+    if(!json_is_array(json) || json_is_frozen(json) || json == value)
     {
         json_decref(value);
         return -1;
@@ -407,7 +554,13 @@ int json_array_set_new(json_t *json, size_t index, json_t *value)
         return -1;
     }
 
-    json_decref(array->table[index]);
+    if(json_adopt(jsonp_arena_of(json), value))
+    {
+        json_decref(value);
+        return -1;
+    }
+
+    json_release(jsonp_arena_of(json), array->table[index]);
     array->table[index] = value;
 
     return 0;
@@ -432,14 +585,16 @@ static json_t **json_array_grow(json_array_t *array,
 {
     size_t new_size;
     json_t **old_table, **new_table;
+    json_arena_t *arena;
 
     if(array->entries + amount <= array->size)
         return array->table;
 
     old_table = array->table;
+    arena = jsonp_arena_of(&array->json);
 
     new_size = max(array->size + amount, array->size * 2);
-    new_table = jsonp_malloc(new_size * sizeof(json_t *));
+    new_table = jsonp_arena_malloc(arena, new_size * sizeof(json_t *));
     if(!new_table)
         return NULL;
 
@@ -448,7 +603,7 @@ static json_t **json_array_grow(json_array_t *array,
 
     if(copy) {
         array_copy(array->table, 0, old_table, 0, array->entries);
-        jsonp_free(old_table);
+        jsonp_arena_free(arena, old_table);
         return array->table;
     }
 
@@ -462,18 +617,23 @@ int json_array_append_new(json_t *json, json_t *value)
     if(!value)
         return -1;
 
-    if(!json_is_array(json) || json == value)
+    if(!json_is_array(json) || json_is_frozen(json) || json == value)
     {
         json_decref(value);
         return -1;
     }
     array = json_to_array(json);
 
-    if(!json_array_grow(array, 1, 1)) {
+    if(json_adopt(jsonp_arena_of(json), value)) {
         json_decref(value);
         return -1;
     }
 
+    if(!json_array_grow(array, 1, 1)) {
+        json_release(jsonp_arena_of(json), value);
+        return -1;
+    }
+
     array->table[array->entries] = value;
     array->entries++;
 
@@ -488,7 +648,7 @@ int json_array_insert_new(json_t *json, size_t index, json_t *value)
     if(!value)
         return -1;
 
-    if(!json_is_array(json) || json == value) {
+    if(!json_is_array(json) || json_is_frozen(json) || json == value) {
         json_decref(value);
         return -1;
     }
@@ -499,9 +659,14 @@ int json_array_insert_new(json_t *json, size_t index, json_t *value)
         return -1;
     }
 
+    if(json_adopt(jsonp_arena_of(json), value)) {
+        json_decref(value);
+        return -1;
+    }
+
     old_table = json_array_grow(array, 1, 0);
     if(!old_table) {
-        json_decref(value);
+        json_release(jsonp_arena_of(json), value);
         return -1;
     }
 
@@ -509,7 +674,7 @@ int json_array_insert_new(json_t *json, size_t index, json_t *value)
         array_copy(array->table, 0, old_table, 0, index);
         array_copy(array->table, index + 1, old_table, index,
                    array->entries - index);
-        jsonp_free(old_table);
+        jsonp_arena_free(jsonp_arena_of(json), old_table);
     }
     else
         array_move(array, index + 1, index, array->entries - index);
@@ -524,14 +689,14 @@ int json_array_remove(json_t *json, size_t index)
 {
     json_array_t *array;
 
-    if(!json_is_array(json))
+    if(!json_is_array(json) || json_is_frozen(json))
         return -1;
     array = json_to_array(json);
 
     if(index >= array->entries)
         return -1;
 
-    json_decref(array->table[index]);
+    json_release(jsonp_arena_of(json), array->table[index]);
 
     /* If we're removing the last element, nothing has to be moved */
     if(index < array->entries - 1)
@@ -547,12 +712,12 @@ int json_array_clear(json_t *json)
     json_array_t *array;
     size_t i;
 
-    if(!json_is_array(json))
+    if(!json_is_array(json) || json_is_frozen(json))
         return -1;
     array = json_to_array(json);
 
     for(i = 0; i < array->entries; i++)
-        json_decref(array->table[i]);
+        json_release(jsonp_arena_of(json), array->table[i]);
 
     array->entries = 0;
     return 0;
@@ -563,7 +728,7 @@ int json_array_extend(json_t *json, json_t *other_json)
     json_array_t *array, *other;
     size_t i;
 
-    if(!json_is_array(json) || !json_is_array(other_json))
+    if(!json_is_array(json) || json_is_frozen(json) || !json_is_array(other_json))
         return -1;
     array = json_to_array(json);
     other = json_to_array(other_json);
@@ -571,15 +736,50 @@ int json_array_extend(json_t *json, json_t *other_json)
     if(!json_array_grow(array, other->entries, 1))
         return -1;
 
-    for(i = 0; i < other->entries; i++)
+    for(i = 0; i < other->entries; i++) {
         json_incref(other->table[i]);
 
+        /* entries adopted so far are released with the arena */
+        if(json_adopt(jsonp_arena_of(json), other->table[i])) {
+            json_decref(other->table[i]);
+            return -1;
+        }
+    }
+
     array_copy(array->table, array->entries, other->table, 0, other->entries);
 
     array->entries += other->entries;
     return 0;
 }
 
+int jsonp_array_splice(json_t *json, json_t *other_json)
+{
+    json_array_t *array, *other;
+
+    if(!json_is_array(json) || !json_is_array(other_json) || json == other_json ||
+       json_is_frozen(json) || json_is_frozen(other_json))
+        return -1;
+
+    /* arena arrays have to adopt their entries */
+    if(jsonp_arena_of(json) || jsonp_arena_of(other_json)) {
+        if(json_array_extend(json, other_json))
+            return -1;
+        return json_array_clear(other_json);
+    }
+
+    array = json_to_array(json);
+    other = json_to_array(other_json);
+
+    if(!json_array_grow(array, other->entries, 1))
+        return -1;
+
+    /* the references move along with the entries */
+    array_copy(array->table, array->entries, other->table, 0, other->entries);
+    array->entries += other->entries;
+    other->entries = 0;
+    return 0;
+}
+
 static int json_array_equal(const json_t *array1, const json_t *array2)
 {
     size_t i, size;
@@ -632,30 +832,95 @@ static json_t *json_array_deep_copy(const json_t *array)
     return result;
 }
 
+/*** borrowed memory ***/
+
+/* Borrowed strings and bytes point at memory owned by someone else. The
+   release callback is called once the value stops using it, i.e. when the
+   value is deleted or set to new contents, which it then owns. */
+typedef struct {
+    json_release_t release;
+    void *ctx;
+} json_borrow_t;
+
+static void borrow_release(json_borrow_t *borrow, const void *ptr, size_t size)
+{
+    json_release_t release = borrow->release;
+
+    borrow->release = NULL;
+    if(release)
+        release(ptr, size, borrow->ctx);
+}
+
+static void borrow_release_owned(const void *ptr, size_t size, void *ctx)
+{
+    (void)size;
+    (void)ctx;
+    jsonp_free((void *)ptr);
+}
+
 /*** string ***/
 
+/* Strings shorter than STRING_INLINE_SIZE are stored in the same
+   allocation as the node */
+#define STRING_INLINE_SIZE 24
+
+typedef struct {
+    json_string_t string;
+    char data[STRING_INLINE_SIZE];
+} json_string_inline_t;
+
+#define string_inline_data(string_) (((json_string_inline_t *)(string_))->data)
+
+typedef struct {
+    json_string_t string;
+    json_borrow_t borrow;
+} json_string_borrowed_t;
+
+#define string_borrow(string_) (&((json_string_borrowed_t *)(string_))->borrow)
+
 static json_t *string_create(const char *value, size_t len, int own)
 {
     char *v;
     json_string_t *string;
+    json_arena_t *arena = jsonp_arena_current();
 
     if(!value)
         return NULL;
 
-    if(own)
+    if(len < STRING_INLINE_SIZE) {
+        string = jsonp_arena_node_malloc(arena, sizeof(json_string_inline_t));
+        if(string) {
+            memcpy(string_inline_data(string), value, len);
+            string_inline_data(string)[len] = '\0';
+        }
+        if(own)
+            jsonp_free((char *)value);
+        if(!string)
+            return NULL;
+
+        json_init(&string->json, JSON_STRING, arena);
+        string->json.flags |= JSON_FLAG_INLINE;
+        string->value = string_inline_data(string);
+        string->length = len;
+        return &string->json;
+    }
+
+    if(own && !arena)
         v = (char *)value;
     else {
-        v = jsonp_strndup(value, len);
+        v = jsonp_arena_strndup(arena, value, len);
+        if(own)
+            jsonp_free((char *)value);
         if(!v)
             return NULL;
     }
 
-    string = jsonp_malloc(sizeof(json_string_t));
+    string = jsonp_arena_node_malloc(arena, sizeof(json_string_t));
     if(!string) {
-        jsonp_free(v);
+        jsonp_arena_free(arena, v);
         return NULL;
     }
-    json_init(&string->json, JSON_STRING);
+    json_init(&string->json, JSON_STRING, arena);
     string->value = v;
     string->length = len;
 
@@ -681,6 +946,32 @@ json_t *jsonp_stringn_nocheck_own(const char *value, size_t len)
     return string_create(value, len, 1);
 }
 
+json_t *json_string_borrow(const char *value, size_t len, json_release_t release, void *ctx)
+{
+    json_string_borrowed_t *string;
+    json_arena_t *arena = jsonp_arena_current();
+
+    /* json_string_value() hands the memory out as a C string */
+    if(!value || value[len] != '\0' || !utf8_check_string(value, len))
+        return NULL;
+
+    string = jsonp_arena_node_malloc(arena, sizeof(json_string_borrowed_t));
+    if(!string)
+        return NULL;
+    json_init(&string->string.json, JSON_STRING, arena);
+    string->string.json.flags |= JSON_FLAG_BORROWED;
+    string->string.value = (char *)value;
+    string->string.length = len;
+    string->borrow.release = release;
+    string->borrow.ctx = ctx;
+
+    /* the arena releases the memory when it is reset */
+    if(arena && jsonp_arena_adopt_bytes(arena, &string->string.json))
+        return NULL;
+
+    return &string->string.json;
+}
+
 json_t *json_string(const char *value)
 {
     if(!value)
@@ -726,15 +1017,32 @@ int json_string_setn_nocheck(json_t *json, const char *value, size_t len)
     char *dup;
     json_string_t *string;
 
-    if(!json_is_string(json) || !value)
-        return -1;
-
-    dup = jsonp_strndup(value, len);
-    if(!dup)
+    if(!json_is_string(json) || json_is_frozen(json) || !value)
         return -1;
 
     string = json_to_string(json);
-    jsonp_free(string->value);
+
+    if(json->flags & JSON_FLAG_INLINE && len < STRING_INLINE_SIZE) {
+        /* value may point into the current value */
+        memmove(string_inline_data(string), value, len);
+        string_inline_data(string)[len] = '\0';
+        dup = string_inline_data(string);
+    }
+    else {
+        dup = jsonp_arena_strndup(jsonp_arena_of(json), value, len);
+        if(!dup)
+            return -1;
+    }
+
+    if(json->flags & JSON_FLAG_BORROWED) {
+        borrow_release(string_borrow(string), string->value, string->length);
+
+        /* arena memory goes with the arena */
+        if(!jsonp_arena_of(json))
+            string_borrow(string)->release = borrow_release_owned;
+    }
+    else if(string->value != string_inline_data(string) || !(json->flags & JSON_FLAG_INLINE))
+        jsonp_arena_free(jsonp_arena_of(json), string->value);
     string->value = dup;
     string->length = len;
 
@@ -759,8 +1067,21 @@ int json_string_setn(json_t *json, const char *value, size_t len)
 
 static void json_delete_string(json_string_t *string)
 {
+    if(string->json.flags & JSON_FLAG_INLINE) {
+        if(string->value != string_inline_data(string))
+            jsonp_free(string->value);
+        jsonp_node_free(string, sizeof(json_string_inline_t));
+        return;
+    }
+
+    if(string->json.flags & JSON_FLAG_BORROWED) {
+        borrow_release(string_borrow(string), string->value, string->length);
+        jsonp_node_free(string, sizeof(json_string_borrowed_t));
+        return;
+    }
+
     jsonp_free(string->value);
-    jsonp_free(string);
+    jsonp_node_free(string, sizeof(json_string_t));
 }
 
 static int json_string_equal(const json_t *string1, const json_t *string2)
@@ -826,10 +1147,11 @@ json_t *json_sprintf(const char *fmt, ...) {
 
 json_t *json_integer(json_int_t value)
 {
-    json_integer_t *integer = jsonp_malloc(sizeof(json_integer_t));
+    json_arena_t *arena = jsonp_arena_current();
+    json_integer_t *integer = jsonp_arena_node_malloc(arena, sizeof(json_integer_t));
     if(!integer)
         return NULL;
-    json_init(&integer->json, JSON_INTEGER);
+    json_init(&integer->json, JSON_INTEGER, arena);
 
     integer->value = value;
     return &integer->json;
@@ -845,7 +1167,7 @@ json_int_t json_integer_value(const json_t *json)
 
 int json_integer_set(json_t *json, json_int_t value)
 {
-    if(!json_is_integer(json))
+    if(!json_is_integer(json) || json_is_frozen(json))
         return -1;
 
     json_to_integer(json)->value = value;
@@ -855,7 +1177,7 @@ int json_integer_set(json_t *json, json_int_t value)
 
 static void json_delete_integer(json_integer_t *integer)
 {
-    jsonp_free(integer);
+    jsonp_node_free(integer, sizeof(json_integer_t));
 }
 
 static int json_integer_equal(const json_t *integer1, const json_t *integer2)
@@ -874,14 +1196,16 @@ static json_t *json_integer_copy(const json_t *integer)
 json_t *json_real(double value)
 {
     json_real_t *real;
+    json_arena_t *arena;
 
     if(isnan(value) || isinf(value))
         return NULL;
 
-    real = jsonp_malloc(sizeof(json_real_t));
+    arena = jsonp_arena_current();
+    real = jsonp_arena_node_malloc(arena, sizeof(json_real_t));
     if(!real)
         return NULL;
-    json_init(&real->json, JSON_REAL);
+    json_init(&real->json, JSON_REAL, arena);
 
     real->value = value;
     return &real->json;
@@ -897,7 +1221,7 @@ double json_real_value(const json_t *json)
 
 int json_real_set(json_t *json, double value)
 {
-    if(!json_is_real(json) || isnan(value) || isinf(value))
+    if(!json_is_real(json) || json_is_frozen(json) || isnan(value) || isinf(value))
         return -1;
 
     json_to_real(json)->value = value;
@@ -907,7 +1231,7 @@ int json_real_set(json_t *json, double value)
 
 static void json_delete_real(json_real_t *real)
 {
-    jsonp_free(real);
+    jsonp_node_free(real, sizeof(json_real_t));
 }
 
 static int json_real_equal(const json_t *real1, const json_t *real2)
@@ -935,18 +1259,52 @@ double json_number_value(const json_t *json)
 
 /*** bytes ***/
 
+typedef struct {
+    json_bytes_t bytes;
+    json_borrow_t borrow;
+} json_bytes_borrowed_t;
+
+#define bytes_borrow(bytes_) (&((json_bytes_borrowed_t *)(bytes_))->borrow)
+
 json_t *json_bytes(void *value, size_t size)
 {
-    json_bytes_t *bytes = jsonp_malloc(sizeof(json_bytes_t));
+    json_arena_t *arena = jsonp_arena_current();
+    json_bytes_t *bytes = jsonp_arena_node_malloc(arena, sizeof(json_bytes_t));
     if(!bytes)
         return NULL;
-    json_init(&bytes->json, JSON_BYTES);
+    json_init(&bytes->json, JSON_BYTES, arena);
 
     bytes->value = value;
     bytes->size = size;
+
+    /* the arena frees the value when it is released */
+    if(arena && jsonp_arena_adopt_bytes(arena, &bytes->json))
+        return NULL;
+
     return &bytes->json;
 }
 
+json_t *json_bytes_borrow(const void *value, size_t size, json_release_t release, void *ctx)
+{
+    json_arena_t *arena = jsonp_arena_current();
+    json_bytes_borrowed_t *bytes = jsonp_arena_node_malloc(arena, sizeof(json_bytes_borrowed_t));
+    if(!bytes)
+        return NULL;
+    json_init(&bytes->bytes.json, JSON_BYTES, arena);
+    bytes->bytes.json.flags |= JSON_FLAG_BORROWED;
+
+    bytes->bytes.value = (void *)value;
+    bytes->bytes.size = size;
+    bytes->borrow.release = release;
+    bytes->borrow.ctx = ctx;
+
+    /* adopted even without a callback, json_bytes_set can give it one */
+    if(arena && jsonp_arena_adopt_bytes(arena, &bytes->bytes.json))
+        return NULL;
+
+    return &bytes->bytes.json;
+}
+
 const void *json_bytes_value(const json_t *json)
 {
     if(!json_is_bytes(json))
@@ -965,9 +1323,19 @@ size_t json_bytes_size(const json_t *json)
 
 int json_bytes_set(json_t *json, void *value, size_t size)
 {
-    if(!json_is_bytes(json))
+    json_bytes_t *bytes;
+
+    if(!json_is_bytes(json) || json_is_frozen(json))
         return -1;
 
+    bytes = json_to_bytes(json);
+
+    /* the new value is owned like the value passed to json_bytes */
+    if(json->flags & JSON_FLAG_BORROWED) {
+        borrow_release(bytes_borrow(bytes), bytes->value, bytes->size);
+        bytes_borrow(bytes)->release = borrow_release_owned;
+    }
+
     json_to_bytes(json)->value = value;
     json_to_bytes(json)->size = size;
 
@@ -976,8 +1344,14 @@ int json_bytes_set(json_t *json, void *value, size_t size)
 
 static void json_delete_bytes(json_bytes_t *bytes)
 {
+    if(bytes->json.flags & JSON_FLAG_BORROWED) {
+        borrow_release(bytes_borrow(bytes), bytes->value, bytes->size);
+        jsonp_node_free(bytes, sizeof(json_bytes_borrowed_t));
+        return;
+    }
+
     jsonp_free(bytes->value);
-    jsonp_free(bytes);
+    jsonp_node_free(bytes, sizeof(json_bytes_t));
 }
 
 static int json_bytes_equal(const json_t *bytes1, const json_t *bytes2)
@@ -1007,25 +1381,297 @@ static json_t *json_bytes_copy(const json_t *json)
 }
 
 
+void jsonp_release_borrowed(json_t *json)
+{
+    if(json_is_string(json))
+        borrow_release(string_borrow(json_to_string(json)),
+                       json_to_string(json)->value, json_to_string(json)->length);
+    else if(json_is_bytes(json))
+        borrow_release(bytes_borrow(json_to_bytes(json)),
+                       json_to_bytes(json)->value, json_to_bytes(json)->size);
+}
+
+
+/*** packed arrays ***/
+
+json_t *json_packed(json_packed_type type, const void *data, size_t count)
+{
+    json_arena_t *arena = jsonp_arena_current();
+    size_t element_size = jsonp_packed_element_size(type);
+    json_packed_t *packed;
+    void *storage = NULL;
+
+    if(!element_size || count > SIZE_MAX / element_size)
+        return NULL;
+
+    if(count) {
+        storage = jsonp_malloc(count * element_size);
+        if(!storage)
+            return NULL;
+
+        if(data)
+            memcpy(storage, data, count * element_size);
+        else
+            memset(storage, 0, count * element_size);
+    }
+
+    packed = jsonp_arena_node_malloc(arena, sizeof(json_packed_t));
+    if(!packed) {
+        jsonp_free(storage);
+        return NULL;
+    }
+    json_init(&packed->json, JSON_PACKED, arena);
+    packed->type = type;
+    packed->size = count;
+    packed->allocated = count;
+    packed->data = storage;
+
+    /* the arena frees the storage when it is released */
+    if(arena && jsonp_arena_adopt_bytes(arena, &packed->json))
+        return NULL;
+
+    return &packed->json;
+}
+
+int json_packed_type_of(const json_t *json)
+{
+    if(!json_is_packed(json))
+        return -1;
+
+    return (int)json_to_packed(json)->type;
+}
+
+size_t json_packed_size(const json_t *json)
+{
+    if(!json_is_packed(json))
+        return 0;
+
+    return json_to_packed(json)->size;
+}
+
+void *json_packed_data(const json_t *json)
+{
+    if(!json_is_packed(json))
+        return NULL;
+
+    return json_to_packed(json)->data;
+}
+
+int json_packed_resize(json_t *json, size_t count)
+{
+    json_packed_t *packed;
+    size_t element_size, new_allocated;
+    void *storage;
+
+    if(!json_is_packed(json) || json_is_frozen(json))
+        return -1;
+
+    packed = json_to_packed(json);
+    element_size = jsonp_packed_element_size(packed->type);
+
+    if(count > packed->allocated) {
+        /* grow like arrays do so that appending one at a time is amortized */
+        new_allocated = packed->allocated * 2 > count ? packed->allocated * 2 : count;
+        if(new_allocated > SIZE_MAX / element_size)
+            return -1;
+
+        storage = jsonp_malloc(new_allocated * element_size);
+        if(!storage)
+            return -1;
+
+        if(packed->size)
+            memcpy(storage, packed->data, packed->size * element_size);
+        jsonp_free(packed->data);
+        packed->data = storage;
+        packed->allocated = new_allocated;
+    }
+
+    if(count > packed->size)
+        memset((char *)packed->data + packed->size * element_size, 0,
+               (count - packed->size) * element_size);
+
+    packed->size = count;
+    return 0;
+}
+
+static void json_delete_packed(json_packed_t *packed)
+{
+    jsonp_free(packed->data);
+    jsonp_node_free(packed, sizeof(json_packed_t));
+}
+
+static int json_packed_equal(const json_t *packed1, const json_t *packed2)
+{
+    json_packed_t *p1 = json_to_packed(packed1);
+    json_packed_t *p2 = json_to_packed(packed2);
+    size_t i;
+
+    if(p1->type != p2->type || p1->size != p2->size)
+        return 0;
+
+    /* compare doubles by value like reals */
+    if(p1->type == JSON_PACKED_DOUBLE) {
+        for(i = 0; i < p1->size; i++) {
+            if(((double *)p1->data)[i] != ((double *)p2->data)[i])
+                return 0;
+        }
+        return 1;
+    }
+
+    return !p1->size || memcmp(p1->data, p2->data, p1->size * jsonp_packed_element_size(p1->type)) == 0;
+}
+
+static json_t *json_packed_copy(const json_t *json)
+{
+    json_packed_t *packed = json_to_packed(json);
+    return json_packed(packed->type, packed->data, packed->size);
+}
+
+
+/*** fragments ***/
+
+/* Fragments are meant to be shared by many values and outlive them,
+   so they are never allocated from an arena */
+static json_t *fragment_new(json_t *value, const char *text, size_t len, size_t text_flags,
+                            const void *bos, size_t size, size_t bos_flags)
+{
+    json_fragment_t *fragment;
+    char *storage;
+
+    if(len > SIZE_MAX - 1 - size)
+        return NULL;
+
+    /* the text and the BOS value share one allocation */
+    storage = jsonp_malloc(len + 1 + size);
+    if(!storage)
+        return NULL;
+
+    fragment = jsonp_node_malloc(sizeof(json_fragment_t));
+    if(!fragment) {
+        jsonp_free(storage);
+        return NULL;
+    }
+    json_init(&fragment->json, JSON_FRAGMENT, NULL);
+
+    fragment->value = json_incref(value);
+    fragment->text = text ? storage : NULL;
+    fragment->text_length = text ? len : 0;
+    fragment->text_flags = text_flags;
+    fragment->bos = bos ? (unsigned char *)storage + len + 1 : NULL;
+    fragment->bos_size = bos ? size : 0;
+    fragment->bos_flags = bos_flags;
+
+    if(text)
+        memcpy(storage, text, len);
+    storage[len] = '\0';
+    if(bos)
+        memcpy(storage + len + 1, bos, size);
+
+    return &fragment->json;
+}
+
+json_t *json_fragment(const char *text, size_t len, const void *bos, size_t size)
+{
+    uint32_t frame_size;
+
+    if(!text && !bos)
+        return NULL;
+
+    if(!text)
+        len = 0;
+    if(!bos)
+        size = 0;
+
+    /* bos is a whole BOS frame, the fragment keeps the value inside it */
+    if(bos) {
+        if(size <= 4)
+            return NULL;
+        memcpy(&frame_size, bos, 4);
+        if(frame_size != size)
+            return NULL;
+    }
+
+    return fragment_new(NULL, text, len, 0,
+                        bos ? (const unsigned char *)bos + 4 : NULL, bos ? size - 4 : 0, 0);
+}
+
+json_t *json_encode_cache(json_t *value, size_t json_flags, size_t bos_flags)
+{
+    json_t *fragment;
+    char *text;
+    bos_t *bos;
+
+    if(!value || json_is_fragment(value))
+        return NULL;
+
+    json_flags &= JSON_FRAGMENT_FLAGS;
+    bos_flags &= BOS_FRAGMENT_FLAGS;
+
+    /* either form may fail on its own, bytes have no JSON text */
+    text = json_dumps(value, json_flags | JSON_ENCODE_ANY);
+    bos = bos_serialize_ex(value, bos_flags, NULL);
+    if(!text && !bos)
+        return NULL;
+
+    fragment = fragment_new(value, text, text ? strlen(text) : 0, json_flags,
+                            bos ? (const unsigned char *)bos->data + 4 : NULL, bos ? bos->size - 4 : 0,
+                            bos_flags);
+
+    jsonp_free(text);
+    bos_free(bos);
+    return fragment;
+}
+
+json_t *json_fragment_value(const json_t *json)
+{
+    if(!json_is_fragment(json))
+        return NULL;
+
+    return json_to_fragment(json)->value;
+}
+
+static void json_delete_fragment(json_fragment_t *fragment)
+{
+    /* the storage starts with the text, which is at least a terminator */
+    json_decref(fragment->value);
+    jsonp_free(fragment->text ? (void *)fragment->text : (void *)(fragment->bos - 1));
+    jsonp_node_free(fragment, sizeof(json_fragment_t));
+}
+
+static int json_fragment_equal(const json_t *fragment1, const json_t *fragment2)
+{
+    json_fragment_t *f1 = json_to_fragment(fragment1);
+    json_fragment_t *f2 = json_to_fragment(fragment2);
+
+    if(f1->value || f2->value)
+        return json_equal(f1->value, f2->value);
+
+    return f1->text_length == f2->text_length && f1->bos_size == f2->bos_size &&
+           !f1->text == !f2->text && !f1->bos == !f2->bos &&
+           (!f1->text || memcmp(f1->text, f2->text, f1->text_length) == 0) &&
+           (!f1->bos || memcmp(f1->bos, f2->bos, f1->bos_size) == 0);
+}
+
+
 /*** simple values ***/
 
 json_t *json_true(void)
 {
-    static json_t the_true = {JSON_TRUE, (size_t)-1};
+    static json_t the_true = {JSON_TRUE, 0, (size_t)-1};
     return &the_true;
 }
 
 
 json_t *json_false(void)
 {
-    static json_t the_false = {JSON_FALSE, (size_t)-1};
+    static json_t the_false = {JSON_FALSE, 0, (size_t)-1};
     return &the_false;
 }
 
 
 json_t *json_null(void)
 {
-    static json_t the_null = {JSON_NULL, (size_t)-1};
+    static json_t the_null = {JSON_NULL, 0, (size_t)-1};
     return &the_null;
 }
 
@@ -1034,7 +1680,7 @@ json_t *json_null(void)
 
 void json_delete(json_t *json)
 {
-    if (!json)
+    if (!json || json->flags & JSON_FLAG_ARENA)
         return;
 
     switch(json_typeof(json)) {
@@ -1056,6 +1702,12 @@ void json_delete(json_t *json)
         case JSON_BYTES:
             json_delete_bytes(json_to_bytes(json));
             break;
+        case JSON_PACKED:
+            json_delete_packed(json_to_packed(json));
+            break;
+        case JSON_FRAGMENT:
+            json_delete_fragment(json_to_fragment(json));
+            break;
         default:
             return;
     }
@@ -1064,16 +1716,223 @@ void json_delete(json_t *json)
 }
 
 
+/*** freezing ***/
+
+/* Frozen nodes keep their reference count so that thawing restores
+   the ownership they had. The singletons are left alone, they are
+   shared by everything and never counted anyway. */
+static void json_set_frozen(json_t *json, int frozen)
+{
+    size_t i;
+
+    if(json_is_true(json) || json_is_false(json) || json_is_null(json))
+        return;
+
+    /* subtrees that already have the state were reached another way */
+    if(!(json->flags & JSON_FLAG_FROZEN) == !frozen)
+        return;
+
+    /* a thawed container can change, so its hash goes too */
+    if(frozen)
+        json->flags |= JSON_FLAG_FROZEN;
+    else
+        json->flags &= ~(JSON_FLAG_FROZEN | JSON_FLAG_HASHED);
+
+    if(json_is_object(json)) {
+        void *iter = json_object_iter(json);
+        while(iter) {
+            json_set_frozen(json_object_iter_value(iter), frozen);
+            iter = json_object_iter_next(json, iter);
+        }
+    }
+    else if(json_is_array(json)) {
+        for(i = 0; i < json_array_size(json); i++)
+            json_set_frozen(json_array_get(json, i), frozen);
+    }
+}
+
+int json_freeze(json_t *json)
+{
+    if(!json)
+        return -1;
+
+    json_set_frozen(json, 1);
+    return 0;
+}
+
+void json_thaw_release(json_t *json)
+{
+    if(!json)
+        return;
+
+    json_set_frozen(json, 0);
+    json_decref(json);
+}
+
+
+/*** hashing ***/
+
+static JSON_INLINE uint64_t hash_combine(uint64_t hash, uint64_t value)
+{
+    hash ^= xxh_round(0, value);
+    return xxh_rotl64(hash, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+static JSON_INLINE uint64_t hash_finish(uint64_t hash)
+{
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME64_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+/* 0.0 and -0.0 are equal, so they hash the same */
+static JSON_INLINE uint64_t hash_real(double value)
+{
+    uint64_t bits;
+
+    if(value == 0.0)
+        value = 0.0;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static JSON_INLINE int hash_cached(const json_t *json, uint64_t *hash, uint64_t *seed)
+{
+    if(!(json->flags & JSON_FLAG_HASHED))
+        return 0;
+
+    if(json_is_object(json)) {
+        *hash = json_to_object(json)->hash;
+        *seed = json_to_object(json)->hash_seed;
+    }
+    else {
+        *hash = json_to_array(json)->hash;
+        *seed = json_to_array(json)->hash_seed;
+    }
+    return 1;
+}
+
+/* Object members are summed so that their order doesn't matter. With
+   store set, frozen containers keep their hash. */
+static uint64_t hash_value(json_t *json, uint64_t seed, int store)
+{
+    uint64_t hash = hash_combine(seed, (uint64_t)json_typeof(json));
+    uint64_t cached, cached_seed;
+    size_t i;
+
+    if(hash_cached(json, &cached, &cached_seed) && cached_seed == seed)
+        return cached;
+
+    switch(json_typeof(json)) {
+        case JSON_OBJECT: {
+            uint64_t sum = 0;
+            void *iter;
+
+            for(iter = json_object_iter(json); iter; iter = json_object_iter_next(json, iter)) {
+                const struct hashtable_pair *pair = iter;
+                uint64_t key = xxh64(pair->key, pair->key_len, seed);
+
+                sum += hash_finish(hash_combine(key, hash_value(pair->value, seed, store)));
+            }
+            hash = hash_combine(hash_combine(hash, (uint64_t)json_object_size(json)), sum);
+
+            if(store && json_is_frozen(json)) {
+                json_to_object(json)->hash = hash_finish(hash);
+                json_to_object(json)->hash_seed = seed;
+                json->flags |= JSON_FLAG_HASHED;
+            }
+            break;
+        }
+        case JSON_ARRAY:
+            hash = hash_combine(hash, (uint64_t)json_array_size(json));
+            for(i = 0; i < json_array_size(json); i++)
+                hash = hash_combine(hash, hash_value(json_array_get(json, i), seed, store));
+
+            if(store && json_is_frozen(json)) {
+                json_to_array(json)->hash = hash_finish(hash);
+                json_to_array(json)->hash_seed = seed;
+                json->flags |= JSON_FLAG_HASHED;
+            }
+            break;
+        case JSON_STRING:
+            hash = hash_combine(hash, xxh64(json_string_value(json), json_string_length(json), seed));
+            break;
+        case JSON_INTEGER:
+            hash = hash_combine(hash, (uint64_t)json_integer_value(json));
+            break;
+        case JSON_REAL:
+            hash = hash_combine(hash, hash_real(json_real_value(json)));
+            break;
+        case JSON_BYTES:
+            hash = hash_combine(hash, xxh64(json_bytes_value(json), json_bytes_size(json), seed));
+            break;
+        case JSON_PACKED: {
+            json_packed_t *packed = json_to_packed(json);
+
+            hash = hash_combine(hash_combine(hash, (uint64_t)packed->type), (uint64_t)packed->size);
+            if(packed->type == JSON_PACKED_DOUBLE) {
+                for(i = 0; i < packed->size; i++)
+                    hash = hash_combine(hash, hash_real(((const double *)packed->data)[i]));
+            }
+            else if(packed->size)
+                hash = hash_combine(hash, xxh64(packed->data, packed->size * jsonp_packed_element_size(packed->type), seed));
+            break;
+        }
+        case JSON_FRAGMENT: {
+            json_fragment_t *fragment = json_to_fragment(json);
+
+            if(fragment->value)
+                return hash_finish(hash_combine(hash, hash_value(fragment->value, seed, store)));
+
+            hash = hash_combine(hash, fragment->text ? xxh64(fragment->text, fragment->text_length, seed) : 0);
+            hash = hash_combine(hash, fragment->bos ? xxh64(fragment->bos, fragment->bos_size, seed) : 0);
+            break;
+        }
+        default:
+            break;
+    }
+
+    return hash_finish(hash);
+}
+
+uint64_t json_hash(const json_t *json, uint64_t seed)
+{
+    if(!json)
+        return 0;
+
+    return hash_value((json_t *)json, seed, 0);
+}
+
+int json_hash_cache(json_t *json, uint64_t seed)
+{
+    if(!json_is_frozen(json))
+        return -1;
+
+    hash_value(json, seed, 1);
+    return 0;
+}
+
+
 /*** equality ***/
 
 int json_equal(const json_t *json1, const json_t *json2)
 {
+    uint64_t hash1, hash2, seed1, seed2;
+
     if(!json1 || !json2)
         return 0;
 
     if(json_typeof(json1) != json_typeof(json2))
         return 0;
 
+    /* containers hashed with the same seed differ if their hashes do */
+    if(hash_cached(json1, &hash1, &seed1) && hash_cached(json2, &hash2, &seed2) &&
+       seed1 == seed2 && hash1 != hash2)
+        return 0;
+
     /* this covers true, false and null as they are singletons */
     if(json1 == json2)
         return 1;
@@ -1091,6 +1950,10 @@ int json_equal(const json_t *json1, const json_t *json2)
             return json_real_equal(json1, json2);
         case JSON_BYTES:
             return json_bytes_equal(json1, json2);
+        case JSON_PACKED:
+            return json_packed_equal(json1, json2);
+        case JSON_FRAGMENT:
+            return json_fragment_equal(json1, json2);
         default:
             return 0;
     }
@@ -1117,6 +1980,11 @@ json_t *json_copy(json_t *json)
             return json_real_copy(json);
         case JSON_BYTES:
             return json_bytes_copy(json);
+        case JSON_PACKED:
+            return json_packed_copy(json);
+        case JSON_FRAGMENT:
+            /* fragments can't be modified, so they can be shared */
+            return json_incref(json);
         case JSON_TRUE:
         case JSON_FALSE:
         case JSON_NULL:
@@ -1146,6 +2014,10 @@ json_t *json_deep_copy(const json_t *json)
             return json_real_copy(json);
         case JSON_BYTES:
             return json_bytes_copy(json);
+        case JSON_PACKED:
+            return json_packed_copy(json);
+        case JSON_FRAGMENT:
+            return json_incref((json_t *)json);
         case JSON_TRUE:
         case JSON_FALSE:
         case JSON_NULL:
@@ -1154,3 +2026,64 @@ json_t *json_deep_copy(const json_t *json)
             return NULL;
     }
 }
+
+json_t *json_object_with_new(json_t *json, const char *key, json_t *value)
+{
+    json_t *result;
+    void *iter;
+
+    if(!json_is_object(json) || !key || !value || !utf8_check_string(key, strlen(key))) {
+        json_decref(value);
+        return NULL;
+    }
+
+    result = json_object();
+    if(!result) {
+        json_decref(value);
+        return NULL;
+    }
+
+    /* every pair stores the hash it was set with, so the keys are
+       copied without hashing them again */
+    for(iter = json_object_iter(json); iter; iter = json_object_iter_next(json, iter)) {
+        struct hashtable_pair *pair = iter;
+
+        if(jsonp_object_set_hashed_new(result, pair->key, pair->key_len, pair->hash,
+                                       json_incref(pair->value))) {
+            json_decref(result);
+            json_decref(value);
+            return NULL;
+        }
+    }
+
+    if(json_object_set_new_nocheck(result, key, value)) {
+        json_decref(result);
+        return NULL;
+    }
+
+    return result;
+}
+
+json_t *json_array_with_new(json_t *json, size_t index, json_t *value)
+{
+    json_t *result;
+
+    if(!json_is_array(json) || index >= json_array_size(json) || !value) {
+        json_decref(value);
+        return NULL;
+    }
+
+    result = json_array();
+    if(!result || json_array_extend(result, json)) {
+        json_decref(result);
+        json_decref(value);
+        return NULL;
+    }
+
+    if(json_array_set_new(result, index, value)) {
+        json_decref(result);
+        return NULL;
+    }
+
+    return result;
+}
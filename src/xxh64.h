@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2018 JCThePants <github.com/JCThePants>
+ *
+ * Bos-Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+/*
+ * XXH64, the 64-bit variant of Yann Collet's xxHash. Processes 8 bytes
+ * per step where lookup3 handles 4, and needs no separate length pass
+ * over the key.
+ */
+
+#ifndef XXH64_H
+#define XXH64_H
+
+#include <stdlib.h>
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include <jansson_config.h>   /* for JSON_INLINE */
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+#define xxh_rotl64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+/* little endian loads on every platform, compilers turn these into
+   a single load where possible */
+static JSON_INLINE uint64_t xxh_read64(const unsigned char *p)
+{
+    return (uint64_t)p[0] | (uint64_t)p[1] << 8 |
+           (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24 |
+           (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 |
+           (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+}
+
+static JSON_INLINE uint32_t xxh_read32(const unsigned char *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+           (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static JSON_INLINE uint64_t xxh_round(uint64_t acc, uint64_t input)
+{
+    acc += input * XXH_PRIME64_2;
+    acc = xxh_rotl64(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
+
+static JSON_INLINE uint64_t xxh_merge(uint64_t acc, uint64_t val)
+{
+    acc ^= xxh_round(0, val);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+static JSON_INLINE uint64_t xxh64(const void *key, size_t length, uint64_t seed)
+{
+    const unsigned char *p = (const unsigned char *)key;
+    const unsigned char *end = p + length;
+    uint64_t h64;
+
+    if(length >= 32)
+    {
+        const unsigned char *limit = end - 32;
+        uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+        uint64_t v2 = seed + XXH_PRIME64_2;
+        uint64_t v3 = seed + 0;
+        uint64_t v4 = seed - XXH_PRIME64_1;
+
+        do {
+            v1 = xxh_round(v1, xxh_read64(p));
+            v2 = xxh_round(v2, xxh_read64(p + 8));
+            v3 = xxh_round(v3, xxh_read64(p + 16));
+            v4 = xxh_round(v4, xxh_read64(p + 24));
+            p += 32;
+        } while(p <= limit);
+
+        h64 = xxh_rotl64(v1, 1) + xxh_rotl64(v2, 7) + xxh_rotl64(v3, 12) + xxh_rotl64(v4, 18);
+        h64 = xxh_merge(h64, v1);
+        h64 = xxh_merge(h64, v2);
+        h64 = xxh_merge(h64, v3);
+        h64 = xxh_merge(h64, v4);
+    }
+    else
+    {
+        h64 = seed + XXH_PRIME64_5;
+    }
+
+    h64 += (uint64_t)length;
+
+    while(p + 8 <= end)
+    {
+        h64 ^= xxh_round(0, xxh_read64(p));
+        h64 = xxh_rotl64(h64, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+        p += 8;
+    }
+
+    if(p + 4 <= end)
+    {
+        h64 ^= (uint64_t)xxh_read32(p) * XXH_PRIME64_1;
+        h64 = xxh_rotl64(h64, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+
+    while(p < end)
+    {
+        h64 ^= (uint64_t)(*p) * XXH_PRIME64_5;
+        h64 = xxh_rotl64(h64, 11) * XXH_PRIME64_1;
+        p++;
+    }
+
+    h64 ^= h64 >> 33;
+    h64 *= XXH_PRIME64_2;
+    h64 ^= h64 >> 29;
+    h64 *= XXH_PRIME64_3;
+    h64 ^= h64 >> 32;
+
+    return h64;
+}
+
+#endif
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2018 JCThePants <github.com/JCThePants>
+ *
+ * Bos-Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <string.h>
+#include <bosjansson.h>
+#include "util.h"
+
+static void test_arena_values(void)
+{
+    json_arena_t *arena = json_arena_new(0);
+    json_t *object, *array, *string, *value;
+    int i;
+
+    if(!arena)
+        fail("unable to create an arena");
+
+    if(json_arena_use(arena) != NULL)
+        fail("json_arena_use returned a previous arena");
+
+    object = json_object();
+    array = json_array();
+    string = json_string("arena string");
+    if(!object || !array || !string)
+        fail("unable to create values in an arena");
+
+    if(json_arena_used(arena) == 0)
+        fail("arena reports no memory used");
+
+    /* reference counting does nothing for arena values */
+    json_incref(string);
+    json_decref(string);
+    json_decref(string);
+
+    for(i = 0; i < 100; i++) {
+        if(json_array_append_new(array, json_integer(i)))
+            fail("unable to append to an arena array");
+    }
+
+    for(i = 0; i < 100; i++) {
+        char key[16];
+        snprintf(key, sizeof(key), "key%d", i);
+        if(json_object_set_new(object, key, json_real(i + 0.5)))
+            fail("unable to set an arena object member");
+    }
+
+    if(json_object_set(object, "string", string) ||
+       json_object_set_new(object, "array", array))
+        fail("unable to set an arena object member");
+
+    if(json_array_size(array) != 100 || json_object_size(object) != 102)
+        fail("arena containers have the wrong size");
+
+    value = json_object_get(object, "key42");
+    if(!value || json_real_value(value) != 42.5)
+        fail("arena object lookup failed");
+
+    if(json_string_set(string, "changed") || strcmp(json_string_value(string), "changed"))
+        fail("unable to set an arena string");
+
+    if(json_array_remove(array, 0) || json_integer_value(json_array_get(array, 0)) != 1)
+        fail("unable to remove from an arena array");
+
+    if(json_object_del(object, "key0") || json_object_get(object, "key0"))
+        fail("unable to delete from an arena object");
+
+    json_decref(object);
+
+    if(json_arena_use(NULL) != arena)
+        fail("json_arena_use did not return the arena in use");
+
+    /* values created outside of the arena use the heap */
+    value = json_integer(1);
+    if(value->refcount != 1)
+        fail("heap value created while no arena is in use");
+    json_decref(value);
+
+    json_arena_reset(arena);
+    if(json_arena_used(arena) != 0)
+        fail("arena reports memory used after reset");
+
+    json_arena_free(arena);
+}
+
+static void test_arena_foreign_values(void)
+{
+    json_arena_t *arena = json_arena_new(256);
+    json_t *heap_string = json_string("heap");
+    json_t *heap_array = json_array();
+    json_t *object, *array;
+    void *bytes = malloc(5);
+
+    memcpy(bytes, "bytes", 5);
+    json_arena_use(arena);
+
+    object = json_object();
+    array = json_array();
+
+    /* heap values are held by the arena until it is released */
+    json_object_set(object, "heap", heap_string);
+    json_array_append(array, heap_string);
+    json_array_append_new(array, heap_array);
+    json_object_set_new(object, "bytes", json_bytes(bytes, 5));
+
+    if(heap_string->refcount != 3)
+        fail("arena containers did not take a reference to a heap value");
+
+    /* replacing and removing does not release the heap value early */
+    json_object_set_new(object, "heap", json_null());
+    json_array_remove(array, 0);
+    if(heap_string->refcount != 3)
+        fail("arena container released a heap value early");
+
+    json_arena_use(NULL);
+    json_arena_free(arena);
+
+    if(heap_string->refcount != 1)
+        fail("arena did not release heap values");
+
+    json_decref(heap_string);
+}
+
+static void test_arena_load(void)
+{
+    json_arena_t *arena = json_arena_new(0);
+    json_error_t error;
+    json_t *value, *copy;
+    bos_t *serialized;
+    const char *text = "{\"id\": 1, \"method\": \"mining.submit\", \"params\": [\"a\", \"b\", 2.5, true]}";
+    int i;
+
+    for(i = 0; i < 3; i++) {
+        json_arena_use(arena);
+
+        value = json_loads(text, 0, &error);
+        if(!value)
+            fail("unable to load into an arena");
+
+        serialized = bos_serialize(value, &error);
+        if(!serialized)
+            fail("unable to serialize an arena value");
+
+        copy = bos_deserialize(serialized->data, &error);
+        if(!copy || !json_equal(value, copy))
+            fail("unable to deserialize into an arena");
+
+        bos_free(serialized);
+        json_decref(copy);
+        json_decref(value);
+
+        json_arena_use(NULL);
+        json_arena_reset(arena);
+    }
+
+    json_arena_free(arena);
+}
+
+static void run_tests()
+{
+    test_arena_values();
+    test_arena_foreign_values();
+    test_arena_load();
+}
@@ -866,20 +866,33 @@ static void test_format_obj() {
 static void test_validation(bos_t *serialized) {
 
     uint32_t invalid_size;
+    json_error_t error;
+    json_t *value;
 
     if (!bos_validate(serialized->data, serialized->size))
         fail("validation failed but should have succeeded");
 
+    value = bos_deserialize_ex(serialized->data, serialized->size, 0, &error);
+    if (!value)
+        fail("checked deserialize failed but should have succeeded");
+    json_decref(value);
+
     invalid_size = serialized->size - 1;
 
     // should fail if data size is less than the size indicated in the data
     if (bos_validate(serialized->data, invalid_size))
         fail("validation succeeded but should have failed");
 
+    if (bos_deserialize_ex(serialized->data, invalid_size, 0, &error))
+        fail("checked deserialize succeeded but should have failed");
+
     // should fail if the data is corrupt and the size indicated in the data is smaller than required
     memcpy((void *)serialized->data, &invalid_size, sizeof(uint32_t));
     if (bos_validate(serialized->data, invalid_size))
         fail("validation succeeded but should have failed");
+
+    if (bos_deserialize_ex(serialized->data, invalid_size, 0, &error))
+        fail("checked deserialize succeeded but should have failed");
 }
 
 static void test_validation_obj() {
@@ -1137,6 +1150,1530 @@ static void test_validation_array() {
     bos_free(serialized);
 }
 
+/*** BOS writer tests ***/
+
+static void test_writer_reuse() {
+
+    bos_writer_t writer;
+    json_error_t error;
+    json_t *value = json_pack("{s:s, s:i}", "method", "mining.notify", "id", 7);
+    const void *first_data;
+    size_t first_size;
+    bos_t *serialized = bos_serialize(value, &error);
+
+    bos_writer_init(&writer, NULL, 0, 0);
+
+    if (bos_writer_serialize(&writer, value, &error))
+        fail("writer serialize failed");
+
+    if (bos_writer_size(&writer) != serialized->size ||
+        memcmp(bos_writer_data(&writer), serialized->data, serialized->size) != 0)
+        fail("writer output differs from bos_serialize");
+
+    first_data = bos_writer_data(&writer);
+    first_size = bos_writer_size(&writer);
+
+    /* frames are appended until the writer is reset */
+    if (bos_writer_serialize(&writer, value, &error))
+        fail("writer serialize failed");
+
+    if (bos_writer_size(&writer) != 2 * first_size ||
+        bos_sizeof((const char *)bos_writer_data(&writer) + first_size) != first_size)
+        fail("writer did not append the second frame");
+
+    /* the buffer is kept across a reset */
+    bos_writer_reset(&writer);
+    if (bos_writer_size(&writer) != 0)
+        fail("writer reset did not clear the size");
+
+    if (bos_writer_serialize(&writer, value, &error))
+        fail("writer serialize failed");
+
+    if (bos_writer_data(&writer) != first_data)
+        fail("writer did not reuse its buffer");
+
+    bos_writer_close(&writer);
+    bos_free(serialized);
+    json_decref(value);
+}
+
+static void test_writer_region() {
+
+    bos_writer_t writer;
+    json_error_t error;
+    unsigned char region[64];
+    json_t *small = json_integer(1);
+    json_t *large = json_string("a string that is far too long to fit into sixteen bytes");
+    bos_t *taken;
+
+    bos_writer_init(&writer, region, sizeof(region), 0);
+
+    if (bos_writer_serialize(&writer, small, &error))
+        fail("region serialize failed");
+
+    if (bos_writer_data(&writer) != region || bos_writer_size(&writer) != 6)
+        fail("region serialize did not write into the region");
+
+    /* a frame that doesn't fit fails and leaves earlier frames intact */
+    bos_writer_init(&writer, region, 16, 0);
+    if (bos_writer_serialize(&writer, small, &error))
+        fail("region serialize failed");
+
+    if (!bos_writer_serialize(&writer, large, &error))
+        fail("region serialize should have failed");
+
+    if (json_error_code(&error) != json_error_out_of_memory)
+        fail("region overflow reported wrong error code");
+
+    if (bos_writer_size(&writer) != 6)
+        fail("failed frame was not rolled back");
+
+    /* the taken frame is a copy, the region stays with the caller */
+    taken = bos_writer_take(&writer);
+    if (!taken || taken->data == (void *)region || taken->size != 6)
+        fail("take from region failed");
+    bos_free(taken);
+
+    bos_writer_close(&writer);
+    json_decref(small);
+    json_decref(large);
+}
+
+static void test_writer_spill() {
+
+    bos_writer_t writer;
+    json_error_t error;
+    unsigned char region[16];
+    json_t *small = json_integer(1);
+    json_t *large = json_string("a string that is far too long to fit into sixteen bytes");
+    bos_t *taken;
+    json_t *decoded;
+
+    bos_writer_init(&writer, region, sizeof(region), BOS_WRITER_SPILL);
+
+    if (bos_writer_serialize(&writer, small, &error))
+        fail("spill serialize failed");
+
+    if (bos_writer_serialize(&writer, large, &error))
+        fail("spill serialize should have spilled to the heap");
+
+    if (bos_writer_data(&writer) == region)
+        fail("writer did not spill");
+
+    if (bos_sizeof(bos_writer_data(&writer)) != 6)
+        fail("spilled writer lost the first frame");
+
+    taken = bos_writer_take(&writer);
+    if (!taken)
+        fail("take after spill failed");
+
+    decoded = bos_deserialize((const char *)taken->data + 6, &error);
+    if (!decoded || !json_equal(decoded, large))
+        fail("spilled frame did not round trip");
+
+    /* after a take or reset the writer goes back to the region */
+    if (bos_writer_serialize(&writer, small, &error) || bos_writer_data(&writer) != region)
+        fail("writer did not return to the region");
+
+    json_decref(decoded);
+    bos_free(taken);
+    bos_writer_close(&writer);
+    json_decref(small);
+    json_decref(large);
+}
+
+/*** exact size tests ***/
+
+static void check_real_encoding(double real, size_t flags, uint8_t expected) {
+
+    json_error_t error;
+    json_t *value = json_real(real);
+    bos_t *serialized = bos_serialize_ex(value, flags | BOS_EXACT_SIZE, &error);
+    json_t *result;
+
+    if (!serialized)
+        fail("serializing a real failed");
+
+    if (((uint8_t *)serialized->data)[4] != expected)
+        fail("real serialized with the wrong type");
+
+    if (!flags && serialized->size != bos_serialized_size(value))
+        fail("bos_serialized_size differs for a real");
+
+    result = bos_deserialize(serialized->data, &error);
+    if (!result || json_number_value(result) != real)
+        fail("real did not round trip");
+
+    json_decref(result);
+    json_decref(value);
+    bos_free(serialized);
+}
+
+static void test_real_encoding() {
+
+    json_error_t error;
+    json_t *value;
+    bos_t *serialized;
+
+    /* the smallest encoding that round trips, 0x0A float and 0x0B double */
+    check_real_encoding(5.5, 0, 0x0A);
+    check_real_encoding(-0.0, 0, 0x0A);
+    check_real_encoding(0.1, 0, 0x0B);
+    check_real_encoding(1e300, 0, 0x0B);
+    check_real_encoding(123456789.0, 0, 0x0B);
+
+    /* integral values as integers when allowed, 0x06 uint8, 0x03 int16 and 0x08 uint32 */
+    check_real_encoding(3.0, BOS_INTEGRAL_REALS, 0x06);
+    check_real_encoding(-200.0, BOS_INTEGRAL_REALS, 0x03);
+    check_real_encoding(123456789.0, BOS_INTEGRAL_REALS, 0x08);
+    check_real_encoding(2.5, BOS_INTEGRAL_REALS, 0x0A);
+    check_real_encoding(-0.0, BOS_INTEGRAL_REALS, 0x0A);
+    check_real_encoding(1e300, BOS_INTEGRAL_REALS, 0x0B);
+
+    /* which then come back as integers */
+    value = json_real(42.0);
+    serialized = bos_serialize_ex(value, BOS_INTEGRAL_REALS, &error);
+    json_decref(value);
+    value = bos_deserialize(serialized->data, &error);
+    if (!json_is_integer(value) || json_integer_value(value) != 42)
+        fail("integral real did not deserialize as an integer");
+    json_decref(value);
+    bos_free(serialized);
+
+    /* compatibility: every real as a float */
+    value = json_real(0.1);
+    serialized = bos_serialize_ex(value, BOS_FLOAT_REALS, &error);
+    if (!serialized || serialized->size != 9 || ((uint8_t *)serialized->data)[4] != 0x0A)
+        fail("BOS_FLOAT_REALS did not write a float");
+    bos_free(serialized);
+    json_decref(value);
+}
+
+static void test_packed() {
+
+    int64_t integers[] = {1, -2, 3000000000LL, 4};
+    double reals[] = {0.5, 0.1, -3.0};
+    json_error_t error;
+    json_t *value, *result, *copy;
+    bos_t *serialized;
+    bos_view_t view;
+    json_packed_type type;
+    const void *data;
+    size_t count;
+    char *text;
+    uint32_t *words;
+
+    value = json_packed(JSON_PACKED_INT64, integers, 4);
+    if (!json_is_packed(value) || json_packed_type_of(value) != JSON_PACKED_INT64 ||
+        json_packed_size(value) != 4 || memcmp(json_packed_data(value), integers, sizeof(integers)))
+        fail("json_packed failed");
+
+    if (json_packed_type_of(json_true()) != -1 || json_packed((json_packed_type)7, NULL, 1))
+        fail("json_packed accepted a bad type");
+
+    /* growing zero fills */
+    if (json_packed_resize(value, 6) || json_packed_size(value) != 6 ||
+        ((int64_t *)json_packed_data(value))[5] != 0 || ((int64_t *)json_packed_data(value))[2] != 3000000000LL)
+        fail("json_packed_resize failed");
+    json_packed_resize(value, 4);
+
+    copy = json_deep_copy(value);
+    if (!json_equal(copy, value) || json_packed_data(copy) == json_packed_data(value))
+        fail("copying a packed array failed");
+    json_decref(copy);
+
+    /* one tag, the element type, the count and the raw block */
+    serialized = bos_serialize(value, &error);
+    if (!serialized || serialized->size != 4 + 3 + sizeof(integers) || bos_serialized_size(value) != serialized->size)
+        fail("packed array serialized to the wrong size");
+    if (((uint8_t *)serialized->data)[4] != 0x10 || ((uint8_t *)serialized->data)[5] != 0x05 ||
+        ((uint8_t *)serialized->data)[6] != 4 || memcmp((uint8_t *)serialized->data + 7, integers, sizeof(integers)))
+        fail("packed array serialized incorrectly");
+
+    if (!bos_validate(serialized->data, serialized->size))
+        fail("bos_validate rejected a packed array");
+
+    result = bos_deserialize(serialized->data, &error);
+    if (!json_is_packed(result) || !json_equal(result, value))
+        fail("packed array did not round trip");
+    json_decref(result);
+
+    bos_view_init(&view, serialized->data, serialized->size);
+    if (bos_view_type(&view) != JSON_PACKED || bos_view_size(&view) != 4 ||
+        bos_view_packed(&view, &type, &data, &count) || type != JSON_PACKED_INT64 || count != 4 ||
+        memcmp(data, integers, sizeof(integers)))
+        fail("packed array view failed");
+
+    /* truncated elements */
+    ((uint8_t *)serialized->data)[6] = 5;
+    if (bos_deserialize_ex(serialized->data, serialized->size, 0, &error) ||
+        bos_validate(serialized->data, serialized->size))
+        fail("truncated packed array was accepted");
+    bos_free(serialized);
+
+    /* expanded as a regular array for older readers */
+    serialized = bos_serialize_ex(value, BOS_EXPAND_PACKED | BOS_EXACT_SIZE, &error);
+    result = bos_deserialize(serialized->data, &error);
+    if (!json_is_array(result) || json_array_size(result) != 4 ||
+        json_integer_value(json_array_get(result, 2)) != 3000000000LL ||
+        json_integer_value(json_array_get(result, 1)) != -2)
+        fail("expanded packed array did not deserialize as an array");
+    json_decref(result);
+    bos_free(serialized);
+    json_decref(value);
+
+    value = json_packed(JSON_PACKED_DOUBLE, reals, 3);
+    serialized = bos_serialize_ex(value, BOS_EXPAND_PACKED | BOS_INTEGRAL_REALS | BOS_EXACT_SIZE, &error);
+    result = bos_deserialize(serialized->data, &error);
+    if (!result || json_real_value(json_array_get(result, 1)) != 0.1 ||
+        json_integer_value(json_array_get(result, 2)) != -3)
+        fail("expanded packed reals did not deserialize");
+    json_decref(result);
+    bos_free(serialized);
+
+    /* reals out of the integer range stay reals */
+    ((double *)json_packed_data(value))[0] = 1e300;
+    ((double *)json_packed_data(value))[1] = -1e300;
+    serialized = bos_serialize_ex(value, BOS_EXPAND_PACKED | BOS_INTEGRAL_REALS | BOS_EXACT_SIZE, &error);
+    result = bos_deserialize(serialized->data, &error);
+    if (!result || json_real_value(json_array_get(result, 0)) != 1e300 ||
+        json_real_value(json_array_get(result, 1)) != -1e300)
+        fail("expanded packed reals out of range did not deserialize");
+    json_decref(result);
+    bos_free(serialized);
+    ((double *)json_packed_data(value))[0] = 0.5;
+    ((double *)json_packed_data(value))[1] = 0.1;
+
+    text = json_dumps(value, JSON_COMPACT);
+    if (!text || strcmp(text, "[0.5,0.1,-3.0]"))
+        fail("packed array dumped incorrectly");
+    free(text);
+    json_decref(value);
+
+    /* built in place */
+    value = json_packed(JSON_PACKED_UINT32, NULL, 2);
+    words = json_packed_data(value);
+    words[0] = 7;
+    words[1] = 4000000000U;
+    serialized = bos_serialize(value, &error);
+    result = bos_deserialize(serialized->data, &error);
+    if (!json_equal(result, value) || serialized->size != 4 + 3 + 8)
+        fail("packed uint32 array did not round trip");
+    json_decref(result);
+    bos_free(serialized);
+    json_decref(value);
+}
+
+static void test_key_table() {
+
+    json_error_t error;
+    json_t *value, *wide, *result;
+    bos_t *plain, *keyed;
+    bos_writer_t writer;
+    bos_view_t root, item;
+    bos_view_iter_t iter;
+    size_t i, first;
+    char key[16];
+    unsigned char bad_ref[] = {
+        8, 0, 0, 0,
+        0x11, 1,     /* object with a key table */
+        1, 0x00      /* reference to a key that was never written */
+    };
+
+    value = json_array();
+    for (i = 0; i < 100; i++)
+        json_array_append_new(value, json_pack("{s:i, s:f, s:s}", "id", (int)i, "difficulty", 0.5, "worker", "rig1"));
+
+    /* many distinct keys outgrow the initial tables */
+    wide = json_object();
+    for (i = 0; i < 300; i++) {
+        snprintf(key, sizeof(key), "key%u", (unsigned int)i);
+        json_object_set_new(wide, key, json_integer((json_int_t)i));
+    }
+    json_array_append(value, wide);
+    json_array_append_new(value, wide);
+
+    plain = bos_serialize(value, &error);
+    keyed = bos_serialize_ex(value, BOS_KEY_TABLE | BOS_EXACT_SIZE, &error);
+    /* the 99 repeats of the three short keys cost one byte each instead of 21 */
+    if (!plain || !keyed || plain->size - keyed->size < 99 * 18)
+        fail("BOS_KEY_TABLE did not shrink repeated keys");
+
+    if (!bos_validate(keyed->data, keyed->size))
+        fail("bos_validate rejected a key table frame");
+
+    result = bos_deserialize(keyed->data, &error);
+    if (!json_equal(result, value))
+        fail("key table frame did not round trip");
+    json_decref(result);
+
+    /* "id" written once, then referenced as 1 */
+    if (memcmp((unsigned char *)keyed->data + 5, "\x66\x11\x03\x00\x02id\x06\x00", 9))
+        fail("key table frame has the wrong layout");
+
+    /* views see the object but cannot resolve its keys */
+    if (bos_view_init(&root, keyed->data, keyed->size) || bos_view_array_at(&root, 1, &item) ||
+        bos_view_type(&item) != JSON_OBJECT || bos_view_size(&item) != 3)
+        fail("view of a key table object failed");
+    if (bos_view_object_get(&item, "id", NULL) != BOS_VIEW_UNSUPPORTED ||
+        bos_view_iter_init(&item, &iter) != BOS_VIEW_UNSUPPORTED)
+        fail("view of a key table object did not report it as unsupported");
+
+    /* references past the table are rejected */
+    if (bos_validate(bad_ref, sizeof(bad_ref)) || bos_deserialize(bad_ref, &error))
+        fail("invalid key reference was accepted");
+    if (json_error_code(&error) != json_error_invalid_format)
+        fail("invalid key reference reported the wrong error");
+    bos_free(keyed);
+
+    /* each frame has its own table */
+    bos_writer_init(&writer, NULL, 0, BOS_KEY_TABLE);
+    if (bos_writer_serialize(&writer, value, &error))
+        fail("writer with a key table failed");
+    first = bos_writer_size(&writer);
+    if (bos_writer_serialize(&writer, value, &error) || bos_writer_size(&writer) != 2 * first)
+        fail("writer with a key table failed on a second frame");
+
+    result = bos_deserialize((const unsigned char *)bos_writer_data(&writer) + first, &error);
+    if (!json_equal(result, value))
+        fail("second key table frame did not round trip");
+    json_decref(result);
+    bos_writer_close(&writer);
+
+    bos_free(plain);
+    json_decref(value);
+
+    /* a short key whose reference needs 3 bytes is written in full again */
+    value = json_array();
+    wide = json_object();
+    for (i = 0; i < 253; i++) {
+        snprintf(key, sizeof(key), "key%u", (unsigned int)i);
+        json_object_set_new(wide, key, json_integer((json_int_t)i));
+    }
+    json_object_set_new(wide, "", json_null());
+    json_array_append_new(value, wide);
+    for (i = 0; i < 100; i++)
+        json_array_append_new(value, json_pack("{s:i}", "", (int)i));
+    json_array_append_new(value, json_pack("{s:i}", "key0", 1));
+
+    plain = bos_serialize(value, &error);
+    keyed = bos_serialize_ex(value, BOS_KEY_TABLE, &error);
+    /* every key costs at most its reference byte more than a plain key,
+       "key0" is referenced and saves 4 bytes */
+    if (!plain || !keyed || keyed->size != plain->size + 354 - 4)
+        fail("BOS_KEY_TABLE wrote a reference longer than its key");
+
+    result = bos_deserialize(keyed->data, &error);
+    if (!json_equal(result, value))
+        fail("key table frame with repeated full keys did not round trip");
+    json_decref(result);
+
+    /* the exact size budgets one byte per key and is never grown */
+    bos_writer_init(&writer, NULL, 0, BOS_KEY_TABLE | BOS_EXACT_SIZE);
+    if (bos_writer_serialize(&writer, value, &error) || bos_writer_size(&writer) != keyed->size ||
+        writer.allocated != plain->size + 355)
+        fail("BOS_EXACT_SIZE under-estimated a key table frame");
+    bos_writer_close(&writer);
+
+    bos_free(plain);
+    bos_free(keyed);
+    json_decref(value);
+}
+
+static void test_serialized_size() {
+
+    json_error_t error;
+    char long_key[300];
+    void *bytes = malloc(70000);
+    json_t *value = json_pack("{s:s, s:[i, I, I, f, b, n], s:{s:I}}",
+                              "str", "string", "array", 1, (json_int_t)-70000,
+                              (json_int_t)7000000000LL, 2.5, 1, "obj", "int", (json_int_t)-1);
+    bos_t *serialized, *exact;
+
+    memset(bytes, 7, 70000);
+    json_object_set_new(value, "bytes", json_bytes(bytes, 70000));
+
+    serialized = bos_serialize(value, &error);
+    if (!serialized)
+        fail("serialize failed");
+
+    if (bos_serialized_size(value) != serialized->size)
+        fail("bos_serialized_size does not match the serialized size");
+
+    exact = bos_serialize_ex(value, BOS_EXACT_SIZE, &error);
+    if (!exact)
+        fail("exact size serialize failed");
+
+    if (exact->size != serialized->size ||
+        memcmp(exact->data, serialized->data, serialized->size) != 0)
+        fail("exact size serialize output differs");
+
+    /* keys longer than 255 bytes cannot be encoded */
+    memset(long_key, 'k', sizeof(long_key) - 1);
+    long_key[sizeof(long_key) - 1] = '\0';
+    json_object_set_new(value, long_key, json_null());
+
+    if (bos_serialized_size(value) != 0)
+        fail("bos_serialized_size should fail for a long key");
+
+    if (bos_serialize_ex(value, BOS_EXACT_SIZE, &error))
+        fail("exact size serialize should fail for a long key");
+
+    bos_free(serialized);
+    bos_free(exact);
+    json_decref(value);
+}
+
+
+static void test_view() {
+
+    json_error_t error;
+    json_t *value = json_pack("{s:s, s:[i, I, f, b, n], s:{s:I}}",
+                              "str", "string", "array", 1, (json_int_t)7000000000LL,
+                              2.5, 1, "obj", "int", (json_int_t)-1);
+    bos_t *serialized;
+    bos_view_t root, field, item;
+    bos_view_iter_t iter;
+    const char *str, *key;
+    const void *bytes;
+    size_t len, key_len, count;
+    json_int_t integer;
+    double real;
+    int boolean, ret;
+    void *data = malloc(3);
+
+    memcpy(data, "\x01\x02\x03", 3);
+    json_object_set_new(value, "bytes", json_bytes(data, 3));
+
+    serialized = bos_serialize(value, &error);
+    if (!serialized)
+        fail("serialize failed");
+
+    if (bos_view_init(&root, serialized->data, serialized->size - 1) == 0)
+        fail("bos_view_init should fail for truncated data");
+
+    if (bos_view_init(&root, serialized->data, serialized->size))
+        fail("bos_view_init failed");
+
+    if (bos_view_type(&root) != JSON_OBJECT || bos_view_size(&root) != 4)
+        fail("view root is not an object of size 4");
+
+    if (bos_view_object_get(&root, "str", &field) ||
+        bos_view_string(&field, &str, &len) ||
+        len != 6 || memcmp(str, "string", 6) != 0)
+        fail("view string lookup failed");
+
+    /* strings point into the serialized data */
+    if ((const unsigned char *)str < (const unsigned char *)serialized->data ||
+        (const unsigned char *)str >= (const unsigned char *)serialized->data + serialized->size)
+        fail("view string does not point into the serialized data");
+
+    if (bos_view_object_get(&root, "missing", &field) == 0)
+        fail("view lookup of a missing key should fail");
+
+    if (bos_view_object_getn(&root, "strxx", 3, &field) || bos_view_type(&field) != JSON_STRING)
+        fail("view lookup by length failed");
+
+    if (bos_view_object_get(&root, "bytes", &field) ||
+        bos_view_bytes(&field, &bytes, &len) ||
+        len != 3 || memcmp(bytes, "\x01\x02\x03", 3) != 0)
+        fail("view bytes lookup failed");
+
+    if (bos_view_object_get(&root, "array", &field) || bos_view_size(&field) != 5)
+        fail("view array lookup failed");
+
+    if (bos_view_array_at(&field, 1, &item) ||
+        bos_view_integer(&item, &integer) || integer != 7000000000LL)
+        fail("view array integer failed");
+
+    if (bos_view_array_at(&field, 2, &item) ||
+        bos_view_real(&item, &real) || real != 2.5)
+        fail("view array real failed");
+
+    if (bos_view_array_at(&field, 0, &item) ||
+        bos_view_number(&item, &real) || real != 1.0)
+        fail("view array number failed");
+
+    if (bos_view_array_at(&field, 3, &item) ||
+        bos_view_type(&item) != JSON_TRUE ||
+        bos_view_boolean(&item, &boolean) || !boolean)
+        fail("view array boolean failed");
+
+    if (bos_view_array_at(&field, 4, &item) || bos_view_type(&item) != JSON_NULL)
+        fail("view array null failed");
+
+    if (bos_view_array_at(&field, 5, &item) == 0)
+        fail("view array index out of range should fail");
+
+    if (bos_view_string(&field, &str, &len) == 0 || bos_view_integer(&field, &integer) == 0)
+        fail("view accessors should fail for the wrong type");
+
+    if (bos_view_object_get(&root, "obj", &field) ||
+        bos_view_object_get(&field, "int", &item) ||
+        bos_view_integer(&item, &integer) || integer != -1)
+        fail("view nested object lookup failed");
+
+    if (bos_view_iter_init(&root, &iter))
+        fail("view iter init failed");
+
+    count = 0;
+    while ((ret = bos_view_iter_next(&iter, &key, &key_len, &item)) == 1) {
+        char name[16];
+        if (key_len >= sizeof(name))
+            fail("view iter returned a long key");
+        memcpy(name, key, key_len);
+        name[key_len] = '\0';
+        if (!json_object_get(value, name))
+            fail("view iter returned an unknown key");
+        count++;
+    }
+
+    if (ret != 0 || count != 4)
+        fail("view iter did not visit every member");
+
+    bos_free(serialized);
+    json_decref(value);
+}
+
+static void test_view_truncated() {
+
+    json_error_t error;
+    json_t *value = json_pack("[s, s]", "first", "second");
+    bos_t *serialized = bos_serialize(value, &error);
+    bos_view_t root, item;
+    uint32_t size;
+    const char *str;
+    size_t len;
+
+    if (!serialized)
+        fail("serialize failed");
+
+    /* shrink the declared size so the second string runs past the end */
+    size = (uint32_t)serialized->size - 3;
+    memcpy((void *)serialized->data, &size, sizeof(uint32_t));
+
+    if (bos_view_init(&root, serialized->data, serialized->size))
+        fail("bos_view_init failed");
+
+    if (bos_view_array_at(&root, 0, &item) || bos_view_string(&item, &str, &len))
+        fail("view of the first string failed");
+
+    if (bos_view_array_at(&root, 1, &item) == 0 && bos_view_string(&item, &str, &len) == 0)
+        fail("view of a truncated string should fail");
+
+    if (bos_view_skip(&root, NULL) == 0)
+        fail("skipping a truncated array should fail");
+
+    bos_free(serialized);
+    json_decref(value);
+}
+
+static void test_deserialize_ex() {
+
+    json_error_t error;
+    json_t *value, *nested;
+    bos_t *serialized;
+    unsigned char corrupt[] = {
+        13, 0, 0, 0,     /* size */
+        0x0E, 2,         /* array */
+        0x0C, 1, 'a',    /* string */
+        0x0C, 0xFD, 0xFF, 0xFF
+    };
+    int i;
+
+    /* a string length running past the end reports its offset */
+    value = bos_deserialize_ex(corrupt, sizeof(corrupt), 0, &error);
+    if (value)
+        fail("checked deserialize should fail for a corrupt length");
+
+    if (json_error_code(&error) != json_error_premature_end_of_input || error.position != 10)
+        fail("checked deserialize reported the wrong error");
+
+    /* errors inside containers must not leak the entries already decoded */
+    corrupt[12] = 0x7F;
+    if (bos_deserialize_ex(corrupt, sizeof(corrupt), 0, &error))
+        fail("checked deserialize should fail for a corrupt length");
+
+    if (bos_deserialize(corrupt, &error))
+        fail("bos_deserialize should fail for a corrupt length");
+
+    /* bytes left in the frame after the value are only rejected by the checked decoder */
+    corrupt[0] = 10;
+    corrupt[5] = 1;
+    value = bos_deserialize(corrupt, &error);
+    if (json_array_size(value) != 1 || !bos_validate(corrupt, 10))
+        fail("bos_deserialize should ignore bytes after the value");
+    json_decref(value);
+
+    if (bos_deserialize_ex(corrupt, 10, 0, &error) || json_error_code(&error) != json_error_end_of_input_expected)
+        fail("checked deserialize should reject bytes after the value");
+    corrupt[0] = 13;
+    corrupt[5] = 2;
+
+    /* nesting depth limit */
+    value = json_array();
+    nested = value;
+    for (i = 0; i < 10; i++) {
+        json_t *inner = json_array();
+        json_array_append_new(nested, inner);
+        nested = inner;
+    }
+
+    serialized = bos_serialize(value, &error);
+    if (!serialized)
+        fail("serialize failed");
+    json_decref(value);
+
+    value = bos_deserialize_ex(serialized->data, serialized->size, BOS_DEPTH_LIMIT(11), &error);
+    if (!value)
+        fail("checked deserialize failed within the depth limit");
+    json_decref(value);
+
+    if (bos_deserialize_ex(serialized->data, serialized->size, BOS_DEPTH_LIMIT(10), &error))
+        fail("checked deserialize should fail past the depth limit");
+
+    if (json_error_code(&error) != json_error_stack_overflow)
+        fail("checked deserialize reported the wrong error for the depth limit");
+
+    bos_free(serialized);
+}
+
+static void test_deep_nesting() {
+
+    json_t *value, *nested, *result;
+    json_error_t error;
+    bos_t *serialized;
+    unsigned char *hostile;
+    uint32_t hostile_size;
+    size_t i, levels = 100000;
+
+    /* deeper than the inline stacks of the decoder and validator */
+    value = json_object();
+    nested = value;
+    for (i = 0; i < 200; i++) {
+        json_t *inner = i % 2 ? json_object() : json_array();
+        if (json_is_object(nested))
+            json_object_set_new(nested, "a", inner);
+        else {
+            json_array_append_new(nested, json_integer((json_int_t)i));
+            json_array_append_new(nested, inner);
+        }
+        nested = inner;
+    }
+
+    serialized = bos_serialize(value, &error);
+    if (!serialized)
+        fail("serialize failed");
+
+    result = bos_deserialize_ex(serialized->data, serialized->size, 0, &error);
+    if (!result || !json_equal(result, value))
+        fail("deeply nested value did not round trip");
+    json_decref(result);
+
+    result = bos_deserialize(serialized->data, &error);
+    if (!result || !json_equal(result, value))
+        fail("bos_deserialize failed for a deeply nested value");
+    json_decref(result);
+    json_decref(value);
+
+    if (!bos_validate(serialized->data, serialized->size))
+        fail("bos_validate failed for a deeply nested value");
+
+    if (!bos_validate_ex(serialized->data, serialized->size, BOS_DEPTH_LIMIT(201)))
+        fail("bos_validate_ex failed within the depth limit");
+
+    if (bos_validate_ex(serialized->data, serialized->size, BOS_DEPTH_LIMIT(200)))
+        fail("bos_validate_ex should fail past the depth limit");
+
+    if (bos_deserialize_ex(serialized->data, serialized->size, BOS_DEPTH_LIMIT(200), &error) ||
+        json_error_code(&error) != json_error_stack_overflow)
+        fail("checked deserialize should fail past the depth limit");
+
+    bos_free(serialized);
+
+    /* hostile nesting must fail on the limit instead of the stack */
+    hostile_size = (uint32_t)(4 + levels * 2 + 1);
+    hostile = malloc(hostile_size);
+    memcpy(hostile, &hostile_size, sizeof(uint32_t));
+    for (i = 0; i < levels; i++) {
+        hostile[4 + i * 2] = 0x0E; /* array of one */
+        hostile[5 + i * 2] = 1;
+    }
+    hostile[hostile_size - 1] = 0x00; /* null */
+
+    if (bos_validate(hostile, hostile_size))
+        fail("bos_validate should reject hostile nesting");
+
+    if (bos_deserialize_ex(hostile, hostile_size, 0, &error) ||
+        json_error_code(&error) != json_error_stack_overflow)
+        fail("checked deserialize should reject hostile nesting");
+
+    if (bos_validate_ex(hostile, hostile_size, BOS_DEPTH_LIMIT(0xFFFF)))
+        fail("bos_validate_ex should reject nesting past the largest limit");
+
+    free(hostile);
+}
+
+static void test_load_file() {
+
+    const char *path = "test_bos_load_file.bos";
+    json_t *value, *result;
+    json_error_t error;
+    bos_t *first, *second;
+    bos_view_t view, field;
+    bos_file_t file;
+    json_int_t id;
+    FILE *fp;
+
+    value = json_pack("{s:i, s:[s, b]}", "id", 7, "params", "abc", 1);
+    first = bos_serialize(value, &error);
+    second = bos_serialize(json_true(), &error);
+    if (!first || !second)
+        fail("serialize failed");
+
+    /* two frames, the loaders read the first one */
+    fp = fopen(path, "wb");
+    if (!fp)
+        fail("unable to create a file");
+    fwrite(first->data, 1, first->size, fp);
+    fwrite(second->data, 1, second->size, fp);
+    fclose(fp);
+
+    result = bos_load_file_mmap(path, BOS_BORROW, &error);
+    if (!result || !json_equal(result, value))
+        fail("bos_load_file_mmap returned a wrong value");
+    json_decref(result);
+
+    if (bos_view_open_file(&view, &file, path, &error) ||
+        bos_view_object_get(&view, "id", &field) || bos_view_integer(&field, &id) || id != 7)
+        fail("bos_view_open_file did not view the first frame");
+
+    if (file.size != first->size + second->size ||
+        bos_view_init(&view, (const char *)file.data + bos_sizeof(file.data), file.size - first->size) ||
+        bos_view_type(&view) != JSON_TRUE)
+        fail("bos_view_open_file did not expose the following frames");
+    bos_file_close(&file);
+
+    /* a file that is shorter than its header */
+    fp = fopen(path, "wb");
+    if (!fp)
+        fail("unable to create a file");
+    fwrite(first->data, 1, 3, fp);
+    fclose(fp);
+
+    if (bos_load_file_mmap(path, 0, &error) || strcmp(error.source, path))
+        fail("bos_load_file_mmap accepted a truncated file");
+
+    if (!bos_view_open_file(&view, &file, path, &error) || file.data ||
+        json_error_code(&error) != json_error_invalid_format)
+        fail("bos_view_open_file accepted a truncated file");
+    remove(path);
+
+    if (bos_load_file_mmap("/path/to/nonexistent/file.bos", 0, &error) ||
+        json_error_code(&error) != json_error_cannot_open_file)
+        fail("bos_load_file_mmap returned a wrong error for a nonexistent file");
+
+    json_decref(value);
+    bos_free(first);
+    bos_free(second);
+}
+
+static size_t released_size;
+static int released_count;
+
+static void count_release(const void *ptr, size_t size, void *ctx) {
+    (void)ptr;
+    released_size += size;
+    released_count += *(int *)ctx;
+}
+
+static void test_borrow() {
+
+    static const char text[] = "borrowed text";
+    unsigned char blob[256];
+    json_error_t error;
+    json_t *value, *copy;
+    json_arena_t *arena;
+    bos_t *serialized;
+    const unsigned char *data;
+    int one = 1;
+
+    memset(blob, 0x5A, sizeof(blob));
+
+    /* borrowed bytes are released, not freed */
+    released_size = 0;
+    released_count = 0;
+    value = json_bytes_borrow(blob, sizeof(blob), count_release, &one);
+    if (!value || json_bytes_value(value) != blob || json_bytes_size(value) != sizeof(blob))
+        fail("json_bytes_borrow failed");
+
+    copy = json_deep_copy(value);
+    if (!copy || json_bytes_value(copy) == blob || !json_equal(copy, value))
+        fail("copying borrowed bytes should copy the data");
+    json_decref(copy);
+
+    json_decref(value);
+    if (released_count != 1 || released_size != sizeof(blob))
+        fail("borrowed bytes were not released");
+
+    /* setting new contents releases the borrowed memory and owns the new */
+    value = json_bytes_borrow(blob, sizeof(blob), count_release, &one);
+    if (json_bytes_set(value, malloc(16), 16) || released_count != 2)
+        fail("json_bytes_set did not release borrowed bytes");
+    json_decref(value);
+    if (released_count != 2)
+        fail("borrowed bytes were released twice");
+
+    /* borrowed strings must be null terminated valid UTF-8 */
+    if (json_string_borrow(text, 8, count_release, &one))
+        fail("json_string_borrow accepted a string that is not terminated");
+    if (json_string_borrow("\xff", 1, count_release, &one))
+        fail("json_string_borrow accepted invalid UTF-8");
+
+    value = json_string_borrow(text, sizeof(text) - 1, count_release, &one);
+    if (!value || json_string_value(value) != text || json_string_length(value) != sizeof(text) - 1)
+        fail("json_string_borrow failed");
+
+    if (json_string_set(value, "a much longer replacement string") || released_count != 3 ||
+        strcmp(json_string_value(value), "a much longer replacement string"))
+        fail("json_string_set did not release a borrowed string");
+    json_decref(value);
+    if (released_count != 3)
+        fail("borrowed string was released twice");
+
+    /* arena values are released with the arena */
+    arena = json_arena_new(0);
+    json_arena_use(arena);
+    value = json_object();
+    json_object_set_new(value, "s", json_string_borrow(text, sizeof(text) - 1, count_release, &one));
+    json_object_set_new(value, "b", json_bytes_borrow(blob, sizeof(blob), count_release, &one));
+    json_arena_use(NULL);
+    json_arena_reset(arena);
+    if (released_count != 5)
+        fail("arena did not release borrowed values");
+    json_arena_free(arena);
+
+    /* BOS_BORROW references bytes payloads in the frame */
+    value = json_pack("{s:s, s:o}", "method", "submit", "blob", json_bytes(malloc(sizeof(blob)), sizeof(blob)));
+    memcpy((void *)json_bytes_value(json_object_get(value, "blob")), blob, sizeof(blob));
+    serialized = bos_serialize(value, &error);
+    copy = bos_deserialize_ex(serialized->data, serialized->size, BOS_BORROW, &error);
+    if (!copy || !json_equal(copy, value))
+        fail("borrowing deserialize failed");
+
+    data = json_bytes_value(json_object_get(copy, "blob"));
+    if (data < (const unsigned char *)serialized->data ||
+        data + sizeof(blob) > (const unsigned char *)serialized->data + serialized->size)
+        fail("borrowing deserialize copied a bytes payload");
+
+    json_decref(copy);
+    json_decref(value);
+    bos_free(serialized);
+
+    /* short payloads are copied instead */
+    value = json_pack("{s:o}", "blob", json_bytes(malloc(8), 8));
+    memcpy((void *)json_bytes_value(json_object_get(value, "blob")), blob, 8);
+    serialized = bos_serialize(value, &error);
+    copy = bos_deserialize_ex(serialized->data, serialized->size, BOS_BORROW, &error);
+    if (!copy || !json_equal(copy, value))
+        fail("borrowing deserialize of a short payload failed");
+
+    data = json_bytes_value(json_object_get(copy, "blob"));
+    if (data >= (const unsigned char *)serialized->data &&
+        data < (const unsigned char *)serialized->data + serialized->size)
+        fail("borrowing deserialize borrowed a short payload");
+
+    json_decref(copy);
+    json_decref(value);
+    bos_free(serialized);
+}
+
+static void test_stream() {
+
+    json_error_t error;
+    bos_writer_t writer;
+    bos_stream_t stream;
+    bos_view_t view;
+    json_t *values[3], *decoded;
+    const unsigned char *data;
+    const void *frame;
+    size_t size, frame_size, i, count;
+    int ret;
+
+    values[0] = json_pack("{s:i}", "id", 1);
+    values[1] = json_pack("[s, f]", "second", 2.5);
+    values[2] = json_string("third");
+
+    bos_writer_init(&writer, NULL, 0, 0);
+    for (i = 0; i < 3; i++) {
+        if (bos_writer_serialize(&writer, values[i], &error))
+            fail("writer serialize failed");
+    }
+
+    data = bos_writer_data(&writer);
+    size = bos_writer_size(&writer);
+
+    /* several frames in one chunk are decoded in place */
+    bos_stream_init(&stream, 0, 0);
+    if (bos_stream_feed(&stream, data, size))
+        fail("stream feed failed");
+
+    count = 0;
+    while ((ret = bos_stream_next_frame(&stream, &frame, &frame_size, &error)) == 1) {
+        if ((const unsigned char *)frame < data || (const unsigned char *)frame >= data + size)
+            fail("stream frame inside the chunk was copied");
+        count++;
+    }
+
+    if (ret != 0 || count != 3 || bos_stream_pending(&stream) != 0)
+        fail("stream did not return every frame of the chunk");
+
+    /* frames split across single byte chunks are reassembled */
+    count = 0;
+    for (i = 0; i < size; i++) {
+        if (bos_stream_feed(&stream, data + i, 1))
+            fail("stream feed failed");
+
+        while ((ret = bos_stream_next(&stream, &decoded, &error)) == 1) {
+            if (!json_equal(decoded, values[count]))
+                fail("stream decoded the wrong value");
+            json_decref(decoded);
+            count++;
+        }
+
+        if (ret != 0)
+            fail("stream decode failed");
+    }
+
+    if (count != 3)
+        fail("stream did not reassemble every frame");
+
+    /* feeding before the chunk is drained fails */
+    if (bos_stream_feed(&stream, data, size) || bos_stream_feed(&stream, data, size) == 0)
+        fail("stream feed should fail while the chunk is not drained");
+
+    if (bos_stream_next_view(&stream, &view, &error) != 1 || bos_view_type(&view) != JSON_OBJECT)
+        fail("stream view failed");
+
+    bos_stream_close(&stream);
+
+    /* frames larger than max_frame are rejected */
+    bos_stream_init(&stream, 8, 0);
+    if (bos_stream_feed(&stream, data, size) ||
+        bos_stream_next_frame(&stream, &frame, &frame_size, &error) != -1)
+        fail("stream should reject frames larger than max_frame");
+    bos_stream_close(&stream);
+
+    bos_writer_close(&writer);
+    for (i = 0; i < 3; i++)
+        json_decref(values[i]);
+}
+
+static size_t gather_iov(const bos_iov_list_t *list, unsigned char *out, size_t size) {
+
+    size_t i, used = 0;
+
+    for (i = 0; i < list->count; i++) {
+        if (used + list->iov[i].iov_len > size)
+            fail("iov output larger than expected");
+        memcpy(out + used, list->iov[i].iov_base, list->iov[i].iov_len);
+        used += list->iov[i].iov_len;
+    }
+    return used;
+}
+
+static void test_serialize_iov() {
+
+    bos_iov_list_t list;
+    json_error_t error;
+    static unsigned char gathered[16384];
+    unsigned char *payload = malloc(3000);
+    char long_key[300];
+    bos_t *serialized;
+    json_t *value, *bad;
+    size_t i, used, count;
+    int referenced = 0;
+
+    memset(payload, 0xAB, 3000);
+    value = json_pack("{s:i, s:o, s:s, s:[i, s]}", "id", 7,
+                      "blob", json_bytes(payload, 3000),
+                      "method", "mining.notify", "params", 1, "short");
+    serialized = bos_serialize(value, &error);
+
+    bos_iov_init(&list, 1024);
+    if (bos_serialize_iov(&list, value, &error))
+        fail("bos_serialize_iov failed");
+
+    /* the gathered pieces are the same frame */
+    used = gather_iov(&list, gathered, sizeof(gathered));
+    if (used != serialized->size || list.size != used || memcmp(gathered, serialized->data, used))
+        fail("bos_serialize_iov output differs from bos_serialize");
+
+    /* the large payload is referenced in place */
+    for (i = 0; i < list.count; i++) {
+        if (list.iov[i].iov_base == json_bytes_value(json_object_get(value, "blob")))
+            referenced = 1;
+    }
+    if (!referenced || list.count != 3)
+        fail("bos_serialize_iov copied a large payload");
+
+    /* frames are appended until the list is reset */
+    count = list.count;
+    if (bos_serialize_iov(&list, value, &error) || list.size != 2 * serialized->size)
+        fail("bos_serialize_iov did not append a frame");
+
+    used = gather_iov(&list, gathered, sizeof(gathered));
+    if (memcmp(gathered + serialized->size, serialized->data, serialized->size))
+        fail("bos_serialize_iov appended a wrong frame");
+
+    /* a failing frame leaves the earlier frames intact */
+    memset(long_key, 'k', sizeof(long_key) - 1);
+    long_key[sizeof(long_key) - 1] = '\0';
+    bad = json_pack("{s:s, s:i}", "a", "b", long_key, 1);
+    if (!bos_serialize_iov(&list, bad, &error) || list.size != 2 * serialized->size ||
+        list.count > 2 * count)
+        fail("bos_serialize_iov did not discard a failed frame");
+
+    used = gather_iov(&list, gathered, sizeof(gathered));
+    if (used != 2 * serialized->size || memcmp(gathered, serialized->data, serialized->size))
+        fail("bos_serialize_iov damaged earlier frames");
+
+    /* below the threshold everything is copied into one piece */
+    bos_iov_reset(&list);
+    bos_iov_close(&list);
+    bos_iov_init(&list, 3001);
+    if (bos_serialize_iov(&list, value, &error) || list.count != 1 ||
+        list.iov[0].iov_len != serialized->size ||
+        memcmp(list.iov[0].iov_base, serialized->data, serialized->size))
+        fail("bos_serialize_iov referenced a small payload");
+
+    bos_iov_close(&list);
+    bos_free(serialized);
+    json_decref(bad);
+    json_decref(value);
+}
+
+typedef struct {
+    char data[1 << 20];
+    size_t used;
+} text_buffer_t;
+
+static int text_append(const char *buffer, size_t size, void *data) {
+    text_buffer_t *text = data;
+
+    if (size > sizeof(text->data) - 1 - text->used)
+        return -1;
+    memcpy(text->data + text->used, buffer, size);
+    text->used += size;
+    text->data[text->used] = '\0';
+    return 0;
+}
+
+/* bos_to_json_dump() must write what json_dump_callback() writes for the deserialized value */
+static void check_bos_to_json(const void *data, size_t size, size_t flags) {
+
+    static text_buffer_t text;
+    json_error_t error;
+    json_t *value = bos_deserialize(data, &error);
+    char *expected = json_dumps(value, flags);
+
+    text.used = 0;
+    text.data[0] = '\0';
+    if (!expected || bos_to_json_dump(data, size, text_append, &text, flags, &error) ||
+        strcmp(text.data, expected))
+        fail("bos_to_json_dump output differs from json_dumps");
+
+    free(expected);
+    json_decref(value);
+}
+
+static void test_transcode() {
+
+    static const char *docs[] = {
+        "{\"id\":1,\"method\":\"mining.notify\",\"params\":[\"job\",true,false,null,-5,70000,"
+        "-3000000000,0.5,1.1,\"caf\\u00e9 \\\"q\\\"\"]}",
+        "[]",
+        "{}",
+        "[{\"a\":[[]],\"b\":{}},\"x\"]",
+        "[1e300,2.5,-1e300]"
+    };
+    static text_buffer_t text;
+    bos_writer_t writer;
+    json_error_t error;
+    char long_key[300];
+    char *big;
+    json_t *value;
+    bos_t *serialized;
+    size_t i, used;
+    unsigned char region[16];
+    unsigned char bytes_frame[] = {
+        8, 0, 0, 0,
+        0x07, 1,     /* array of one */
+        0x0E, 0      /* empty bytes */
+    };
+
+    /* a wide count has to be moved up once the array is closed */
+    value = json_array();
+    for (i = 0; i < 70000; i++)
+        json_array_append_new(value, json_integer((json_int_t)(i % 3)));
+    big = json_dumps(value, JSON_COMPACT);
+    json_decref(value);
+
+    bos_writer_init(&writer, NULL, 0, 0);
+    for (i = 0; i < sizeof(docs) / sizeof(docs[0]) + 1; i++) {
+        const char *doc = i < sizeof(docs) / sizeof(docs[0]) ? docs[i] : big;
+
+        value = json_loads(doc, 0, &error);
+        serialized = bos_serialize(value, &error);
+
+        bos_writer_reset(&writer);
+        if (json_text_to_bos(&writer, doc, strlen(doc), 0, &error) ||
+            bos_writer_size(&writer) != serialized->size ||
+            memcmp(bos_writer_data(&writer), serialized->data, serialized->size))
+            fail("json_text_to_bos output differs from bos_serialize");
+
+        check_bos_to_json(serialized->data, serialized->size, JSON_COMPACT);
+        check_bos_to_json(serialized->data, serialized->size, JSON_INDENT(2) | JSON_ENSURE_ASCII);
+        check_bos_to_json(serialized->data, serialized->size, JSON_SORT_KEYS | JSON_DUMP_BUFFERED);
+
+        bos_free(serialized);
+        json_decref(value);
+    }
+    free(big);
+
+    /* packed arrays and key tables are written as plain JSON */
+    value = json_pack("[{s:o, s:i}, {s:o, s:i}]",
+                      "v", json_packed(JSON_PACKED_DOUBLE, NULL, 3), "n", 1,
+                      "v", json_packed(JSON_PACKED_UINT32, NULL, 2), "n", 2);
+    serialized = bos_serialize_ex(value, BOS_KEY_TABLE, &error);
+    check_bos_to_json(serialized->data, serialized->size, 0);
+    check_bos_to_json(serialized->data, serialized->size, JSON_EMBED);
+    bos_free(serialized);
+    json_decref(value);
+
+    /* scalars need JSON_ENCODE_ANY, like json_dump_callback */
+    value = json_integer(5);
+    serialized = bos_serialize(value, &error);
+    text.used = 0;
+    if (!bos_to_json_dump(serialized->data, serialized->size, text_append, &text, 0, &error) ||
+        bos_to_json_dump(serialized->data, serialized->size, text_append, &text, JSON_ENCODE_ANY, &error) ||
+        text.used != 1 || text.data[0] != '5')
+        fail("bos_to_json_dump mishandled a scalar root");
+    bos_free(serialized);
+    json_decref(value);
+
+    if (!bos_to_json_dump(bytes_frame, sizeof(bytes_frame), text_append, &text, 0, &error) ||
+        json_error_code(&error) != json_error_wrong_type)
+        fail("bos_to_json_dump accepted bytes");
+
+    /* a failed frame leaves the frames before it */
+    bos_writer_reset(&writer);
+    if (json_text_to_bos(&writer, "[1]", 3, 0, &error))
+        fail("json_text_to_bos failed");
+    used = bos_writer_size(&writer);
+
+    if (!json_text_to_bos(&writer, "[1, 2", 5, 0, &error) || bos_writer_size(&writer) != used ||
+        json_error_code(&error) != json_error_premature_end_of_input)
+        fail("json_text_to_bos accepted truncated text");
+
+    if (!json_text_to_bos(&writer, "{\"a\":1,\"a\":2}", 13, JSON_REJECT_DUPLICATES, &error) ||
+        json_error_code(&error) != json_error_duplicate_key)
+        fail("json_text_to_bos accepted a duplicate key");
+
+    if (json_text_to_bos(&writer, "{\"a\":1,\"a\":2}", 13, 0, &error))
+        fail("json_text_to_bos rejected a duplicate key without JSON_REJECT_DUPLICATES");
+
+    memset(long_key, 'k', sizeof(long_key));
+    long_key[0] = '{';
+    long_key[1] = '"';
+    memcpy(long_key + sizeof(long_key) - 4, "\":1}", 4);
+    if (!json_text_to_bos(&writer, long_key, sizeof(long_key), 0, &error) ||
+        json_error_code(&error) != json_error_invalid_argument)
+        fail("json_text_to_bos accepted a long key");
+
+    if (!json_text_to_bos(&writer, "5", 1, 0, &error) ||
+        json_text_to_bos(&writer, "5", 1, JSON_DECODE_ANY, &error))
+        fail("json_text_to_bos mishandled JSON_DECODE_ANY");
+    bos_writer_close(&writer);
+
+    /* a region that is too small fails cleanly */
+    bos_writer_init(&writer, region, sizeof(region), 0);
+    if (!json_text_to_bos(&writer, docs[0], strlen(docs[0]), 0, &error) || bos_writer_size(&writer) != 0 ||
+        json_error_code(&error) != json_error_out_of_memory)
+        fail("json_text_to_bos overflowed a region");
+    bos_writer_close(&writer);
+}
+
+static void test_deserialize_select() {
+
+    bos_writer_t writer;
+    json_error_t error;
+    json_t *value, *values[4];
+    bos_t *serialized;
+    const char *paths[] = {"/1/worker", "/2/shares", "/0/missing", "/1"};
+    double shares[] = {1.5, 2.5};
+    unsigned char *copy;
+
+    value = json_pack("[{s:i, s:s}, {s:i, s:s}, {s:o}]", "id", 1, "worker", "rig1", "id", 2, "worker", "rig2",
+                      "shares", json_packed(JSON_PACKED_DOUBLE, shares, 2));
+
+    /* the skipped first object defines the keys the second one references */
+    serialized = bos_serialize_ex(value, BOS_KEY_TABLE, &error);
+    if (!serialized)
+        fail("bos_serialize_ex failed");
+
+    if (bos_deserialize_select(serialized->data, serialized->size, 0, paths, 4, values, &error) != 3)
+        fail("bos_deserialize_select found the wrong number of values");
+
+    if (strcmp(json_string_value(values[0]), "rig2") || json_packed_size(values[1]) != 2 || values[2] ||
+        json_object_get(values[3], "worker") != values[0])
+        fail("bos_deserialize_select returned wrong values");
+    json_decref(values[0]);
+    json_decref(values[1]);
+    json_decref(values[3]);
+
+    /* a repeated key replaces the value of its path */
+    bos_writer_init(&writer, NULL, 0, 0);
+    if (json_text_to_bos(&writer, "{\"id\":1,\"id\":2}", 15, 0, &error))
+        fail("json_text_to_bos failed");
+    paths[1] = "/id";
+    if (bos_deserialize_select(bos_writer_data(&writer), bos_writer_size(&writer), 0, paths + 1, 1, values,
+                               &error) != 1 || json_integer_value(values[0]) != 2)
+        fail("bos_deserialize_select mishandled a repeated key");
+    json_decref(values[0]);
+    paths[1] = "/2/shares";
+    bos_writer_close(&writer);
+
+    /* skipped values are still bounds checked */
+    copy = malloc(serialized->size);
+    memcpy(copy, serialized->data, serialized->size);
+    copy[0]--;
+    if (bos_deserialize_select(copy, serialized->size, 0, paths + 2, 1, values, &error) != -1 || values[0] ||
+        json_error_code(&error) != json_error_premature_end_of_input)
+        fail("bos_deserialize_select accepted a truncated frame");
+    free(copy);
+
+    paths[0] = "1";
+    if (bos_deserialize_select(serialized->data, serialized->size, 0, paths, 1, values, &error) != -1 ||
+        json_error_code(&error) != json_error_invalid_argument)
+        fail("bos_deserialize_select accepted an invalid path");
+
+    paths[0] = "";
+    if (bos_deserialize_select(serialized->data, serialized->size, 0, paths, 1, values, &error) != 1 ||
+        !json_equal(values[0], value))
+        fail("bos_deserialize_select did not select the root");
+    json_decref(values[0]);
+
+    bos_free(serialized);
+    json_decref(value);
+}
+
+static void test_fragment() {
+
+    json_error_t error;
+    json_t *branches, *cache, *raw, *message, *expected, *decoded, *integer;
+    bos_t *serialized, *plain, *frame;
+
+    branches = json_pack("[s, s, f]", "ab", "cd", 0.5);
+    cache = json_encode_cache(branches, 0, 0);
+    message = json_pack("{s:i, s:O}", "id", 1, "params", cache);
+    expected = json_pack("{s:i, s:O}", "id", 1, "params", branches);
+    if (!cache || !message || !expected)
+        fail("unable to create a fragment");
+
+    serialized = bos_serialize(message, &error);
+    plain = bos_serialize(expected, &error);
+    if (!serialized || !plain || serialized->size != plain->size ||
+        memcmp(serialized->data, plain->data, plain->size) != 0 ||
+        bos_serialized_size(message) != plain->size)
+        fail("fragment was not serialized verbatim");
+    bos_free(serialized);
+    bos_free(plain);
+
+    /* frames with a key table can hold plain objects */
+    serialized = bos_serialize_ex(message, BOS_KEY_TABLE, &error);
+    decoded = serialized ? bos_deserialize(serialized->data, &error) : NULL;
+    if (!json_equal(decoded, expected))
+        fail("fragment in a frame with a key table failed");
+    json_decref(decoded);
+    bos_free(serialized);
+
+    /* other flags encode the value instead */
+    serialized = bos_serialize_ex(message, BOS_FLOAT_REALS, &error);
+    plain = bos_serialize_ex(expected, BOS_FLOAT_REALS, &error);
+    if (!serialized || !plain || serialized->size != plain->size ||
+        memcmp(serialized->data, plain->data, plain->size) != 0)
+        fail("fragment with other flags was not encoded from its value");
+    bos_free(serialized);
+    bos_free(plain);
+
+    /* raw fragments take a whole frame */
+    integer = json_integer(7);
+    frame = bos_serialize(integer, &error);
+    raw = json_fragment(NULL, 0, frame->data, frame->size);
+    if (!raw || json_fragment(NULL, 0, frame->data, frame->size - 1))
+        fail("json_fragment failed");
+    bos_free(frame);
+
+    serialized = bos_serialize(raw, &error);
+    decoded = serialized ? bos_deserialize(serialized->data, &error) : NULL;
+    if (!json_equal(decoded, integer))
+        fail("raw fragment was not serialized");
+    json_decref(decoded);
+    bos_free(serialized);
+    json_decref(raw);
+
+    raw = json_fragment("7", 1, NULL, 0);
+    if (bos_serialize(raw, &error) || json_error_code(&error) != json_error_wrong_type)
+        fail("fragment without BOS data was serialized");
+    json_decref(raw);
+
+    json_decref(integer);
+    json_decref(expected);
+    json_decref(message);
+    json_decref(cache);
+    json_decref(branches);
+}
+
+static void test_many() {
+
+    json_error_t error;
+    json_t *values[3], *decoded[4];
+    bos_t *serialized;
+    bos_writer_t writer;
+    size_t offsets[4], i;
+
+    values[0] = json_pack("{s:i, s:s}", "id", 1, "method", "mining.notify");
+    values[1] = json_pack("[i, f]", 2, 0.5);
+    values[2] = json_pack("{s:i, s:s}", "id", 3, "method", "mining.submit");
+
+    serialized = bos_serialize_many(values, 3, BOS_KEY_TABLE, offsets, &error);
+    if (!serialized || offsets[0] != 0 || offsets[3] != serialized->size)
+        fail("bos_serialize_many failed");
+
+    for (i = 0; i < 3; i++) {
+        if (bos_sizeof((const unsigned char *)serialized->data + offsets[i]) != offsets[i + 1] - offsets[i])
+            fail("bos_serialize_many returned wrong offsets");
+    }
+
+    if (bos_deserialize_many(serialized->data, serialized->size, 0, decoded, 4, &error) != 3 ||
+        error.position != (int)serialized->size)
+        fail("bos_deserialize_many did not decode every frame");
+
+    for (i = 0; i < 3; i++) {
+        if (!json_equal(decoded[i], values[i]))
+            fail("bos_deserialize_many returned a wrong value");
+        json_decref(decoded[i]);
+    }
+
+    /* a full values array leaves the rest for the next call */
+    if (bos_deserialize_many(serialized->data, serialized->size, 0, decoded, 2, &error) != 2 ||
+        error.position != (int)offsets[2])
+        fail("bos_deserialize_many did not stop after the last frame");
+    json_decref(decoded[0]);
+    json_decref(decoded[1]);
+
+    /* a truncated last frame fails the batch, positions count from the start */
+    if (bos_deserialize_many(serialized->data, serialized->size - 1, 0, decoded, 4, &error) != -1 ||
+        error.position != (int)offsets[2] || json_error_code(&error) != json_error_premature_end_of_input)
+        fail("bos_deserialize_many accepted a truncated frame");
+    bos_free(serialized);
+
+    /* a failing value discards the whole batch */
+    bos_writer_init(&writer, NULL, 0, 0);
+    if (bos_writer_serialize(&writer, values[0], &error))
+        fail("bos_writer_serialize failed");
+    json_decref(values[2]);
+    decoded[0] = values[1];
+    decoded[1] = NULL;
+    if (!bos_writer_serialize_many(&writer, decoded, 2, offsets, &error) ||
+        bos_writer_size(&writer) != offsets[0])
+        fail("bos_writer_serialize_many kept a partial batch");
+    bos_writer_close(&writer);
+
+    json_decref(values[0]);
+    json_decref(values[1]);
+}
+
+/* runs the tasks backwards to show that they don't depend on each other */
+static void run_reversed(void *pool, bos_task_t task, void *arg, size_t count) {
+    size_t *calls = (size_t *)pool;
+
+    while (count > 0) {
+        task(arg, --count);
+        (*calls)++;
+    }
+}
+
+static void test_parallel() {
+
+    json_error_t error;
+    json_t *value, *result;
+    bos_t *serialized, *parallel;
+    size_t i, calls = 0;
+    unsigned char *copy;
+
+    value = json_array();
+    for (i = 0; i < 5000; i++)
+        json_array_append_new(value, json_pack("{s:i, s:s, s:f}", "id", (int)i, "worker", "rig1", "shares", 0.5));
+
+    serialized = bos_serialize_ex(value, 0, &error);
+    parallel = bos_serialize_parallel(value, 0, 4, run_reversed, &calls, &error);
+    if (!parallel || calls != 4 || parallel->size != serialized->size ||
+        memcmp(parallel->data, serialized->data, serialized->size))
+        fail("bos_serialize_parallel wrote a different frame");
+    bos_free(parallel);
+
+    calls = 0;
+    result = bos_deserialize_parallel(serialized->data, serialized->size, 0, 4, run_reversed, &calls, &error);
+    if (!result || calls != 4 || !json_equal(result, value))
+        fail("bos_deserialize_parallel returned a different value");
+    json_decref(result);
+    bos_free(serialized);
+
+    /* later runs reference keys that an earlier run defined */
+    serialized = bos_serialize_parallel(value, BOS_KEY_TABLE, 4, run_reversed, &calls, &error);
+    result = bos_deserialize_parallel(serialized->data, serialized->size, 0, 3, NULL, NULL, &error);
+    if (!result || !json_equal(result, value))
+        fail("bos_deserialize_parallel failed on a key table frame");
+    json_decref(result);
+    bos_free(serialized);
+
+    /* a string that is not UTF-8 is only found by the task decoding it */
+    json_array_set_new(value, 4990, json_string("last"));
+    serialized = bos_serialize_ex(value, 0, &error);
+    copy = malloc(serialized->size);
+    memcpy(copy, serialized->data, serialized->size);
+    for (i = serialized->size - 4; i > 0; i--) {
+        if (!memcmp(copy + i, "last", 4)) {
+            copy[i] = 0xFF;
+            break;
+        }
+    }
+    result = bos_deserialize_parallel(copy, serialized->size, 0, 4, NULL, NULL, &error);
+    if (result || json_error_code(&error) != json_error_invalid_utf8)
+        fail("bos_deserialize_parallel accepted invalid UTF-8");
+
+    /* a truncated frame is found by the first pass */
+    result = bos_deserialize_parallel(copy, serialized->size - 1, 0, 4, NULL, NULL, &error);
+    if (result || json_error_code(&error) != json_error_premature_end_of_input)
+        fail("bos_deserialize_parallel accepted a truncated frame");
+    free(copy);
+    bos_free(serialized);
+
+    /* small arrays are decoded in one go */
+    result = json_pack("[i, i]", 1, 2);
+    serialized = bos_serialize_parallel(result, 0, 4, run_reversed, &calls, &error);
+    calls = 0;
+    json_decref(result);
+    result = bos_deserialize_parallel(serialized->data, serialized->size, 0, 4, run_reversed, &calls, &error);
+    if (!result || calls != 0 || json_array_size(result) != 2)
+        fail("bos_deserialize_parallel split a small array");
+    json_decref(result);
+    bos_free(serialized);
+
+    json_decref(value);
+}
 
 static void run_tests()
 {
@@ -1170,4 +2707,24 @@ static void run_tests()
     test_validation_string();
     test_validation_bytes();
     test_validation_array();
+    test_writer_reuse();
+    test_writer_region();
+    test_writer_spill();
+    test_serialize_iov();
+    test_transcode();
+    test_real_encoding();
+    test_packed();
+    test_key_table();
+    test_serialized_size();
+    test_view();
+    test_view_truncated();
+    test_deserialize_ex();
+    test_deep_nesting();
+    test_load_file();
+    test_deserialize_select();
+    test_fragment();
+    test_many();
+    test_parallel();
+    test_borrow();
+    test_stream();
 }
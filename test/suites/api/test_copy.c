@@ -323,6 +323,75 @@ static void test_deep_copy_object(void)
     json_decref(copy);
 }
 
+static void test_with(void)
+{
+    const char *json_object_text =
+        "{\"foo\": \"bar\", \"a\": 1, \"b\": 3.141592, \"c\": [1,2,3,4]}";
+
+    json_t *object, *array, *copy, *value;
+    char key[8];
+    int i;
+
+    object = json_loads(json_object_text, 0, NULL);
+    if(!object)
+        fail("unable to parse an object");
+
+    copy = json_object_with_new(object, "a", json_integer(2));
+    if(!copy || copy == object)
+        fail("json_object_with_new failed");
+    if(json_integer_value(json_object_get(object, "a")) != 1)
+        fail("json_object_with_new modified the original");
+    if(json_integer_value(json_object_get(copy, "a")) != 2)
+        fail("json_object_with_new did not set the value");
+    if(json_object_get(copy, "c") != json_object_get(object, "c"))
+        fail("json_object_with_new did not share the other values");
+    if(strcmp(json_object_iter_key(json_object_iter_next(copy, json_object_iter(copy))), "a") != 0)
+        fail("json_object_with_new did not preserve key order");
+    json_decref(copy);
+
+    /* the original is indexed, so the copy reuses its hashes */
+    for(i = 0; i < 20; i++) {
+        snprintf(key, sizeof(key), "k%d", i);
+        json_object_set_new(object, key, json_integer(i));
+    }
+    copy = json_object_with(object, "new", json_null());
+    if(!copy || json_object_size(copy) != json_object_size(object) + 1)
+        fail("json_object_with did not add the key");
+    for(i = 0; i < 20; i++) {
+        snprintf(key, sizeof(key), "k%d", i);
+        if(json_object_get(copy, key) != json_object_get(object, key))
+            fail("json_object_with lost a key");
+    }
+    json_decref(copy);
+
+    array = json_object_get(object, "c");
+    copy = json_array_with_new(array, 1, json_string("x"));
+    if(!copy || json_array_size(copy) != 4)
+        fail("json_array_with_new failed");
+    if(json_integer_value(json_array_get(array, 1)) != 2 ||
+       !json_is_string(json_array_get(copy, 1)) ||
+       json_array_get(copy, 2) != json_array_get(array, 2))
+        fail("json_array_with_new produced a wrong copy");
+    json_decref(copy);
+
+    value = json_integer(5);
+    if(json_array_with(array, 4, value) || json_array_with(object, 0, value) ||
+       json_object_with(array, "a", value) || json_object_with(object, NULL, value) ||
+       json_object_with(object, "\xff", value) || json_object_with_new(object, "a", NULL))
+        fail("copying with a change succeeded with bad arguments");
+    if(value->refcount != 1)
+        fail("copying with a change leaked a reference");
+    json_decref(value);
+
+    /* copies of a frozen tree can be changed */
+    json_freeze(object);
+    copy = json_object_with_new(object, "a", json_integer(3));
+    if(!copy || json_is_frozen(copy) || json_object_set_new(copy, "b", json_null()))
+        fail("json_object_with_new of a frozen object failed");
+    json_decref(copy);
+    json_thaw_release(object);
+}
+
 static void run_tests()
 {
     test_copy_simple();
@@ -331,4 +400,5 @@ static void run_tests()
     test_deep_copy_array();
     test_copy_object();
     test_deep_copy_object();
+    test_with();
 }
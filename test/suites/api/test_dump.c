@@ -131,6 +131,37 @@ static void circular_references()
     json_decref(json);
 }
 
+static void deep_nesting()
+{
+    /* deeper than the loop detection stack that needs no allocation */
+    json_t *json, *inner;
+    char *result, *plain;
+    int i;
+
+    json = inner = json_array();
+    for(i = 0; i < 100; i++) {
+        json_t *next = json_object();
+        json_array_append_new(inner, next);
+        inner = json_array();
+        json_object_set_new(next, "a", inner);
+    }
+
+    result = json_dumps(json, JSON_COMPACT);
+    plain = json_dumps(json, JSON_COMPACT | JSON_NO_CYCLE_CHECK);
+    if(!result || !plain || strcmp(result, plain) != 0 || strlen(result) != 100 * 8 + 2)
+        fail("json_dumps failed for deeply nested values");
+    free(result);
+    free(plain);
+
+    /* a loop far down the tree */
+    json_array_append(inner, json_array_get(json, 0));
+    if(json_dumps(json, 0))
+        fail("json_dumps encoded a deep circular reference!");
+    json_array_clear(inner);
+
+    json_decref(json);
+}
+
 static void encode_other_than_array_or_object()
 {
     /* Encoding anything other than array or object should only
@@ -210,6 +241,143 @@ static void encode_nul_byte()
     json_decref(json);
 }
 
+static void escape_long_strings()
+{
+    static const char *plain = "0123456789abcdef0123456789abcdef0123456789";
+    static const char *specials[] = {"\"", "/", "\x1f", "\xc3\xa9", "\xf0\x9f\x98\x80"};
+    static const char *escaped[] = {"\\\"", "\\/", "\\u001F", "\\u00E9", "\\uD83D\\uDE00"};
+    char text[64], expected[128];
+    json_t *json;
+    char *result;
+    size_t i, offset;
+
+    /* escapes at every offset of a block */
+    for(i = 0; i < sizeof(specials) / sizeof(specials[0]); i++) {
+        for(offset = 0; offset < 40; offset++) {
+            snprintf(text, sizeof(text), "%.*s%s%.*s",
+                     (int)offset, plain, specials[i], (int)(40 - offset), plain);
+            snprintf(expected, sizeof(expected), "\"%.*s%s%.*s\"",
+                     (int)offset, plain, escaped[i], (int)(40 - offset), plain);
+
+            json = json_string(text);
+            result = json_dumps(json, JSON_ENCODE_ANY | JSON_ESCAPE_SLASH | JSON_ENSURE_ASCII);
+            if(!result || strcmp(result, expected))
+                fail("json_dumps escaped a long string incorrectly");
+            free(result);
+
+            /* without the flags only mandatory escapes are written */
+            result = json_dumps(json, JSON_ENCODE_ANY);
+            if(!result || (i < 1 || i == 2 ? strcmp(result, expected) != 0
+                                           : strstr(result, specials[i]) == NULL))
+                fail("json_dumps escaped a long string without being asked to");
+            free(result);
+            json_decref(json);
+        }
+    }
+}
+
+static void dump_numbers()
+{
+    static const double reals[] = {0.1, -2.5, 100.0, 1e22, 5e-324, 1.7976931348623157e308, 0.0001, 1e-5};
+    static const char *expected[] = {"0.1", "-2.5", "100.0", "1e22", "5e-324",
+                                     "1.7976931348623157e308", "0.0001", "1e-5"};
+    json_t *json;
+    char *result;
+    size_t i;
+
+    /* shortest digits that read back as the same double */
+    for(i = 0; i < sizeof(reals) / sizeof(reals[0]); i++) {
+        json = json_real(reals[i]);
+        result = json_dumps(json, JSON_ENCODE_ANY);
+        if(!result || strcmp(result, expected[i]))
+            fail("json_dumps formatted a real incorrectly");
+        free(result);
+        json_decref(json);
+    }
+
+    /* an explicit precision keeps the printf formatting */
+    json = json_real(0.1);
+    result = json_dumps(json, JSON_ENCODE_ANY | JSON_REAL_PRECISION(17));
+    if(!result || strcmp(result, "0.10000000000000001"))
+        fail("json_dumps ignored JSON_REAL_PRECISION");
+    free(result);
+    json_decref(json);
+
+    if(sizeof(json_int_t) == 8) {
+        json = json_pack("[I, I, i, I]", (json_int_t)(-9223372036854775807LL - 1),
+                         (json_int_t)9223372036854775807LL, 0, (json_int_t)-42);
+        result = json_dumps(json, JSON_COMPACT);
+        if(!result || strcmp(result, "[-9223372036854775808,9223372036854775807,0,-42]"))
+            fail("json_dumps formatted an integer incorrectly");
+        free(result);
+        json_decref(json);
+    }
+
+    json = json_pack("[i, i, i]", 0, 7, -42);
+    result = json_dumps(json, JSON_COMPACT);
+    if(!result || strcmp(result, "[0,7,-42]"))
+        fail("json_dumps formatted an integer incorrectly");
+    free(result);
+    json_decref(json);
+}
+
+struct counting_buffer {
+    char data[8192];
+    size_t used;
+    size_t calls;
+};
+
+static int dump_counting(const char *buffer, size_t size, void *data)
+{
+    struct counting_buffer *out = (struct counting_buffer *)data;
+
+    if(out->used + size > sizeof(out->data))
+        return -1;
+
+    memcpy(out->data + out->used, buffer, size);
+    out->used += size;
+    out->calls++;
+    return 0;
+}
+
+static void dump_buffered()
+{
+    struct counting_buffer out;
+    char long_string[6000];
+    char *expected;
+    json_t *json;
+
+    json = json_pack("{s:i, s:[s, f, b, n]}", "id", 42, "params", "worker", 2.5, 1);
+    expected = json_dumps(json, JSON_SORT_KEYS);
+
+    /* small documents are passed on in one piece */
+    out.used = out.calls = 0;
+    if(json_dump_callback(json, dump_counting, &out, JSON_SORT_KEYS | JSON_DUMP_BUFFERED) ||
+       out.calls != 1 || out.used != strlen(expected) || memcmp(out.data, expected, out.used))
+        fail("json_dump_callback did not buffer a small document");
+
+    out.used = out.calls = 0;
+    if(json_dump_callback(json, dump_counting, &out, JSON_SORT_KEYS) || out.calls < 10)
+        fail("json_dump_callback buffered without JSON_DUMP_BUFFERED");
+
+    free(expected);
+    json_decref(json);
+
+    /* pieces larger than the staging buffer */
+    memset(long_string, 'x', sizeof(long_string) - 1);
+    long_string[sizeof(long_string) - 1] = '\0';
+    json = json_pack("[s, s, i]", "short", long_string, 1);
+    expected = json_dumps(json, JSON_COMPACT);
+
+    out.used = out.calls = 0;
+    if(json_dump_callback(json, dump_counting, &out, JSON_COMPACT | JSON_DUMP_BUFFERED) ||
+       out.calls > 4 || out.used != strlen(expected) || memcmp(out.data, expected, out.used))
+        fail("json_dump_callback buffered a long string incorrectly");
+
+    free(expected);
+    json_decref(json);
+}
+
 static void dump_file()
 {
     json_t *json;
@@ -250,6 +418,87 @@ static void dumpb()
     json_decref(obj);
 }
 
+static void dumpb_many()
+{
+    char buf[64];
+    json_t *values[3];
+    size_t offsets[4], size;
+
+    values[0] = json_pack("{s:i}", "id", 1);
+    values[1] = json_pack("[s,b]", "x", 1);
+    values[2] = json_integer(5);
+
+    size = json_dumpb_many(values, 2, buf, sizeof(buf), offsets, JSON_COMPACT);
+    if(size != 20 || strncmp(buf, "{\"id\":1}\n[\"x\",true]\n", 20))
+      fail("json_dumpb_many failed");
+
+    if(offsets[0] != 0 || offsets[1] != 9 || offsets[2] != 20)
+      fail("json_dumpb_many returned wrong offsets");
+
+    /* the size needed is returned when the buffer is too small */
+    if(json_dumpb_many(values, 2, buf, 4, NULL, JSON_COMPACT) != 20)
+      fail("json_dumpb_many size check failed");
+
+    if(json_dumpb_many(values, 3, buf, sizeof(buf), offsets, JSON_COMPACT) != 0 ||
+       json_dumpb_many(values, 3, buf, sizeof(buf), offsets, JSON_COMPACT | JSON_ENCODE_ANY) != 22)
+      fail("json_dumpb_many mishandled JSON_ENCODE_ANY");
+
+    json_decref(values[0]);
+    json_decref(values[1]);
+    json_decref(values[2]);
+}
+
+static void dump_fragment()
+{
+    json_t *branches, *cache, *raw, *message;
+    char *result;
+
+    branches = json_pack("[s,s]", "ab", "cd");
+    cache = json_encode_cache(branches, JSON_COMPACT, 0);
+    raw = json_fragment("[1, 2]", 6, NULL, 0);
+    if(!cache || !raw || json_fragment_value(cache) != branches || json_fragment_value(raw))
+      fail("unable to create fragments");
+
+    /* the cached text is used as is, even after the value changes */
+    json_array_append_new(branches, json_string("ef"));
+    message = json_pack("{s:O,s:O}", "params", cache, "raw", raw);
+
+    result = json_dumps(message, JSON_COMPACT);
+    if(!result || strcmp(result, "{\"params\":[\"ab\",\"cd\"],\"raw\":[1, 2]}") != 0)
+      fail("fragments were not dumped verbatim");
+    free(result);
+
+    /* other flags dump the value instead */
+    result = json_dumps(message, JSON_COMPACT | JSON_SORT_KEYS);
+    if(!result || strcmp(result, "{\"params\":[\"ab\",\"cd\",\"ef\"],\"raw\":[1, 2]}") != 0)
+      fail("dumping a fragment with other flags failed");
+    free(result);
+
+    result = json_dumps(cache, JSON_INDENT(1));
+    if(!result || strcmp(result, "[\n \"ab\",\n \"cd\",\n \"ef\"\n]") != 0)
+      fail("dumping a fragment with an indent failed");
+    free(result);
+
+    /* fragments count as arrays and objects when their text does */
+    result = json_dumps(raw, 0);
+    if(!result || strcmp(result, "[1, 2]") != 0)
+      fail("dumping a fragment failed");
+    free(result);
+    json_decref(raw);
+
+    raw = json_fragment("12", 2, NULL, 0);
+    if(json_dumps(raw, 0))
+      fail("dumping a scalar fragment succeeded without JSON_ENCODE_ANY");
+    json_decref(raw);
+
+    if(json_fragment(NULL, 0, NULL, 0) || json_encode_cache(cache, 0, 0))
+      fail("creating a fragment succeeded with bad arguments");
+
+    json_decref(message);
+    json_decref(cache);
+    json_decref(branches);
+}
+
 static void dumpfd()
 {
 #ifdef HAVE_UNISTD_H
@@ -316,11 +565,17 @@ static void run_tests()
     encode_null();
     encode_twice();
     circular_references();
+    deep_nesting();
     encode_other_than_array_or_object();
     escape_slashes();
     encode_nul_byte();
+    escape_long_strings();
+    dump_numbers();
+    dump_buffered();
     dump_file();
     dumpb();
+    dumpb_many();
+    dump_fragment();
     dumpfd();
     embed();
 }
@@ -187,10 +187,50 @@ static void test_equal_complex()
     /* TODO: There's no negative test case here */
 }
 
+static void test_hash()
+{
+    json_t *value1, *value2, *value3, *value4;
+
+    value1 = json_loads("{\"id\": 1, \"params\": [\"a\", 0.0, null], \"b\": \"x\"}", 0, NULL);
+    value2 = json_loads("{\"b\": \"x\", \"params\": [\"a\", -0.0, null], \"id\": 1}", 0, NULL);
+    value3 = json_loads("{\"id\": 1, \"params\": [\"a\", 0.0, false], \"b\": \"x\"}", 0, NULL);
+    if(!value1 || !value2 || !value3)
+        fail("unable to parse JSON");
+
+    if(json_hash(value1, 0) != json_hash(value2, 0))
+        fail("equal values have different hashes");
+    if(json_hash(value1, 0) == json_hash(value3, 0) ||
+       json_hash(value1, 0) == json_hash(value1, 1))
+        fail("json_hash collides");
+    value4 = json_integer(0);
+    if(json_hash(value4, 0) == json_hash(json_array_get(json_object_get(value1, "params"), 1), 0))
+        fail("json_hash collides for an integer and a real");
+    json_decref(value4);
+    if(json_hash(NULL, 0) != 0)
+        fail("json_hash fails for NULL");
+
+    /* stored hashes of frozen values */
+    if(json_hash_cache(value1, 0) != -1)
+        fail("json_hash_cache succeeded for a value that isn't frozen");
+    json_freeze(value1);
+    json_freeze(value3);
+    if(json_hash_cache(value1, 0) || json_hash_cache(value3, 0))
+        fail("json_hash_cache failed");
+    if(json_hash(value1, 0) != json_hash(value2, 0) || json_hash(value1, 1) == json_hash(value1, 0))
+        fail("stored hashes differ from computed ones");
+    if(!json_equal(value1, value2) || json_equal(value1, value3))
+        fail("json_equal fails for hashed values");
+
+    json_thaw_release(value1);
+    json_thaw_release(value3);
+    json_decref(value2);
+}
+
 static void run_tests()
 {
     test_equal_simple();
     test_equal_array();
     test_equal_object();
     test_equal_complex();
+    test_hash();
 }
@@ -231,6 +231,567 @@ static void error_code()
         fail("json_loads returned incorrect error code");
 }
 
+struct chunk_data {
+    const char *text;
+    size_t len;
+    size_t pos;
+};
+
+static size_t chunk_callback(void *buffer, size_t buflen, void *arg)
+{
+    struct chunk_data *data = (struct chunk_data *)arg;
+
+    /* one byte at a time to exercise the callback path */
+    if(data->pos >= data->len || buflen == 0)
+        return 0;
+
+    *(char *)buffer = data->text[data->pos++];
+    return 1;
+}
+
+static void buffer_error_location()
+{
+    static const char *texts[] = {
+        "[\n  \"foo\",\n  \"b\xc3r\"\n]",
+        "{\n\"a\": \"\\uD800x\"}",
+        "[1,\n 2,\n \"\xe2\x82\xac\xe2\x82\xac\" x]",
+        "{\"long\": \"abcdefghijklmnopqrstuvwxyz\t\"}",
+        "\n\n  \"unterminated",
+        "[1,\n 99999999999999999999]",
+        "[1.5e999,\n 2]",
+        "[-01]",
+    };
+    json_error_t buffer_error, callback_error;
+    struct chunk_data data;
+    size_t i;
+
+    /* contiguous and callback input report errors at the same place */
+    for(i = 0; i < sizeof(texts) / sizeof(texts[0]); i++) {
+        if(json_loadb(texts[i], strlen(texts[i]), 0, &buffer_error))
+            fail("json_loadb accepted invalid input");
+
+        data.text = texts[i];
+        data.len = strlen(texts[i]);
+        data.pos = 0;
+        if(json_load_callback(chunk_callback, &data, 0, &callback_error))
+            fail("json_load_callback accepted invalid input");
+
+        if(buffer_error.line != callback_error.line ||
+           buffer_error.column != callback_error.column ||
+           buffer_error.position != callback_error.position ||
+           strcmp(buffer_error.text, callback_error.text))
+            fail("json_loadb and json_load_callback report different errors");
+    }
+
+    if(json_loads(texts[0], 0, &buffer_error))
+        fail("json_loads accepted invalid input");
+    if(buffer_error.line != 3 || buffer_error.column != 4 ||
+       json_error_code(&buffer_error) != json_error_invalid_utf8)
+        fail("json_loads reported a wrong error location");
+}
+
+static void long_strings()
+{
+    static const char *specials[] = {"\\n", "\\\"", "\\u00e9", "\xc3\xa9", "\xe2\x82\xac"};
+    static const char *decoded[] = {"\n", "\"", "\xc3\xa9", "\xc3\xa9", "\xe2\x82\xac"};
+    char text[128], expected[128];
+    json_error_t error;
+    json_t *json;
+    size_t i, offset;
+
+    /* escapes and multibyte characters at every offset of a block */
+    for(i = 0; i < sizeof(specials) / sizeof(specials[0]); i++) {
+        for(offset = 0; offset < 40; offset++) {
+            snprintf(text, sizeof(text), "[\"%.*s%s%.*s\"]",
+                     (int)offset, "0123456789abcdef0123456789abcdef0123456789",
+                     specials[i], (int)(40 - offset), "0123456789abcdef0123456789abcdef0123456789");
+            snprintf(expected, sizeof(expected), "%.*s%s%.*s",
+                     (int)offset, "0123456789abcdef0123456789abcdef0123456789",
+                     decoded[i], (int)(40 - offset), "0123456789abcdef0123456789abcdef0123456789");
+
+            json = json_loads(text, 0, &error);
+            if(!json || strcmp(json_string_value(json_array_get(json, 0)), expected))
+                fail("json_loads decoded a long string incorrectly");
+            json_decref(json);
+        }
+    }
+
+    /* a control character deep inside a block is still rejected */
+    json = json_loads("[\"0123456789abcdef0123456789\x01" "abcdef\"]", 0, &error);
+    if(json || error.column != 28 || error.position != 28)
+        fail("json_loads accepted a control character in a long string");
+}
+
+static void number_boundaries()
+{
+    static const char *reals[] = {
+        "[2.2250738585072011e-308]", "[9007199254740993]", "[1e23]", "[4.9406564584124654e-324]",
+        "[1.7976931348623157e308]", "[0.1]", "[-0.0]", "[123456789012345678901234567890]",
+        "[1.00000000000000011102230246251565404236316680908203125]"
+    };
+    static const double values[] = {
+        2.2250738585072011e-308, 9007199254740993.0, 1e23, 4.9406564584124654e-324,
+        1.7976931348623157e308, 0.1, -0.0, 123456789012345678901234567890.0,
+        1.00000000000000011102230246251565404236316680908203125
+    };
+    json_error_t error;
+    json_t *json;
+    size_t i;
+
+    /* the nearest double, the same as the C library's strtod */
+    for(i = 0; i < sizeof(reals) / sizeof(reals[0]); i++) {
+        json = json_loads(reals[i], JSON_DECODE_INT_AS_REAL, &error);
+        if(!json || json_real_value(json_array_get(json, 0)) != values[i])
+            fail("json_loads decoded a real incorrectly");
+        json_decref(json);
+    }
+
+    if(sizeof(json_int_t) == 8) {
+        json = json_loads("[9223372036854775807, -9223372036854775808]", 0, &error);
+        if(!json || json_integer_value(json_array_get(json, 0)) != (json_int_t)9223372036854775807LL ||
+           json_integer_value(json_array_get(json, 1)) != (json_int_t)(-9223372036854775807LL - 1))
+            fail("json_loads decoded the integer limits incorrectly");
+        json_decref(json);
+
+        json = json_loads("[-9223372036854775809]", 0, &error);
+        if(json || strcmp(error.text, "too big negative integer near '-9223372036854775809'"))
+            fail("json_loads accepted a too big negative integer");
+    }
+}
+
+/* records the events as "{ k:id i:1 [ s:a ] }" */
+typedef struct {
+    char events[512];
+    const char *input;
+    size_t input_len;
+    int spans;           /* unescaped strings pointing into the input */
+    const char *skip;    /* key whose value is skipped */
+    const char *stop;    /* key that stops parsing */
+} sax_record_t;
+
+static void sax_append(sax_record_t *record, const char *event, const char *value, size_t len)
+{
+    size_t used = strlen(record->events);
+    snprintf(record->events + used, sizeof(record->events) - used, "%s%s%.*s",
+             used ? " " : "", event, (int)len, value ? value : "");
+}
+
+static void sax_span(sax_record_t *record, const char *value)
+{
+    if(value >= record->input && value < record->input + record->input_len)
+        record->spans++;
+}
+
+static int sax_start_object(void *data) { sax_append(data, "{", NULL, 0); return JSON_SAX_CONTINUE; }
+static int sax_end_object(void *data) { sax_append(data, "}", NULL, 0); return JSON_SAX_CONTINUE; }
+static int sax_start_array(void *data) { sax_append(data, "[", NULL, 0); return JSON_SAX_CONTINUE; }
+static int sax_end_array(void *data) { sax_append(data, "]", NULL, 0); return JSON_SAX_CONTINUE; }
+static int sax_null(void *data) { sax_append(data, "n", NULL, 0); return JSON_SAX_CONTINUE; }
+
+static int sax_key(void *data, const char *key, size_t len)
+{
+    sax_record_t *record = data;
+
+    sax_append(record, "k:", key, len);
+    sax_span(record, key);
+    if(record->skip && strlen(record->skip) == len && !memcmp(record->skip, key, len))
+        return JSON_SAX_SKIP;
+    if(record->stop && strlen(record->stop) == len && !memcmp(record->stop, key, len))
+        return JSON_SAX_STOP;
+    return JSON_SAX_CONTINUE;
+}
+
+static int sax_string(void *data, const char *value, size_t len)
+{
+    sax_append(data, "s:", value, len);
+    sax_span(data, value);
+    return JSON_SAX_CONTINUE;
+}
+
+static int sax_integer(void *data, json_int_t value)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "%" JSON_INTEGER_FORMAT, value);
+    sax_append(data, "i:", text, strlen(text));
+    return JSON_SAX_CONTINUE;
+}
+
+static int sax_real(void *data, double value)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "%g", value);
+    sax_append(data, "r:", text, strlen(text));
+    return JSON_SAX_CONTINUE;
+}
+
+static int sax_boolean(void *data, int value)
+{
+    sax_append(data, value ? "true" : "false", NULL, 0);
+    return JSON_SAX_CONTINUE;
+}
+
+static const json_sax_t sax_recorder = {
+    sax_start_object, sax_end_object, sax_start_array, sax_end_array,
+    sax_key, sax_string, sax_integer, sax_real, sax_boolean, sax_null
+};
+
+static int sax_run(sax_record_t *record, const char *text, size_t flags, json_error_t *error)
+{
+    record->events[0] = '\0';
+    record->input = text;
+    record->input_len = strlen(text);
+    record->spans = 0;
+    return json_sax_parse(text, strlen(text), flags, &sax_recorder, record, error);
+}
+
+static void sax_parse()
+{
+    const char *text = "{\"id\": 1, \"method\": \"mining.notify\", "
+                       "\"params\": [\"a\\tb\", true, false, null, -2, 0.5, {}, []]}";
+    sax_record_t record;
+    json_error_t error, load_error;
+    const char *bad[] = {"[1, 2", "{\"a\" 1}", "[\"\\u0000\"]", "{\"a\": [1 2]}", "[1] x"};
+    size_t i;
+
+    memset(&record, 0, sizeof(record));
+
+    if(sax_run(&record, text, 0, &error) ||
+       strcmp(record.events, "{ k:id i:1 k:method s:mining.notify k:params "
+                             "[ s:a\tb true false n i:-2 r:0.5 { } [ ] ] }"))
+        fail("json_sax_parse reported wrong events");
+
+    /* the three keys and one string without escapes need no copy */
+    if(record.spans != 4)
+        fail("json_sax_parse copied unescaped strings");
+
+    /* a skipped value is checked but not reported */
+    record.skip = "params";
+    if(sax_run(&record, text, 0, &error) ||
+       strcmp(record.events, "{ k:id i:1 k:method s:mining.notify k:params }"))
+        fail("json_sax_parse did not skip a value");
+
+    if(sax_run(&record, "{\"params\": [1, }", 0, &error) != -1)
+        fail("json_sax_parse accepted invalid JSON in a skipped value");
+    record.skip = NULL;
+
+    /* stopping leaves the rest of the input unread */
+    record.stop = "method";
+    if(sax_run(&record, "{\"id\": 1, \"method\": \"x\", ]", 0, &error) != 1 ||
+       strcmp(record.events, "{ k:id i:1 k:method"))
+        fail("json_sax_parse did not stop");
+    record.stop = NULL;
+
+    /* the same errors as json_loadb */
+    for(i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        json_t *json = json_loadb(bad[i], strlen(bad[i]), 0, &load_error);
+
+        if(json || sax_run(&record, bad[i], 0, &error) != -1 ||
+           error.position != load_error.position || strcmp(error.text, load_error.text) ||
+           json_error_code(&error) != json_error_code(&load_error))
+            fail("json_sax_parse and json_loadb report different errors");
+    }
+
+    if(sax_run(&record, "{\"a\": 1, \"a\": 2}", JSON_REJECT_DUPLICATES, &error) != -1 ||
+       json_error_code(&error) != json_error_duplicate_key)
+        fail("json_sax_parse accepted a duplicate key");
+
+    if(sax_run(&record, "7", JSON_DECODE_ANY, &error) || strcmp(record.events, "i:7"))
+        fail("json_sax_parse did not decode a scalar");
+}
+
+static void loadb_select()
+{
+    const char *text = "{\"id\": 7, \"method\": \"mining.submit\", "
+                       "\"params\": [\"worker\", \"job\", {\"a/b\": \"x\\ty\", \"n\": [1, 2]}], "
+                       "\"extra\": {\"deep\": [[[1]]]}}";
+    const char *paths[] = {"/method", "/params/1", "/params/2/a~1b", "/params/2/n/1", "/missing", "/id/0", "/params/2"};
+    const char *repeated = "{\"id\": 1, \"id\": 2}";
+    const char *bad[] = {"{\"a\": [1, }", "{\"a\": 1} x", "[\"\\u0000\"]"};
+    json_t *values[7];
+    json_error_t error, load_error;
+    size_t i;
+
+    if(json_loadb_select(text, strlen(text), 0, paths, 7, values, &error) != 5)
+        fail("json_loadb_select found the wrong number of values");
+
+    if(strcmp(json_string_value(values[0]), "mining.submit") || strcmp(json_string_value(values[1]), "job") ||
+       strcmp(json_string_value(values[2]), "x\ty") || json_integer_value(values[3]) != 2 ||
+       values[4] || values[5] || json_object_size(values[6]) != 2)
+        fail("json_loadb_select returned wrong values");
+
+    /* a path inside another selected value shares its node */
+    if(json_array_get(json_object_get(values[6], "n"), 1) != values[3])
+        fail("json_loadb_select decoded a value twice");
+
+    for(i = 0; i < 7; i++)
+        json_decref(values[i]);
+
+    /* a repeated key replaces the value of its path */
+    paths[0] = "/id";
+    if(json_loadb_select(repeated, strlen(repeated), 0, paths, 1, values, &error) != 1 ||
+       json_integer_value(values[0]) != 2)
+        fail("json_loadb_select mishandled a repeated key");
+    json_decref(values[0]);
+
+    /* paths inside a selected value decode keys like the others */
+    {
+        char long_text[400], long_path[320];
+        const char *inner[4];
+
+        memset(long_path, 'k', sizeof(long_path));
+        memcpy(long_path, "/a/", 3);
+        long_path[303] = '\0';
+        snprintf(long_text, sizeof(long_text), "{\"a\": {\"%s\": 1, \"x~2\": 2, \"~/\": 3}}", long_path + 3);
+
+        inner[0] = "/a";
+        inner[1] = long_path;
+        inner[2] = "/a/x~2";
+        inner[3] = "/a/~0~1";
+        if(json_loadb_select(long_text, strlen(long_text), 0, inner, 4, values, &error) != 3 ||
+           json_integer_value(values[1]) != 1 || values[2] || json_integer_value(values[3]) != 3)
+            fail("json_loadb_select mishandled keys inside a selected value");
+        for(i = 0; i < 4; i++)
+            json_decref(values[i]);
+    }
+
+    /* the root path selects the whole document */
+    paths[0] = "";
+    if(json_loadb_select(text, strlen(text), 0, paths, 1, values, &error) != 1 || json_object_size(values[0]) != 4)
+        fail("json_loadb_select did not select the root");
+    json_decref(values[0]);
+
+    paths[0] = "method";
+    if(json_loadb_select(text, strlen(text), 0, paths, 1, values, &error) != -1 ||
+       json_error_code(&error) != json_error_invalid_argument)
+        fail("json_loadb_select accepted an invalid path");
+
+    /* skipped values are still checked and fail like json_loadb */
+    paths[0] = "/b";
+    for(i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        json_t *json = json_loadb(bad[i], strlen(bad[i]), 0, &load_error);
+
+        if(json || json_loadb_select(bad[i], strlen(bad[i]), 0, paths, 1, values, &error) != -1 || values[0] ||
+           error.position != load_error.position || strcmp(error.text, load_error.text))
+            fail("json_loadb_select and json_loadb report different errors");
+    }
+
+    if(json_loadb_select("{\"b\": 1, \"b\": 2}", 16, JSON_REJECT_DUPLICATES, paths, 1, values, &error) != -1 ||
+       json_error_code(&error) != json_error_duplicate_key || values[0])
+        fail("json_loadb_select accepted a duplicate key");
+}
+
+static void loadb_many()
+{
+    const char *text = "{\"id\": 1}\n[2, 3]\n  {\"id\": 4}\n";
+    json_t *values[4];
+    json_error_t error;
+    size_t i;
+
+    if(json_loadb_many(text, strlen(text), 0, values, 4, &error) != 3 || error.position != (int)strlen(text))
+        fail("json_loadb_many did not decode every value");
+
+    if(json_integer_value(json_object_get(values[0], "id")) != 1 || json_array_size(values[1]) != 2 ||
+       json_integer_value(json_object_get(values[2], "id")) != 4)
+        fail("json_loadb_many returned wrong values");
+
+    for(i = 0; i < 3; i++)
+        json_decref(values[i]);
+
+    /* a full values array leaves the rest for the next call */
+    if(json_loadb_many(text, strlen(text), 0, values, 2, &error) != 2 || error.position != 16)
+        fail("json_loadb_many did not stop after the last value");
+    json_decref(values[0]);
+    json_decref(values[1]);
+
+    if(json_loadb_many("[1] [2", 6, 0, values, 4, &error) != -1 ||
+       json_error_code(&error) != json_error_premature_end_of_input)
+        fail("json_loadb_many accepted invalid JSON");
+
+    if(json_loadb_many("[1] 2", 5, 0, values, 4, &error) != -1 ||
+       json_loadb_many("1 2", 3, JSON_DECODE_ANY, values, 4, &error) != 2 ||
+       json_integer_value(values[1]) != 2)
+        fail("json_loadb_many mishandled JSON_DECODE_ANY");
+    json_decref(values[0]);
+    json_decref(values[1]);
+
+    if(json_loadb_many(" \n", 2, 0, values, 4, &error) != 0)
+        fail("json_loadb_many failed on empty input");
+}
+
+static void push_parse()
+{
+    const char *text = "{\"id\": 1, \"method\": \"mining.subscribe\", \"params\": [\"}\\\"]\"]}\n"
+                       "[1, [2, {\"a\": []}]]\r\n"
+                       "  {\"id\": 2, \"result\": true}\n";
+    const char *expected[] = {"{\"id\": 1, \"method\": \"mining.subscribe\", \"params\": [\"}\\\"]\"]}",
+                              "[1, [2, {\"a\": []}]]", "{\"id\": 2, \"result\": true}"};
+    json_stream_t stream;
+    json_error_t error;
+    json_t *value, *copy;
+    size_t i, n = 0;
+    int result;
+
+    json_stream_init(&stream, 0, 0);
+
+    /* all values in one chunk */
+    if(json_stream_feed(&stream, text, strlen(text)))
+        fail("json_stream_feed failed");
+    while((result = json_stream_next(&stream, &value, &error)) == 1) {
+        copy = json_loads(expected[n], 0, NULL);
+        if(n >= 3 || !json_equal(value, copy))
+            fail("json_stream_next returned a wrong value");
+        json_decref(copy);
+        json_decref(value);
+        n++;
+    }
+    if(result || n != 3 || json_stream_pending(&stream))
+        fail("json_stream_next did not return every value");
+
+    /* one byte at a time */
+    n = 0;
+    for(i = 0; i < strlen(text); i++) {
+        if(json_stream_feed(&stream, text + i, 1))
+            fail("json_stream_feed failed");
+        while((result = json_stream_next(&stream, &value, &error)) == 1) {
+            copy = json_loads(expected[n], 0, NULL);
+            if(n >= 3 || !json_equal(value, copy))
+                fail("json_stream_next returned a wrong value from split input");
+            json_decref(copy);
+            json_decref(value);
+            n++;
+        }
+        if(result)
+            fail("json_stream_next failed on split input");
+    }
+    if(n != 3)
+        fail("json_stream_next did not return every value from split input");
+
+    /* the previous chunk has to be drained first */
+    if(json_stream_feed(&stream, "[1]", 3) || !json_stream_feed(&stream, "[2]", 3))
+        fail("json_stream_feed accepted a chunk before the last one was read");
+    json_stream_reset(&stream);
+
+    /* a value that does not parse is dropped */
+    if(json_stream_feed(&stream, "[1 2]\n[3]", 9) || json_stream_next(&stream, &value, &error) != -1 ||
+       value || json_error_code(&error) != json_error_invalid_syntax)
+        fail("json_stream_next accepted invalid JSON");
+    if(json_stream_next(&stream, &value, &error) != 1 || json_integer_value(json_array_get(value, 0)) != 3)
+        fail("json_stream_next did not continue after invalid JSON");
+    json_decref(value);
+
+    if(json_stream_feed(&stream, "7\n", 2) || json_stream_next(&stream, &value, &error) != -1)
+        fail("json_stream_next accepted a scalar without JSON_DECODE_ANY");
+    json_stream_close(&stream);
+
+    /* scalars end at the next delimiter */
+    json_stream_init(&stream, 0, JSON_DECODE_ANY);
+    if(json_stream_feed(&stream, "12", 2) || json_stream_next(&stream, &value, &error) != 0 ||
+       json_stream_feed(&stream, "3 \"x\"", 5) || json_stream_next(&stream, &value, &error) != 1 ||
+       json_integer_value(value) != 123)
+        fail("json_stream_next did not decode a split scalar");
+    json_decref(value);
+    if(json_stream_next(&stream, &value, &error) != 1 || strcmp(json_string_value(value), "x"))
+        fail("json_stream_next did not decode a string");
+    json_decref(value);
+    json_stream_close(&stream);
+
+    json_stream_init(&stream, 8, 0);
+    if(json_stream_feed(&stream, "[1, 2, 3, 4]", 12) || json_stream_next(&stream, &value, &error) != -1 ||
+       json_error_code(&error) != json_error_invalid_format)
+        fail("json_stream_next accepted a value over the maximum size");
+    json_stream_close(&stream);
+}
+
+static void loader_parse()
+{
+    const char *texts[] = {"{\"id\": 1, \"method\": \"mining.subscribe\", \"params\": []}",
+                           "[\"a string that is longer than the initial lexer buffer\", 1.5]",
+                           "\"x\""};
+    json_loader_t loader;
+    json_arena_t *arena;
+    json_error_t error;
+    json_t *value, *copy;
+    size_t i, j;
+
+    json_loader_init(&loader, JSON_DECODE_ANY, NULL);
+    for(i = 0; i < 3; i++) {
+        for(j = 0; j < 3; j++) {
+            value = json_loader_parse(&loader, texts[j], strlen(texts[j]), &error);
+            copy = json_loads(texts[j], JSON_DECODE_ANY, NULL);
+            if(!value || !json_equal(value, copy))
+                fail("json_loader_parse returned a wrong value");
+            json_decref(copy);
+            json_decref(value);
+        }
+    }
+
+    /* errors leave the loader usable */
+    if(json_loader_parse(&loader, "[1 2]", 5, &error) || json_error_code(&error) != json_error_invalid_syntax ||
+       error.position != 4)
+        fail("json_loader_parse accepted invalid JSON");
+    if(json_loader_parse(&loader, NULL, 0, &error) || json_error_code(&error) != json_error_invalid_argument)
+        fail("json_loader_parse accepted a NULL buffer");
+
+    value = json_loader_parse(&loader, "[3]", 3, &error);
+    if(!value || json_integer_value(json_array_get(value, 0)) != 3)
+        fail("json_loader_parse failed after an error");
+    json_decref(value);
+    json_loader_close(&loader);
+
+    /* loader flags apply to every text */
+    json_loader_init(&loader, 0, NULL);
+    if(json_loader_parse(&loader, "7", 1, &error))
+        fail("json_loader_parse accepted a scalar without JSON_DECODE_ANY");
+    json_loader_close(&loader);
+
+    /* values from the arena of the loader */
+    arena = json_arena_new(0);
+    json_loader_init(&loader, 0, arena);
+    value = json_loader_parse(&loader, texts[0], strlen(texts[0]), &error);
+    if(!value || !json_arena_used(arena) || json_arena_use(NULL))
+        fail("json_loader_parse did not use the arena of the loader");
+    json_loader_close(&loader);
+    json_arena_free(arena);
+}
+
+static void load_file_mmap()
+{
+    json_t *json, *value;
+    json_error_t error;
+    FILE *fp;
+
+    json = json_pack("{s:i, s:[s, f], s:{}}", "id", 1, "params", "a string that is longer than a few bytes", 1.5,
+                     "result");
+    if(json_dump_file(json, "load_file_mmap.json", 0))
+        fail("json_dump_file failed");
+
+    value = json_load_file_mmap("load_file_mmap.json", 0, &error);
+    if(!value || !json_equal(value, json))
+        fail("json_load_file_mmap returned a wrong value");
+    if(strcmp(error.source, "load_file_mmap.json"))
+        fail("json_load_file_mmap returned a wrong source");
+    json_decref(value);
+    json_decref(json);
+
+    /* empty files are read instead of mapped */
+    fp = fopen("load_file_mmap.json", "wb");
+    if(!fp)
+        fail("unable to create a file");
+    fclose(fp);
+
+    if(json_load_file_mmap("load_file_mmap.json", 0, &error) ||
+       json_error_code(&error) != json_error_premature_end_of_input)
+        fail("json_load_file_mmap accepted an empty file");
+    remove("load_file_mmap.json");
+
+    if(json_load_file_mmap("/path/to/nonexistent/file.json", 0, &error) ||
+       json_error_code(&error) != json_error_cannot_open_file)
+        fail("json_load_file_mmap returned a wrong error for a nonexistent file");
+
+    if(json_load_file_mmap(NULL, 0, &error) || json_error_code(&error) != json_error_invalid_argument)
+        fail("json_load_file_mmap accepted a NULL path");
+}
+
 static void run_tests()
 {
     file_not_found();
@@ -243,4 +804,13 @@ static void run_tests()
     load_wrong_args();
     position();
     error_code();
+    buffer_error_location();
+    long_strings();
+    number_boundaries();
+    sax_parse();
+    loadb_select();
+    loadb_many();
+    push_parse();
+    loader_parse();
+    load_file_mmap();
 }
@@ -122,6 +122,113 @@ static void test_secure_funcs(void)
     create_and_free_complex_object();
 }
 
+static int pool_malloc_called = 0;
+
+static void *pool_malloc(size_t size)
+{
+    pool_malloc_called++;
+    return malloc(size);
+}
+
+static void test_pools(void)
+{
+    json_t *integer, *real, *object;
+    void *first;
+
+    json_set_alloc_funcs(pool_malloc, free);
+    json_pool_set_limit(16);
+    if (json_pool_get_limit() != 16)
+        fail("json_pool_get_limit returned the wrong limit");
+
+    integer = json_integer(1);
+    first = integer;
+    json_decref(integer);
+
+    /* freed nodes are reused without allocating */
+    pool_malloc_called = 0;
+    integer = json_integer(2);
+    if (integer != first || pool_malloc_called != 0)
+        fail("freed node was not reused from the pool");
+
+    /* nodes of the same size share a pool */
+    json_decref(integer);
+    real = json_real(2.5);
+    if (real != first || json_real_value(real) != 2.5)
+        fail("freed node was not reused for a node of the same size");
+    json_decref(real);
+
+    /* objects carry their small table inline and are pooled too */
+    object = json_object();
+    first = object;
+    json_decref(object);
+    pool_malloc_called = 0;
+    object = json_object();
+    if (object != first || pool_malloc_called != 0)
+        fail("freed object was not reused from the pool");
+    json_decref(object);
+
+    json_pool_trim();
+    json_pool_set_limit(0);
+
+    /* disabled pools do not cache */
+    integer = json_integer(3);
+    json_decref(integer);
+    pool_malloc_called = 0;
+    integer = json_integer(4);
+    if (pool_malloc_called != 1)
+        fail("node was cached while pools are disabled");
+    json_decref(integer);
+}
+
+static void test_stats(void)
+{
+    json_stats_t stats;
+    json_t *json, *copy;
+    json_error_t error;
+    bos_t *serialized;
+    char *text;
+
+    json_set_alloc_funcs(malloc, free);
+    json_reset_stats();
+
+    /* without JANSSON_STATS nothing is counted */
+    if (json_get_stats(&stats)) {
+        if (stats.allocations || stats.load_calls)
+            fail("json_get_stats returned counters while disabled");
+        return;
+    }
+
+    if (stats.allocations || stats.frees || stats.load_calls || stats.dump_calls)
+        fail("json_reset_stats did not reset the counters");
+
+    json = json_loads("[1, \"abc\"]", 0, &error);
+    if (json_get_stats(&stats) || stats.load_calls != 1 || stats.load_bytes != 10 || !stats.allocations ||
+        stats.allocated_bytes < stats.allocations)
+        fail("json_get_stats did not count json_loads");
+
+    text = json_dumps(json, JSON_COMPACT);
+    if (json_get_stats(&stats) || stats.dump_calls != 1 || stats.dump_bytes != strlen(text))
+        fail("json_get_stats did not count json_dumps");
+    free(text);
+
+    serialized = bos_serialize(json, &error);
+    copy = bos_deserialize_ex(serialized->data, serialized->size, 0, &error);
+    if (json_get_stats(&stats) || stats.serialize_calls != 1 || stats.serialize_bytes != serialized->size ||
+        stats.deserialize_calls != 1 || stats.deserialize_bytes != serialized->size)
+        fail("json_get_stats did not count BOS calls");
+
+    json_decref(copy);
+    json_decref(json);
+    bos_free(serialized);
+
+    if (json_get_stats(&stats) || !stats.frees || stats.peak_bytes < stats.live_bytes)
+        fail("json_get_stats did not count frees");
+
+    json_reset_stats();
+    if (json_get_stats(&stats) || stats.allocations || stats.peak_bytes != stats.live_bytes)
+        fail("json_reset_stats did not keep the live bytes");
+}
+
 static void test_bad_args(void)
 {
     /* The result of this test is not crashing. */
@@ -133,5 +240,7 @@ static void run_tests()
     test_simple();
     test_secure_funcs();
     test_oom();
+    test_pools();
+    test_stats();
     test_bad_args();
 }
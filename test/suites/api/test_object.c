@@ -165,6 +165,116 @@ static void test_set_many_keys()
     json_decref(value);
 }
 
+static void test_delete_many_keys()
+{
+    json_t *object, *value;
+    const char *key;
+    void *tmp;
+    char buf[16];
+    int i, count;
+
+    object = json_object();
+
+    for (i = 0; i < 1000; i++) {
+        snprintf(buf, sizeof(buf), "%d", i);
+        if (json_object_set_new(object, buf, json_integer(i)))
+            fail("unable to set object key");
+    }
+
+    /* deleted keys leave holes that are reclaimed when growing */
+    for (i = 0; i < 1000; i += 2) {
+        snprintf(buf, sizeof(buf), "%d", i);
+        if (json_object_del(object, buf))
+            fail("unable to delete object key");
+    }
+
+    for (i = 0; i < 1000; i += 2) {
+        snprintf(buf, sizeof(buf), "%d", i);
+        if (json_object_set_new(object, buf, json_integer(i)))
+            fail("unable to set object key");
+    }
+
+    if (json_object_size(object) != 1000)
+        fail("object has the wrong size after deleting and setting keys");
+
+    for (i = 0; i < 1000; i++) {
+        snprintf(buf, sizeof(buf), "%d", i);
+        if (json_integer_value(json_object_get(object, buf)) != i)
+            fail("lookup failed after deleting and setting keys");
+    }
+
+    /* odd keys stay in place, even keys come after them */
+    count = 0;
+    json_object_foreach(object, key, value) {
+        i = count < 500 ? count * 2 + 1 : (count - 500) * 2;
+        if (json_integer_value(value) != i)
+            fail("iteration order is wrong after deleting and setting keys");
+        count++;
+    }
+
+    json_object_foreach_safe(object, tmp, key, value) {
+        if (json_object_del(object, key))
+            fail("unable to delete while iterating");
+    }
+
+    if (json_object_size(object) != 0 || json_object_iter(object))
+        fail("object is not empty after deleting all keys");
+
+    json_decref(object);
+}
+
+static void test_small_objects()
+{
+    json_t *object;
+    json_key_t key;
+    const char *keys[] = {"a", "b", "c", "d", "e", "f", "g", "h", "i", "j", "k"};
+    const char *order = "bdfhacegijk";
+    const char *k;
+    json_t *v;
+    size_t i;
+
+    object = json_object();
+
+    for (i = 0; i < 8; i++)
+        json_object_set_new(object, keys[i], json_integer(i));
+
+    /* a full small object reuses the holes of deleted keys */
+    json_object_del(object, "a");
+    json_object_del(object, "c");
+    json_object_del(object, "e");
+    json_object_del(object, "g");
+    json_object_set_new(object, "a", json_integer(0));
+    json_object_set_new(object, "c", json_integer(2));
+    json_object_set_new(object, "e", json_integer(4));
+    json_object_set_new(object, "g", json_integer(6));
+
+    /* prepared keys work before and after the object grows */
+    key = json_key_make("i");
+    json_object_set_new_k(object, &key, json_integer(8));
+    json_object_set_new(object, "j", json_integer(9));
+    json_object_set_new(object, "k", json_integer(10));
+
+    if (json_object_size(object) != 11)
+        fail("small object has the wrong size after growing");
+
+    for (i = 0; i < 11; i++) {
+        if (json_integer_value(json_object_get(object, keys[i])) != (json_int_t)i)
+            fail("lookup failed after a small object grew");
+    }
+
+    if (json_integer_value(json_object_get_k(object, &key)) != 8 ||
+        json_integer_value(json_object_getn(object, "jk", 1)) != 9)
+        fail("lookup with a known hash failed after a small object grew");
+
+    i = 0;
+    json_object_foreach(object, k, v) {
+        if (k[0] != order[i++])
+            fail("small object lost the insertion order when growing");
+    }
+
+    json_decref(object);
+}
+
 static void test_conditional_updates()
 {
     json_t *object, *other;
@@ -660,12 +770,113 @@ static void test_bad_args(void)
     json_decref(num);
 }
 
+static void test_repeated_keys(void)
+{
+    json_t *array, *object, *loaded, *copy;
+    json_error_t error;
+    bos_t *serialized;
+    char *text;
+    char key[64];
+    size_t i, j;
+
+    /* keys that repeat across objects take the cached hash path */
+    array = json_array();
+    for(i = 0; i < 50; i++) {
+        object = json_object();
+        for(j = 0; j < 80; j++) {
+            snprintf(key, sizeof(key), "key%d", (int)j);
+            json_object_set_new(object, key, json_integer((json_int_t)(i * j)));
+        }
+        json_object_set_new(object, "a key that is too long to be cached", json_integer((json_int_t)i));
+        json_array_append_new(array, object);
+    }
+
+    text = json_dumps(array, JSON_COMPACT);
+    if(!text)
+        fail("unable to dump objects with repeated keys");
+
+    loaded = json_loads(text, JSON_REJECT_DUPLICATES, &error);
+    if(!loaded || !json_equal(array, loaded))
+        fail("objects with repeated keys did not load correctly");
+
+    serialized = bos_serialize(loaded, &error);
+    if(!serialized)
+        fail("unable to serialize objects with repeated keys");
+
+    copy = bos_deserialize(serialized->data, &error);
+    if(!copy || !json_equal(array, copy))
+        fail("objects with repeated keys did not deserialize correctly");
+
+    object = json_array_get(copy, 49);
+    if(json_integer_value(json_object_get(object, "key79")) != 49 * 79 ||
+       json_integer_value(json_object_get(object, "a key that is too long to be cached")) != 49)
+        fail("lookup in a deserialized object failed");
+
+    free(text);
+    bos_free(serialized);
+    json_decref(copy);
+    json_decref(loaded);
+    json_decref(array);
+
+    loaded = json_loads("[{\"id\": 1}, {\"id\": 2, \"id\": 3}]", JSON_REJECT_DUPLICATES, &error);
+    if(loaded || error.position != 26)
+        fail("duplicate cached key was not rejected");
+}
+
+static void test_prepared_keys(void)
+{
+    json_t *object, *value;
+    json_key_t id, params, bad;
+    const char *buffer = "paramsid";
+
+    id = json_key_make("id");
+    params = json_key_maken(buffer, 6);
+    bad = json_key_make("\xff");
+    if(!id.key || id.len != 2 || !params.key || params.len != 6 || bad.key)
+        fail("json_key_make failed");
+
+    object = json_object();
+    value = json_integer(1);
+
+    if(json_object_set_k(object, &id, value) || value->refcount != 2)
+        fail("json_object_set_k failed");
+    if(json_object_set_new_k(object, &params, json_array()))
+        fail("json_object_set_new_k failed");
+    if(!json_object_set_new_k(object, &bad, json_null()))
+        fail("json_object_set_new_k accepted an invalid key");
+
+    if(json_object_get_k(object, &id) != value || json_object_get(object, "id") != value)
+        fail("json_object_get_k returned the wrong value");
+    if(!json_is_array(json_object_get_k(object, &params)) ||
+       !json_is_array(json_object_get(object, "params")))
+        fail("json_object_set_k did not store the key length");
+
+    if(json_object_getn(object, buffer, 6) != json_object_get(object, "params") ||
+       json_object_getn(object, buffer + 6, 2) != value ||
+       json_object_getn(object, buffer, 5) ||
+       json_object_getn(object, "id\0", 3))
+        fail("json_object_getn failed");
+
+    if(json_object_del_k(object, &id) || json_object_get(object, "id") ||
+       !json_object_del_k(object, &id) || value->refcount != 1)
+        fail("json_object_del_k failed");
+
+    if(json_object_get_k(NULL, &params) || json_object_get_k(object, NULL) ||
+       json_object_get_k(object, &bad) || json_object_getn(object, NULL, 0))
+        fail("prepared key lookup accepted bad arguments");
+
+    json_decref(value);
+    json_decref(object);
+}
+
 static void run_tests()
 {
     test_misc();
     test_clear();
     test_update();
     test_set_many_keys();
+    test_delete_many_keys();
+    test_small_objects();
     test_conditional_updates();
     test_circular();
     test_set_nocheck();
@@ -674,4 +885,6 @@ static void run_tests()
     test_object_foreach();
     test_object_foreach_safe();
     test_bad_args();
+    test_repeated_keys();
+    test_prepared_keys();
 }
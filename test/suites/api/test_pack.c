@@ -48,6 +48,86 @@ static void test_inifity()
 }
 #endif // INFINITY
 
+static void test_compiled()
+{
+    json_pack_program_t *program;
+    json_key_t id_key = json_key_make("id");
+    json_t *value, *expected;
+    json_error_t error;
+    int i;
+
+    program = json_pack_compile("{s:I, s:s, s:[sssss]}", &error);
+    if(!program)
+        fail("json_pack_compile failed");
+
+    /* a program can be run any number of times */
+    for(i = 0; i < 3; i++) {
+        value = json_pack_run(program, "id", (json_int_t)i, "method", "mining.submit",
+                              "params", "worker", "job", "extranonce2", "ntime", "nonce");
+        expected = json_pack("{s:I, s:s, s:[sssss]}", "id", (json_int_t)i, "method", "mining.submit",
+                             "params", "worker", "job", "extranonce2", "ntime", "nonce");
+        if(!value || !json_equal(value, expected))
+            fail("json_pack_run returned a wrong value");
+        json_decref(value);
+        json_decref(expected);
+    }
+    json_pack_program_free(program);
+
+    /* prepared keys */
+    value = json_pack("{k:i, s:i}", &id_key, 1, "foo", 2);
+    if(!value || json_integer_value(json_object_get(value, "id")) != 1 ||
+       json_integer_value(json_object_get(value, "foo")) != 2)
+        fail("json_pack failed to pack a prepared key");
+    json_decref(value);
+
+    if(json_pack_ex(&error, 0, "{k:i}", NULL, 1))
+        fail("json_pack failed to catch NULL prepared key");
+    check_error(json_error_null_value, "NULL object key", "<args>", 1, 2, 2);
+
+    /* arrays are sized for all of their values */
+    program = json_pack_compile("[iiiiiiiiii[ii]]", &error);
+    value = json_pack_run(program, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11);
+    if(json_array_size(value) != 11 || json_integer_value(json_array_get(value, 9)) != 9 ||
+       json_array_size(json_array_get(value, 10)) != 2)
+        fail("json_pack_run failed to pack a large array");
+    json_decref(value);
+    json_pack_program_free(program);
+
+    /* argument errors are reported at the position in the format */
+    program = json_pack_compile("{s:o}", &error);
+    if(json_pack_run_ex(&error, 0, program, "foo", NULL))
+        fail("json_pack_run failed to catch nullable object");
+    check_error(json_error_null_value, "NULL object", "<args>", 1, 4, 4);
+    json_pack_program_free(program);
+
+    program = json_pack_compile("ia", &error);
+    if(json_pack_run_ex(&error, 0, program, 42))
+        fail("json_pack_run failed to catch garbage after format string");
+    check_error(json_error_invalid_format, "Garbage after format string", "<format>", 1, 2, 2);
+    json_pack_program_free(program);
+
+    /* and so are unbalanced containers */
+    if(json_pack_compile("", &error))
+        fail("json_pack_compile failed to catch empty format string");
+    check_error(json_error_invalid_argument, "NULL or empty format string", "<format>", -1, -1, 0);
+
+    if(json_pack_compile("[i}", &error))
+        fail("json_pack_compile failed to catch mismatched '}'");
+    check_error(json_error_invalid_format, "Unexpected format character '}'", "<format>", 1, 3, 3);
+
+    if(json_pack_compile("{s:[i}", &error))
+        fail("json_pack_compile failed to catch missing ']'");
+    check_error(json_error_invalid_format, "Unexpected format character '}'", "<format>", 1, 6, 6);
+
+    if(json_pack_compile("{s:i", &error))
+        fail("json_pack_compile failed to catch missing '}'");
+    check_error(json_error_invalid_format, "Unexpected end of format string", "<format>", 1, 5, 5);
+
+    if(json_pack_run_ex(&error, 0, NULL))
+        fail("json_pack_run failed to catch NULL program");
+    check_error(json_error_invalid_argument, "NULL program", "<format>", -1, -1, 0);
+}
+
 static void run_tests()
 {
     json_t *value;
@@ -494,4 +574,6 @@ static void run_tests()
     if(json_pack_ex(&error, 0, "{s:O}", "foo", NULL))
         fail("json_pack failed to catch nullable incref object");
     check_error(json_error_null_value, "NULL object", "<args>", 1, 4, 4);
+
+    test_compiled();
 }
@@ -59,6 +59,66 @@ static void test_bad_args(void)
     json_decref(txt);
 }
 
+static void test_freeze(void)
+{
+    json_t *object, *array, *num, *copy;
+    int i;
+
+    object = json_object();
+    array = json_array();
+    num = json_integer(1);
+    json_object_set(object, "num", num);
+    json_array_append(array, num);
+    json_array_append_new(array, json_true());
+    json_object_set_new(object, "array", array);
+
+    if(json_freeze(NULL) != -1)
+        fail("json_freeze succeeded with NULL");
+    if(json_freeze(object))
+        fail("json_freeze failed");
+    if(!json_is_frozen(object) || !json_is_frozen(array) || !json_is_frozen(num))
+        fail("json_freeze did not freeze the whole tree");
+    if(json_is_frozen(json_true()))
+        fail("json_freeze froze a singleton");
+
+    /* reference counting is a no-op */
+    for(i = 0; i < 3; i++)
+        json_decref(object);
+    json_incref(num);
+    if(object->refcount != 1 || array->refcount != 1 || num->refcount != 3)
+        fail("frozen reference counts changed");
+
+    if(json_object_set_new(object, "foo", json_integer(2)) != -1 ||
+       json_object_del(object, "num") != -1 ||
+       json_object_clear(object) != -1)
+        fail("modified a frozen object");
+    if(json_array_append_new(array, json_integer(2)) != -1 ||
+       json_array_remove(array, 0) != -1 ||
+       json_array_clear(array) != -1)
+        fail("modified a frozen array");
+    if(json_integer_set(num, 2) != -1 || json_integer_value(num) != 1)
+        fail("modified a frozen integer");
+    if(json_object_size(object) != 2 || json_array_size(array) != 2)
+        fail("frozen containers changed");
+
+    /* copies are not frozen */
+    copy = json_deep_copy(object);
+    if(!copy || json_is_frozen(copy) || json_is_frozen(json_object_get(copy, "num")))
+        fail("json_deep_copy copied the frozen flag");
+    if(json_object_set_new(copy, "foo", json_integer(2)))
+        fail("could not modify a copy of a frozen object");
+    json_decref(copy);
+
+    json_thaw_release(object);
+    if(json_is_frozen(num) || num->refcount != 1)
+        fail("json_thaw_release did not release the tree");
+    if(json_integer_set(num, 2))
+        fail("could not modify a thawed value");
+    json_decref(num);
+
+    json_thaw_release(NULL);
+}
+
 /* Call the simple functions not covered by other tests of the public API */
 static void run_tests()
 {
@@ -143,6 +203,19 @@ static void run_tests()
 
     json_decref(value);
 
+    /* switch between short and long values */
+    value = json_string("short");
+    if(json_string_set(value, "a value that is longer than the inline storage") ||
+       strcmp(json_string_value(value), "a value that is longer than the inline storage"))
+        fail("json_string_set to a long value failed");
+    if(json_string_set(value, json_string_value(value) + 39) ||
+       strcmp(json_string_value(value), "storage") || json_string_length(value) != 7)
+        fail("json_string_set to a short value failed");
+    if(json_string_set(value, json_string_value(value) + 1) ||
+       strcmp(json_string_value(value), "torage"))
+        fail("json_string_set to a part of the current value failed");
+    json_decref(value);
+
     value = json_string(NULL);
     if(value)
         fail("json_string(NULL) failed");
@@ -289,4 +362,5 @@ static void run_tests()
 #endif
 
     test_bad_args();
+    test_freeze();
 }
@@ -11,6 +11,89 @@
 #include <stdio.h>
 #include "util.h"
 
+static void test_compiled()
+{
+    json_unpack_program_t *program;
+    json_key_t id_key = json_key_make("id");
+    json_key_t params_key = json_key_make("params");
+    const char *method, *worker, *job;
+    json_int_t id;
+    json_t *j;
+    json_error_t error;
+    int i1 = 0, i2 = 0;
+
+    j = json_pack("{s:I, s:s, s:[ss]}", "id", (json_int_t)7, "method", "mining.submit",
+                  "params", "worker", "job");
+
+    program = json_unpack_compile("{s:I, s:s, s:[ss]}", &error);
+    if(!program)
+        fail("json_unpack_compile failed");
+
+    id = 0;
+    method = worker = job = NULL;
+    if(json_unpack_run(j, program, "id", &id, "method", &method, "params", &worker, &job) ||
+       id != 7 || strcmp(method, "mining.submit") || strcmp(worker, "worker") || strcmp(job, "job"))
+        fail("json_unpack_run failed");
+
+    /* a program can be run any number of times */
+    worker = NULL;
+    if(json_unpack_run(j, program, "id", &id, "method", &method, "params", &worker, &job) ||
+       strcmp(worker, "worker"))
+        fail("json_unpack_run failed to run again");
+
+    json_unpack_program_free(program);
+
+    /* the strict check works without '!' in the format */
+    program = json_unpack_compile("{s:I}", &error);
+    if(!json_unpack_run_ex(j, &error, JSON_STRICT, program, "id", &id))
+        fail("json_unpack_run failed to catch unpacked object items");
+    check_error(json_error_end_of_input_expected, "2 object item(s) left unpacked: method, params",
+                "<validation>", 1, 5, 5);
+    json_unpack_program_free(program);
+
+    /* prepared keys */
+    if(json_unpack(j, "{k:I, k:[s*]}", &id_key, &id, &params_key, &worker) || id != 7)
+        fail("json_unpack failed to unpack prepared keys");
+
+    program = json_unpack_compile("{k:I, s:s, k:[ss] !}", &error);
+    if(json_unpack_run(j, program, &id_key, &id, "method", &method, &params_key, &worker, &job))
+        fail("json_unpack_run failed to unpack prepared keys in strict mode");
+    json_unpack_program_free(program);
+
+    program = json_unpack_compile("{k:I !}", &error);
+    if(!json_unpack_run_ex(j, &error, 0, program, &id_key, &id))
+        fail("json_unpack_run failed to catch unpacked object items");
+    check_error(json_error_end_of_input_expected, "2 object item(s) left unpacked: method, params",
+                "<validation>", 1, 7, 7);
+    json_unpack_program_free(program);
+
+    if(!json_unpack_ex(j, &error, 0, "{k:i}", NULL, &i1))
+        fail("json_unpack failed to catch NULL prepared key");
+    check_error(json_error_null_value, "NULL object key", "<args>", 1, 2, 2);
+    json_decref(j);
+
+    /* errors keep their position in the format */
+    j = json_pack("[ii]", 1, 2);
+    program = json_unpack_compile("[i s]", &error);
+    if(!json_unpack_run_ex(j, &error, 0, program, &i1, &i2))
+        fail("json_unpack_run failed to catch a wrong type");
+    check_error(json_error_wrong_type, "Expected string, got integer", "<validation>", 1, 4, 4);
+    json_unpack_program_free(program);
+
+    if(json_unpack_compile("[i}", &error))
+        fail("json_unpack_compile failed to catch mismatched '}'");
+    check_error(json_error_invalid_format, "Unexpected format character '}'", "<format>", 1, 3, 3);
+
+    if(!json_unpack_run_ex(j, &error, 0, NULL))
+        fail("json_unpack_run failed to catch NULL program");
+    check_error(json_error_invalid_argument, "NULL program", "<format>", -1, -1, 0);
+
+    if(!json_unpack_run_ex(NULL, &error, 0, NULL))
+        fail("json_unpack_run failed to catch NULL root");
+    check_error(json_error_null_value, "NULL root value", "<root>", -1, -1, 0);
+    json_decref(j);
+}
+
 static void run_tests()
 {
     json_t *j, *j2;
@@ -403,4 +486,6 @@ static void run_tests()
         fail("json_unpack failed for optional values with strict mode and compensation");
     check_error(json_error_end_of_input_expected, "1 object item(s) left unpacked: baz", "<validation>", 1, 8, 8);
     json_decref(j);
+
+    test_compiled();
 }